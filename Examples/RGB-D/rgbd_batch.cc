@@ -0,0 +1,447 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include<iostream>
+#include<algorithm>
+#include<fstream>
+#include<sstream>
+#include<iomanip>
+#include<chrono>
+#include<thread>
+#include<atomic>
+#include<sys/stat.h>
+
+#include<opencv2/core/core.hpp>
+#include<opencv2/optflow.hpp>
+
+#include<System.h>
+
+using namespace std;
+
+// Runs a list of sequences with several trackers in one process. All trackers share one vocabulary
+// and one scheduler, frames are fed as fast as they are tracked (no real-time pacing).
+
+struct Sequence
+{
+    string strPath;
+    string strSettings;
+    string strName;
+};
+
+struct SequenceResult
+{
+    bool bOk;
+    int nFrames;
+    double wallSec;
+    vector<double> vLatencyMs;
+};
+
+void LoadSequenceList(const string &strFile, const string &strDefaultSettings, vector<Sequence> &vSequences);
+
+void LoadData(const string &strPathToSequence, vector<string> &vstrFilenamesSEM,
+              vector<string> &vstrFilenamesRGB, vector<string> &vstrFilenamesDEP, vector<string> &vstrFilenamesFLO,
+              vector<double> &vTimestamps, vector<cv::Mat> &vPoseGT, vector<vector<float> > &vObjPoseGT);
+
+void LoadMask(const string &strFilenamesMask, cv::Mat &imMask);
+
+SequenceResult RunSequence(const Sequence &seq, const string &strPathToOutput, ORB_SLAM2::ORBVocabulary* pVoc,
+                           ORB_SLAM2::Scheduler* pScheduler);
+
+double Percentile(vector<double> v, const double p);
+
+int main(int argc, char **argv)
+{
+    if(argc != 5 && argc != 6)
+    {
+        cerr << endl << "Usage: ./rgbd_batch path_to_vocabulary path_to_settings path_to_sequence_list path_to_output [n_trackers]" << endl;
+        cerr << "Each line of the sequence list is: path_to_sequence [path_to_settings]" << endl;
+        return 1;
+    }
+
+    const string strPathToOutput = argv[4];
+    const int nHardware = max(1,(int)std::thread::hardware_concurrency());
+    const int nTrackers = argc==6 ? max(1,atoi(argv[5])) : max(1,nHardware/4);
+
+    vector<Sequence> vSequences;
+    LoadSequenceList(argv[3], argv[2], vSequences);
+    if(vSequences.empty())
+    {
+        cerr << endl << "No sequences found in: " << argv[3] << endl;
+        return 1;
+    }
+
+    // Load the vocabulary once for all trackers
+    cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
+    ORB_SLAM2::ORBVocabulary* pVoc = new ORB_SLAM2::ORBVocabulary();
+    const string strVocFile = argv[1];
+    const bool bBinary = strVocFile.size()>4 && strVocFile.compare(strVocFile.size()-4,4,".bin")==0;
+    if(!(bBinary ? pVoc->loadFromBinaryFile(strVocFile) : pVoc->loadFromTextFile(strVocFile)))
+    {
+        cerr << "Wrong path to vocabulary. " << endl;
+        cerr << "Falied to open at: " << argv[1] << endl;
+        return 1;
+    }
+    cout << "Vocabulary loaded!" << endl << endl;
+
+    mkdir(strPathToOutput.c_str(),0755);
+
+    // The tracking threads run their own frames, the workers take what is left of the cores
+    ORB_SLAM2::Scheduler* pScheduler = new ORB_SLAM2::Scheduler(max(1,nHardware-nTrackers));
+
+    cout << "Sequences: " << vSequences.size() << ", trackers: " << nTrackers << ", workers: " << pScheduler->NumWorkers() << endl;
+
+    vector<SequenceResult> vResults(vSequences.size());
+    std::atomic<int> nNext(0);
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+    vector<thread> vTrackers;
+    for(int k=0; k<nTrackers; k++)
+    {
+        vTrackers.push_back(thread([&]()
+        {
+            for(int i=nNext++; i<(int)vSequences.size(); i=nNext++)
+                vResults[i] = RunSequence(vSequences[i],strPathToOutput,pVoc,pScheduler);
+        }));
+    }
+    for(size_t k=0; k<vTrackers.size(); k++)
+        vTrackers[k].join();
+
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    const double wallSec = std::chrono::duration_cast<std::chrono::duration<double> >(t1 - t0).count();
+
+    // Throughput report
+    ofstream f;
+    string strReport = strPathToOutput + "/throughput.txt";
+    f.open(strReport.c_str(),ios::trunc);
+    f << fixed << setprecision(3);
+
+    int nTotFrames = 0;
+    vector<double> vAllLatencyMs;
+    for(size_t i=0; i<vSequences.size(); i++)
+    {
+        const SequenceResult &res = vResults[i];
+        f << vSequences[i].strName;
+        if(!res.bOk)
+        {
+            f << " failed" << endl;
+            continue;
+        }
+        f << " frames " << res.nFrames << " fps " << res.nFrames/res.wallSec
+          << " p50_ms " << Percentile(res.vLatencyMs,0.5) << " p99_ms " << Percentile(res.vLatencyMs,0.99) << endl;
+        nTotFrames += res.nFrames;
+        vAllLatencyMs.insert(vAllLatencyMs.end(),res.vLatencyMs.begin(),res.vLatencyMs.end());
+    }
+
+    f << "total frames " << nTotFrames << " wall_s " << wallSec << " fps " << nTotFrames/wallSec
+      << " fps_per_core " << nTotFrames/wallSec/nHardware
+      << " p50_ms " << Percentile(vAllLatencyMs,0.5) << " p99_ms " << Percentile(vAllLatencyMs,0.99) << endl;
+    f.close();
+
+    cout << "-------------------------------------------------------------------" << endl;
+    cout << "frames: " << nTotFrames << " in " << wallSec << " s (" << nTrackers << " trackers, " << nHardware << " cores)" << endl;
+    cout << "throughput: " << nTotFrames/wallSec << " frames/s, " << nTotFrames/wallSec/nHardware << " frames/s per core" << endl;
+    cout << "frame latency: p50 " << Percentile(vAllLatencyMs,0.5) << " ms, p99 " << Percentile(vAllLatencyMs,0.99) << " ms" << endl;
+    cout << "report saved to " << strReport << endl;
+
+    // Every System has joined its Local Mapping and Loop Closing loops when its sequence returned
+    delete pScheduler;
+    delete pVoc;
+
+    return 0;
+}
+
+SequenceResult RunSequence(const Sequence &seq, const string &strPathToOutput, ORB_SLAM2::ORBVocabulary* pVoc,
+                           ORB_SLAM2::Scheduler* pScheduler)
+{
+    SequenceResult res;
+    res.bOk = false;
+    res.nFrames = 0;
+    res.wallSec = 0;
+
+    // Retrieve paths to images
+    vector<string> vstrFilenamesRGB;
+    vector<string> vstrFilenamesDEP;
+    vector<string> vstrFilenamesSEM;
+    vector<string> vstrFilenamesFLO;
+    std::vector<cv::Mat> vPoseGT;
+    vector<vector<float> > vObjPoseGT;
+    vector<double> vTimestamps;
+
+    LoadData(seq.strPath, vstrFilenamesSEM, vstrFilenamesRGB, vstrFilenamesDEP, vstrFilenamesFLO,
+             vTimestamps, vPoseGT, vObjPoseGT);
+
+    const int nImages = vstrFilenamesRGB.size();
+    if(vstrFilenamesRGB.empty() || vstrFilenamesDEP.size()!=vstrFilenamesRGB.size() || (int)vPoseGT.size()<nImages)
+    {
+        cerr << endl << "Incomplete sequence: " << seq.strPath << endl;
+        return res;
+    }
+
+    // save the id of object pose in each frame
+    vector<vector<int> > vObjPoseID(nImages);
+    for (int i = 0; i < vObjPoseGT.size(); ++i)
+    {
+        int f_id = vObjPoseGT[i][0];
+        if(f_id>=0 && f_id<nImages)
+            vObjPoseID[f_id].push_back(i);
+    }
+
+    // No viewer: nothing is drawn or shown while tracking. The System frees its map and threads when
+    // this function returns, so memory does not grow with the number of sequences.
+    ORB_SLAM2::System SLAM(pVoc,seq.strSettings,ORB_SLAM2::System::RGBD,false,pScheduler);
+
+    // Per-frame evaluation outputs of the tracker. The batch run only reports throughput and the
+    // saved results, so one scratch set is reused for every frame.
+    std::vector<float> vCoEr, vRpEr;
+    int nMotions = 0;
+    cv::Mat imTraj;
+
+    res.vLatencyMs.reserve(nImages);
+
+    std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+
+    cv::Mat imRGB, imD, mTcw_gt;
+    for(int ni=0; ni<nImages; ni++)
+    {
+        // Read image and depthmap from file
+        imRGB = cv::imread(vstrFilenamesRGB[ni],CV_LOAD_IMAGE_UNCHANGED);
+        imD   = cv::imread(vstrFilenamesDEP[ni],CV_LOAD_IMAGE_UNCHANGED);
+        if(imRGB.empty() || imD.empty())
+        {
+            cerr << endl << "Failed to load image at: " << vstrFilenamesRGB[ni] << endl;
+            return res;
+        }
+        cv::Mat imD_f;
+        imD.convertTo(imD_f, CV_32F);
+
+        cv::Mat imFlow = cv::optflow::readOpticalFlow(vstrFilenamesFLO[ni]);
+
+        cv::Mat imSem(imRGB.rows, imRGB.cols, CV_32SC1);
+        LoadMask(vstrFilenamesSEM[ni],imSem);
+
+        double tframe = vTimestamps[ni];
+        mTcw_gt = vPoseGT[ni];
+
+        // object poses in current frame
+        vector<vector<float> > vObjPose_gt(vObjPoseID[ni].size());
+        for (int i = 0; i < vObjPoseID[ni].size(); ++i)
+            vObjPose_gt[i] = vObjPoseGT[vObjPoseID[ni][i]];
+
+        vCoEr.assign(4,-1);
+        vRpEr.assign(6,0);
+
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+        if(SLAM.PipelinedTracking())
+            SLAM.TrackRGBDPipelined(imRGB,imD_f,imFlow,imSem,mTcw_gt,vObjPose_gt,tframe,vCoEr,vRpEr,nMotions,imTraj);
+        else
+            SLAM.TrackRGBD(imRGB,imD_f,imFlow,imSem,mTcw_gt,vObjPose_gt,tframe,vCoEr,vRpEr,nMotions,imTraj);
+
+        std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+        res.vLatencyMs.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t2 - t1).count());
+    }
+
+    // Track the last frame still in the pipeline
+    if(SLAM.PipelinedTracking())
+    {
+        vCoEr.assign(4,-1);
+        vRpEr.assign(6,0);
+        SLAM.FlushRGBD(vCoEr,vRpEr,nMotions,imTraj);
+    }
+
+    std::chrono::steady_clock::time_point tEnd = std::chrono::steady_clock::now();
+
+    SLAM.Shutdown();
+
+    // Per-sequence trajectory and object motion results
+    const string strPrefix = strPathToOutput + "/" + seq.strName + "/";
+    mkdir(strPrefix.c_str(),0755);
+    SLAM.SaveResults(strPrefix);
+    SLAM.SaveObjectMotions(strPrefix);
+
+    res.bOk = true;
+    res.nFrames = nImages;
+    res.wallSec = std::chrono::duration_cast<std::chrono::duration<double> >(tEnd - tStart).count();
+    return res;
+}
+
+double Percentile(vector<double> v, const double p)
+{
+    if(v.empty())
+        return 0;
+    const size_t k = min(v.size()-1,(size_t)(p*v.size()));
+    nth_element(v.begin(),v.begin()+k,v.end());
+    return v[k];
+}
+
+void LoadSequenceList(const string &strFile, const string &strDefaultSettings, vector<Sequence> &vSequences)
+{
+    ifstream fList;
+    fList.open(strFile.c_str());
+    while(!fList.eof())
+    {
+        string s;
+        getline(fList,s);
+        if(s.empty() || s[0]=='#')
+            continue;
+
+        stringstream ss;
+        ss << s;
+        Sequence seq;
+        ss >> seq.strPath;
+        if(seq.strPath.empty())
+            continue;
+        if(!(ss >> seq.strSettings))
+            seq.strSettings = strDefaultSettings;
+
+        // Output folder named after the last component of the sequence path
+        string strPath = seq.strPath;
+        while(strPath.size()>1 && strPath[strPath.size()-1]=='/')
+            strPath.erase(strPath.size()-1);
+        const size_t pos = strPath.find_last_of('/');
+        seq.strName = pos==string::npos ? strPath : strPath.substr(pos+1);
+
+        vSequences.push_back(seq);
+    }
+    fList.close();
+}
+
+void LoadData(const string &strPathToSequence, vector<string> &vstrFilenamesSEM,
+              vector<string> &vstrFilenamesRGB,vector<string> &vstrFilenamesDEP, vector<string> &vstrFilenamesFLO,
+              vector<double> &vTimestamps, vector<cv::Mat> &vPoseGT, vector<vector<float> > &vObjPoseGT)
+{
+    // +++ timestamps +++
+    ifstream fTimes;
+    string strPathTimeFile = strPathToSequence + "/times.txt";
+    fTimes.open(strPathTimeFile.c_str());
+    while(!fTimes.eof())
+    {
+        string s;
+        getline(fTimes,s);
+        if(!s.empty())
+        {
+            stringstream ss;
+            ss << s;
+            double t;
+            ss >> t;
+            vTimestamps.push_back(t);
+        }
+    }
+    fTimes.close();
+
+    // +++ image, depth, semantic and optical flow +++
+    string strPrefixImage = strPathToSequence + "/image/";
+    string strPrefixDepth = strPathToSequence + "/depth/";
+    string strPrefixSemantic = strPathToSequence + "/semantic/";
+    string strPrefixFlow = strPathToSequence + "/flow/";
+
+    const int nTimes = vTimestamps.size();
+    vstrFilenamesRGB.resize(nTimes);
+    vstrFilenamesDEP.resize(nTimes);
+    vstrFilenamesSEM.resize(nTimes);
+    vstrFilenamesFLO.resize(nTimes);
+
+    for(int i=0; i<nTimes; i++)
+    {
+        stringstream ss;
+        ss << setfill('0') << setw(6) << i;
+        vstrFilenamesRGB[i] = strPrefixImage + ss.str() + ".png";
+        vstrFilenamesDEP[i] = strPrefixDepth + ss.str() + ".png";
+        vstrFilenamesSEM[i] = strPrefixSemantic + ss.str() + ".txt";
+        vstrFilenamesFLO[i] = strPrefixFlow + ss.str() + ".flo";
+    }
+
+    // +++ ground truth pose +++
+    string strFilenamePose = strPathToSequence + "/pose_gt.txt";
+    ifstream fPose;
+    fPose.open(strFilenamePose.c_str());
+    while(!fPose.eof())
+    {
+        string s;
+        getline(fPose,s);
+        if(!s.empty())
+        {
+            stringstream ss;
+            ss << s;
+            int t;
+            ss >> t;
+            cv::Mat Pose_tmp = cv::Mat::eye(4,4,CV_32F);
+            ss >> Pose_tmp.at<float>(0,0) >> Pose_tmp.at<float>(0,1) >> Pose_tmp.at<float>(0,2) >> Pose_tmp.at<float>(0,3)
+               >> Pose_tmp.at<float>(1,0) >> Pose_tmp.at<float>(1,1) >> Pose_tmp.at<float>(1,2) >> Pose_tmp.at<float>(1,3)
+               >> Pose_tmp.at<float>(2,0) >> Pose_tmp.at<float>(2,1) >> Pose_tmp.at<float>(2,2) >> Pose_tmp.at<float>(2,3)
+               >> Pose_tmp.at<float>(3,0) >> Pose_tmp.at<float>(3,1) >> Pose_tmp.at<float>(3,2) >> Pose_tmp.at<float>(3,3);
+
+            vPoseGT.push_back(Pose_tmp);
+        }
+    }
+    fPose.close();
+
+    // +++ ground truth object pose +++
+    string strFilenameObjPose = strPathToSequence + "/object_pose.txt";
+    ifstream fObjPose;
+    fObjPose.open(strFilenameObjPose.c_str());
+    while(!fObjPose.eof())
+    {
+        string s;
+        getline(fObjPose,s);
+        if(!s.empty())
+        {
+            stringstream ss;
+            ss << s;
+
+            std::vector<float> ObjPose_tmp(10,0);
+            ss >> ObjPose_tmp[0] >> ObjPose_tmp[1] >> ObjPose_tmp[2] >> ObjPose_tmp[3]
+               >> ObjPose_tmp[4] >> ObjPose_tmp[5] >> ObjPose_tmp[6] >> ObjPose_tmp[7]
+               >> ObjPose_tmp[8] >> ObjPose_tmp[9];
+
+            vObjPoseGT.push_back(ObjPose_tmp);
+        }
+    }
+    fObjPose.close();
+}
+
+void LoadMask(const string &strFilenamesMask, cv::Mat &imMask)
+{
+    // Same labels as rgbd_tum, without building the display image
+    ifstream file_mask;
+    file_mask.open(strFilenamesMask.c_str());
+
+    int count = 0;
+    while(!file_mask.eof() && count<imMask.rows)
+    {
+        string s;
+        getline(file_mask,s);
+        if(!s.empty())
+        {
+            stringstream ss;
+            ss << s;
+            int tmp;
+            for(int i = 0; i < imMask.cols; ++i)
+            {
+                ss >> tmp;
+                imMask.at<int>(count,i) = (tmp!=0 && tmp<4) ? tmp : 0;
+            }
+            count++;
+        }
+    }
+}
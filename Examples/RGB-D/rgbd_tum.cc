@@ -165,7 +165,14 @@ int main(int argc, char **argv)
         RpEr[ni].resize(6,0);
         IsUsed[ni] = true;
         // Pass the image to the SLAM system
-        SLAM.TrackRGBD(imRGB,imD_f,imFlow,imSem,mTcw_gt,vObjPose_gt,tframe,CoEr[ni],RpEr[ni],M_num[ni],imTraj);
+        if(SLAM.PipelinedTracking())
+        {
+            // The results returned belong to the previous frame
+            const int nj = ni>0 ? ni-1 : ni;
+            SLAM.TrackRGBDPipelined(imRGB,imD_f,imFlow,imSem,mTcw_gt,vObjPose_gt,tframe,CoEr[nj],RpEr[nj],M_num[nj],imTraj);
+        }
+        else
+            SLAM.TrackRGBD(imRGB,imD_f,imFlow,imSem,mTcw_gt,vObjPose_gt,tframe,CoEr[ni],RpEr[ni],M_num[ni],imTraj);
 
 #ifdef COMPILEDWITHC11
         std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
@@ -188,6 +195,10 @@ int main(int argc, char **argv)
             usleep((T-ttrack)*1e6);
     }
 
+    // Track the last frame still in the pipeline
+    if(SLAM.PipelinedTracking())
+        SLAM.FlushRGBD(CoEr[nImages-1],RpEr[nImages-1],M_num[nImages-1],imTraj);
+
     // Stop all threads
     // SLAM.Shutdown();
 
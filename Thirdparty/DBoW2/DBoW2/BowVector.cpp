@@ -31,11 +31,65 @@ BowVector::~BowVector(void)
 
 // --------------------------------------------------------------------------
 
+/// Orders words by id only
+struct WordIdLess
+{
+  inline bool operator()(const BowVector::value_type &a, WordId b) const
+  {
+    return a.first < b;
+  }
+
+  inline bool operator()(const BowVector::value_type &a,
+    const BowVector::value_type &b) const
+  {
+    return a.first < b.first;
+  }
+};
+
+// --------------------------------------------------------------------------
+
+BowVector::iterator BowVector::lower_bound(WordId id)
+{
+  return std::lower_bound(begin(), end(), id, WordIdLess());
+}
+
+// --------------------------------------------------------------------------
+
+BowVector::const_iterator BowVector::lower_bound(WordId id) const
+{
+  return std::lower_bound(begin(), end(), id, WordIdLess());
+}
+
+// --------------------------------------------------------------------------
+
+BowVector::iterator BowVector::find(WordId id)
+{
+  iterator vit = lower_bound(id);
+  return (vit != end() && vit->first == id ? vit : end());
+}
+
+// --------------------------------------------------------------------------
+
+BowVector::const_iterator BowVector::find(WordId id) const
+{
+  const_iterator vit = lower_bound(id);
+  return (vit != end() && vit->first == id ? vit : end());
+}
+
+// --------------------------------------------------------------------------
+
 void BowVector::addWeight(WordId id, WordValue v)
 {
+  // words usually come in increasing order: try the back first
+  if(empty() || back().first < id)
+  {
+    push_back(value_type(id, v));
+    return;
+  }
+
   BowVector::iterator vit = this->lower_bound(id);
   
-  if(vit != this->end() && !(this->key_comp()(id, vit->first)))
+  if(vit->first == id)
   {
     vit->second += v;
   }
@@ -49,9 +103,15 @@ void BowVector::addWeight(WordId id, WordValue v)
 
 void BowVector::addIfNotExist(WordId id, WordValue v)
 {
+  if(empty() || back().first < id)
+  {
+    push_back(value_type(id, v));
+    return;
+  }
+
   BowVector::iterator vit = this->lower_bound(id);
   
-  if(vit == this->end() || (this->key_comp()(id, vit->first)))
+  if(vit->first != id)
   {
     this->insert(vit, BowVector::value_type(id, v));
   }
@@ -59,6 +119,31 @@ void BowVector::addIfNotExist(WordId id, WordValue v)
 
 // --------------------------------------------------------------------------
 
+void BowVector::sortAndMerge(bool add)
+{
+  if(empty()) return;
+
+  // stable, so that repeated words keep the order they were appended in
+  std::stable_sort(begin(), end(), WordIdLess());
+
+  iterator last = begin();
+  for(iterator vit = begin() + 1; vit != end(); ++vit)
+  {
+    if(vit->first == last->first)
+    {
+      if(add) last->second += vit->second;
+    }
+    else
+    {
+      *(++last) = *vit;
+    }
+  }
+
+  erase(last + 1, end());
+}
+
+// --------------------------------------------------------------------------
+
 void BowVector::normalize(LNorm norm_type)
 {
   double norm = 0.0; 
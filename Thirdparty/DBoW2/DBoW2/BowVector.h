@@ -11,8 +11,8 @@
 #define __D_T_BOW_VECTOR__
 
 #include <iostream>
-#include <map>
 #include <vector>
+#include <utility>
 
 namespace DBoW2 {
 
@@ -52,9 +52,10 @@ enum ScoringType
   DOT_PRODUCT,
 };
 
-/// Vector of words to represent images
+/// Vector of words to represent images, sorted by word id.
+/// It is a flat array so that scores are computed by a linear merge
 class BowVector: 
-	public std::map<WordId, WordValue>
+	public std::vector<std::pair<WordId, WordValue> >
 {
 public:
 
@@ -83,6 +84,38 @@ public:
 	 */
 	void addIfNotExist(WordId id, WordValue v);
 
+	/**
+	 * Appends a word without keeping the vector sorted. sortAndMerge must be
+	 * called after the last word is appended
+	 * @param id word id
+	 * @param v word value
+	 */
+	inline void appendWeight(WordId id, WordValue v)
+	{
+		push_back(value_type(id, v));
+	}
+
+	/**
+	 * Sorts the appended words and merges the repeated ones
+	 * @param add if true, the values of a repeated word are added up (as in
+	 *   addWeight); otherwise the first one is kept (as in addIfNotExist)
+	 */
+	void sortAndMerge(bool add);
+
+	/**
+	 * Returns the first word whose id is not less than the given one
+	 * @param id word id
+	 */
+	iterator lower_bound(WordId id);
+	const_iterator lower_bound(WordId id) const;
+
+	/**
+	 * Returns the word with the given id, or end()
+	 * @param id word id
+	 */
+	iterator find(WordId id);
+	const_iterator find(WordId id) const;
+
 	/**
 	 * L1-Normalizes the values in the vector 
 	 * @param norm_type norm used
@@ -13,8 +13,15 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <algorithm>
+#include <cstring>
 #include <stdint.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FORB_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
 #include "FORB.h"
 
 using namespace std;
@@ -23,7 +30,7 @@ namespace DBoW2 {
 
 // --------------------------------------------------------------------------
 
-const int FORB::L=32;
+const int FORB::L;
 
 void FORB::meanValue(const std::vector<FORB::pDescriptor> &descriptors, 
   FORB::TDescriptor &mean)
@@ -81,23 +88,204 @@ void FORB::meanValue(const std::vector<FORB::pDescriptor> &descriptors,
 int FORB::distance(const FORB::TDescriptor &a,
   const FORB::TDescriptor &b)
 {
-  // Bit set count operation from
-  // http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+  return distance(a.ptr<unsigned char>(), b.ptr<unsigned char>());
+}
+
+// --------------------------------------------------------------------------
+
+int FORB::distance(const unsigned char *a, const unsigned char *b)
+{
+  // 64-bit words (a single popcnt instruction each when available)
+  uint64_t pa[4], pb[4];
+  memcpy(pa, a, sizeof(pa));
+  memcpy(pb, b, sizeof(pb));
+
+  return __builtin_popcountll(pa[0] ^ pb[0]) +
+    __builtin_popcountll(pa[1] ^ pb[1]) +
+    __builtin_popcountll(pa[2] ^ pb[2]) +
+    __builtin_popcountll(pa[3] ^ pb[3]);
+}
+
+// --------------------------------------------------------------------------
+
+namespace {
+
+// Rows of the batched distances: contiguous or given by pointers
+struct ContiguousRows
+{
+  const unsigned char *b;
+  const unsigned char* operator[](int i) const { return b + i*FORB::L; }
+};
+
+struct GatheredRows
+{
+  const unsigned char * const *b;
+  const unsigned char* operator[](int i) const { return b[i]; }
+};
+
+template<class Rows>
+void distancesGeneric(const unsigned char *a, Rows b, int n, int *d)
+{
+  for(int i = 0; i < n; ++i)
+    d[i] = FORB::distance(a, b[i]);
+}
+
+#ifdef FORB_X86_DISPATCH
+
+template<class Rows>
+__attribute__((target("popcnt")))
+void distancesPopcnt(const unsigned char *a, Rows b, int n, int *d)
+{
+  uint64_t pa[4];
+  memcpy(pa, a, sizeof(pa));
+
+  for(int i = 0; i < n; ++i)
+  {
+    uint64_t pb[4];
+    memcpy(pb, b[i], sizeof(pb));
+    d[i] = __builtin_popcountll(pa[0] ^ pb[0]) +
+      __builtin_popcountll(pa[1] ^ pb[1]) +
+      __builtin_popcountll(pa[2] ^ pb[2]) +
+      __builtin_popcountll(pa[3] ^ pb[3]);
+  }
+}
+
+template<class Rows>
+__attribute__((target("avx2")))
+void distancesAVX2(const unsigned char *a, Rows b, int n, int *d)
+{
+  // the whole 256-bit descriptor in a register: xor, nibble lookup
+  // popcount and horizontal byte sums
+  const __m256i lookup = _mm256_setr_epi8(
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+
+  for(int i = 0; i < n; ++i)
+  {
+    const __m256i x = _mm256_xor_si256(q,
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b[i])));
+    const __m256i cnt = _mm256_add_epi8(
+      _mm256_shuffle_epi8(lookup, _mm256_and_si256(x, low_mask)),
+      _mm256_shuffle_epi8(lookup,
+        _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask)));
+    const __m256i sums = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+    const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(sums),
+      _mm256_extracti128_si256(sums, 1));
+    d[i] = _mm_cvtsi128_si32(s) + _mm_extract_epi32(s, 2);
+  }
+}
+
+template<class Rows>
+__attribute__((target("avx512f,avx512vl,avx512vpopcntdq")))
+void distancesAVX512(const unsigned char *a, Rows b, int n, int *d)
+{
+  // one popcount instruction per descriptor (four 64-bit lanes)
+  const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+
+  for(int i = 0; i < n; ++i)
+  {
+    const __m256i cnt = _mm256_popcnt_epi64(_mm256_xor_si256(q,
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b[i]))));
+    const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(cnt),
+      _mm256_extracti128_si256(cnt, 1));
+    d[i] = _mm_cvtsi128_si32(s) + _mm_extract_epi32(s, 2);
+  }
+}
+
+#endif
+
+enum DistanceKernel
+{
+  KERNEL_GENERIC,
+  KERNEL_POPCNT,
+  KERNEL_AVX2,
+  KERNEL_AVX512
+};
 
-  const int *pa = a.ptr<int32_t>();
-  const int *pb = b.ptr<int32_t>();
+DistanceKernel selectDistanceKernel()
+{
+#ifdef FORB_X86_DISPATCH
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512vpopcntdq") &&
+    __builtin_cpu_supports("avx512vl"))
+    return KERNEL_AVX512;
+  if(__builtin_cpu_supports("avx2"))
+    return KERNEL_AVX2;
+  if(__builtin_cpu_supports("popcnt"))
+    return KERNEL_POPCNT;
+#endif
+  return KERNEL_GENERIC;
+}
 
-  int dist=0;
+DistanceKernel distanceKernelId()
+{
+  static const DistanceKernel kernel = selectDistanceKernel();
+  return kernel;
+}
 
-  for(int i=0; i<8; i++, pa++, pb++)
+template<class Rows>
+void dispatchDistances(const unsigned char *a, Rows b, int n, int *d)
+{
+  switch(distanceKernelId())
   {
-      unsigned  int v = *pa ^ *pb;
-      v = v - ((v >> 1) & 0x55555555);
-      v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-      dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
+#ifdef FORB_X86_DISPATCH
+    case KERNEL_AVX512: distancesAVX512(a, b, n, d); break;
+    case KERNEL_AVX2: distancesAVX2(a, b, n, d); break;
+    case KERNEL_POPCNT: distancesPopcnt(a, b, n, d); break;
+#endif
+    default: distancesGeneric(a, b, n, d); break;
   }
+}
+
+} // namespace
 
-  return dist;
+// --------------------------------------------------------------------------
+
+void FORB::distances(const unsigned char *a, const unsigned char *b,
+  int n, int *d)
+{
+  ContiguousRows rows = { b };
+  dispatchDistances(a, rows, n, d);
+}
+
+// --------------------------------------------------------------------------
+
+void FORB::distances(const unsigned char *a, const unsigned char * const *b,
+  int n, int *d)
+{
+  GatheredRows rows = { b };
+  dispatchDistances(a, rows, n, d);
+}
+
+// --------------------------------------------------------------------------
+
+const char* FORB::distanceKernel()
+{
+  switch(distanceKernelId())
+  {
+    case KERNEL_AVX512: return "avx512";
+    case KERNEL_AVX2: return "avx2";
+    case KERNEL_POPCNT: return "popcnt";
+    default: return "generic";
+  }
+}
+
+// --------------------------------------------------------------------------
+
+void FORB::toBytes(const FORB::TDescriptor &a, unsigned char *bytes)
+{
+  const unsigned char *p = a.ptr<unsigned char>();
+  std::copy(p, p + FORB::L, bytes);
+}
+
+// --------------------------------------------------------------------------
+
+void FORB::fromBytes(FORB::TDescriptor &a, const unsigned char *bytes)
+{
+  a.create(1, FORB::L, CV_8U);
+  std::copy(bytes, bytes + FORB::L, a.ptr<unsigned char>());
 }
 
 // --------------------------------------------------------------------------
@@ -28,7 +28,7 @@ public:
   /// Pointer to a single descriptor
   typedef const TDescriptor *pDescriptor;
   /// Descriptor length (in bytes)
-  static const int L;
+  static const int L = 32;
 
   /**
    * Calculates the mean value of a set of descriptors
@@ -46,6 +46,56 @@ public:
    */
   static int distance(const TDescriptor &a, const TDescriptor &b);
 
+  /**
+   * Calculates the distance between two descriptors given as L raw bytes
+   * @param a
+   * @param b
+   * @return distance
+   */
+  static int distance(const unsigned char *a, const unsigned char *b);
+
+  /**
+   * Calculates the distances between a descriptor and n descriptors stored
+   * contiguously (e.g. the children of a vocabulary node)
+   * @param a L bytes
+   * @param b n*L bytes
+   * @param n
+   * @param d (out) n distances
+   */
+  static void distances(const unsigned char *a, const unsigned char *b,
+    int n, int *d);
+
+  /**
+   * Calculates the distances between a descriptor and n descriptors given
+   * by pointers (e.g. some rows of a descriptor matrix)
+   * @param a L bytes
+   * @param b n pointers to L bytes
+   * @param n
+   * @param d (out) n distances
+   */
+  static void distances(const unsigned char *a, const unsigned char * const *b,
+    int n, int *d);
+
+  /**
+   * Returns the kernel that computes the batched distances on this cpu,
+   * chosen at run time: "avx512", "avx2", "popcnt" or "generic"
+   */
+  static const char* distanceKernel();
+
+  /**
+   * Copies the L bytes of the descriptor
+   * @param a descriptor
+   * @param bytes (out) L bytes
+   */
+  static void toBytes(const TDescriptor &a, unsigned char *bytes);
+
+  /**
+   * Returns a descriptor from its L raw bytes
+   * @param a (out) descriptor
+   * @param bytes L bytes
+   */
+  static void fromBytes(TDescriptor &a, const unsigned char *bytes);
+
   /**
    * Returns a string version of the descriptor
    * @param a descriptor
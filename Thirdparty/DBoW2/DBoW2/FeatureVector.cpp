@@ -8,8 +8,8 @@
  */
 
 #include "FeatureVector.h"
-#include <map>
 #include <vector>
+#include <algorithm>
 #include <iostream>
 
 namespace DBoW2 {
@@ -28,6 +28,47 @@ FeatureVector::~FeatureVector(void)
 
 // ---------------------------------------------------------------------------
 
+/// Orders nodes by id only
+struct NodeIdLess
+{
+  inline bool operator()(const FeatureVector::value_type &a, NodeId b) const
+  {
+    return a.first < b;
+  }
+};
+
+// ---------------------------------------------------------------------------
+
+FeatureVector::iterator FeatureVector::lower_bound(NodeId id)
+{
+  return std::lower_bound(begin(), end(), id, NodeIdLess());
+}
+
+// ---------------------------------------------------------------------------
+
+FeatureVector::const_iterator FeatureVector::lower_bound(NodeId id) const
+{
+  return std::lower_bound(begin(), end(), id, NodeIdLess());
+}
+
+// ---------------------------------------------------------------------------
+
+FeatureVector::iterator FeatureVector::find(NodeId id)
+{
+  iterator vit = lower_bound(id);
+  return (vit != end() && vit->first == id ? vit : end());
+}
+
+// ---------------------------------------------------------------------------
+
+FeatureVector::const_iterator FeatureVector::find(NodeId id) const
+{
+  const_iterator vit = lower_bound(id);
+  return (vit != end() && vit->first == id ? vit : end());
+}
+
+// ---------------------------------------------------------------------------
+
 void FeatureVector::addFeature(NodeId id, unsigned int i_feature)
 {
   FeatureVector::iterator vit = this->lower_bound(id);
@@ -46,6 +87,38 @@ void FeatureVector::addFeature(NodeId id, unsigned int i_feature)
 
 // ---------------------------------------------------------------------------
 
+void FeatureVector::setFeatures(
+  std::vector<std::pair<NodeId, unsigned int> > &node_features)
+{
+  clear();
+  if(node_features.empty()) return;
+
+  // by node, then by feature index
+  std::sort(node_features.begin(), node_features.end());
+
+  // count the nodes first, so that each index vector is allocated once
+  size_t nnodes = 1;
+  for(size_t i = 1; i < node_features.size(); ++i)
+    if(node_features[i].first != node_features[i-1].first) ++nnodes;
+
+  reserve(nnodes);
+
+  size_t i = 0;
+  while(i < node_features.size())
+  {
+    size_t j = i + 1;
+    while(j < node_features.size() && 
+      node_features[j].first == node_features[i].first) ++j;
+
+    push_back(value_type(node_features[i].first, std::vector<unsigned int>()));
+    std::vector<unsigned int> &indices = back().second;
+    indices.reserve(j - i);
+    for(; i < j; ++i) indices.push_back(node_features[i].second);
+  }
+}
+
+// ---------------------------------------------------------------------------
+
 std::ostream& operator<<(std::ostream &out, 
   const FeatureVector &v)
 {
@@ -11,15 +11,15 @@
 #define __D_T_FEATURE_VECTOR__
 
 #include "BowVector.h"
-#include <map>
 #include <vector>
+#include <utility>
 #include <iostream>
 
 namespace DBoW2 {
 
-/// Vector of nodes with indexes of local features
+/// Vector of nodes with indexes of local features, sorted by node id
 class FeatureVector: 
-  public std::map<NodeId, std::vector<unsigned int> >
+  public std::vector<std::pair<NodeId, std::vector<unsigned int> > >
 {
 public:
 
@@ -41,6 +41,26 @@ public:
    */
   void addFeature(NodeId id, unsigned int i_feature);
 
+  /**
+   * Replaces the content of the vector with the given (node, feature) pairs
+   * @param node_features pairs in any order, sorted in place
+   */
+  void setFeatures(std::vector<std::pair<NodeId, unsigned int> > &node_features);
+
+  /**
+   * Returns the first node whose id is not less than the given one
+   * @param id node id
+   */
+  iterator lower_bound(NodeId id);
+  const_iterator lower_bound(NodeId id) const;
+
+  /**
+   * Returns the node with the given id, or end()
+   * @param id node id
+   */
+  iterator find(NodeId id);
+  const_iterator find(NodeId id) const;
+
   /**
    * Sends a string versions of the feature vector through the stream
    * @param out stream
@@ -17,6 +17,8 @@ using namespace DBoW2;
 // epsilon value (this is needed by the KL method)
 const double GeneralScoring::LOG_EPS = log(DBL_EPSILON); // FLT_EPSILON
 
+// BowVectors are sorted arrays: every score is a linear merge of the two
+
 // ---------------------------------------------------------------------------
 // ---------------------------------------------------------------------------
 
@@ -47,14 +49,12 @@ double L1Scoring::score(const BowVector &v1, const BowVector &v2) const
     else if(v1_it->first < v2_it->first)
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
-      // v1_it = (first element >= v2_it.id)
+      ++v1_it;
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
-      // v2_it = (first element >= v1_it.id)
+      ++v2_it;
     }
   }
   
@@ -97,14 +97,12 @@ double L2Scoring::score(const BowVector &v1, const BowVector &v2) const
     else if(v1_it->first < v2_it->first)
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
-      // v1_it = (first element >= v2_it.id)
+      ++v1_it;
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
-      // v2_it = (first element >= v1_it.id)
+      ++v2_it;
     }
   }
   
@@ -154,12 +152,12 @@ double ChiSquareScoring::score(const BowVector &v1, const BowVector &v2)
     else if(v1_it->first < v2_it->first)
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
+      ++v1_it;
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
+      ++v2_it;
     }
   }
     
@@ -207,8 +205,7 @@ double KLScoring::score(const BowVector &v1, const BowVector &v2) const
     else
     {
       // move v2_it forward, do not add any score
-      v2_it = v2.lower_bound(v1_it->first);
-      // v2_it = (first element >= v1_it.id)
+      ++v2_it;
     }
   }
   
@@ -251,14 +248,12 @@ double BhattacharyyaScoring::score(const BowVector &v1,
     else if(v1_it->first < v2_it->first)
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
-      // v1_it = (first element >= v2_it.id)
+      ++v1_it;
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
-      // v2_it = (first element >= v1_it.id)
+      ++v2_it;
     }
   }
 
@@ -296,14 +291,12 @@ double DotProductScoring::score(const BowVector &v1,
     else if(v1_it->first < v2_it->first)
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
-      // v1_it = (first element >= v2_it.id)
+      ++v1_it;
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
-      // v2_it = (first element >= v1_it.id)
+      ++v2_it;
     }
   }
 
@@ -3,6 +3,9 @@
  * Added functions: Save and Load from text files without using cv::FileStorage.
  * Date: August 2015
  * Raúl Mur-Artal
+ *
+ * The tree is queried from a flat, level-ordered binary image (see
+ * saveToBinaryFile), which can be memory-mapped from disk.
  */
 
 /**
@@ -26,6 +29,13 @@
 #include <algorithm>
 #include <opencv2/core/core.hpp>
 #include <limits>
+#include <cstring>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "FeatureVector.h"
 #include "BowVector.h"
@@ -145,6 +155,28 @@ public:
   virtual void transform(const std::vector<TDescriptor>& features,
     BowVector &v, FeatureVector &fv, int levelsup) const;
 
+  /// Job over the range of features [begin, end)
+  typedef void (*RangeJobFn)(int begin, int end, void *job_data);
+
+  /// Runs job over [0, count), splitting the range among threads
+  typedef void (*ParallelForFn)(int count, RangeJobFn job, void *job_data,
+    void *extra_data);
+
+  /**
+   * Transform a set of descriptors into a bow vector and a feature vector,
+   * descending the tree for the features in parallel. The result is the
+   * same as the sequential version
+   * @param features
+   * @param v (out) bow vector
+   * @param fv (out) feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   * @param parallel_for runs the descent (sequential if NULL)
+   * @param extra_data passed to parallel_for
+   */
+  virtual void transform(const std::vector<TDescriptor>& features,
+    BowVector &v, FeatureVector &fv, int levelsup,
+    ParallelForFn parallel_for, void *extra_data) const;
+
   /**
    * Transforms a single feature into a word (without weight)
    * @param feature
@@ -246,6 +278,22 @@ public:
    */
   void saveToTextFile(const std::string &filename) const;  
 
+  /**
+   * Loads the vocabulary from a binary file written by saveToBinaryFile.
+   * The file is memory-mapped and used in place, so loading is immediate
+   * and processes using the same file share its pages
+   * @param filename
+   * @return false if the file cannot be mapped or is not a vocabulary
+   */
+  bool loadFromBinaryFile(const std::string &filename);
+
+  /**
+   * Saves the vocabulary into a binary file (native byte order)
+   * @param filename
+   * @return false if the file cannot be written
+   */
+  bool saveToBinaryFile(const std::string &filename) const;
+
   /**
    * Saves the vocabulary into a file
    * @param filename
@@ -361,6 +409,25 @@ protected:
    * @param id (out) word id
    */
   virtual void transform(const TDescriptor &feature, WordId &id) const;
+
+  /// Words of a batch of features, filled by transformRange
+  struct TransformJob
+  {
+    const TemplatedVocabulary<TDescriptor, F> *voc;
+    const std::vector<TDescriptor> *features;
+    int levelsup;
+    WordId *word_ids;
+    WordValue *weights;
+    NodeId *nids;
+  };
+
+  /**
+   * Transforms the features [begin, end) of a TransformJob
+   * @param begin
+   * @param end
+   * @param job_data TransformJob
+   */
+  static void transformRange(int begin, int end, void *job_data);
       
   /**
    * Creates a level in the tree, under the parent, by running kmeans with
@@ -396,12 +463,59 @@ protected:
   
   /**
    * Sets the weights of the nodes of tree according to the given features.
-   * Before calling this function, the nodes and the words must be already
-   * created (by calling HKmeansStep and createWords)
+   * Before calling this function, the binary image must be already
+   * created (by calling HKmeansStep, createWords and buildImage)
    * @param features
    */
   void setNodeWeights(const vector<vector<TDescriptor> > &features);
-  
+
+  /// Header of the binary image. Arrays follow at the given byte offsets
+  struct BinaryHeader
+  {
+    char magic[8];
+    uint32_t version;
+    int32_t k;
+    int32_t L;
+    int32_t scoring;
+    int32_t weighting;
+    uint32_t desc_bytes;
+    uint32_t nnodes;
+    uint32_t nwords;
+    uint64_t off_parent;
+    uint64_t off_first_child;
+    uint64_t off_nchildren;
+    uint64_t off_node_word;
+    uint64_t off_weight;
+    uint64_t off_word_node;
+    uint64_t off_desc;
+    uint64_t size;
+  };
+
+  /**
+   * Builds the binary image from m_nodes and m_words, renumbering the
+   * nodes in level order so that the children of a node are consecutive.
+   * m_nodes and m_words are released afterwards
+   */
+  void buildImage();
+
+  /**
+   * Checks the image at base and points the flat arrays into it
+   * @param base image start
+   * @param size image size in bytes
+   * @return false if it is not a valid image
+   */
+  bool setImage(const void *base, size_t size);
+
+  /**
+   * Drops the current image (unmapping it if needed)
+   */
+  void releaseImage();
+
+  /**
+   * Returns the node weights for writing, copying a mapped image first
+   */
+  WordValue* writableWeights();
+
 protected:
 
   /// Branching factor
@@ -419,12 +533,42 @@ protected:
   /// Object for computing scores
   GeneralScoring* m_scoring_object;
   
-  /// Tree nodes
+  /// Tree nodes (only while building, then moved to the binary image)
   std::vector<Node> m_nodes;
   
-  /// Words of the vocabulary (tree leaves)
+  /// Words of the vocabulary (tree leaves), only while building
   /// this condition holds: m_words[wid]->word_id == wid
   std::vector<Node*> m_words;
+
+  /// Binary image owned by the vocabulary (built or copied)
+  std::vector<uint64_t> m_image;
+
+  /// Binary image mapped from a file (NULL if owned)
+  void *m_mapped;
+  size_t m_mapped_size;
+
+  /// Start and size of the current image
+  const unsigned char *m_base;
+  size_t m_size;
+
+  /// Number of nodes (root included) and words in the image
+  unsigned int m_nnodes;
+  unsigned int m_nwords;
+
+  /// Children compared per call to F::distances
+  static const int CHILD_BLOCK = 16;
+
+  /// Flat arrays of the image, indexed by node id (level order, root is 0).
+  /// The children of node i are m_first_child[i] .. m_first_child[i]+m_nchildren[i]-1
+  const NodeId *m_parent;
+  const NodeId *m_first_child;
+  const uint32_t *m_nchildren;
+  const WordId *m_node_word;
+  const WordValue *m_weight;
+  /// Node of each word
+  const NodeId *m_word_node;
+  /// F::L bytes per node
+  const unsigned char *m_desc;
   
 };
 
@@ -434,8 +578,9 @@ template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
   (int k, int L, WeightingType weighting, ScoringType scoring)
   : m_k(k), m_L(L), m_weighting(weighting), m_scoring(scoring),
-  m_scoring_object(NULL)
+  m_scoring_object(NULL), m_mapped(NULL), m_mapped_size(0)
 {
+  releaseImage();
   createScoringObject();
 }
 
@@ -443,8 +588,10 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const std::string &filename): m_scoring_object(NULL)
+  (const std::string &filename): m_scoring_object(NULL), m_mapped(NULL),
+  m_mapped_size(0)
 {
+  releaseImage();
   load(filename);
 }
 
@@ -452,8 +599,10 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const char *filename): m_scoring_object(NULL)
+  (const char *filename): m_scoring_object(NULL), m_mapped(NULL),
+  m_mapped_size(0)
 {
+  releaseImage();
   load(filename);
 }
 
@@ -516,8 +665,9 @@ void TemplatedVocabulary<TDescriptor,F>::setWeightingType(WeightingType type)
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary(
   const TemplatedVocabulary<TDescriptor, F> &voc)
-  : m_scoring_object(NULL)
+  : m_scoring_object(NULL), m_mapped(NULL), m_mapped_size(0)
 {
+  releaseImage();
   *this = voc;
 }
 
@@ -527,6 +677,7 @@ template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::~TemplatedVocabulary()
 {
   delete m_scoring_object;
+  releaseImage();
 }
 
 // --------------------------------------------------------------------------
@@ -542,12 +693,20 @@ TemplatedVocabulary<TDescriptor,F>::operator=
   this->m_weighting = voc.m_weighting;
 
   this->createScoringObject();
+
+  if(this == &voc) return *this;
   
   this->m_nodes.clear();
   this->m_words.clear();
-  
-  this->m_nodes = voc.m_nodes;
-  this->createWords();
+  this->releaseImage();
+
+  // the copy always owns its image
+  if(voc.m_size > 0)
+  {
+    this->m_image.resize((voc.m_size + 7) / 8);
+    memcpy(&this->m_image[0], voc.m_base, voc.m_size);
+    this->setImage(&this->m_image[0], voc.m_size);
+  }
   
   return *this;
 }
@@ -560,6 +719,7 @@ void TemplatedVocabulary<TDescriptor,F>::create(
 {
   m_nodes.clear();
   m_words.clear();
+  releaseImage();
   
   // expected_nodes = Sum_{i=0..L} ( k^i )
 	int expected_nodes = 
@@ -581,6 +741,9 @@ void TemplatedVocabulary<TDescriptor,F>::create(
   // create the words
   createWords();
 
+  // flatten the tree
+  buildImage();
+
   // and set the weight of each node of the tree
   setNodeWeights(training_features);
   
@@ -939,18 +1102,227 @@ void TemplatedVocabulary<TDescriptor,F>::createWords()
 
 // --------------------------------------------------------------------------
 
+/// Rounds a byte offset of the binary image up to a cache line
+inline uint64_t alignImageOffset(uint64_t off)
+{
+  return (off + 63) & ~(uint64_t)63;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::buildImage()
+{
+  const unsigned int N = m_nodes.size();
+  const unsigned int W = m_words.size();
+
+  // level order, so that the children of a node get consecutive ids
+  vector<NodeId> order;
+  vector<NodeId> new_id(N, 0);
+  order.reserve(N);
+  if(N > 0) order.push_back(0);
+
+  for(size_t i = 0; i < order.size(); ++i)
+  {
+    const vector<NodeId> &children = m_nodes[order[i]].children;
+    for(size_t c = 0; c < children.size(); ++c)
+    {
+      new_id[children[c]] = order.size();
+      order.push_back(children[c]);
+    }
+  }
+
+  BinaryHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, "DBOW2VOC", 8);
+  h.version = 1;
+  h.k = m_k;
+  h.L = m_L;
+  h.scoring = m_scoring;
+  h.weighting = m_weighting;
+  h.desc_bytes = F::L;
+  h.nnodes = N;
+  h.nwords = W;
+
+  uint64_t off = alignImageOffset(sizeof(BinaryHeader));
+  h.off_parent = off;
+  off = alignImageOffset(off + (uint64_t)N * sizeof(NodeId));
+  h.off_first_child = off;
+  off = alignImageOffset(off + (uint64_t)N * sizeof(NodeId));
+  h.off_nchildren = off;
+  off = alignImageOffset(off + (uint64_t)N * sizeof(uint32_t));
+  h.off_node_word = off;
+  off = alignImageOffset(off + (uint64_t)N * sizeof(WordId));
+  h.off_weight = off;
+  off = alignImageOffset(off + (uint64_t)N * sizeof(WordValue));
+  h.off_word_node = off;
+  off = alignImageOffset(off + (uint64_t)W * sizeof(NodeId));
+  h.off_desc = off;
+  off = alignImageOffset(off + (uint64_t)N * F::L);
+  h.size = off;
+
+  std::vector<uint64_t> image((h.size + 7) / 8, 0);
+  unsigned char *base = reinterpret_cast<unsigned char*>(&image[0]);
+  memcpy(base, &h, sizeof(h));
+
+  NodeId *parent = reinterpret_cast<NodeId*>(base + h.off_parent);
+  NodeId *first_child = reinterpret_cast<NodeId*>(base + h.off_first_child);
+  uint32_t *nchildren = reinterpret_cast<uint32_t*>(base + h.off_nchildren);
+  WordId *node_word = reinterpret_cast<WordId*>(base + h.off_node_word);
+  WordValue *weight = reinterpret_cast<WordValue*>(base + h.off_weight);
+  NodeId *word_node = reinterpret_cast<NodeId*>(base + h.off_word_node);
+  unsigned char *desc = base + h.off_desc;
+
+  for(NodeId i = 0; i < N; ++i)
+  {
+    const Node &node = m_nodes[order[i]];
+
+    parent[i] = (i == 0 ? 0 : new_id[node.parent]);
+    first_child[i] = (node.children.empty() ? 0 : new_id[node.children[0]]);
+    nchildren[i] = node.children.size();
+    node_word[i] = (i > 0 && node.isLeaf() ? node.word_id : 0);
+    weight[i] = node.weight;
+
+    // the root has no descriptor
+    if(i > 0) F::toBytes(node.descriptor, desc + (size_t)i * F::L);
+  }
+
+  for(WordId wid = 0; wid < W; ++wid)
+    word_node[wid] = new_id[m_words[wid]->id];
+
+  releaseImage();
+  m_image.swap(image);
+  setImage(&m_image[0], h.size);
+
+  m_words.clear();
+  m_nodes.clear();
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::setImage(const void *base, size_t size)
+{
+  if(size < sizeof(BinaryHeader)) return false;
+
+  BinaryHeader h;
+  memcpy(&h, base, sizeof(h));
+
+  if(memcmp(h.magic, "DBOW2VOC", 8) != 0 || h.version != 1 ||
+    h.desc_bytes != (uint32_t)F::L || h.size > size)
+    return false;
+
+  const uint64_t N = h.nnodes;
+  const uint64_t W = h.nwords;
+
+  if(h.off_parent + N * sizeof(NodeId) > h.size ||
+    h.off_first_child + N * sizeof(NodeId) > h.size ||
+    h.off_nchildren + N * sizeof(uint32_t) > h.size ||
+    h.off_node_word + N * sizeof(WordId) > h.size ||
+    h.off_weight + N * sizeof(WordValue) > h.size ||
+    h.off_word_node + W * sizeof(NodeId) > h.size ||
+    h.off_desc + N * F::L > h.size)
+    return false;
+
+  const unsigned char *b = static_cast<const unsigned char*>(base);
+  const NodeId *first_child = reinterpret_cast<const NodeId*>(b + h.off_first_child);
+  const uint32_t *nchildren = reinterpret_cast<const uint32_t*>(b + h.off_nchildren);
+  const NodeId *word_node = reinterpret_cast<const NodeId*>(b + h.off_word_node);
+
+  // a corrupt file must not send transform out of the arrays
+  if(N > 0 && nchildren[0] == 0) return false;
+  for(uint64_t i = 0; i < N; ++i)
+  {
+    if(nchildren[i] > 0 && (first_child[i] <= i ||
+      (uint64_t)first_child[i] + nchildren[i] > N))
+      return false;
+  }
+  for(uint64_t i = 0; i < W; ++i)
+  {
+    if(word_node[i] >= N || nchildren[word_node[i]] > 0) return false;
+  }
+
+  // the word id of a leaf indexes the inverted file: it must be a word that maps back to the leaf
+  const WordId *node_word = reinterpret_cast<const WordId*>(b + h.off_node_word);
+  for(uint64_t i = 1; i < N; ++i)
+  {
+    if(nchildren[i] == 0 && (node_word[i] >= W || word_node[node_word[i]] != i))
+      return false;
+  }
+
+  m_base = b;
+  m_size = size;
+  m_nnodes = h.nnodes;
+  m_nwords = h.nwords;
+  m_parent = reinterpret_cast<const NodeId*>(b + h.off_parent);
+  m_first_child = first_child;
+  m_nchildren = nchildren;
+  m_node_word = node_word;
+  m_weight = reinterpret_cast<const WordValue*>(b + h.off_weight);
+  m_word_node = word_node;
+  m_desc = b + h.off_desc;
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::releaseImage()
+{
+  if(m_mapped != NULL) munmap(m_mapped, m_mapped_size);
+  m_mapped = NULL;
+  m_mapped_size = 0;
+  std::vector<uint64_t>().swap(m_image);
+
+  m_base = NULL;
+  m_size = 0;
+  m_nnodes = 0;
+  m_nwords = 0;
+  m_parent = NULL;
+  m_first_child = NULL;
+  m_nchildren = NULL;
+  m_node_word = NULL;
+  m_weight = NULL;
+  m_word_node = NULL;
+  m_desc = NULL;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+WordValue* TemplatedVocabulary<TDescriptor,F>::writableWeights()
+{
+  if(m_mapped != NULL)
+  {
+    // mapped pages are read-only: take a private copy first
+    const size_t size = m_size;
+    std::vector<uint64_t> image((size + 7) / 8);
+    memcpy(&image[0], m_base, size);
+
+    releaseImage();
+    m_image.swap(image);
+    setImage(&m_image[0], size);
+  }
+
+  return const_cast<WordValue*>(m_weight);
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::setNodeWeights
   (const vector<vector<TDescriptor> > &training_features)
 {
-  const unsigned int NWords = m_words.size();
+  const unsigned int NWords = m_nwords;
   const unsigned int NDocs = training_features.size();
+  WordValue *weights = writableWeights();
 
   if(m_weighting == TF || m_weighting == BINARY)
   {
     // idf part must be 1 always
     for(unsigned int i = 0; i < NWords; i++)
-      m_words[i]->weight = 1;
+      weights[m_word_node[i]] = 1;
   }
   else if(m_weighting == IDF || m_weighting == TF_IDF)
   {
@@ -987,7 +1359,7 @@ void TemplatedVocabulary<TDescriptor,F>::setNodeWeights
     {
       if(Ni[i] > 0)
       {
-        m_words[i]->weight = log((double)NDocs / (double)Ni[i]);
+        weights[m_word_node[i]] = log((double)NDocs / (double)Ni[i]);
       }// else // This cannot occur if using kmeans++
     }
   
@@ -1000,7 +1372,7 @@ void TemplatedVocabulary<TDescriptor,F>::setNodeWeights
 template<class TDescriptor, class F>
 inline unsigned int TemplatedVocabulary<TDescriptor,F>::size() const
 {
-  return m_words.size();
+  return m_nwords;
 }
 
 // --------------------------------------------------------------------------
@@ -1008,7 +1380,7 @@ inline unsigned int TemplatedVocabulary<TDescriptor,F>::size() const
 template<class TDescriptor, class F>
 inline bool TemplatedVocabulary<TDescriptor,F>::empty() const
 {
-  return m_words.empty();
+  return m_nwords == 0;
 }
 
 // --------------------------------------------------------------------------
@@ -1017,15 +1389,14 @@ template<class TDescriptor, class F>
 float TemplatedVocabulary<TDescriptor,F>::getEffectiveLevels() const
 {
   long sum = 0;
-  typename std::vector<Node*>::const_iterator wit;
-  for(wit = m_words.begin(); wit != m_words.end(); ++wit)
+  for(WordId wid = 0; wid < m_nwords; ++wid)
   {
-    const Node *p = *wit;
+    NodeId nid = m_word_node[wid];
     
-    for(; p->id != 0; sum++) p = &m_nodes[p->parent];
+    for(; nid != 0; sum++) nid = m_parent[nid];
   }
   
-  return (float)((double)sum / (double)m_words.size());
+  return (float)((double)sum / (double)m_nwords);
 }
 
 // --------------------------------------------------------------------------
@@ -1033,7 +1404,9 @@ float TemplatedVocabulary<TDescriptor,F>::getEffectiveLevels() const
 template<class TDescriptor, class F>
 TDescriptor TemplatedVocabulary<TDescriptor,F>::getWord(WordId wid) const
 {
-  return m_words[wid]->descriptor;
+  TDescriptor d;
+  F::fromBytes(d, m_desc + (size_t)m_word_node[wid] * F::L);
+  return d;
 }
 
 // --------------------------------------------------------------------------
@@ -1041,7 +1414,7 @@ TDescriptor TemplatedVocabulary<TDescriptor,F>::getWord(WordId wid) const
 template<class TDescriptor, class F>
 WordValue TemplatedVocabulary<TDescriptor, F>::getWordWeight(WordId wid) const
 {
-  return m_words[wid]->weight;
+  return m_weight[m_word_node[wid]];
 }
 
 // --------------------------------------------------------------------------
@@ -1090,8 +1463,10 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
       transform(*fit, id, w);
       
       // not stopped
-      if(w > 0) v.addWeight(id, w);
+      if(w > 0) v.appendWeight(id, w);
     }
+
+    v.sortAndMerge(true);
     
     if(!v.empty() && !must)
     {
@@ -1113,9 +1488,11 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
       transform(*fit, id, w);
       
       // not stopped
-      if(w > 0) v.addIfNotExist(id, w);
+      if(w > 0) v.appendWeight(id, w);
       
     } // if add_features
+
+    v.sortAndMerge(false);
   } // if m_weighting == ...
   
   if(must) v.normalize(norm);
@@ -1127,74 +1504,103 @@ template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::transform(
   const std::vector<TDescriptor>& features,
   BowVector &v, FeatureVector &fv, int levelsup) const
+{
+  transform(features, v, fv, levelsup, NULL, NULL);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F> 
+void TemplatedVocabulary<TDescriptor,F>::transform(
+  const std::vector<TDescriptor>& features,
+  BowVector &v, FeatureVector &fv, int levelsup,
+  ParallelForFn parallel_for, void *extra_data) const
 {
   v.clear();
   fv.clear();
   
-  if(empty()) // safe for subclasses
+  if(empty() || features.empty()) // safe for subclasses
   {
     return;
   }
+
+  // descend the tree for every feature first, the vectors are then
+  // filled in feature order
+  const int N = features.size();
+  std::vector<WordId> word_ids(N);
+  std::vector<WordValue> weights(N);
+  std::vector<NodeId> nids(N);
+
+  TransformJob job;
+  job.voc = this;
+  job.features = &features;
+  job.levelsup = levelsup;
+  job.word_ids = &word_ids[0];
+  job.weights = &weights[0];
+  job.nids = &nids[0];
+
+  if(parallel_for != NULL)
+    parallel_for(N, &TemplatedVocabulary<TDescriptor,F>::transformRange,
+      &job, extra_data);
+  else
+    transformRange(0, N, &job);
   
   // normalize 
   LNorm norm;
   bool must = m_scoring_object->mustNormalize(norm);
-  
-  typename vector<TDescriptor>::const_iterator fit;
-  
-  if(m_weighting == TF || m_weighting == TF_IDF)
+
+  // w is the idf value if TF_IDF, 1 if TF: repeated words are added up.
+  // w is idf if IDF, or 1 if BINARY: repeated words count once
+  const bool add = (m_weighting == TF || m_weighting == TF_IDF);
+
+  // append all the words and nodes, then sort and merge them once
+  std::vector<std::pair<NodeId, unsigned int> > node_features;
+  v.reserve(N);
+  node_features.reserve(N);
+
+  for(int i_feature = 0; i_feature < N; ++i_feature)
   {
-    unsigned int i_feature = 0;
-    for(fit = features.begin(); fit < features.end(); ++fit, ++i_feature)
-    {
-      WordId id;
-      NodeId nid;
-      WordValue w; 
-      // w is the idf value if TF_IDF, 1 if TF
-      
-      transform(*fit, id, w, &nid, levelsup);
-      
-      if(w > 0) // not stopped
-      { 
-        v.addWeight(id, w);
-        fv.addFeature(nid, i_feature);
-      }
-    }
+    const WordValue w = weights[i_feature];
     
-    if(!v.empty() && !must)
-    {
-      // unnecessary when normalizing
-      const double nd = v.size();
-      for(BowVector::iterator vit = v.begin(); vit != v.end(); vit++) 
-        vit->second /= nd;
+    if(w > 0) // not stopped
+    { 
+      v.appendWeight(word_ids[i_feature], w);
+      node_features.push_back(std::make_pair(nids[i_feature], 
+        (unsigned int)i_feature));
     }
-  
   }
-  else // IDF || BINARY
+
+  v.sortAndMerge(add);
+  fv.setFeatures(node_features);
+    
+  if(add && !v.empty() && !must)
   {
-    unsigned int i_feature = 0;
-    for(fit = features.begin(); fit < features.end(); ++fit, ++i_feature)
-    {
-      WordId id;
-      NodeId nid;
-      WordValue w;
-      // w is idf if IDF, or 1 if BINARY
-      
-      transform(*fit, id, w, &nid, levelsup);
-      
-      if(w > 0) // not stopped
-      {
-        v.addIfNotExist(id, w);
-        fv.addFeature(nid, i_feature);
-      }
-    }
-  } // if m_weighting == ...
+    // unnecessary when normalizing
+    const double nd = v.size();
+    for(BowVector::iterator vit = v.begin(); vit != v.end(); vit++) 
+      vit->second /= nd;
+  }
   
   if(must) v.normalize(norm);
 }
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F> 
+void TemplatedVocabulary<TDescriptor,F>::transformRange(int begin, int end,
+  void *job_data)
+{
+  const TransformJob &job = *static_cast<const TransformJob*>(job_data);
+
+  for(int i = begin; i < end; ++i)
+  {
+    job.voc->transform((*job.features)[i], job.word_ids[i], job.weights[i],
+      &job.nids[i], job.levelsup);
+  }
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F> 
 inline double TemplatedVocabulary<TDescriptor,F>::score
   (const BowVector &v1, const BowVector &v2) const
@@ -1219,8 +1625,8 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
   WordId &word_id, WordValue &weight, NodeId *nid, int levelsup) const
 { 
   // propagate the feature down the tree
-  vector<NodeId> nodes;
-  typename vector<NodeId>::const_iterator nit;
+  unsigned char query[F::L];
+  F::toBytes(feature, query);
 
   // level at which the node must be stored in nid, if given
   const int nid_level = m_L - levelsup;
@@ -1232,30 +1638,40 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
   do
   {
     ++current_level;
-    nodes = m_nodes[final_id].children;
-    final_id = nodes[0];
- 
-    double best_d = F::distance(feature, m_nodes[final_id].descriptor);
 
-    for(nit = nodes.begin() + 1; nit != nodes.end(); ++nit)
+    // the children are consecutive, and so are their descriptors: compare
+    // the query against a block of them at once
+    const NodeId first = m_first_child[final_id];
+    const uint32_t nchildren = m_nchildren[final_id];
+    const unsigned char *desc = m_desc + (size_t)first * F::L;
+
+    final_id = first;
+    int best_d = std::numeric_limits<int>::max();
+
+    for(uint32_t c0 = 0; c0 < nchildren; c0 += CHILD_BLOCK)
     {
-      NodeId id = *nit;
-      double d = F::distance(feature, m_nodes[id].descriptor);
-      if(d < best_d)
+      const int n = std::min<uint32_t>(CHILD_BLOCK, nchildren - c0);
+      int d[CHILD_BLOCK];
+      F::distances(query, desc + (size_t)c0 * F::L, n, d);
+
+      for(int c = 0; c < n; ++c)
       {
-        best_d = d;
-        final_id = id;
+        if(d[c] < best_d)
+        {
+          best_d = d[c];
+          final_id = first + c0 + c;
+        }
       }
     }
     
     if(nid != NULL && current_level == nid_level)
       *nid = final_id;
     
-  } while( !m_nodes[final_id].isLeaf() );
+  } while( m_nchildren[final_id] > 0 );
 
   // turn node id into word id
-  word_id = m_nodes[final_id].word_id;
-  weight = m_nodes[final_id].weight;
+  word_id = m_node_word[final_id];
+  weight = m_weight[final_id];
 }
 
 // --------------------------------------------------------------------------
@@ -1264,11 +1680,11 @@ template<class TDescriptor, class F>
 NodeId TemplatedVocabulary<TDescriptor,F>::getParentNode
   (WordId wid, int levelsup) const
 {
-  NodeId ret = m_words[wid]->id; // node id
+  NodeId ret = m_word_node[wid]; // node id
   while(levelsup > 0 && ret != 0) // ret == 0 --> root
   {
     --levelsup;
-    ret = m_nodes[ret].parent;
+    ret = m_parent[ret];
   }
   return ret;
 }
@@ -1281,9 +1697,9 @@ void TemplatedVocabulary<TDescriptor,F>::getWordsFromNode
 {
   words.clear();
   
-  if(m_nodes[nid].isLeaf())
+  if(m_nchildren[nid] == 0)
   {
-    words.push_back(m_nodes[nid].word_id);
+    words.push_back(m_node_word[nid]);
   }
   else
   {
@@ -1297,17 +1713,15 @@ void TemplatedVocabulary<TDescriptor,F>::getWordsFromNode
       NodeId parentid = parents.back();
       parents.pop_back();
       
-      const vector<NodeId> &child_ids = m_nodes[parentid].children;
-      vector<NodeId>::const_iterator cit;
+      const NodeId first = m_first_child[parentid];
+      const NodeId last = first + m_nchildren[parentid];
       
-      for(cit = child_ids.begin(); cit != child_ids.end(); ++cit)
+      for(NodeId cid = first; cid != last; ++cid)
       {
-        const Node &child_node = m_nodes[*cit];
-        
-        if(child_node.isLeaf())
-          words.push_back(child_node.word_id);
+        if(m_nchildren[cid] == 0)
+          words.push_back(m_node_word[cid]);
         else
-          parents.push_back(*cit);
+          parents.push_back(cid);
         
       } // for each child
     } // while !parents.empty
@@ -1320,13 +1734,14 @@ template<class TDescriptor, class F>
 int TemplatedVocabulary<TDescriptor,F>::stopWords(double minWeight)
 {
   int c = 0;
-  typename vector<Node*>::iterator wit;
-  for(wit = m_words.begin(); wit != m_words.end(); ++wit)
+  WordValue *weights = writableWeights();
+  for(WordId wid = 0; wid < m_nwords; ++wid)
   {
-    if((*wit)->weight < minWeight)
+    WordValue &weight = weights[m_word_node[wid]];
+    if(weight < minWeight)
     {
       ++c;
-      (*wit)->weight = 0;
+      weight = 0;
     }
   }
   return c;
@@ -1345,6 +1760,7 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
 
     m_words.clear();
     m_nodes.clear();
+    releaseImage();
 
     string s;
     getline(f,s);
@@ -1379,6 +1795,8 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
     {
         string snode;
         getline(f,snode);
+        if(snode.empty())
+            continue;
         stringstream ssnode;
         ssnode << snode;
 
@@ -1419,6 +1837,8 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
         }
     }
 
+    buildImage();
+
     return true;
 
 }
@@ -1432,17 +1852,18 @@ void TemplatedVocabulary<TDescriptor,F>::saveToTextFile(const std::string &filen
     f.open(filename.c_str(),ios_base::out);
     f << m_k << " " << m_L << " " << " " << m_scoring << " " << m_weighting << endl;
 
-    for(size_t i=1; i<m_nodes.size();i++)
+    // level order: parents are always written before their children
+    TDescriptor descriptor;
+    for(size_t i=1; i<m_nnodes;i++)
     {
-        const Node& node = m_nodes[i];
-
-        f << node.parent << " ";
-        if(node.isLeaf())
+        f << m_parent[i] << " ";
+        if(m_nchildren[i] == 0)
             f << 1 << " ";
         else
             f << 0 << " ";
 
-        f << F::toString(node.descriptor) << " " << (double)node.weight << endl;
+        F::fromBytes(descriptor, m_desc + i * F::L);
+        f << F::toString(descriptor) << " " << (double)m_weight[i] << endl;
     }
 
     f.close();
@@ -1450,6 +1871,74 @@ void TemplatedVocabulary<TDescriptor,F>::saveToTextFile(const std::string &filen
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::loadFromBinaryFile(const std::string &filename)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if(fd < 0) return false;
+
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(BinaryHeader))
+  {
+    close(fd);
+    return false;
+  }
+
+  void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(p == MAP_FAILED) return false;
+
+  m_words.clear();
+  m_nodes.clear();
+  releaseImage();
+
+  m_mapped = p;
+  m_mapped_size = st.st_size;
+
+  if(!setImage(p, st.st_size))
+  {
+    releaseImage();
+    return false;
+  }
+
+  BinaryHeader h;
+  memcpy(&h, p, sizeof(h));
+  m_k = h.k;
+  m_L = h.L;
+  m_scoring = (ScoringType)h.scoring;
+  m_weighting = (WeightingType)h.weighting;
+
+  createScoringObject();
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::saveToBinaryFile(const std::string &filename) const
+{
+  if(m_size < sizeof(BinaryHeader)) return false;
+
+  std::ofstream f(filename.c_str(), std::ios::out | std::ios::binary);
+  if(!f.is_open()) return false;
+
+  // the parameters may have changed after the image was built
+  BinaryHeader h;
+  memcpy(&h, m_base, sizeof(h));
+  h.k = m_k;
+  h.L = m_L;
+  h.scoring = m_scoring;
+  h.weighting = m_weighting;
+
+  f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  f.write(reinterpret_cast<const char*>(m_base) + sizeof(h), h.size - sizeof(h));
+
+  return f.good();
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::save(const std::string &filename) const
 {
@@ -1516,30 +2005,32 @@ void TemplatedVocabulary<TDescriptor,F>::save(cv::FileStorage &f,
   vector<NodeId> parents, children;
   vector<NodeId>::const_iterator pit;
 
+  TDescriptor descriptor;
+
   parents.push_back(0); // root
 
-  while(!parents.empty())
+  while(!parents.empty() && m_nnodes > 0)
   {
     NodeId pid = parents.back();
     parents.pop_back();
 
-    const Node& parent = m_nodes[pid];
-    children = parent.children;
+    children.clear();
+    for(NodeId cid = 0; cid < m_nchildren[pid]; ++cid)
+      children.push_back(m_first_child[pid] + cid);
 
     for(pit = children.begin(); pit != children.end(); pit++)
     {
-      const Node& child = m_nodes[*pit];
-
       // save node data
+      F::fromBytes(descriptor, m_desc + (size_t)(*pit) * F::L);
       f << "{:";
-      f << "nodeId" << (int)child.id;
+      f << "nodeId" << (int)*pit;
       f << "parentId" << (int)pid;
-      f << "weight" << (double)child.weight;
-      f << "descriptor" << F::toString(child.descriptor);
+      f << "weight" << (double)m_weight[*pit];
+      f << "descriptor" << F::toString(descriptor);
       f << "}";
       
       // add to parent list
-      if(!child.isLeaf())
+      if(m_nchildren[*pit] > 0)
       {
         parents.push_back(*pit);
       }
@@ -1551,13 +2042,11 @@ void TemplatedVocabulary<TDescriptor,F>::save(cv::FileStorage &f,
   // words
   f << "words" << "[";
   
-  typename vector<Node*>::const_iterator wit;
-  for(wit = m_words.begin(); wit != m_words.end(); wit++)
+  for(WordId id = 0; id < m_nwords; id++)
   {
-    WordId id = wit - m_words.begin();
     f << "{:";
     f << "wordId" << (int)id;
-    f << "nodeId" << (int)(*wit)->id;
+    f << "nodeId" << (int)m_word_node[id];
     f << "}";
   }
   
@@ -1575,6 +2064,7 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
 {
   m_words.clear();
   m_nodes.clear();
+  releaseImage();
   
   cv::FileNode fvoc = fs[name];
   
@@ -1619,6 +2109,8 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
     m_nodes[nid].word_id = wid;
     m_words[wid] = &m_nodes[nid];
   }
+
+  buildImage();
 }
 
 // --------------------------------------------------------------------------
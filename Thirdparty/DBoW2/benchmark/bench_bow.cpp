@@ -0,0 +1,299 @@
+/**
+ * File: bench_bow.cpp
+ * Description: timing of the bow vector and feature vector containers
+ * License: see the LICENSE.txt file
+ *
+ */
+
+// Keyframes of a sequence (e.g. kitti_sample) are turned into bow and feature
+// vectors, and every pair of keyframes is scored, once through the std::map
+// containers the vectors used to be and once through the sorted flat arrays.
+// The tree descent is the same for both paths; only the filling of the
+// vectors and the scoring differ. The results of both paths are compared.
+//
+// usage: bench_bow path_to_vocabulary path_to_sequence [num_features]
+//   path_to_sequence holds times.txt and image/000000.png, image/000001.png...
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <map>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+#include "../DBoW2/FORB.h"
+#include "../DBoW2/TemplatedVocabulary.h"
+#include "../DUtils/Timestamp.h"
+
+using namespace std;
+using namespace DBoW2;
+
+typedef TemplatedVocabulary<FORB::TDescriptor, FORB> Vocabulary;
+
+// The containers before the flat arrays
+typedef std::map<WordId, WordValue> MapBowVector;
+typedef std::map<NodeId, std::vector<unsigned int> > MapFeatureVector;
+
+/// Gives access to the single feature descent and the scoring settings
+class BenchVocabulary: public Vocabulary
+{
+public:
+  void descend(const FORB::TDescriptor &feature, WordId &id, WordValue &w,
+    NodeId *nid, int levelsup) const
+  {
+    Vocabulary::transform(feature, id, w, nid, levelsup);
+  }
+
+  bool mustNormalize(LNorm &norm) const
+  {
+    return m_scoring_object->mustNormalize(norm);
+  }
+};
+
+static const int LEVELS_UP = 4; // as in KeyFrame::ComputeBoW
+
+// Map version of TemplatedVocabulary::transform(features, v, fv, levelsup)
+static void mapTransform(const BenchVocabulary &voc,
+  const vector<FORB::TDescriptor> &features, MapBowVector &v,
+  MapFeatureVector &fv)
+{
+  v.clear();
+  fv.clear();
+
+  LNorm norm;
+  const bool must = voc.mustNormalize(norm);
+  const bool add = voc.getWeightingType() == TF ||
+    voc.getWeightingType() == TF_IDF;
+
+  for(unsigned int i = 0; i < features.size(); ++i)
+  {
+    WordId id;
+    WordValue w;
+    NodeId nid;
+    voc.descend(features[i], id, w, &nid, LEVELS_UP);
+
+    if(w <= 0) continue; // stopped
+
+    MapBowVector::iterator vit = v.lower_bound(id);
+    if(vit != v.end() && vit->first == id)
+    {
+      if(add) vit->second += w;
+    }
+    else
+      v.insert(vit, MapBowVector::value_type(id, w));
+
+    MapFeatureVector::iterator fit = fv.lower_bound(nid);
+    if(fit != fv.end() && fit->first == nid)
+      fit->second.push_back(i);
+    else
+      fv.insert(fit, MapFeatureVector::value_type(nid,
+        std::vector<unsigned int>(1, i)));
+  }
+
+  if(add && !v.empty() && !must)
+  {
+    const double nd = v.size();
+    for(MapBowVector::iterator vit = v.begin(); vit != v.end(); ++vit)
+      vit->second /= nd;
+  }
+
+  if(must)
+  {
+    double n = 0.0;
+    for(MapBowVector::iterator vit = v.begin(); vit != v.end(); ++vit)
+      n += (norm == L1 ? fabs(vit->second) : vit->second * vit->second);
+    if(norm == L2) n = sqrt(n);
+    if(n > 0.0)
+      for(MapBowVector::iterator vit = v.begin(); vit != v.end(); ++vit)
+        vit->second /= n;
+  }
+}
+
+// Map version of L1Scoring::score
+static double mapScoreL1(const MapBowVector &v1, const MapBowVector &v2)
+{
+  MapBowVector::const_iterator v1_it = v1.begin(), v2_it = v2.begin();
+  double score = 0;
+
+  while(v1_it != v1.end() && v2_it != v2.end())
+  {
+    const WordValue &vi = v1_it->second;
+    const WordValue &wi = v2_it->second;
+
+    if(v1_it->first == v2_it->first)
+    {
+      score += fabs(vi - wi) - fabs(vi) - fabs(wi);
+      ++v1_it;
+      ++v2_it;
+    }
+    else if(v1_it->first < v2_it->first)
+      v1_it = v1.lower_bound(v2_it->first);
+    else
+      v2_it = v2.lower_bound(v1_it->first);
+  }
+
+  return -score / 2.0;
+}
+
+static bool sameVectors(const BowVector &v, const FeatureVector &fv,
+  const MapBowVector &mv, const MapFeatureVector &mfv)
+{
+  if(v.size() != mv.size() || fv.size() != mfv.size()) return false;
+
+  MapBowVector::const_iterator mit = mv.begin();
+  for(BowVector::const_iterator vit = v.begin(); vit != v.end(); ++vit, ++mit)
+    if(vit->first != mit->first || vit->second != mit->second) return false;
+
+  MapFeatureVector::const_iterator mfit = mfv.begin();
+  for(FeatureVector::const_iterator fit = fv.begin(); fit != fv.end();
+    ++fit, ++mfit)
+    if(fit->first != mfit->first || fit->second != mfit->second) return false;
+
+  return true;
+}
+
+static void loadKeyFrames(const string &strSequence, int nFeatures,
+  vector<vector<FORB::TDescriptor> > &vFeatures)
+{
+  ifstream fTimes((strSequence + "/times.txt").c_str());
+  int nImages = 0;
+  string s;
+  while(getline(fTimes, s))
+    if(!s.empty()) ++nImages;
+
+  cv::Ptr<cv::ORB> orb = cv::ORB::create(nFeatures);
+
+  for(int i = 0; i < nImages; ++i)
+  {
+    stringstream ss;
+    ss << strSequence << "/image/" << setfill('0') << setw(6) << i << ".png";
+    cv::Mat im = cv::imread(ss.str(), cv::IMREAD_GRAYSCALE);
+    if(im.empty())
+    {
+      cerr << "Failed to load image at: " << ss.str() << endl;
+      continue;
+    }
+
+    vector<cv::KeyPoint> keys;
+    cv::Mat desc;
+    orb->detectAndCompute(im, cv::Mat(), keys, desc);
+
+    vector<FORB::TDescriptor> features(desc.rows);
+    for(int j = 0; j < desc.rows; ++j)
+      features[j] = desc.row(j);
+    vFeatures.push_back(features);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 3)
+  {
+    cerr << "usage: bench_bow path_to_vocabulary path_to_sequence [num_features]"
+      << endl;
+    return 1;
+  }
+
+  const string strVoc = argv[1];
+  const int nFeatures = argc > 3 ? atoi(argv[3]) : 4000;
+  const int repetitions = 20;
+
+  BenchVocabulary voc;
+  const bool bBinary = strVoc.size() > 4 &&
+    strVoc.compare(strVoc.size() - 4, 4, ".bin") == 0;
+  if(!(bBinary ? voc.loadFromBinaryFile(strVoc) : voc.loadFromTextFile(strVoc)))
+  {
+    cerr << "Failed to load the vocabulary at: " << strVoc << endl;
+    return 1;
+  }
+
+  vector<vector<FORB::TDescriptor> > vFeatures;
+  loadKeyFrames(argv[2], nFeatures, vFeatures);
+  const int nKFs = vFeatures.size();
+  if(nKFs == 0) return 1;
+
+  int nTotFeatures = 0;
+  for(int k = 0; k < nKFs; ++k) nTotFeatures += vFeatures[k].size();
+  cout << "keyframes " << nKFs << ", features per keyframe "
+    << nTotFeatures / nKFs << ", words " << voc.size() << endl;
+
+  vector<BowVector> vBow(nKFs);
+  vector<FeatureVector> vFeat(nKFs);
+  vector<MapBowVector> vMapBow(nKFs);
+  vector<MapFeatureVector> vMapFeat(nKFs);
+
+  // transform, best of the repetitions
+  double tMap = 1e10, tFlat = 1e10;
+  for(int r = 0; r < repetitions; ++r)
+  {
+    DUtils::Timestamp t0, t1, t2;
+    t0.setToCurrentTime();
+    for(int k = 0; k < nKFs; ++k)
+      mapTransform(voc, vFeatures[k], vMapBow[k], vMapFeat[k]);
+    t1.setToCurrentTime();
+    for(int k = 0; k < nKFs; ++k)
+      voc.transform(vFeatures[k], vBow[k], vFeat[k], LEVELS_UP);
+    t2.setToCurrentTime();
+    tMap = min(tMap, t1 - t0);
+    tFlat = min(tFlat, t2 - t1);
+  }
+
+  bool bSame = true;
+  for(int k = 0; k < nKFs; ++k)
+    bSame = bSame && sameVectors(vBow[k], vFeat[k], vMapBow[k], vMapFeat[k]);
+
+  cout << fixed << setprecision(3);
+  cout << "transform per keyframe: map " << 1e3 * tMap / nKFs << " ms, flat "
+    << 1e3 * tFlat / nKFs << " ms, speedup " << tMap / tFlat
+    << (bSame ? ", same vectors" : ", VECTORS DIFFER") << endl;
+
+  if(voc.getScoringType() != L1_NORM)
+  {
+    cout << "score: only the L1 scoring of the ORB vocabulary is compared"
+      << endl;
+    return bSame ? 0 : 1;
+  }
+
+  // score every pair of keyframes, best of the repetitions
+  double sMap = 0, sFlat = 0, maxDiff = 0;
+  tMap = 1e10;
+  tFlat = 1e10;
+  for(int r = 0; r < repetitions; ++r)
+  {
+    DUtils::Timestamp t0, t1, t2;
+    double sum = 0;
+    t0.setToCurrentTime();
+    for(int i = 0; i < nKFs; ++i)
+      for(int j = 0; j < nKFs; ++j)
+        sum += mapScoreL1(vMapBow[i], vMapBow[j]);
+    t1.setToCurrentTime();
+    sMap = sum;
+    sum = 0;
+    for(int i = 0; i < nKFs; ++i)
+      for(int j = 0; j < nKFs; ++j)
+        sum += voc.score(vBow[i], vBow[j]);
+    t2.setToCurrentTime();
+    sFlat = sum;
+    tMap = min(tMap, t1 - t0);
+    tFlat = min(tFlat, t2 - t1);
+  }
+
+  for(int i = 0; i < nKFs; ++i)
+    for(int j = 0; j < nKFs; ++j)
+      maxDiff = max(maxDiff, fabs(mapScoreL1(vMapBow[i], vMapBow[j]) -
+        voc.score(vBow[i], vBow[j])));
+
+  const int nPairs = nKFs * nKFs;
+  cout << setprecision(3) << "score per pair: map " << 1e6 * tMap / nPairs
+    << " us, flat " << 1e6 * tFlat / nPairs << " us, speedup " << tMap / tFlat
+    << ", max difference " << scientific << maxDiff << endl;
+
+  return bSame && sMap == sFlat ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+// g2o - General Graph Optimization
+// Copyright (C) 2011 R. Kuemmerle, G. Grisetti, W. Burgard
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// Local bundle adjustment sized problem (keyframe window, a few thousand map points,
+// monocular reprojection edges with Huber kernel) optimized once single-threaded and
+// once with the parallel build of the linear system for 2..N threads. Besides the whole
+// optimization, the time of buildSystem is reported for the first iteration (right
+// after buildStructure) and summed over all iterations.
+//
+// usage: bench_build_system [num_threads] [num_points] [num_keyframes]
+
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <thread>
+
+#include <Eigen/StdVector>
+
+#include "../g2o/core/block_solver.h"
+#include "../g2o/core/batch_stats.h"
+#include "../g2o/core/optimization_algorithm_levenberg.h"
+#include "../g2o/core/robust_kernel_impl.h"
+#include "../g2o/solvers/linear_solver_eigen.h"
+#include "../g2o/types/types_six_dof_expmap.h"
+#include "../g2o/stuff/thread_pool.h"
+#include "../g2o/stuff/timeutil.h"
+
+using namespace std;
+using namespace Eigen;
+
+struct Problem
+{
+  vector<g2o::SE3Quat, aligned_allocator<g2o::SE3Quat> > poses;
+  vector<Vector3d> points;
+  vector<int> obsKF, obsPoint;
+  vector<Vector2d, aligned_allocator<Vector2d> > obs;
+};
+
+static const double fx = 718.8, fy = 718.8, cx = 607.2, cy = 185.2;
+
+static double uniform(double lo, double hi) { return lo + (hi - lo) * (rand() / (RAND_MAX + 1.0)); }
+
+static Problem makeProblem(int numPoints, int numKFs)
+{
+  Problem p;
+  for (int k = 0; k < numKFs; ++k) {
+    Quaterniond q(AngleAxisd(0.01 * k, Vector3d::UnitY()));
+    p.poses.push_back(g2o::SE3Quat(q, Vector3d(0.05 * k, 0., -1.0 * k)));
+  }
+  for (int i = 0; i < numPoints; ++i) {
+    Vector3d X(uniform(-15, 15), uniform(-3, 3), uniform(5, 40) + numKFs);
+    p.points.push_back(X);
+    // every point is seen by a run of consecutive keyframes, as in a local window
+    int first = rand() % numKFs;
+    int len = 2 + rand() % 5;
+    for (int k = first; k < min(numKFs, first + len); ++k) {
+      Vector3d Xc = p.poses[k].map(X);
+      if (Xc[2] <= 0.)
+        continue;
+      Vector2d uv(fx * Xc[0] / Xc[2] + cx + uniform(-1, 1), fy * Xc[1] / Xc[2] + cy + uniform(-1, 1));
+      p.obsKF.push_back(k);
+      p.obsPoint.push_back(i);
+      p.obs.push_back(uv);
+    }
+  }
+  return p;
+}
+
+struct Timing
+{
+  double total, build, firstBuild;
+};
+
+static Timing run(const Problem& p, g2o::ThreadPool* pool, int iterations, double& chi2)
+{
+  g2o::SparseOptimizer optimizer;
+  g2o::BlockSolver_6_3::LinearSolverType* linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+  g2o::BlockSolver_6_3* solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+  optimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(solver_ptr));
+  optimizer.setThreadPool(pool);
+  optimizer.setComputeBatchStatistics(true);
+
+  const int numKFs = p.poses.size();
+  for (int k = 0; k < numKFs; ++k) {
+    g2o::VertexSE3Expmap* v = new g2o::VertexSE3Expmap();
+    // perturbed initial guess, the first two keyframes are fixed as in LocalBundleAdjustment
+    Matrix<double, 6, 1> d;
+    d << 0.002, -0.001, 0.001, 0.02, -0.01, 0.03;
+    v->setEstimate(k < 2 ? p.poses[k] : g2o::SE3Quat::exp(d) * p.poses[k]);
+    v->setId(k);
+    v->setFixed(k < 2);
+    optimizer.addVertex(v);
+  }
+  for (size_t i = 0; i < p.points.size(); ++i) {
+    g2o::VertexSBAPointXYZ* v = new g2o::VertexSBAPointXYZ();
+    v->setEstimate(p.points[i] + Vector3d(0.05, -0.05, 0.1));
+    v->setId(numKFs + i);
+    v->setMarginalized(true);
+    optimizer.addVertex(v);
+  }
+  const double thHuber = sqrt(5.991);
+  for (size_t j = 0; j < p.obs.size(); ++j) {
+    g2o::EdgeSE3ProjectXYZ* e = new g2o::EdgeSE3ProjectXYZ();
+    e->setVertex(0, optimizer.vertex(numKFs + p.obsPoint[j]));
+    e->setVertex(1, optimizer.vertex(p.obsKF[j]));
+    e->setMeasurement(p.obs[j]);
+    e->setInformation(Matrix2d::Identity());
+    g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+    rk->setDelta(thHuber);
+    e->setRobustKernel(rk);
+    e->fx = fx; e->fy = fy; e->cx = cx; e->cy = cy;
+    optimizer.addEdge(e);
+  }
+
+  Timing t;
+  t.total = g2o::get_monotonic_time();
+  optimizer.initializeOptimization();
+  optimizer.optimize(iterations);
+  t.total = g2o::get_monotonic_time() - t.total;
+  chi2 = optimizer.activeRobustChi2();
+
+  const g2o::BatchStatisticsContainer& stats = optimizer.batchStatistics();
+  t.build = 0.;
+  for (size_t i = 0; i < stats.size(); ++i)
+    t.build += stats[i].timeQuadraticForm;
+  t.firstBuild = stats.empty() ? 0. : stats[0].timeQuadraticForm;
+  return t;
+}
+
+static void keepBest(Timing& best, const Timing& t)
+{
+  best.total = min(best.total, t.total);
+  best.build = min(best.build, t.build);
+  best.firstBuild = min(best.firstBuild, t.firstBuild);
+}
+
+static void print(const Timing& t)
+{
+  cout << t.total * 1e3 << " ms (buildSystem " << t.build * 1e3 << " ms, first "
+       << t.firstBuild * 1e3 << " ms)";
+}
+
+int main(int argc, char** argv)
+{
+  int maxThreads = argc > 1 ? atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+  int numPoints = argc > 2 ? atoi(argv[2]) : 3000;
+  int numKFs = argc > 3 ? atoi(argv[3]) : 20;
+  const int iterations = 10;
+  const int repetitions = 5;
+
+  srand(42);
+  Problem p = makeProblem(numPoints, numKFs);
+  cout << "keyframes " << numKFs << ", points " << numPoints << ", edges " << p.obs.size() << endl;
+
+  double chi2Serial = 0.;
+  Timing tSerial = { 1e10, 1e10, 1e10 };
+  for (int r = 0; r < repetitions; ++r)
+    keepBest(tSerial, run(p, 0, iterations, chi2Serial));
+  cout << "threads 1: ";
+  print(tSerial);
+  cout << ", chi2 " << chi2Serial << endl;
+
+  for (int n = 2; n <= max(2, maxThreads); ++n) {
+    g2o::ThreadPool pool(n);
+    double chi2 = 0.;
+    Timing t = { 1e10, 1e10, 1e10 };
+    for (int r = 0; r < repetitions; ++r)
+      keepBest(t, run(p, &pool, iterations, chi2));
+    cout << "threads " << n << ": ";
+    print(t);
+    cout << ", chi2 " << chi2 << ", speedup " << tSerial.total / t.total
+         << " (buildSystem " << tSerial.build / t.build << ")" << endl;
+  }
+  return 0;
+}
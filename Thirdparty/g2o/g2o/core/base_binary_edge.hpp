@@ -66,6 +66,10 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::constructQuadraticForm()
   bool toNotFixed = !(to->fixed());
 
   if (fromNotFixed || toNotFixed) {
+    Map<Matrix<double, Di, Di> > fromA(fromNotFixed ? this->quadraticFormHessian(from) : 0);
+    Map<Matrix<double, Di, 1> > fromB(fromNotFixed ? this->quadraticFormB(from) : 0);
+    Map<Matrix<double, Dj, Dj> > toA(toNotFixed ? this->quadraticFormHessian(to) : 0);
+    Map<Matrix<double, Dj, 1> > toB(toNotFixed ? this->quadraticFormB(to) : 0);
 #ifdef G2O_OPENMP
     from->lockQuadraticForm();
     to->lockQuadraticForm();
@@ -75,8 +79,8 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::constructQuadraticForm()
     if (this->robustKernel() == 0) {
       if (fromNotFixed) {
         Matrix<double, VertexXiType::Dimension, D> AtO = A.transpose() * omega;
-        from->b().noalias() += A.transpose() * omega_r;
-        from->A().noalias() += AtO*A;
+        fromB.noalias() += A.transpose() * omega_r;
+        fromA.noalias() += AtO*A;
         if (toNotFixed ) {
           if (_hessianRowMajor) // we have to write to the block as transposed
             _hessianTransposed.noalias() += B.transpose() * AtO.transpose();
@@ -85,8 +89,8 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::constructQuadraticForm()
         }
       } 
       if (toNotFixed) {
-        to->b().noalias() += B.transpose() * omega_r;
-        to->A().noalias() += B.transpose() * omega * B;
+        toB.noalias() += B.transpose() * omega_r;
+        toA.noalias() += B.transpose() * omega * B;
       }
     } else { // robust (weighted) error according to some kernel
       double error = this->chi2();
@@ -98,8 +102,8 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::constructQuadraticForm()
 
       omega_r *= rho[1];
       if (fromNotFixed) {
-        from->b().noalias() += A.transpose() * omega_r;
-        from->A().noalias() += A.transpose() * weightedOmega * A;
+        fromB.noalias() += A.transpose() * omega_r;
+        fromA.noalias() += A.transpose() * weightedOmega * A;
         if (toNotFixed ) {
           if (_hessianRowMajor) // we have to write to the block as transposed
             _hessianTransposed.noalias() += B.transpose() * weightedOmega * A;
@@ -108,8 +112,8 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::constructQuadraticForm()
         }
       } 
       if (toNotFixed) {
-        to->b().noalias() += B.transpose() * omega_r;
-        to->A().noalias() += B.transpose() * weightedOmega * B;
+        toB.noalias() += B.transpose() * omega_r;
+        toA.noalias() += B.transpose() * weightedOmega * B;
       }
     }
 #ifdef G2O_OPENMP
@@ -139,6 +143,8 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::linearizeOplus()
   if (!iNotFixed && !jNotFixed)
     return;
 
+  this->_numericJacobian = true;
+
 #ifdef G2O_OPENMP
   vi->lockQuadraticForm();
   vj->lockQuadraticForm();
@@ -62,6 +62,8 @@ void BaseMultiEdge<D, E>::linearizeOplus(JacobianWorkspace& jacobianWorkspace)
 template <int D, typename E>
 void BaseMultiEdge<D, E>::linearizeOplus()
 {
+  this->_numericJacobian = true;
+
 #ifdef G2O_OPENMP
   for (size_t i = 0; i < _vertices.size(); ++i) {
     OptimizableGraph::Vertex* v = static_cast<OptimizableGraph::Vertex*>(_vertices[i]);
@@ -180,8 +182,8 @@ void BaseMultiEdge<D, E>::computeQuadraticForm(const InformationType& omega, con
       MatrixXd AtO = A.transpose() * omega;
       int fromDim = from->dimension();
       assert(fromDim >= 0);
-      Eigen::Map<MatrixXd> fromMap(from->hessianData(), fromDim, fromDim);
-      Eigen::Map<VectorXd> fromB(from->bData(), fromDim);
+      Eigen::Map<MatrixXd> fromMap(this->quadraticFormHessian(from), fromDim, fromDim);
+      Eigen::Map<VectorXd> fromB(this->quadraticFormB(from), fromDim);
 
       // ii block in the hessian
 #ifdef G2O_OPENMP
@@ -50,6 +50,8 @@ void BaseUnaryEdge<D, E, VertexXiType>::constructQuadraticForm()
 
   bool istatus = !from->fixed();
   if (istatus) {
+    Map<Matrix<double, VertexXiType::Dimension, VertexXiType::Dimension> > fromA(this->quadraticFormHessian(from));
+    Map<Matrix<double, VertexXiType::Dimension, 1> > fromB(this->quadraticFormB(from));
 #ifdef G2O_OPENMP
     from->lockQuadraticForm();
 #endif
@@ -59,11 +61,11 @@ void BaseUnaryEdge<D, E, VertexXiType>::constructQuadraticForm()
       this->robustKernel()->robustify(error, rho);
       InformationType weightedOmega = this->robustInformation(rho);
 
-      from->b().noalias() -= rho[1] * A.transpose() * omega * _error;
-      from->A().noalias() += A.transpose() * weightedOmega * A;
+      fromB.noalias() -= rho[1] * A.transpose() * omega * _error;
+      fromA.noalias() += A.transpose() * weightedOmega * A;
     } else {
-      from->b().noalias() -= A.transpose() * omega * _error;
-      from->A().noalias() += A.transpose() * omega * A;
+      fromB.noalias() -= A.transpose() * omega * _error;
+      fromA.noalias() += A.transpose() * omega * A;
     }
 #ifdef G2O_OPENMP
     from->unlockQuadraticForm();
@@ -87,6 +89,8 @@ void BaseUnaryEdge<D, E, VertexXiType>::linearizeOplus()
   if (vi->fixed())
     return;
 
+  this->_numericJacobian = true;
+
 #ifdef G2O_OPENMP
   vi->lockQuadraticForm();
 #endif
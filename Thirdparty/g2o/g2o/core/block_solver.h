@@ -27,16 +27,22 @@
 #ifndef G2O_BLOCK_SOLVER_H
 #define G2O_BLOCK_SOLVER_H
 #include <Eigen/Core>
+#include <map>
+#include <typeindex>
 #include "solver.h"
 #include "linear_solver.h"
 #include "sparse_block_matrix.h"
 #include "sparse_block_matrix_diagonal.h"
 #include "openmp_mutex.h"
+#include "hessian_accumulator.h"
+#include "jacobian_workspace.h"
 #include "../../config.h"
 
 namespace g2o {
   using namespace Eigen;
 
+  class ThreadPool;
+
   /**
    * \brief traits to summarize the properties of the fixed size optimization problem
    */
@@ -147,6 +153,17 @@ namespace g2o {
 
       void deallocate();
 
+      /**
+       * builds the system with the edges split among the threads of the pool. Each thread
+       * accumulates the diagonal blocks and b into its own HessianAccumulator, which are
+       * summed into the vertices afterwards. Edges which cannot run concurrently, see
+       * _parallelEdge, are added on the calling thread once the threads are done.
+       */
+      void buildSystemParallel(ThreadPool& pool);
+
+      //! linearize edge k into the vertices and record whether it may be processed concurrently
+      void buildEdgeSerial(int k, JacobianWorkspace& jacobianWorkspace);
+
       SparseBlockMatrix<PoseMatrixType>* _Hpp;
       SparseBlockMatrix<LandmarkMatrixType>* _Hll;
       SparseBlockMatrix<PoseLandmarkMatrixType>* _Hpl;
@@ -166,6 +183,16 @@ namespace g2o {
       std::vector<OpenMPMutex> _coefficientsMutex;
 #    endif
 
+      // parallel build: an edge goes to the threads only if its type showed an analytic
+      // Jacobian (the numeric one perturbs the shared vertices) and if no other edge maps
+      // the same off-diagonal Hessian block
+      std::vector<char> _parallelEdge;
+      std::vector<char> _sharedBlockEdge;
+      std::map<std::type_index, bool> _analyticEdgeTypes;
+      std::vector<JacobianWorkspace> _threadWorkspaces;
+      std::vector<HessianAccumulator> _threadAccumulators;
+      bool _threadWorkspacesValid;
+
       bool _doSchur;
 
       double* _coefficients;
@@ -32,6 +32,10 @@
 #include "../stuff/timeutil.h"
 #include "../stuff/macros.h"
 #include "../stuff/misc.h"
+#include "../stuff/thread_pool.h"
+
+#include <algorithm>
+#include <typeinfo>
 
 namespace g2o {
 
@@ -58,6 +62,7 @@ BlockSolver<Traits>::BlockSolver(LinearSolverType* linearSolver) :
   _numLandmarks=0;
   _sizePoses=0;
   _sizeLandmarks=0;
+  _threadWorkspacesValid=false;
   _doSchur=true;
 }
 
@@ -201,10 +206,15 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
     schurMatrixLookup->blockCols().resize(_Hschur->blockCols().size());
   }
 
+  // off-diagonal blocks mapped by the edges, to find edges sharing a block
+  const int numActiveEdges = static_cast<int>(_optimizer->activeEdges().size());
+  std::vector<std::pair<double*, int> > mappedBlocks;
+  mappedBlocks.reserve(numActiveEdges);
+
   // here we assume that the landmark indices start after the pose ones
   // create the structure in Hpp, Hll and in Hpl
-  for (SparseOptimizer::EdgeContainer::const_iterator it=_optimizer->activeEdges().begin(); it!=_optimizer->activeEdges().end(); ++it){
-    OptimizableGraph::Edge* e = *it;
+  for (int k = 0; k < numActiveEdges; ++k){
+    OptimizableGraph::Edge* e = _optimizer->activeEdges()[k];
 
     for (size_t viIdx = 0; viIdx < e->vertices().size(); ++viIdx) {
       OptimizableGraph::Vertex* v1 = (OptimizableGraph::Vertex*) e->vertex(viIdx);
@@ -227,6 +237,7 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
           if (zeroBlocks)
             m->setZero();
           e->mapHessianMemory(m->data(), viIdx, vjIdx, transposedBlock);
+          mappedBlocks.push_back(std::make_pair(m->data(), k));
           if (_Hschur) {// assume this is only needed in case we solve with the schur complement
             schurMatrixLookup->addBlock(ind1, ind2);
           }
@@ -236,23 +247,57 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
           if (zeroBlocks)
             m->setZero();
           e->mapHessianMemory(m->data(), viIdx, vjIdx, false);
+          mappedBlocks.push_back(std::make_pair(m->data(), k));
         } else { 
           if (v1->marginalized()){ 
             PoseLandmarkMatrixType* m = _Hpl->block(v2->hessianIndex(),v1->hessianIndex()-_numPoses, true);
             if (zeroBlocks)
               m->setZero();
             e->mapHessianMemory(m->data(), viIdx, vjIdx, true); // transpose the block before writing to it
+            mappedBlocks.push_back(std::make_pair(m->data(), k));
           } else {
             PoseLandmarkMatrixType* m = _Hpl->block(v1->hessianIndex(),v2->hessianIndex()-_numPoses, true);
             if (zeroBlocks)
               m->setZero();
             e->mapHessianMemory(m->data(), viIdx, vjIdx, false); // directly the block
+            mappedBlocks.push_back(std::make_pair(m->data(), k));
           }
         }
       }
     }
   }
 
+  _sharedBlockEdge.assign(numActiveEdges, 0);
+  std::sort(mappedBlocks.begin(), mappedBlocks.end());
+  for (size_t i = 1; i < mappedBlocks.size(); ++i) {
+    if (mappedBlocks[i].first == mappedBlocks[i-1].first) {
+      _sharedBlockEdge[mappedBlocks[i].second] = 1;
+      _sharedBlockEdge[mappedBlocks[i-1].second] = 1;
+    }
+  }
+  // whether an edge linearizes numerically is only known after its linearizeOplus ran,
+  // probe one edge per type here so that already the first buildSystem runs in parallel
+  _parallelEdge.assign(numActiveEdges, 0);
+  JacobianWorkspace& jacobianWorkspace = _optimizer->jacobianWorkspace();
+  for (size_t k = 0; k < numActiveEdges; ++k) {
+    OptimizableGraph::Edge* e = _optimizer->activeEdges()[k];
+    if (_sharedBlockEdge[k])
+      continue;
+    // the numeric linearization returns before flagging itself if all vertices are fixed
+    bool allFixed = true;
+    for (size_t i = 0; i < e->vertices().size(); ++i)
+      allFixed = allFixed && static_cast<OptimizableGraph::Vertex*>(e->vertex(i))->fixed();
+    if (allFixed)
+      continue;
+    std::map<std::type_index, bool>::const_iterator it = _analyticEdgeTypes.find(typeid(*e));
+    if (it == _analyticEdgeTypes.end()) {
+      e->linearizeOplus(jacobianWorkspace);
+      it = _analyticEdgeTypes.insert(std::make_pair(std::type_index(typeid(*e)), ! e->numericJacobian())).first;
+    }
+    _parallelEdge[k] = it->second;
+  }
+  _threadWorkspacesValid = false;
+
   if (! _doSchur)
     return true;
 
@@ -519,13 +564,20 @@ bool BlockSolver<Traits>::buildSystem()
   // resetting the terms for the pairwise constraints
   // built up the current system by storing the Hessian blocks in the edges and vertices
 # ifndef G2O_OPENMP
-  // no threading, we do not need to copy the workspace
-  JacobianWorkspace& jacobianWorkspace = _optimizer->jacobianWorkspace();
+  ThreadPool* pool = _optimizer->threadPool();
+  if (pool && pool->numThreads() > 1 && _optimizer->activeEdges().size() > 1000 &&
+      _parallelEdge.size() == _optimizer->activeEdges().size()) {
+    buildSystemParallel(*pool);
+  } else {
+    // no threading, we do not need to copy the workspace
+    JacobianWorkspace& jacobianWorkspace = _optimizer->jacobianWorkspace();
+    for (int k = 0; k < static_cast<int>(_optimizer->activeEdges().size()); ++k)
+      buildEdgeSerial(k, jacobianWorkspace);
+  }
 # else
   // if running with threads need to produce copies of the workspace for each thread
   JacobianWorkspace jacobianWorkspace = _optimizer->jacobianWorkspace();
 # pragma omp parallel for default (shared) firstprivate(jacobianWorkspace) if (_optimizer->activeEdges().size() > 100)
-# endif
   for (int k = 0; k < static_cast<int>(_optimizer->activeEdges().size()); ++k) {
     OptimizableGraph::Edge* e = _optimizer->activeEdges()[k];
     e->linearizeOplus(jacobianWorkspace); // jacobian of the nodes' oplus (manifold)
@@ -543,6 +595,7 @@ bool BlockSolver<Traits>::buildSystem()
     }
 #  endif
   }
+# endif
 
   // flush the current system in a sparse block matrix
 # ifdef G2O_OPENMP
@@ -560,6 +613,87 @@ bool BlockSolver<Traits>::buildSystem()
 }
 
 
+template <typename Traits>
+void BlockSolver<Traits>::buildEdgeSerial(int k, JacobianWorkspace& jacobianWorkspace)
+{
+  OptimizableGraph::Edge* e = _optimizer->activeEdges()[k];
+  e->linearizeOplus(jacobianWorkspace); // jacobian of the nodes' oplus (manifold)
+  e->constructQuadraticForm();
+#  ifndef NDEBUG
+  for (size_t i = 0; i < e->vertices().size(); ++i) {
+    const OptimizableGraph::Vertex* v = static_cast<const OptimizableGraph::Vertex*>(e->vertex(i));
+    if (! v->fixed()) {
+      bool hasANan = arrayHasNaN(jacobianWorkspace.workspaceForVertex(i), e->dimension() * v->dimension());
+      if (hasANan) {
+        cerr << "buildSystem(): NaN within Jacobian for edge " << e << " for vertex " << i << endl;
+        break;
+      }
+    }
+  }
+#  endif
+  if (k < static_cast<int>(_parallelEdge.size()))
+    _parallelEdge[k] = !_sharedBlockEdge[k] && !e->numericJacobian();
+}
+
+template <typename Traits>
+void BlockSolver<Traits>::buildSystemParallel(ThreadPool& pool)
+{
+  const SparseOptimizer::EdgeContainer& edges = _optimizer->activeEdges();
+  const SparseOptimizer::VertexContainer& vertices = _optimizer->indexMapping();
+  const int numThreads = pool.numThreads();
+
+  if (static_cast<int>(_threadAccumulators.size()) != numThreads) {
+    _threadAccumulators.resize(numThreads);
+    _threadWorkspacesValid = false;
+  }
+  if (! _threadWorkspacesValid) {
+    std::vector<int> dims(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+      dims[i] = vertices[i]->dimension();
+    _threadWorkspaces.assign(numThreads, _optimizer->jacobianWorkspace());
+    for (int t = 0; t < numThreads; ++t)
+      _threadAccumulators[t].resize(dims);
+    _threadWorkspacesValid = true;
+  }
+
+  // linearize the independent edges, diagonal blocks and b go to the private accumulators
+  const int numChunks = pool.parallelFor(static_cast<int>(edges.size()), [&](int begin, int end, int thread) {
+    HessianAccumulator& accumulator = _threadAccumulators[thread];
+    JacobianWorkspace& jacobianWorkspace = _threadWorkspaces[thread];
+    accumulator.clear();
+    for (int k = begin; k < end; ++k) {
+      if (! _parallelEdge[k])
+        continue;
+      OptimizableGraph::Edge* e = edges[k];
+      e->setHessianAccumulator(&accumulator);
+      e->linearizeOplus(jacobianWorkspace);
+      e->constructQuadraticForm();
+      e->setHessianAccumulator(0);
+    }
+  });
+
+  // reduce, every vertex is owned by exactly one thread
+  pool.parallelFor(static_cast<int>(vertices.size()), [&](int begin, int end, int) {
+    for (int i = begin; i < end; ++i) {
+      OptimizableGraph::Vertex* v = vertices[i];
+      const int dim = v->dimension();
+      Map<MatrixXd> A(v->hessianData(), dim, dim);
+      Map<VectorXd> b(v->bData(), dim);
+      for (int t = 0; t < numChunks; ++t) {
+        A += Map<const MatrixXd>(_threadAccumulators[t].hessian(i), dim, dim);
+        b += Map<const VectorXd>(_threadAccumulators[t].b(i), dim);
+      }
+    }
+  });
+
+  // remaining edges write to shared memory, add them now that the threads are done
+  JacobianWorkspace& jacobianWorkspace = _optimizer->jacobianWorkspace();
+  for (int k = 0; k < static_cast<int>(edges.size()); ++k) {
+    if (! _parallelEdge[k])
+      buildEdgeSerial(k, jacobianWorkspace);
+  }
+}
+
 template <typename Traits>
 bool BlockSolver<Traits>::setLambda(double lambda, bool backup)
 {
@@ -0,0 +1,79 @@
+// g2o - General Graph Optimization
+// Copyright (C) 2011 R. Kuemmerle, G. Grisetti, W. Burgard
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef G2O_HESSIAN_ACCUMULATOR_H
+#define G2O_HESSIAN_ACCUMULATOR_H
+
+#include <vector>
+#include <algorithm>
+
+namespace g2o {
+
+  /**
+   * \brief private copy of the diagonal Hessian blocks and of b for one build thread
+   *
+   * During a parallel BlockSolver::buildSystem every thread owns one accumulator. The
+   * edges processed by that thread add their ii blocks and b contributions here instead
+   * of into the (shared) vertices, and the accumulators are summed into the vertices
+   * once all threads are done. The layout follows the hessian index of the vertices:
+   * for vertex i the block of size dim*dim is followed by its b of size dim.
+   */
+  class HessianAccumulator
+  {
+    public:
+      HessianAccumulator() {}
+
+      //! dims[i] is the dimension of the vertex with hessian index i
+      void resize(const std::vector<int>& dims)
+      {
+        _offsets.resize(dims.size() + 1);
+        _dims = dims;
+        _offsets[0] = 0;
+        for (size_t i = 0; i < dims.size(); ++i)
+          _offsets[i+1] = _offsets[i] + dims[i] * (dims[i] + 1);
+        _data.resize(_offsets.back());
+      }
+
+      void clear() { std::fill(_data.begin(), _data.end(), 0.);}
+
+      size_t size() const { return _dims.size();}
+      int dimension(int hessianIndex) const { return _dims[hessianIndex];}
+
+      double* hessian(int hessianIndex) { return &_data[_offsets[hessianIndex]];}
+      const double* hessian(int hessianIndex) const { return &_data[_offsets[hessianIndex]];}
+      double* b(int hessianIndex) { return hessian(hessianIndex) + _dims[hessianIndex] * _dims[hessianIndex];}
+      const double* b(int hessianIndex) const { return hessian(hessianIndex) + _dims[hessianIndex] * _dims[hessianIndex];}
+
+    protected:
+      std::vector<int> _dims;
+      std::vector<int> _offsets;
+      std::vector<double> _data;
+  };
+
+} // end namespace g2o
+
+#endif
@@ -131,7 +131,8 @@ namespace g2o {
 
   OptimizableGraph::Edge::Edge() :
     HyperGraph::Edge(),
-    _dimension(-1), _level(0), _robustKernel(0)
+    _dimension(-1), _level(0), _robustKernel(0),
+    _hessianAccumulator(0), _numericJacobian(false)
   {
   }
 
@@ -39,6 +39,7 @@
 #include "parameter.h"
 #include "parameter_container.h"
 #include "jacobian_workspace.h"
+#include "hessian_accumulator.h"
 
 #include "../stuff/macros.h"
 
@@ -471,6 +472,16 @@ namespace g2o {
         //! returns the dimensions of the error function
         int dimension() const { return _dimension;}
 
+        /**
+         * redirects the ii blocks and b written by constructQuadraticForm() into a thread private
+         * accumulator (parallel build), or directly into the vertices if acc is 0
+         */
+        void setHessianAccumulator(HessianAccumulator* acc) { _hessianAccumulator = acc;}
+        HessianAccumulator* hessianAccumulator() const { return _hessianAccumulator;}
+
+        //! true once the edge was linearized by numeric differentiation, which perturbs the vertices
+        bool numericJacobian() const { return _numericJacobian;}
+
         virtual Vertex* createFrom() {return 0;}
         virtual Vertex* createTo()   {return 0;}
 
@@ -498,6 +509,17 @@ namespace g2o {
         int _level;
         RobustKernel* _robustKernel;
         long long _internalId;
+        HessianAccumulator* _hessianAccumulator;
+        bool _numericJacobian;
+
+        //! target of the ii block of vertex v in constructQuadraticForm()
+        double* quadraticFormHessian(Vertex* v) const {
+          return _hessianAccumulator ? _hessianAccumulator->hessian(v->hessianIndex()) : v->hessianData();
+        }
+        //! target of the b part of vertex v in constructQuadraticForm()
+        double* quadraticFormB(Vertex* v) const {
+          return _hessianAccumulator ? _hessianAccumulator->b(v->hessianIndex()) : v->bData();
+        }
 
         std::vector<int> _cacheIds;
 
@@ -41,6 +41,7 @@
 #include "../stuff/timeutil.h"
 #include "../stuff/macros.h"
 #include "../stuff/misc.h"
+#include "../stuff/thread_pool.h"
 #include "../../config.h"
 
 namespace g2o{
@@ -48,7 +49,7 @@ namespace g2o{
 
 
   SparseOptimizer::SparseOptimizer() :
-    _forceStopFlag(0), _verbose(false), _algorithm(0), _computeBatchStatistics(false)
+    _forceStopFlag(0), _verbose(false), _threadPool(0), _algorithm(0), _computeBatchStatistics(false)
   {
     _graphActions.resize(AT_NUM_ELEMENTS);
   }
@@ -69,11 +70,24 @@ namespace g2o{
 
 #   ifdef G2O_OPENMP
 #   pragma omp parallel for default (shared) if (_activeEdges.size() > 50)
-#   endif
     for (int k = 0; k < static_cast<int>(_activeEdges.size()); ++k) {
       OptimizableGraph::Edge* e = _activeEdges[k];
       e->computeError();
     }
+#   else
+    // errors are private to the edges, so the edges can be split freely among the threads
+    if (_threadPool && _activeEdges.size() > 1000) {
+      _threadPool->parallelFor(static_cast<int>(_activeEdges.size()), [this](int begin, int end, int) {
+        for (int k = begin; k < end; ++k)
+          _activeEdges[k]->computeError();
+      });
+    } else {
+      for (int k = 0; k < static_cast<int>(_activeEdges.size()); ++k) {
+        OptimizableGraph::Edge* e = _activeEdges[k];
+        e->computeError();
+      }
+    }
+#   endif
 
 #  ifndef NDEBUG
     for (int k = 0; k < static_cast<int>(_activeEdges.size()); ++k) {
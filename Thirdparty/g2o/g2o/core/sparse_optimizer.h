@@ -41,6 +41,7 @@ namespace g2o {
   class ActivePathCostFunction;
   class OptimizationAlgorithm;
   class EstimatePropagatorCost;
+  class ThreadPool;
 
   class  SparseOptimizer : public OptimizableGraph {
 
@@ -187,6 +188,13 @@ namespace g2o {
     //! if external stop flag is given, return its state. False otherwise
     bool terminate() {return _forceStopFlag ? (*_forceStopFlag) : false; }
 
+    /**
+     * threads used to evaluate the errors and to build the linear system, 0 runs single-threaded.
+     * The pool is not owned by the optimizer and may be shared between optimizers.
+     */
+    void setThreadPool(ThreadPool* pool) { _threadPool = pool;}
+    ThreadPool* threadPool() const { return _threadPool;}
+
     //! the index mapping of the vertices
     const VertexContainer& indexMapping() const {return _ivMap;}
     //! the vertices active in the current optimization
@@ -289,6 +297,7 @@ namespace g2o {
     protected:
     bool* _forceStopFlag;
     bool _verbose;
+    ThreadPool* _threadPool;
 
     VertexContainer _ivMap;
     VertexContainer _activeVertices;   ///< sorted according to VertexIDCompare
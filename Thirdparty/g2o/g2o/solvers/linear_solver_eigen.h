@@ -38,6 +38,7 @@
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
 
 namespace g2o {
 
@@ -77,7 +78,8 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
   public:
     LinearSolverEigen() :
       LinearSolver<MatrixType>(),
-      _init(true), _blockOrdering(false), _writeDebug(false)
+      _init(true), _blockOrdering(false), _writeDebug(false),
+      _numSymbolicDecompositions(0), _numSymbolicReuses(0)
     {
     }
 
@@ -96,8 +98,14 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
       if (_init)
         _sparseMatrix.resize(A.rows(), A.cols());
       fillSparseMatrix(A, !_init);
-      if (_init) // compute the symbolic composition once
-        computeSymbolicDecomposition(A);
+      if (_init) { // compute the symbolic composition once per sparsity pattern
+        if (samePatternAsAnalyzed()) {
+          ++_numSymbolicReuses;
+        } else {
+          computeSymbolicDecomposition(A);
+          ++_numSymbolicDecompositions;
+        }
+      }
       _init = false;
 
       double t=get_monotonic_time();
@@ -131,12 +139,36 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
     virtual bool writeDebug() const { return _writeDebug;}
     virtual void setWriteDebug(bool b) { _writeDebug = b;}
 
+    //! number of structures for which the symbolic decomposition was computed / reused
+    int numSymbolicDecompositions() const { return _numSymbolicDecompositions;}
+    int numSymbolicReuses() const { return _numSymbolicReuses;}
+
   protected:
     bool _init;
     bool _blockOrdering;
     bool _writeDebug;
     SparseMatrix _sparseMatrix;
     CholeskyDecomposition _cholesky;
+    std::vector<int> _analyzedOuter;   ///< column pointers of the last analyzed pattern
+    std::vector<int> _analyzedInner;   ///< row indices of the last analyzed pattern
+    int _numSymbolicDecompositions;
+    int _numSymbolicReuses;
+
+    /**
+     * init() is called at every optimize(), also when the graph did not change
+     * (e.g. the same window is optimized again after removing outliers, or the
+     * solver is kept between problems). The fill-in reducing ordering and the
+     * elimination tree only depend on the sparsity pattern, so they are kept if
+     * the new matrix has exactly the pattern that was analyzed last.
+     */
+    bool samePatternAsAnalyzed() const
+    {
+      const int n = _sparseMatrix.cols();
+      if (static_cast<int>(_analyzedOuter.size()) != n + 1 || _sparseMatrix.nonZeros() != static_cast<int>(_analyzedInner.size()))
+        return false;
+      return std::equal(_analyzedOuter.begin(), _analyzedOuter.end(), _sparseMatrix.outerIndexPtr()) &&
+        std::equal(_analyzedInner.begin(), _analyzedInner.end(), _sparseMatrix.innerIndexPtr());
+    }
 
     /**
      * compute the symbolic decompostion of the matrix only once.
@@ -195,6 +227,9 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
         _cholesky.analyzePatternWithPermutation(_sparseMatrix, scalarP);
 
       }
+      const int n = _sparseMatrix.cols();
+      _analyzedOuter.assign(_sparseMatrix.outerIndexPtr(), _sparseMatrix.outerIndexPtr() + n + 1);
+      _analyzedInner.assign(_sparseMatrix.innerIndexPtr(), _sparseMatrix.innerIndexPtr() + _sparseMatrix.nonZeros());
       G2OBatchStatistics* globalStats = G2OBatchStatistics::globalStats();
       if (globalStats)
         globalStats->timeSymbolicDecomposition = get_monotonic_time() - t;
@@ -0,0 +1,108 @@
+// g2o - General Graph Optimization
+// Copyright (C) 2011 R. Kuemmerle, G. Grisetti, W. Burgard
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "thread_pool.h"
+
+namespace g2o {
+
+  ThreadPool::ThreadPool(int numThreads, bool spawnWorkers) :
+    _numThreads(numThreads < 1 ? 1 : numThreads),
+    _func(0), _n(0), _pending(0), _generation(0), _stop(false)
+  {
+    for (int t = 1; spawnWorkers && t < _numThreads; ++t)
+      _workers.push_back(std::thread(&ThreadPool::workerLoop, this, t));
+  }
+
+  ThreadPool::~ThreadPool()
+  {
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _wakeUp.notify_all();
+    for (size_t i = 0; i < _workers.size(); ++i)
+      _workers[i].join();
+  }
+
+  int ThreadPool::parallelFor(int n, const RangeFunction& func)
+  {
+    if (n <= 0)
+      return 0;
+
+    std::unique_lock<std::mutex> callLock(_callMutex, std::try_to_lock);
+    if (_numThreads == 1 || n < _numThreads || !callLock.owns_lock()) {
+      func(0, n, 0);
+      return 1;
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _func = &func;
+      _n = n;
+      _pending = _numThreads - 1;
+      ++_generation;
+    }
+    _wakeUp.notify_all();
+
+    runChunk(0);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_pending > 0)
+      _finished.wait(lock);
+    _func = 0;
+    return _numThreads;
+  }
+
+  void ThreadPool::runChunk(int thread)
+  {
+    int begin = static_cast<int>((static_cast<long long>(_n) * thread) / _numThreads);
+    int end = static_cast<int>((static_cast<long long>(_n) * (thread + 1)) / _numThreads);
+    if (begin < end)
+      (*_func)(begin, end, thread);
+  }
+
+  void ThreadPool::workerLoop(int thread)
+  {
+    unsigned long seen = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_stop && _generation == seen)
+          _wakeUp.wait(lock);
+        if (_stop)
+          return;
+        seen = _generation;
+      }
+
+      runChunk(thread);
+
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (--_pending == 0)
+        _finished.notify_one();
+    }
+  }
+
+} // end namespace g2o
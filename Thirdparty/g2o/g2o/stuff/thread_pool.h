@@ -0,0 +1,91 @@
+// g2o - General Graph Optimization
+// Copyright (C) 2011 R. Kuemmerle, G. Grisetti, W. Burgard
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef G2O_THREAD_POOL_H
+#define G2O_THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace g2o {
+
+  /**
+   * \brief fixed set of worker threads running data-parallel loops
+   *
+   * parallelFor() splits a range into one contiguous chunk per thread; the calling
+   * thread processes chunk 0. The pool serves one loop at a time: a caller that finds
+   * it busy (e.g. LocalMapping BA while a GBA is building) runs its loop inline
+   * instead of waiting, so sharing a pool between optimizers never blocks.
+   * An application with its own scheduler derives from it, constructs it without
+   * workers and overrides parallelFor().
+   */
+  class ThreadPool
+  {
+    public:
+      //! signature of a chunk: [begin, end) and the index of the executing thread
+      typedef std::function<void(int, int, int)> RangeFunction;
+
+      //! numThreads counts the calling thread, so numThreads-1 workers are spawned (none if !spawnWorkers)
+      explicit ThreadPool(int numThreads, bool spawnWorkers = true);
+      virtual ~ThreadPool();
+
+      int numThreads() const { return _numThreads;}
+
+      /**
+       * run func over [0,n) split into numThreads() chunks and return when all are done.
+       * @returns the number of chunks used, 1 if the loop ran inline on the caller
+       */
+      virtual int parallelFor(int n, const RangeFunction& func);
+
+    protected:
+      void workerLoop(int thread);
+      void runChunk(int thread);
+
+      int _numThreads;
+      std::vector<std::thread> _workers;
+
+      std::mutex _callMutex;       ///< held by the caller for the duration of one parallelFor
+      std::mutex _mutex;
+      std::condition_variable _wakeUp;
+      std::condition_variable _finished;
+
+      const RangeFunction* _func;
+      int _n;
+      int _pending;
+      unsigned long _generation;
+      bool _stop;
+
+    private:
+      ThreadPool(const ThreadPool&);
+      void operator=(const ThreadPool&);
+  };
+
+} // end namespace g2o
+
+#endif
@@ -365,6 +365,143 @@ void EdgeStereoSE3ProjectXYZOnlyPose::linearizeOplus() {
 
 // ************************************************************************************************
 
+EdgeSE3ProjectXYZOnlyPoseBatch::EdgeSE3ProjectXYZOnlyPoseBatch() : BaseUnaryEdge<1, double, VertexSE3Expmap>(),
+  _n(0), _delta(0.0), _cost(0.0)
+{
+  _information.setIdentity();
+  _error.setZero();
+}
+
+bool EdgeSE3ProjectXYZOnlyPoseBatch::read(std::istream& is){
+  int n;
+  is >> n >> _delta;
+  reserve(n);
+  for (int i=0; i<n; i++){
+    Vector2d obs;
+    Vector3d Xw;
+    double info, inlier;
+    is >> obs[0] >> obs[1] >> Xw[0] >> Xw[1] >> Xw[2] >> info >> inlier;
+    addObservation(obs, Xw, info);
+    setInlier(i, inlier>0.0);
+  }
+  return is.good() || is.eof();
+}
+
+bool EdgeSE3ProjectXYZOnlyPoseBatch::write(std::ostream& os) const {
+
+  os << _n << " " << _delta;
+  for (int i=0; i<_n; i++){
+    os << " " << _u[i] << " " << _v[i] << " " << _X[i] << " " << _Y[i] << " " << _Z[i]
+       << " " << _info[i] << " " << _inlier[i];
+  }
+  return os.good();
+}
+
+void EdgeSE3ProjectXYZOnlyPoseBatch::reserve(int n) {
+  _u.reserve(n); _v.reserve(n);
+  _X.reserve(n); _Y.reserve(n); _Z.reserve(n);
+  _info.reserve(n); _inlier.reserve(n);
+}
+
+int EdgeSE3ProjectXYZOnlyPoseBatch::addObservation(const Vector2d& obs, const Vector3d& Xw, double invSigma2) {
+  _u.push_back(obs[0]); _v.push_back(obs[1]);
+  _X.push_back(Xw[0]); _Y.push_back(Xw[1]); _Z.push_back(Xw[2]);
+  _info.push_back(invSigma2);
+  _inlier.push_back(1.0);
+
+  _xc.resize(_n+1); _yc.resize(_n+1); _invz.resize(_n+1);
+  _ex.resize(_n+1); _ey.resize(_n+1);
+  _chi2.resize(_n+1); _w.resize(_n+1);
+
+  return _n++;
+}
+
+void EdgeSE3ProjectXYZOnlyPoseBatch::computeError() {
+  const VertexSE3Expmap* v1 = static_cast<const VertexSE3Expmap*>(_vertices[0]);
+  const Matrix3d R = v1->estimate().rotation().toRotationMatrix();
+  const Vector3d t = v1->estimate().translation();
+
+  Map<const ArrayXd> X(_X.data(),_n), Y(_Y.data(),_n), Z(_Z.data(),_n);
+  Map<const ArrayXd> u(_u.data(),_n), v(_v.data(),_n);
+  Map<const ArrayXd> info(_info.data(),_n), inlier(_inlier.data(),_n);
+  Map<ArrayXd> xc(_xc.data(),_n), yc(_yc.data(),_n), invz(_invz.data(),_n);
+  Map<ArrayXd> ex(_ex.data(),_n), ey(_ey.data(),_n);
+  Map<ArrayXd> chi2(_chi2.data(),_n), w(_w.data(),_n);
+
+  xc = R(0,0)*X + R(0,1)*Y + R(0,2)*Z + t[0];
+  yc = R(1,0)*X + R(1,1)*Y + R(1,2)*Z + t[1];
+  invz = (R(2,0)*X + R(2,1)*Y + R(2,2)*Z + t[2]).inverse();
+
+  ex = u - (fx*xc*invz + cx);
+  ey = v - (fy*yc*invz + cy);
+  chi2 = info*(ex.square() + ey.square());
+
+  // Huber: rho(e) = e inside the threshold, 2*delta*sqrt(e)-delta^2 outside; w = rho'(e)
+  if (_delta>0.0) {
+    const double dsqr = _delta*_delta;
+    w = (chi2<=dsqr).select(1.0, _delta*chi2.sqrt().inverse());
+    _cost = (inlier*(chi2<=dsqr).select(chi2, 2.0*_delta*chi2.sqrt()-dsqr)).sum();
+  } else {
+    w.setOnes();
+    _cost = (inlier*chi2).sum();
+  }
+
+  _error[0] = std::sqrt(_cost);
+}
+
+void EdgeSE3ProjectXYZOnlyPoseBatch::linearizeOplus() {
+  // relies on the camera coordinates cached by computeError(), which the optimizer
+  // always evaluates right before building the system
+  Map<const ArrayXd> x(_xc.data(),_n), y(_yc.data(),_n), invz(_invz.data(),_n);
+
+  _Ju.resize(_n,6);
+  _Jv.resize(_n,6);
+
+  _Ju.col(0) = (x*y*invz.square()*fx).matrix();
+  _Ju.col(1) = (-(1.0+x.square()*invz.square())*fx).matrix();
+  _Ju.col(2) = (y*invz*fx).matrix();
+  _Ju.col(3) = (-invz*fx).matrix();
+  _Ju.col(4).setZero();
+  _Ju.col(5) = (x*invz.square()*fx).matrix();
+
+  _Jv.col(0) = ((1.0+y.square()*invz.square())*fy).matrix();
+  _Jv.col(1) = (-x*y*invz.square()*fy).matrix();
+  _Jv.col(2) = (-x*invz*fy).matrix();
+  _Jv.col(3).setZero();
+  _Jv.col(4) = (-invz*fy).matrix();
+  _Jv.col(5) = (y*invz.square()*fy).matrix();
+}
+
+void EdgeSE3ProjectXYZOnlyPoseBatch::constructQuadraticForm() {
+  VertexSE3Expmap* from = static_cast<VertexSE3Expmap*>(_vertices[0]);
+  if (from->fixed())
+    return;
+
+  // scale the Jacobian rows by sqrt(inlier*info*w) so that H = Ju'Ju + Jv'Jv
+  Map<const ArrayXd> info(_info.data(),_n), inlier(_inlier.data(),_n), w(_w.data(),_n);
+  Map<const ArrayXd> ex(_ex.data(),_n), ey(_ey.data(),_n);
+  const ArrayXd sqrtWeight = (inlier*info*w).sqrt();
+
+  _Ju.array().colwise() *= sqrtWeight;
+  _Jv.array().colwise() *= sqrtWeight;
+
+  Map<Matrix6d> fromA(quadraticFormHessian(from));
+  Map<Vector6d> fromB(quadraticFormB(from));
+
+#ifdef G2O_OPENMP
+  from->lockQuadraticForm();
+#endif
+  fromA.noalias() += _Ju.transpose()*_Ju;
+  fromA.noalias() += _Jv.transpose()*_Jv;
+  fromB.noalias() -= _Ju.transpose()*(sqrtWeight*ex).matrix();
+  fromB.noalias() -= _Jv.transpose()*(sqrtWeight*ey).matrix();
+#ifdef G2O_OPENMP
+  from->unlockQuadraticForm();
+#endif
+}
+
+// ************************************************************************************************
+
 bool EdgeSE3ProjectXYZOnlyObjMotion::read(std::istream& is){
   for (int i=0; i<2; i++){
     is >> _measurement[i];
@@ -204,6 +204,69 @@ public:
 
 // **************************************************************************************************
 
+/**
+ * \brief Batched EdgeSE3ProjectXYZOnlyPose: N monocular observations of fixed 3D points
+ * constraining one pose. Observations are stored as structure-of-arrays so the residuals,
+ * Jacobians and the 6x6 Hessian block of the pose are evaluated in vectorised passes
+ * instead of one virtual call per observation. Each observation keeps its own information
+ * weight, Huber weight and inlier flag, so the usual inlier/outlier rounds are done by
+ * masking observations rather than changing edge levels.
+ */
+class  EdgeSE3ProjectXYZOnlyPoseBatch: public  BaseUnaryEdge<1, double, VertexSE3Expmap>{
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  EdgeSE3ProjectXYZOnlyPoseBatch();
+
+  bool read(std::istream& is);
+
+  bool write(std::ostream& os) const;
+
+  void reserve(int n);
+
+  //! appends an observation and returns its index, all observations start as inliers
+  int addObservation(const Vector2d& obs, const Vector3d& Xw, double invSigma2=1.0);
+
+  int size() const { return _n; }
+
+  void setInlier(int i, bool inlier) { _inlier[i] = inlier ? 1.0 : 0.0; }
+  bool isInlier(int i) const { return _inlier[i]>0.0; }
+
+  //! Huber threshold applied per observation, a value <= 0 disables the robust kernel
+  void setRobustDelta(double delta) { _delta = delta; }
+  double robustDelta() const { return _delta; }
+
+  //! chi2 of a single observation (without robust kernel), valid after computeError()
+  double chi2(int i) const { return _chi2[i]; }
+
+  bool isDepthPositive(int i) const { return _invz[i]>0.0; }
+
+  //! sum of the robustified chi2 over the inlier observations
+  virtual double chi2() const { return _cost; }
+
+  void computeError();
+
+  virtual void linearizeOplus();
+
+  virtual void constructQuadraticForm();
+
+  double fx, fy, cx, cy;
+
+protected:
+  int _n;
+  double _delta;
+  double _cost;
+
+  // observations (SoA)
+  std::vector<double> _u, _v, _X, _Y, _Z, _info, _inlier;
+
+  // per-observation workspace, refreshed by computeError()/linearizeOplus()
+  std::vector<double> _xc, _yc, _invz, _ex, _ey, _chi2, _w;
+  Matrix<double, Dynamic, 6> _Ju, _Jv;
+};
+
+// **************************************************************************************************
+
 class  EdgeSE3ProjectXYZOnlyObjMotion: public  BaseUnaryEdge<2, Vector2d, VertexSE3Expmap>{
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -36,6 +36,7 @@ public:
     static std::vector<cv::Mat> toDescriptorVector(const cv::Mat &Descriptors);
 
     static g2o::SE3Quat toSE3Quat(const cv::Mat &cvT);
+    static g2o::SE3Quat toSE3Quat(const cv::Matx44f &T);
     static g2o::SE3Quat toSE3Quat(const g2o::Sim3 &gSim3);
 
     static cv::Mat toCvMat(const g2o::SE3Quat &SE3);
@@ -47,6 +48,7 @@ public:
 
     static Eigen::Matrix<double,3,1> toVector3d(const cv::Mat &cvVector);
     static Eigen::Matrix<double,3,1> toVector3d(const cv::Point3f &cvPoint);
+    static Eigen::Matrix<double,3,1> toVector3d(const cv::Matx31f &v);
     static Eigen::Matrix<double,3,3> toMatrix3d(const cv::Mat &cvMat3);
     static Eigen::Matrix<double,4,4> toMatrix4d(const cv::Mat &cvMat4);
 
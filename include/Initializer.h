@@ -21,12 +21,16 @@
 #define INITIALIZER_H
 
 #include<opencv2/opencv.hpp>
+#include<functional>
+#include<Eigen/Core>
 #include "Frame.h"
 
 
 namespace ORB_SLAM2
 {
 
+class Scheduler;
+
 // THIS IS THE INITIALIZER FOR MONOCULAR SLAM. NOT USED IN THE STEREO OR RGBD CASE.
 class Initializer
 {
@@ -34,8 +38,8 @@ class Initializer
 
 public:
 
-    // Fix the reference frame
-    Initializer(const Frame &ReferenceFrame, float sigma = 1.0, int iterations = 200);
+    // Fix the reference frame. The homography and fundamental hypotheses are evaluated in chunks on pScheduler if given.
+    Initializer(const Frame &ReferenceFrame, float sigma = 1.0, int iterations = 200, Scheduler* pScheduler = NULL);
 
     // Computes in parallel a fundamental matrix and a homography
     // Selects a model and tries to recover the motion and the structure from motion
@@ -45,15 +49,33 @@ public:
 
 private:
 
+    // Per-match score and inlier flag of a model, preallocated for each chunk of the RANSAC
+    struct ModelScore
+    {
+        vector<float> vScores;
+        vector<unsigned char> vbInliers;
+    };
+
+    // Minimal set of normalized points, one column per point
+    typedef Eigen::Matrix<float,2,8> MinimalSet;
+
+    // Solves the model of a RANSAC iteration and returns its score
+    typedef std::function<float(const int it, Eigen::Matrix3f &model, ModelScore &score)> Hypothesis;
+
     void FindHomography(vector<bool> &vbMatchesInliers, float &score, cv::Mat &H21);
     void FindFundamental(vector<bool> &vbInliers, float &score, cv::Mat &F21);
 
-    cv::Mat ComputeH21(const vector<cv::Point2f> &vP1, const vector<cv::Point2f> &vP2);
-    cv::Mat ComputeF21(const vector<cv::Point2f> &vP1, const vector<cv::Point2f> &vP2);
+    // Evaluates the hypotheses of all the RANSAC iterations in chunks and keeps the one with the highest
+    // score (the earliest on ties). Returns false if no hypothesis scored above zero.
+    bool FindBestHypothesis(const Hypothesis &hypothesis, vector<ModelScore> &vScoreBuffers,
+                            Eigen::Matrix3f &bestModel, float &bestScore);
+
+    Eigen::Matrix3f ComputeH21(const MinimalSet &P1, const MinimalSet &P2);
+    Eigen::Matrix3f ComputeF21(const MinimalSet &P1, const MinimalSet &P2);
 
-    float CheckHomography(const cv::Mat &H21, const cv::Mat &H12, vector<bool> &vbMatchesInliers, float sigma);
+    float CheckHomography(const Eigen::Matrix3f &H21, const Eigen::Matrix3f &H12, ModelScore &score, float sigma);
 
-    float CheckFundamental(const cv::Mat &F21, vector<bool> &vbMatchesInliers, float sigma);
+    float CheckFundamental(const Eigen::Matrix3f &F21, ModelScore &score, float sigma);
 
     bool ReconstructF(vector<bool> &vbMatchesInliers, cv::Mat &F21, cv::Mat &K,
                       cv::Mat &R21, cv::Mat &t21, vector<cv::Point3f> &vP3D, vector<bool> &vbTriangulated, float minParallax, int minTriangulated);
@@ -63,7 +85,7 @@ private:
 
     void Triangulate(const cv::KeyPoint &kp1, const cv::KeyPoint &kp2, const cv::Mat &P1, const cv::Mat &P2, cv::Mat &x3D);
 
-    void Normalize(const vector<cv::KeyPoint> &vKeys, vector<cv::Point2f> &vNormalizedPoints, cv::Mat &T);
+    void Normalize(const vector<cv::KeyPoint> &vKeys, Eigen::Matrix<float,2,Eigen::Dynamic> &Pn, Eigen::Matrix3f &T);
 
     int CheckRT(const cv::Mat &R, const cv::Mat &t, const vector<cv::KeyPoint> &vKeys1, const vector<cv::KeyPoint> &vKeys2,
                        const vector<Match> &vMatches12, vector<bool> &vbInliers,
@@ -82,6 +104,13 @@ private:
     vector<Match> mvMatches12;
     vector<bool> mvbMatched1;
 
+    // Coordinates of the matched keypoints, one array per coordinate
+    vector<float> mvU1, mvV1, mvU2, mvV2;
+
+    // Normalized keypoints (one column per keypoint) and their normalization transforms
+    Eigen::Matrix<float,2,Eigen::Dynamic> mPn1, mPn2;
+    Eigen::Matrix3f mT1, mT2;
+
     // Calibration
     cv::Mat mK;
 
@@ -94,6 +123,12 @@ private:
     // Ransac sets
     vector<vector<size_t> > mvSets;   
 
+    // Scoring buffers of each chunk, kept between calls
+    vector<ModelScore> mvHomographyScores;
+    vector<ModelScore> mvFundamentalScores;
+
+    Scheduler* mpScheduler;
+
 };
 
 } //namespace ORB_SLAM
@@ -28,6 +28,8 @@
 #include "ORBextractor.h"
 #include "Frame.h"
 #include "KeyFrameDatabase.h"
+#include "SeqLock.h"
+#include "SystemContext.h"
 
 #include <mutex>
 
@@ -39,6 +41,7 @@ class Map;
 class MapPoint;
 class Frame;
 class KeyFrameDatabase;
+class Scheduler;
 
 class KeyFrame
 {
@@ -54,8 +57,13 @@ public:
     cv::Mat GetRotation();
     cv::Mat GetTranslation();
 
-    // Bag of Words Representation
-    void ComputeBoW();
+    // Lock-free by-value pose readers for hot loops
+    cv::Matx44f GetPose4f() const;
+    cv::Matx44f GetPoseInverse4f() const;
+    cv::Matx31f GetCameraCenter3f() const;
+
+    // Bag of Words Representation, transformed in parallel if a scheduler is given
+    void ComputeBoW(Scheduler* pScheduler=NULL);
 
     // Covisibility graph functions
     void AddConnection(KeyFrame* pKF, const int &weight);
@@ -92,6 +100,7 @@ public:
 
     // KeyPoint functions
     std::vector<size_t> GetFeaturesInArea(const float &x, const float  &y, const float  &r) const;
+    void GetFeaturesInArea(const float &x, const float  &y, const float  &r, std::vector<size_t> &vIndices) const;
     cv::Mat UnprojectStereo(int i);
 
     // Image
@@ -120,7 +129,8 @@ public:
     // The following variables are accesed from only 1 thread or never change (no mutex needed).
 public:
 
-    static long unsigned int nNextId;
+    // Context of the System this KeyFrame belongs to (hands out the ids).
+    SystemContext* const mpContext;
     long unsigned int mnId;
     const long unsigned int mnFrameId;
 
@@ -140,14 +150,6 @@ public:
     long unsigned int mnBALocalForKF;
     long unsigned int mnBAFixedForKF;
 
-    // Variables used by the keyframe database
-    long unsigned int mnLoopQuery;
-    int mnLoopWords;
-    float mLoopScore;
-    long unsigned int mnRelocQuery;
-    int mnRelocWords;
-    float mRelocScore;
-
     // Variables used by loop closing
     cv::Mat mTcwGBA;
     cv::Mat mTcwBefGBA;
@@ -202,6 +204,10 @@ protected:
 
     cv::Mat Cw; // Stereo middle point. Only for visualization
 
+    // Published copies of Tcw and Twc, stored by SetPose under mMutexPose and read without locks
+    SeqLock<cv::Matx44f> mTcwSeq;
+    SeqLock<cv::Matx44f> mTwcSeq;
+
     // MapPoints associated to keypoints
     std::vector<MapPoint*> mvpMapPoints;
 
@@ -210,7 +216,7 @@ protected:
     ORBVocabulary* mpORBvocabulary;
 
     // Grid over the image to speed up feature matching
-    std::vector< std::vector <std::vector<size_t> > > mGrid;
+    KeyPointGrid mGrid;
 
     std::map<KeyFrame*,int> mConnectedKeyFrameWeights;
     std::vector<KeyFrame*> mvpOrderedConnectedKeyFrames;
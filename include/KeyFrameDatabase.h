@@ -22,8 +22,8 @@
 #define KEYFRAMEDATABASE_H
 
 #include <vector>
-#include <list>
 #include <set>
+#include <unordered_map>
 
 #include "KeyFrame.h"
 #include "Frame.h"
@@ -37,13 +37,19 @@ namespace ORB_SLAM2
 
 class KeyFrame;
 class Frame;
+class Scheduler;
 
 
+// Inverted file of the keyframes. Each keyframe takes a slot in the database and the postings
+// of a word are the contiguous slots of the keyframes that contain it. Erased keyframes leave
+// a tombstone in their slot; the postings are compacted once tombstones are half of them.
+// Queries count words and keep scores in their own arrays indexed by slot, so several queries
+// (loop detection and relocalization) can run at the same time.
 class KeyFrameDatabase
 {
 public:
 
-    KeyFrameDatabase(const ORBVocabulary &voc);
+    KeyFrameDatabase(const ORBVocabulary &voc, Scheduler* pScheduler=NULL);
 
    void add(KeyFrame* pKF);
 
@@ -59,11 +65,48 @@ public:
 
 protected:
 
+  // Keyframe sharing words with a query
+  struct Candidate
+  {
+      KeyFrame* pKF;
+      int nWords;
+      float score;
+  };
+
+  // Keyframes sharing words with bowVec, in order of first appearance in the inverted file.
+  // Keyframes in spExcluded are skipped.
+  void GetCandidates(const DBoW2::BowVector &bowVec, const std::set<KeyFrame*> &spExcluded,
+                     std::vector<Candidate> &vCandidates);
+
+  // Scores (in parallel) the candidates sharing more than minCommonWords with bowVec. Others get a
+  // negative score.
+  void ScoreCandidates(const DBoW2::BowVector &bowVec, const int minCommonWords,
+                       std::vector<Candidate> &vCandidates);
+
+  // Removes the tombstones from the postings and frees their slots
+  void Compact();
+
   // Associated vocabulary
   const ORBVocabulary* mpVoc;
 
-  // Inverted file
-  std::vector<list<KeyFrame*> > mvInvertedFile;
+  Scheduler* mpScheduler;
+
+  // Inverted file: slots of the keyframes of each word, in insertion order
+  std::vector<std::vector<unsigned int> > mvInvertedFile;
+
+  // Keyframe of each slot, NULL for a tombstone
+  std::vector<KeyFrame*> mvpSlotKFs;
+  std::unordered_map<KeyFrame*,unsigned int> mmKFSlots;
+
+  // Tombstones still in the postings, and slots that can be reused
+  std::vector<unsigned int> mvErasedSlots;
+  std::vector<unsigned int> mvFreeSlots;
+
+  // Words whose postings hold tombstones
+  std::vector<DBoW2::WordId> mvDirtyWords;
+
+  size_t mnPostings;
+  size_t mnDeadPostings;
 
   // Mutex
   std::mutex mMutex;
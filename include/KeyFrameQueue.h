@@ -0,0 +1,86 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef KEYFRAMEQUEUE_H
+#define KEYFRAMEQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstddef>
+
+namespace ORB_SLAM2
+{
+
+class KeyFrame;
+
+// Bounded single-producer/single-consumer ring used to hand keyframes between threads.
+// Push must only be called by one producer thread. Pop may be called from several threads
+// on the consumer side as long as they serialise among themselves (e.g. with a mutex).
+// Neither side takes a lock, the indices are published with acquire/release.
+class KeyFrameQueue
+{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    // Capacity is rounded up to a power of two
+    KeyFrameQueue(const size_t capacity);
+
+    // Producer side. Returns false (and counts a full event) if there is no free slot.
+    bool Push(KeyFrame* pKF);
+
+    // Consumer side. Returns false if the queue is empty.
+    bool Pop(KeyFrame* &pKF, TimePoint &tInserted);
+
+    // Safe from any thread, the result may be stale by the time it is used
+    size_t Size() const;
+    bool Empty() const;
+    bool Full() const;
+    size_t Capacity() const;
+
+    // Backpressure statistics: deepest the queue has been and number of rejected pushes
+    size_t MaxDepth() const;
+    size_t FullEvents() const;
+
+protected:
+
+    struct Slot
+    {
+        KeyFrame* pKF;
+        TimePoint tInserted;
+    };
+
+    std::vector<Slot> mvSlots;
+    size_t mnMask;
+
+    // Head and tail live on their own cache lines so producer and consumer do not false-share
+    char mPad0[64];
+    std::atomic<size_t> mnHead;     // Next slot to pop, written by the consumer
+    char mPad1[64];
+    std::atomic<size_t> mnTail;     // Next slot to push, written by the producer
+    std::atomic<size_t> mnMaxDepth;
+    std::atomic<size_t> mnFullEvents;
+    char mPad2[64];
+};
+
+} //namespace ORB_SLAM
+
+#endif // KEYFRAMEQUEUE_H
@@ -0,0 +1,82 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef KEYPOINTGRID_H
+#define KEYPOINTGRID_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#define FRAME_GRID_ROWS 48
+#define FRAME_GRID_COLS 64
+
+namespace ORB_SLAM2
+{
+
+// Keypoints bucketed in the cells of a grid over the undistorted image, in compressed sparse row
+// form: the keypoint indices sorted by cell (ascending within a cell) and the offset of the first
+// keypoint of each cell. A Frame or KeyFrame holds two arrays instead of one vector per cell, and
+// area queries walk contiguous spans.
+class KeyPointGrid
+{
+public:
+    KeyPointGrid();
+
+    // Bucket the keypoints. Keypoints out of the grid (after undistortion) are left out.
+    void Assign(const std::vector<cv::KeyPoint> &vKeysUn, const float minX, const float minY,
+                const float gridElementWidthInv, const float gridElementHeightInv);
+
+    // Compute the cell of a keypoint (return false if outside the grid)
+    bool PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY) const;
+
+    // Keypoints in the square of half side r around (x,y), with octave in [minLevel,maxLevel]
+    // (no bound if negative). vIndices is overwritten and keeps its capacity between queries.
+    void GetFeaturesInArea(const std::vector<cv::KeyPoint> &vKeysUn, const float x, const float y, const float r,
+                           const int minLevel, const int maxLevel, std::vector<size_t> &vIndices) const;
+
+    // Keypoints of a cell: [CellBegin, CellEnd)
+    const unsigned int* CellBegin(const int ix, const int iy) const
+    {
+        return mvIndices.data()+mvCellStart[ix*FRAME_GRID_ROWS+iy];
+    }
+
+    const unsigned int* CellEnd(const int ix, const int iy) const
+    {
+        return mvIndices.data()+mvCellStart[ix*FRAME_GRID_ROWS+iy+1];
+    }
+
+protected:
+
+    float mfMinX;
+    float mfMinY;
+    float mfGridElementWidthInv;
+    float mfGridElementHeightInv;
+
+    // Offset in mvIndices of the first keypoint of each cell (ix*FRAME_GRID_ROWS+iy), and the total
+    std::vector<int> mvCellStart;
+
+    // Keypoint indices sorted by cell
+    std::vector<unsigned int> mvIndices;
+};
+
+} //namespace ORB_SLAM
+
+#endif // KEYPOINTGRID_H
@@ -0,0 +1,119 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOCALBUNDLEADJUSTER_H
+#define LOCALBUNDLEADJUSTER_H
+
+#include "Map.h"
+#include "MapPoint.h"
+#include "KeyFrame.h"
+
+#include "Thirdparty/g2o/g2o/core/block_solver.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_eigen.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+
+#include <vector>
+#include <unordered_map>
+
+namespace ORB_SLAM2
+{
+
+class Scheduler;
+
+// Local BA of Local Mapping that keeps its g2o graph from one keyframe to the next. Consecutive
+// windows share most keyframes, points and observations, so instead of building the graph from
+// scratch (Optimizer::LocalBundleAdjustment) the new window is diffed against the cached one:
+// vertices and edges that are still in it get fresh estimates and kernels, the rest is added or
+// removed. Vertex ids follow the keyframe and point ids, so the camera ordering is stable. The
+// linear solver reuses its symbolic factorization only while the Schur complement pattern is the
+// same. Every new keyframe adds a camera and changes it, so in practice the reuse is limited to
+// the second pass (without the outliers) of the same keyframe, and the block solver still builds
+// its Hessian structure on every pass. This is graph reuse only, so it is off by default
+// (LocalMapping.IncrementalBA) until it has been timed against Optimizer::LocalBundleAdjustment.
+// Optimize must always be called from the same thread (Local Mapping).
+class LocalBundleAdjuster
+{
+public:
+    LocalBundleAdjuster(Scheduler* pScheduler=NULL);
+
+    // Same window, robust kernels, outlier rejection and map update as
+    // Optimizer::LocalBundleAdjustment
+    void Optimize(KeyFrame* pKF, bool* pbStopFlag, Map* pMap);
+
+    // Drop the cached problem. Needed before keyframes or points can be deleted (reset) and after
+    // the map was corrected while Local Mapping was stopped.
+    void Clear();
+
+    // Camera systems whose symbolic factorization was computed / reused
+    void GetSymbolicStats(int &nAnalyzed, int &nReused);
+
+protected:
+
+    struct Observation
+    {
+        KeyFrame* pKF;
+        size_t idx;
+        g2o::OptimizableGraph::Edge* pEdge;
+        bool bStereo;
+    };
+
+    struct CameraEntry
+    {
+        g2o::VertexSE3Expmap* pVertex;
+        unsigned long nWindow;
+    };
+
+    // Observations sorted by keyframe, as in MapPoint::mObservations
+    struct PointEntry
+    {
+        g2o::VertexSBAPointXYZ* pVertex;
+        std::vector<Observation> vObs;
+        unsigned long nWindow;
+    };
+
+    g2o::VertexSE3Expmap* UpdateCamera(KeyFrame* pKF, const bool bFixed);
+    void UpdatePoint(MapPoint* pMP, const size_t nObsBegin, const size_t nObsEnd);
+    Observation CreateEdge(g2o::VertexSBAPointXYZ* pVertex, KeyFrame* pKF, const size_t idx);
+    void ResetEdge(const Observation &obs);
+    void RemoveStale();
+
+    g2o::SparseOptimizer mOptimizer;
+    g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>* mpLinearSolver;
+
+    std::unordered_map<KeyFrame*,CameraEntry> mCameras;
+    std::unordered_map<MapPoint*,PointEntry> mPoints;
+
+    // Incremented at every Optimize, entries not touched by the current window are removed
+    unsigned long mnWindow;
+
+    // Buffers reused between windows
+    std::vector<KeyFrame*> mvpLocalKeyFrames;
+    std::vector<KeyFrame*> mvpFixedCameras;
+    std::vector<MapPoint*> mvpLocalMapPoints;
+    std::vector<std::pair<KeyFrame*,size_t> > mvObservations;
+    std::vector<size_t> mvObservationsBegin;
+    std::vector<Observation> mvMergedObs;
+    std::vector<std::pair<Observation,MapPoint*> > mvEdgesMono;
+    std::vector<std::pair<Observation,MapPoint*> > mvEdgesStereo;
+};
+
+} //namespace ORB_SLAM
+
+#endif // LOCALBUNDLEADJUSTER_H
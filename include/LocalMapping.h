@@ -26,8 +26,12 @@
 #include "LoopClosing.h"
 #include "Tracking.h"
 #include "KeyFrameDatabase.h"
+#include "KeyFrameQueue.h"
+#include "LocalBundleAdjuster.h"
 
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 
 namespace ORB_SLAM2
@@ -36,11 +40,15 @@ namespace ORB_SLAM2
 class Tracking;
 class LoopClosing;
 class Map;
+class Scheduler;
 
 class LocalMapping
 {
 public:
-    LocalMapping(Map* pMap, const float bMonocular);
+    // bIncrementalBA: keep the local BA graph between keyframes (LocalBundleAdjuster) instead of
+    // building it from scratch for every keyframe (Optimizer::LocalBundleAdjustment). Experimental:
+    // it only saves the graph construction, and has not been timed against the default yet.
+    LocalMapping(Map* pMap, const float bMonocular, Scheduler* pScheduler=NULL, const bool bIncrementalBA=false);
 
     void SetLoopCloser(LoopClosing* pLoopCloser);
 
@@ -49,7 +57,11 @@ public:
     // Main function
     void Run();
 
-    void InsertKeyFrame(KeyFrame* pKF);
+    // Never blocks. Returns false if the queue is full, check KeyFrameQueueFreeSlots before creating the keyframe.
+    bool InsertKeyFrame(KeyFrame* pKF);
+
+    // Loop Closing took a keyframe from its queue, Run may be waiting for that free slot
+    void LoopQueuePopped();
 
     // Thread Synch
     void RequestStop();
@@ -67,10 +79,30 @@ public:
     void RequestFinish();
     bool isFinished();
 
+    // Block the caller until Local Mapping has stopped or finished
+    void WaitUntilStopped();
+    void WaitUntilFinished();
+
+    // Time between InsertKeyFrame and the keyframe being picked up by Run (ms)
+    void GetKeyFrameLatency(int &nKFs, double &meanMs, double &maxMs);
+
+    // Queue depth and backpressure, lock-free so Tracking can poll them every frame
     int KeyframesInQueue(){
-        unique_lock<std::mutex> lock(mMutexNewKFs);
-        return mlNewKeyFrames.size();
+        return mNewKeyFrames.Size();
     }
+    bool KeyFrameQueueFull(){
+        return mNewKeyFrames.Full();
+    }
+    // Tracking is the only producer, so the free slots it sees can only grow until it inserts
+    int KeyFrameQueueFreeSlots(){
+        return mNewKeyFrames.Capacity()-mNewKeyFrames.Size();
+    }
+    void GetKeyFrameQueueStats(int &nMaxDepth, int &nFullEvents);
+
+    // Duration of the local BA of each keyframe (ms), and for the incremental one how many camera
+    // systems needed a new symbolic factorization / reused the previous one (at most the second
+    // pass of each keyframe, a new keyframe changes the pattern)
+    void GetLocalBAStats(int &nKFs, double &meanMs, double &maxMs, int &nSymbolic, int &nSymbolicReused);
 
 protected:
 
@@ -92,25 +124,56 @@ protected:
     void ResetIfRequested();
     bool mbResetRequested;
     std::mutex mMutexReset;
+    std::condition_variable mCondReset;
 
     bool CheckFinish();
     void SetFinish();
     bool mbFinishRequested;
     bool mbFinished;
     std::mutex mMutexFinish;
+    std::condition_variable mCondFinish;
+
+    // Run sleeps here until a keyframe arrives or a stop/reset/finish request is posted.
+    // InsertKeyFrame only takes mMutexNewKFs to notify when mbSleeping is set.
+    void WakeUp();
+    void WaitForWork(const bool bKeyFrames);
+    bool mbWakeUp;
+    std::atomic<bool> mbSleeping;
 
     Map* mpMap;
 
+    // Workers for the local BA
+    Scheduler* mpScheduler;
+
+    void LocalBundleAdjustment();
+    bool mbIncrementalBA;
+    LocalBundleAdjuster mLocalBA;
+
+    // Local BA statistics, guarded by mMutexLocalBAStats
+    int mnLocalBAs;
+    double mLocalBASum;
+    double mLocalBAMax;
+    int mnSymbolic;
+    int mnSymbolicReused;
+    std::mutex mMutexLocalBAStats;
+
     LoopClosing* mpLoopCloser;
     Tracking* mpTracker;
 
-    std::list<KeyFrame*> mlNewKeyFrames;
+    // Produced by Tracking only, popped under mMutexNewKFs (Run, Release and Reset)
+    KeyFrameQueue mNewKeyFrames;
 
     KeyFrame* mpCurrentKeyFrame;
 
     std::list<MapPoint*> mlpRecentAddedMapPoints;
 
     std::mutex mMutexNewKFs;
+    std::condition_variable mCondNewKFs;
+
+    // Hand-off latency statistics, guarded by mMutexNewKFs
+    int mnLatencyKFs;
+    double mLatencySum;
+    double mLatencyMax;
 
     bool mbAbortBA;
 
@@ -118,9 +181,9 @@ protected:
     bool mbStopRequested;
     bool mbNotStop;
     std::mutex mMutexStop;
+    std::condition_variable mCondStop;
 
-    bool mbAcceptKeyFrames;
-    std::mutex mMutexAccept;
+    std::atomic<bool> mbAcceptKeyFrames;
 };
 
 } //namespace ORB_SLAM
@@ -28,9 +28,12 @@
 #include "Tracking.h"
 
 #include "KeyFrameDatabase.h"
+#include "KeyFrameQueue.h"
 
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include "Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
 
 namespace ORB_SLAM2
@@ -39,6 +42,7 @@ namespace ORB_SLAM2
 class Tracking;
 class LocalMapping;
 class KeyFrameDatabase;
+class Scheduler;
 
 
 class LoopClosing
@@ -52,7 +56,7 @@ public:
 
 public:
 
-    LoopClosing(Map* pMap, KeyFrameDatabase* pDB, ORBVocabulary* pVoc,const bool bFixScale);
+    LoopClosing(Map* pMap, KeyFrameDatabase* pDB, ORBVocabulary* pVoc,const bool bFixScale, Scheduler* pScheduler=NULL);
 
     void SetTracker(Tracking* pTracker);
 
@@ -61,7 +65,8 @@ public:
     // Main function
     void Run();
 
-    void InsertKeyFrame(KeyFrame *pKF);
+    // Never blocks. Returns false if the queue is full, Local Mapping checks KeyFrameQueueFull first.
+    bool InsertKeyFrame(KeyFrame *pKF);
 
     void RequestReset();
 
@@ -81,6 +86,20 @@ public:
 
     bool isFinished();
 
+    // Block the caller until Loop Closing and any running Global BA have finished
+    void WaitUntilFinished();
+
+    // Time between InsertKeyFrame and the keyframe being picked up by Run (ms)
+    void GetKeyFrameLatency(int &nKFs, double &meanMs, double &maxMs);
+
+    int KeyframesInQueue(){
+        return mLoopKeyFrameQueue.Size();
+    }
+    bool KeyFrameQueueFull(){
+        return mLoopKeyFrameQueue.Full();
+    }
+    void GetKeyFrameQueueStats(int &nMaxDepth, int &nFullEvents);
+
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 protected:
@@ -98,24 +117,42 @@ protected:
     void ResetIfRequested();
     bool mbResetRequested;
     std::mutex mMutexReset;
+    std::condition_variable mCondReset;
 
     bool CheckFinish();
     void SetFinish();
     bool mbFinishRequested;
     bool mbFinished;
     std::mutex mMutexFinish;
+    std::condition_variable mCondFinish;
+
+    // Run sleeps here until a keyframe arrives or a reset/finish request is posted
+    void WakeUp();
+    void WaitForWork();
+    bool mbWakeUp;
+    std::atomic<bool> mbSleeping;
 
     Map* mpMap;
     Tracking* mpTracker;
 
+    // Runs the Global BA as a task and the optimizations on its workers
+    Scheduler* mpScheduler;
+
     KeyFrameDatabase* mpKeyFrameDB;
     ORBVocabulary* mpORBVocabulary;
 
     LocalMapping *mpLocalMapper;
 
-    std::list<KeyFrame*> mlpLoopKeyFrameQueue;
+    // Produced by Local Mapping only, popped by Run under mMutexLoopQueue
+    KeyFrameQueue mLoopKeyFrameQueue;
 
     std::mutex mMutexLoopQueue;
+    std::condition_variable mCondLoopQueue;
+
+    // Hand-off latency statistics, guarded by mMutexLoopQueue
+    int mnLatencyKFs;
+    double mLatencySum;
+    double mLatencyMax;
 
     // Loop detector parameters
     float mnCovisibilityConsistencyTh;
@@ -137,14 +174,17 @@ protected:
     bool mbRunningGBA;
     bool mbFinishedGBA;
     bool mbStopGBA;
+    // GBA tasks that have not returned yet, including aborted ones (mbRunningGBA only follows
+    // the newest). Guarded by mMutexGBA.
+    int mnGBATasks;
     std::mutex mMutexGBA;
-    std::thread* mpThreadGBA;
+    std::condition_variable mCondGBA;
 
     // Fix scale in the stereo/RGB-D case
     bool mbFixScale;
 
 
-    bool mnFullBAIdx;
+    int mnFullBAIdx;
 };
 
 } //namespace ORB_SLAM
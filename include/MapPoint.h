@@ -24,9 +24,12 @@
 #include"KeyFrame.h"
 #include"Frame.h"
 #include"Map.h"
+#include"SeqLock.h"
+#include"SystemContext.h"
 
 #include<opencv2/core/core.hpp>
 #include<mutex>
+#include<atomic>
 
 namespace ORB_SLAM2
 {
@@ -39,6 +42,9 @@ class Frame;
 class MapPoint
 {
 public:
+    // ORB descriptor (256 bits)
+    typedef cv::Vec<uchar,32> Descriptor;
+
     MapPoint(const cv::Mat &Pos, KeyFrame* pRefKF, Map* pMap);
     MapPoint(const cv::Mat &Pos,  Map* pMap, Frame* pFrame, const int &idxF);
 
@@ -46,9 +52,18 @@ public:
     cv::Mat GetWorldPos();
 
     cv::Mat GetNormal();
+
+    // Lock-free by-value readers for the tracking hot loops. They never wait for Local Mapping.
+    cv::Matx31f GetWorldPos3f() const;
+    cv::Matx31f GetNormal3f() const;
+    // Returns false if the descriptor has not been computed yet
+    bool GetDescriptor(Descriptor &descriptor) const;
+
     KeyFrame* GetReferenceKeyFrame();
 
     std::map<KeyFrame*,size_t> GetObservations();
+    // Appends the observations to vObs in the same order, reusing the caller's buffer
+    void GetObservations(std::vector<std::pair<KeyFrame*,size_t> > &vObs);
     int Observations();
 
     void AddObservation(KeyFrame* pKF,size_t idx);
@@ -82,8 +97,9 @@ public:
     int PredictScale(const float &currentDist, Frame* pF);
 
 public:
+    // Context of the System this MapPoint belongs to (hands out the ids, global mutex).
+    SystemContext* const mpContext;
     long unsigned int mnId;
-    static long unsigned int nNextId;
     long int mnFirstKFid;
     long int mnFirstFrame;
     int nObs;
@@ -110,8 +126,6 @@ public:
     long unsigned int mnBAGlobalForKF;
 
 
-    static std::mutex mGlobalMutex;
-
 protected:
 
      // Position in absolute coordinates
@@ -145,6 +159,21 @@ protected:
 
      std::mutex mMutexPos;
      std::mutex mMutexFeatures;
+
+     // Published copies of the position, normal/scale distances and descriptor. They are stored
+     // under mMutexPos / mMutexFeatures together with the cv::Mat members and read without locks.
+     struct ViewInfo
+     {
+         cv::Matx31f normal;
+         float fMinDistance;
+         float fMaxDistance;
+     };
+     void PublishViewInfo();
+     void PublishDescriptor();
+     SeqLock<cv::Matx31f> mWorldPosSeq;
+     SeqLock<ViewInfo> mViewInfoSeq;
+     SeqLock<Descriptor> mDescriptorSeq;
+     std::atomic<bool> mbHasDescriptor;
 };
 
 } //namespace ORB_SLAM
@@ -0,0 +1,96 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MOTIONLABELER_H
+#define MOTIONLABELER_H
+
+#include<opencv2/core/core.hpp>
+
+#include<vector>
+
+#include "gco/GCoptimization.h"
+
+namespace ORB_SLAM2
+{
+
+class Scheduler;
+
+// Multi-label graph-cut assignment of points to rigid motion models (alpha-expansion).
+// The binary graph of the expansion moves and the cost buffers are kept between calls,
+// so a new frame only allocates when it has more points or neighbors than any before.
+class MotionLabeler
+{
+public:
+    typedef GCoptimization::EnergyTermType EnergyTermType;
+
+    // With a scheduler the connected components of the neighbor graph are solved concurrently
+    MotionLabeler(const double lambda=80, const double beta=1, const double thRepro=16, Scheduler* pScheduler=NULL);
+    ~MotionLabeler();
+
+    // vPre3d: points in the previous camera frame, vCur2d: their observations in the current image.
+    // Mods: 6 x L motion models (rvec, tvec) taking previous camera points to the current camera.
+    // vOffsets, vAdj: symmetric CSR neighbor graph over the points.
+    // vLabels: initial labeling in, optimal labeling out. Returns the final energy.
+    long long Label(const std::vector<cv::Point3d> &vPre3d, const std::vector<cv::Point2d> &vCur2d,
+                    const cv::Mat &Mods, const cv::Mat &K, const std::vector<int> &vOffsets,
+                    const std::vector<int> &vAdj, std::vector<int> &vLabels, const int maxIterations=100);
+
+    // Print the timing of every expansion move, not only the summary
+    void SetVerbose(const bool bVerbose) { mbVerbose = bVerbose; }
+
+protected:
+
+    // Reprojection cost of every (point, model) pair, site-major
+    void ComputeDataCosts(const std::vector<cv::Point3d> &vPre3d, const std::vector<cv::Point2d> &vCur2d,
+                          const cv::Mat &Mods, const cv::Mat &K);
+
+    // Weight of every neighbor relation, decaying with the image distance
+    void ComputeNeighborWeights(const std::vector<cv::Point2d> &vCur2d, const std::vector<int> &vOffsets,
+                                const std::vector<int> &vAdj);
+
+    void PrintTimings(const GCoptimization &gc, const double tDataCost) const;
+
+    double mLambda;
+    double mBeta;
+    double mThRepro;
+    bool mbVerbose;
+
+    std::vector<EnergyTermType> mvDataCost;
+    std::vector<EnergyTermType> mvSmoothCost;
+    std::vector<EnergyTermType> mvWeights;
+
+    // Binary graph shared by the expansion moves of all frames
+    GCoptimization::EnergyT mEnergy;
+
+    // Binary graphs of the per-component moves, one per worker, also shared by all frames
+    std::vector<GCoptimization::EnergyT*> mvThreadEnergies;
+
+    // Workers for the per-component expansion moves (NULL if single-threaded)
+    Scheduler* mpScheduler;
+
+private:
+    MotionLabeler(const MotionLabeler&);
+    MotionLabeler& operator=(const MotionLabeler&);
+};
+
+} //namespace ORB_SLAM
+
+#endif // MOTIONLABELER_H
@@ -29,6 +29,8 @@
 namespace ORB_SLAM2
 {
 
+class Scheduler;
+
 class ExtractorNode
 {
 public:
@@ -82,12 +84,20 @@ public:
         return mvInvLevelSigma2;
     }
 
+    // Detect and describe the pyramid levels concurrently on the scheduler (NULL: one after the other)
+    void SetScheduler(Scheduler* pScheduler){
+        mpScheduler = pScheduler;}
+
+    Scheduler* GetScheduler(){
+        return mpScheduler;}
+
     std::vector<cv::Mat> mvImagePyramid;
 
 protected:
 
     void ComputePyramid(cv::Mat image);
     void ComputeKeyPointsOctTree(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);    
+    void ComputeKeyPointsLevel(const int level, std::vector<cv::KeyPoint>& keypoints);
     std::vector<cv::KeyPoint> DistributeOctTree(const std::vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
                                            const int &maxX, const int &minY, const int &maxY, const int &nFeatures, const int &level);
 
@@ -108,6 +118,8 @@ protected:
     std::vector<float> mvInvScaleFactor;    
     std::vector<float> mvLevelSigma2;
     std::vector<float> mvInvLevelSigma2;
+
+    Scheduler* mpScheduler;
 };
 
 } //namespace ORB_SLAM
@@ -23,6 +23,7 @@
 #define ORBMATCHER_H
 
 #include<vector>
+#include<functional>
 #include<opencv2/core/core.hpp>
 #include<opencv2/features2d/features2d.hpp>
 
@@ -34,6 +35,8 @@
 namespace ORB_SLAM2
 {
 
+class Scheduler;
+
 class ORBmatcher
 {    
 public:
@@ -42,17 +45,33 @@ public:
 
     // Computes the Hamming distance between two ORB descriptors
     static int DescriptorDistance(const cv::Mat &a, const cv::Mat &b);
+    static int DescriptorDistance(const MapPoint::Descriptor &a, const cv::Mat &b);
+    static int DescriptorDistance(const uchar* a, const uchar* b);
+
+    // Computes in one batch the Hamming distances between a descriptor and the rows vIndices of
+    // a descriptor matrix
+    static void DescriptorDistances(const uchar* a, const cv::Mat &B, const std::vector<size_t> &vIndices,
+                                    std::vector<int> &vDist);
+
+    // Best and second best Hamming distances between a descriptor and the rows vIndices of a
+    // descriptor matrix, in one pass. bestPos and bestPos2 are positions in vIndices, -1 (with
+    // distance 256) if there is none.
+    static void SearchBestTwo(const uchar* a, const cv::Mat &B, const std::vector<size_t> &vIndices,
+                              int &bestDist, int &bestPos, int &bestDist2, int &bestPos2);
 
     // Search matches based on motion prior and sift descriptor
     int ProjMatching(Frame &CurrentFrame, Frame &LastFrame, vector<int> &TemperalMatch, const bool &bSecondFrame);
 
     // Search matches between Frame keypoints and projected MapPoints. Returns number of matches
     // Used to track the local map (Tracking)
-    int SearchByProjection(Frame &F, const std::vector<MapPoint*> &vpMapPoints, const float th=3);
+    // The projection searches below run in parallel on pScheduler if given. A keypoint wanted by
+    // several MapPoints goes to the closest one, so the matches do not depend on the number of workers.
+    int SearchByProjection(Frame &F, const std::vector<MapPoint*> &vpMapPoints, const float th=3, Scheduler* pScheduler=NULL);
 
     // Project MapPoints tracked in last frame into the current frame and search matches.
     // Used to track from previous frame (Tracking)
-    int SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono, vector<int> &TemperalMatch);
+    int SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono, vector<int> &TemperalMatch,
+                           Scheduler* pScheduler=NULL);
 
     // Search matches in quad frames (previous left, right and current left right frames)
     int SearchByQuad(Frame &CurrentFrame, const Frame &LastFrame, vector<int> &TemperalMatch);
@@ -60,7 +79,8 @@ public:
 
     // Project MapPoints seen in KeyFrame into the Frame and search matches.
     // Used in relocalisation (Tracking)
-    int SearchByProjection(Frame &CurrentFrame, KeyFrame* pKF, const std::set<MapPoint*> &sAlreadyFound, const float th, const int ORBdist);
+    int SearchByProjection(Frame &CurrentFrame, KeyFrame* pKF, const std::set<MapPoint*> &sAlreadyFound, const float th, const int ORBdist,
+                           Scheduler* pScheduler=NULL);
 
     // Project MapPoints using a Similarity Transformation and search matches.
     // Used in loop detection (Loop Closing)
@@ -98,6 +118,17 @@ public:
 
 protected:
 
+    // Best keypoint for an item of a projection search (-1 if none) and its distance, skipping the
+    // blocked keypoints. The buffers are scratch owned by the calling worker.
+    typedef std::function<int(const int item, const std::vector<char> &vbBlocked, int &bestDist,
+                              std::vector<size_t> &vIndices, std::vector<size_t> &vCandidates)> ProposalFunction;
+
+    // Matches items to keypoints in rounds. Every pending item proposes its best keypoint (in
+    // parallel), each keypoint goes to its closest proposal (the lowest item on ties) and the other
+    // proposers search again without the keypoints taken. vbTaken is updated with the matches.
+    void ResolveProjections(const int nItems, std::vector<char> &vbTaken, const ProposalFunction &propose,
+                            Scheduler* pScheduler, std::vector<int> &vItemMatches);
+
     bool CheckDistEpipolarLine(const cv::KeyPoint &kp1, const cv::KeyPoint &kp2, const cv::Mat &F12, const KeyFrame *pKF);
 
     float RadiusByViewingCos(const float &viewCos);
@@ -33,16 +33,20 @@ namespace ORB_SLAM2
 {
 
 class LoopClosing;
+class Scheduler;
 
+// The map-wide optimizations (BA, local BA, essential graph) build their linear system on the
+// workers of pScheduler if given, single-threaded otherwise.
 class Optimizer
 {
 public:
     void static BundleAdjustment(const std::vector<KeyFrame*> &vpKF, const std::vector<MapPoint*> &vpMP,
                                  int nIterations = 5, bool *pbStopFlag=NULL, const unsigned long nLoopKF=0,
-                                 const bool bRobust = true);
+                                 const bool bRobust = true, Scheduler* pScheduler=NULL);
     void static GlobalBundleAdjustemnt(Map* pMap, int nIterations=5, bool *pbStopFlag=NULL,
-                                       const unsigned long nLoopKF=0, const bool bRobust = true);
-    void static LocalBundleAdjustment(KeyFrame* pKF, bool *pbStopFlag, Map *pMap);
+                                       const unsigned long nLoopKF=0, const bool bRobust = true,
+                                       Scheduler* pScheduler=NULL);
+    void static LocalBundleAdjustment(KeyFrame* pKF, bool *pbStopFlag, Map *pMap, Scheduler* pScheduler=NULL);
     int static PoseOptimization(Frame* pFrame);
     int static PoseOptimizationNew(Frame *pCurFrame, Frame *pLastFrame, const vector<int> &TemperalMatch);
     int static PoseOptimizationFlow2Cam(Frame *pCurFrame, Frame *pLastFrame, const vector<int> &TemperalMatch, const vector<Eigen::Vector2d> &flo_gt, const vector<double> &e_bef);
@@ -64,7 +68,7 @@ public:
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
                                        const map<KeyFrame *, set<KeyFrame *> > &LoopConnections,
-                                       const bool &bFixScale);
+                                       const bool &bFixScale, Scheduler* pScheduler=NULL);
 
     // if bFixScale is true, optimize SE3 (stereo,rgbd), Sim3 otherwise (mono)
     static int OptimizeSim3(KeyFrame* pKF1, KeyFrame* pKF2, std::vector<MapPoint *> &vpMatches1,
@@ -51,6 +51,8 @@
 #ifndef PNPSOLVER_H
 #define PNPSOLVER_H
 
+#include <atomic>
+#include <random>
 #include <opencv2/core/core.hpp>
 #include "MapPoint.h"
 #include "Frame.h"
@@ -67,6 +69,10 @@ class PnPsolver {
   void SetRansacParameters(double probability = 0.99, int minInliers = 8 , int maxIterations = 300, int minSet = 4, float epsilon = 0.4,
                            float th2 = 5.991);
 
+  // Stop iterating as soon as *pbCancel is set (e.g. another relocalization candidate succeeded).
+  // iterate then returns an empty pose with bNoMore=true.
+  void SetCancelFlag(const std::atomic<bool>* pbCancel);
+
   cv::Mat find(vector<bool> &vbInliers, int &nInliers);
 
   cv::Mat iterate(int nIterations, bool &bNoMore, vector<bool> &vbInliers, int &nInliers);
@@ -136,12 +142,15 @@ class PnPsolver {
 
   vector<MapPoint*> mvpMapPointMatches;
 
-  // 2D Points
-  vector<cv::Point2f> mvP2D;
+  // 2D Points (structure of arrays, so that CheckInliers vectorizes)
+  vector<float> mvU;
+  vector<float> mvV;
   vector<float> mvSigma2;
 
   // 3D Points
-  vector<cv::Point3f> mvP3Dw;
+  vector<float> mvPwX;
+  vector<float> mvPwY;
+  vector<float> mvPwZ;
 
   // Index in Frame
   vector<size_t> mvKeyPointIndices;
@@ -150,18 +159,18 @@ class PnPsolver {
   double mRi[3][3];
   double mti[3];
   cv::Mat mTcwi;
-  vector<bool> mvbInliersi;
+  vector<unsigned char> mvbInliersi;
   int mnInliersi;
 
   // Current Ransac State
   int mnIterations;
-  vector<bool> mvbBestInliers;
+  vector<unsigned char> mvbBestInliers;
   int mnBestInliers;
   cv::Mat mBestTcw;
 
   // Refined
   cv::Mat mRefinedTcw;
-  vector<bool> mvbRefinedInliers;
+  vector<unsigned char> mvbRefinedInliers;
   int mnRefinedInliers;
 
   // Number of Correspondences
@@ -191,6 +200,12 @@ class PnPsolver {
   // Max square error associated with scale level. Max error = th*th*sigma(level)*sigma(level)
   vector<float> mvMaxError;
 
+  // Own random generator, so that solvers running on different threads do not share rand()
+  std::minstd_rand mRng;
+
+  // Set by the caller to abort the RANSAC, NULL if it cannot be cancelled
+  const std::atomic<bool>* mpbCancel;
+
 };
 
 } //namespace ORB_SLAM
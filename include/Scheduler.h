@@ -0,0 +1,224 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace g2o
+{
+class ThreadPool;
+}
+
+namespace ORB_SLAM2
+{
+
+class TaskGroup;
+
+// Work-stealing task scheduler shared by all the threads of a System, so that the parallel
+// parts of tracking, local mapping and loop closing draw from one set of workers instead of
+// each spawning their own. Every worker owns a deque: it pops its own tasks from the back and
+// steals from the front of the others when it runs dry. A thread waiting for a TaskGroup or a
+// ParallelFor runs the queued tasks of that group meanwhile, so nested parallelism never
+// deadlocks, and a waiter that holds a lock never runs unrelated work under it.
+// The long-lived loops (Local Mapping, Loop Closing) run on pinned threads owned by the
+// scheduler, since they block on their own events and would otherwise hold a worker forever.
+class Scheduler
+{
+public:
+    typedef std::function<void()> Task;
+
+    // Chunk of a parallel loop: [begin, end) and the index of the chunk, in [0, number of chunks)
+    typedef std::function<void(int, int, int)> RangeFunction;
+
+    struct WorkerStats
+    {
+        std::string name;
+        bool bPinned;
+        long nTasks;        // tasks run by this worker
+        long nStolen;       // of which taken from another worker's deque
+        double busyMs;
+        double utilization; // busy time over the lifetime of the scheduler
+    };
+
+    // nWorkers<=0 starts one worker per hardware thread, minus the thread that submits the work.
+    // There is always at least one worker.
+    explicit Scheduler(int nWorkers=0);
+
+    // Pinned loops must have returned (e.g. after RequestFinish), they are joined here
+    ~Scheduler();
+
+    int NumWorkers() const { return mnWorkers; }
+
+    // Threads that can work on a parallel loop: the workers and the caller
+    int Concurrency() const { return mnWorkers+1; }
+
+    // Queue a fire-and-forget task that may run long or block (e.g. the Global BA). Only the
+    // workers pick these up, never a thread that helps while waiting on a TaskGroup.
+    void Submit(const Task &task);
+
+    // Run func over [0,n) split into at most nChunks chunks (Concurrency() if nChunks<=0).
+    // The caller runs the first chunk and helps with the rest. Returns the number of chunks used.
+    int ParallelFor(const int n, const RangeFunction &func, int nChunks=0);
+
+    // Adapter for libraries that take a C parallel-for callback (ORBVocabulary::transform):
+    // pass it with the scheduler as extraData.
+    static void RangeParallelFor(int count, void (*job)(int, int, void*), void* jobData, void* extraData);
+
+    // Start a long-lived loop on a dedicated thread. Returns the id to pass to JoinPinned.
+    int StartPinned(const std::string &name, const Task &loop);
+
+    // Join a pinned loop that has returned (e.g. after RequestFinish), before its owner is destroyed
+    void JoinPinned(const int id);
+
+    // Adapter so that g2o optimizers linearize on the scheduler workers
+    g2o::ThreadPool* GetThreadPool() { return mpThreadPool; }
+
+    std::vector<WorkerStats> GetWorkerStats();
+
+    // Tasks run by threads that were waiting on a TaskGroup or ParallelFor
+    long GetHelpedTasks() const { return mnHelped; }
+
+protected:
+    friend class TaskGroup;
+
+    // Task of a TaskGroup, tagged with it so that its waiter can find it
+    struct GroupTask
+    {
+        Task task;
+        TaskGroup* pGroup;
+    };
+
+    struct Worker
+    {
+        Worker(): nTasks(0), nStolen(0), busyNs(0) {}
+
+        std::mutex mMutex;
+        std::deque<GroupTask> mTasks;
+        std::thread mThread;
+
+        std::atomic<long> nTasks;
+        std::atomic<long> nStolen;
+        std::atomic<long long> busyNs;
+    };
+
+    struct PinnedLoop
+    {
+        int id;
+        std::string name;
+        std::thread thread;
+    };
+
+    void WorkerLoop(const int w);
+
+    // Queue a task of a TaskGroup on the deque of the calling worker (round robin from other threads)
+    void Push(const Task &task, TaskGroup* pGroup);
+
+    // Take a TaskGroup task (workers only), from the back of the own deque, else from the
+    // front of another deque. Returns false if every deque is empty.
+    bool TakeTask(const int self, Task &task, bool &bStolen);
+
+    // Take a queued task of pGroup from any deque. Returns false if there is none.
+    bool TakeGroupTask(TaskGroup* pGroup, Task &task);
+
+    // Take a submitted task (workers only)
+    bool TakeDetached(Task &task);
+
+    void NotifyQueued();
+
+    // Run one queued task of pGroup on the calling thread (used while waiting). Returns false if none.
+    bool Help(TaskGroup* pGroup);
+
+    // Index of the calling thread in this scheduler, -1 if it is not one of its workers
+    int CurrentWorker() const;
+
+    int mnWorkers;
+    std::vector<Worker*> mvpWorkers;
+    std::atomic<unsigned int> mnNextWorker;
+
+    // Submitted tasks, first in first out
+    std::mutex mMutexDetached;
+    std::deque<Task> mDetached;
+
+    // Tasks in the deques and mDetached. Sleeping workers wait for mnQueued>0.
+    std::atomic<int> mnQueued;
+    std::mutex mMutexSleep;
+    std::condition_variable mCondWork;
+    bool mbStop;
+
+    std::atomic<long> mnHelped;
+
+    std::mutex mMutexPinned;
+    std::vector<PinnedLoop*> mvpPinned;
+    int mnNextPinned;
+
+    std::chrono::steady_clock::time_point mtStart;
+
+    g2o::ThreadPool* mpThreadPool;
+
+private:
+    Scheduler(const Scheduler&);
+    Scheduler& operator=(const Scheduler&);
+};
+
+// Tasks that are waited for together. Wait() runs the queued tasks of the group while it is not
+// done, so it can be called from inside another task, and sleeps while the rest are running.
+class TaskGroup
+{
+public:
+    explicit TaskGroup(Scheduler* pScheduler);
+
+    // Waits for the pending tasks
+    ~TaskGroup();
+
+    void Run(const Scheduler::Task &task);
+
+    void Wait();
+
+protected:
+    friend class Scheduler;
+
+    void TaskDone();
+
+    Scheduler* mpScheduler;
+    std::atomic<int> mnPending;
+    // Pending tasks still in a deque, decremented by the scheduler when one is taken
+    std::atomic<int> mnQueued;
+    std::mutex mMutex;
+    std::condition_variable mCond;
+
+private:
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+};
+
+} //namespace ORB_SLAM
+
+#endif // SCHEDULER_H
@@ -0,0 +1,87 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstring>
+#include <stdint.h>
+
+namespace ORB_SLAM2
+{
+
+// Sequence lock around a small plain-old-data value (positions, poses, descriptors).
+// Readers never block and never write shared memory: they retry if a store overlapped the copy.
+// Stores must be serialised by the caller, e.g. by the mutex that already guards the owner.
+// The payload is kept in relaxed atomic words so concurrent copies are well defined.
+template<typename T>
+class SeqLock
+{
+public:
+    SeqLock(): mnSeq(0)
+    {
+        for(size_t i=0; i<NWORDS; i++)
+            mvWords[i].store(0,std::memory_order_relaxed);
+    }
+
+    void Store(const T &value)
+    {
+        uint32_t words[NWORDS] = {0};
+        memcpy(words,&value,sizeof(T));
+
+        const unsigned int seq = mnSeq.load(std::memory_order_relaxed);
+        mnSeq.store(seq+1,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for(size_t i=0; i<NWORDS; i++)
+            mvWords[i].store(words[i],std::memory_order_relaxed);
+        mnSeq.store(seq+2,std::memory_order_release);
+    }
+
+    T Load() const
+    {
+        uint32_t words[NWORDS];
+        unsigned int seq0, seq1;
+        do
+        {
+            seq0 = mnSeq.load(std::memory_order_acquire);
+            for(size_t i=0; i<NWORDS; i++)
+                words[i] = mvWords[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            seq1 = mnSeq.load(std::memory_order_relaxed);
+        }
+        while((seq0&1) || seq0!=seq1);
+
+        T value;
+        memcpy(&value,words,sizeof(T));
+        return value;
+    }
+
+protected:
+    static const size_t NWORDS = (sizeof(T)+sizeof(uint32_t)-1)/sizeof(uint32_t);
+
+    std::atomic<unsigned int> mnSeq;
+    std::atomic<uint32_t> mvWords[NWORDS];
+};
+
+} //namespace ORB_SLAM
+
+#endif // SEQLOCK_H
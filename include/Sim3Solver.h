@@ -24,6 +24,9 @@
 
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <atomic>
+#include <random>
+#include <Eigen/Core>
 
 #include "KeyFrame.h"
 
@@ -40,6 +43,10 @@ public:
 
     void SetRansacParameters(double probability = 0.99, int minInliers = 6 , int maxIterations = 300);
 
+    // Stop iterating as soon as *pbCancel is set (e.g. another loop candidate was accepted).
+    // iterate then returns an empty transformation with bNoMore=true.
+    void SetCancelFlag(const std::atomic<bool>* pbCancel);
+
     cv::Mat find(std::vector<bool> &vbInliers12, int &nInliers);
 
     cv::Mat iterate(int nIterations, bool &bNoMore, std::vector<bool> &vbInliers, int &nInliers);
@@ -51,14 +58,18 @@ public:
 
 protected:
 
-    void ComputeCentroid(cv::Mat &P, cv::Mat &Pr, cv::Mat &C);
+    // Points stored one coordinate per column (structure of arrays), so that the
+    // transformation and projection of all the correspondences run as vector operations
+    typedef Eigen::Matrix<float,Eigen::Dynamic,3> Points3;
+    typedef Eigen::Matrix<float,Eigen::Dynamic,2> Points2;
 
-    void ComputeSim3(cv::Mat &P1, cv::Mat &P2);
+    // Columns of P1 and P2 are the minimal set of points in each camera
+    void ComputeSim3(const Eigen::Matrix3f &P1, const Eigen::Matrix3f &P2);
 
     void CheckInliers();
 
-    void Project(const std::vector<cv::Mat> &vP3Dw, std::vector<cv::Mat> &vP2D, cv::Mat Tcw, cv::Mat K);
-    void FromCameraToImage(const std::vector<cv::Mat> &vP3Dc, std::vector<cv::Mat> &vP2D, cv::Mat K);
+    void Project(const Points3 &P3D, const Eigen::Matrix3f &sR, const Eigen::Vector3f &t, const Eigen::Matrix3f &K, Points2 &P2D);
+    void FromCameraToImage(const Points3 &P3Dc, const Eigen::Matrix3f &K, Points2 &P2D);
 
 
 protected:
@@ -67,36 +78,33 @@ protected:
     KeyFrame* mpKF1;
     KeyFrame* mpKF2;
 
-    std::vector<cv::Mat> mvX3Dc1;
-    std::vector<cv::Mat> mvX3Dc2;
+    Points3 mX3Dc1;
+    Points3 mX3Dc2;
     std::vector<MapPoint*> mvpMapPoints1;
     std::vector<MapPoint*> mvpMapPoints2;
     std::vector<MapPoint*> mvpMatches12;
     std::vector<size_t> mvnIndices1;
-    std::vector<size_t> mvSigmaSquare1;
-    std::vector<size_t> mvSigmaSquare2;
-    std::vector<size_t> mvnMaxError1;
-    std::vector<size_t> mvnMaxError2;
+    Eigen::ArrayXf mMaxError1;
+    Eigen::ArrayXf mMaxError2;
 
     int N;
     int mN1;
 
     // Current Estimation
-    cv::Mat mR12i;
-    cv::Mat mt12i;
+    Eigen::Matrix3f mR12i;
+    Eigen::Vector3f mt12i;
     float ms12i;
-    cv::Mat mT12i;
-    cv::Mat mT21i;
-    std::vector<bool> mvbInliersi;
+    Eigen::Matrix3f msR21i;
+    Eigen::Vector3f mt21i;
+    Eigen::Array<bool,Eigen::Dynamic,1> mvbInliersi;
     int mnInliersi;
 
     // Current Ransac State
     int mnIterations;
-    std::vector<bool> mvbBestInliers;
+    Eigen::Array<bool,Eigen::Dynamic,1> mvbBestInliers;
     int mnBestInliers;
-    cv::Mat mBestT12;
-    cv::Mat mBestRotation;
-    cv::Mat mBestTranslation;
+    Eigen::Matrix3f mBestRotation;
+    Eigen::Vector3f mBestTranslation;
     float mBestScale;
 
     // Scale is fixed to 1 in the stereo/RGBD case
@@ -106,8 +114,13 @@ protected:
     std::vector<size_t> mvAllIndices;
 
     // Projections
-    std::vector<cv::Mat> mvP1im1;
-    std::vector<cv::Mat> mvP2im2;
+    Points2 mP1im1;
+    Points2 mP2im2;
+
+    // Buffers of CheckInliers, kept to avoid allocations at every iteration
+    Points3 mP3Dbuffer;
+    Points2 mP2im1;
+    Points2 mP1im2;
 
     // RANSAC probability
     double mRansacProb;
@@ -123,8 +136,14 @@ protected:
     float mSigma2;
 
     // Calibration
-    cv::Mat mK1;
-    cv::Mat mK2;
+    Eigen::Matrix3f mK1;
+    Eigen::Matrix3f mK2;
+
+    // Own random generator, so that solvers running on different threads do not share rand()
+    std::minstd_rand mRng;
+
+    // Set by the caller to abort the RANSAC, NULL if it cannot be cancelled
+    const std::atomic<bool>* mpbCancel;
 
 };
 
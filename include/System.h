@@ -35,6 +35,8 @@
 #include "KeyFrameDatabase.h"
 #include "ORBVocabulary.h"
 #include "Viewer.h"
+#include "Scheduler.h"
+#include "SystemContext.h"
 
 namespace ORB_SLAM2
 {
@@ -45,6 +47,7 @@ class Map;
 class Tracking;
 class LocalMapping;
 class LoopClosing;
+class Scheduler;
 
 class System
 {
@@ -61,6 +64,16 @@ public:
     // Initialize the SLAM system. It launches the Local Mapping, Loop Closing and Viewer threads.
     System(const string &strVocFile, const string &strSettingsFile, const eSensor sensor, const bool bUseViewer = true);
 
+    // Same, but uses an already loaded vocabulary, so several Systems can run in one process sharing it.
+    // The vocabulary is only read and must outlive the System. If pScheduler is given, its workers are
+    // shared too (System.nWorkers is then ignored) and it must outlive the System.
+    System(ORBVocabulary* pVoc, const string &strSettingsFile, const eSensor sensor, const bool bUseViewer = true,
+           Scheduler* pScheduler = NULL);
+
+    // Shuts the System down if Shutdown was not called, then frees the map and the threads' objects.
+    // The shared vocabulary and scheduler are left to the caller.
+    ~System();
+
     // Proccess the given stereo frame. Images must be synchronized and rectified.
     // Input images: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to grayscale.
     // Returns the camera pose (empty if tracking fails).
@@ -74,6 +87,17 @@ public:
                       const cv::Mat &mTcw_gt, const vector<vector<float> > &vObjPose_gt, const double &timestamp,
                       std::vector<float> &coer, std::vector<float> &reproer, int &m_num, cv::Mat &imTraj);
 
+    // Pipelined TrackRGBD: the frame passed in is built while the one of the previous call is tracked.
+    // The returned pose and the outputs belong to the previous frame (empty pose on the first call),
+    // and the images must stay untouched until the next call returns. Call FlushRGBD after the last frame.
+    cv::Mat TrackRGBDPipelined(const cv::Mat &im, cv::Mat &depthmap, const cv::Mat &flowmap, const cv::Mat &masksem,
+                               const cv::Mat &mTcw_gt, const vector<vector<float> > &vObjPose_gt, const double &timestamp,
+                               std::vector<float> &coer, std::vector<float> &reproer, int &m_num, cv::Mat &imTraj);
+    cv::Mat FlushRGBD(std::vector<float> &coer, std::vector<float> &reproer, int &m_num, cv::Mat &imTraj);
+
+    // System.Pipelined in the settings file
+    bool PipelinedTracking() const { return mbPipelined; }
+
     // Proccess the given monocular frame
     // Input images: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to grayscale.
     // Returns the camera pose (empty if tracking fails).
@@ -120,6 +144,10 @@ public:
 
     void SaveResults(const string &filename);
 
+    // Save the per-frame object motion errors (obj_mot_err.txt, obj_mot_err_convert.txt and obj_speed_err.txt).
+    // Files are named by appending to the given prefix. Call first Shutdown()
+    void SaveObjectMotions(const string &filename);
+
     // Information from most recent processed frame
     // You can call this right after TrackMonocular (or stereo or RGBD)
     int GetTrackingState();
@@ -130,6 +158,11 @@ public:
 
 private:
 
+    // Builds the whole System. pVoc and pScheduler are used if not NULL, otherwise the vocabulary is loaded
+    // from strVocFile and the workers are created from the settings.
+    void Initialize(ORBVocabulary* pVoc, const string &strVocFile, const string &strSettingsFile, const bool bUseViewer,
+                    Scheduler* pScheduler);
+
     // Input sensor
     eSensor mSensor;
 
@@ -160,11 +193,25 @@ private:
     FrameDrawer* mpFrameDrawer;
     MapDrawer* mpMapDrawer;
 
-    // System threads: Local Mapping, Loop Closing, Viewer.
-    // The Tracking thread "lives" in the main execution thread that creates the System object.
-    std::thread* mptLocalMapping;
-    std::thread* mptLoopClosing;
-    std::thread* mptViewer;
+    // Workers shared by all threads. Local Mapping and Loop Closing run as pinned loops on it.
+    // The Tracking thread "lives" in the main execution thread that creates the System object,
+    // the Viewer is run by the main thread through StartViewer.
+    Scheduler* mpScheduler;
+    int mnLocalMappingLoop;
+    int mnLoopClosingLoop;
+
+    // False if the vocabulary or the scheduler were given to the constructor
+    bool mbOwnVocabulary;
+    bool mbOwnScheduler;
+
+    // Calibration and id counters of the Frames, KeyFrames and MapPoints of this System.
+    SystemContext* mpContext;
+
+    // RGB-D frames are built one frame ahead of tracking
+    bool mbPipelined;
+
+    // Last map change reported by MapChanged
+    int mnLastBigChangeIdx;
 
     // Reset flag
     std::mutex mMutexReset;
@@ -175,6 +222,9 @@ private:
     bool mbActivateLocalizationMode;
     bool mbDeactivateLocalizationMode;
 
+    // Set by Shutdown, so that the destructor does not shut down twice
+    bool mbShutdown;
+
     // Tracking state
     int mTrackingState;
     std::vector<MapPoint*> mTrackedMapPoints;
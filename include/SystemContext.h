@@ -0,0 +1,71 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef SYSTEMCONTEXT_H
+#define SYSTEMCONTEXT_H
+
+#include <atomic>
+#include <mutex>
+
+namespace ORB_SLAM2
+{
+
+// State shared by the Frames, KeyFrames and MapPoints of one System: calibration, undistorted
+// image bounds and id counters. Each System owns its context, so several Systems can run in
+// the same process (sharing a read-only vocabulary) without corrupting each other.
+class SystemContext
+{
+public:
+    SystemContext();
+
+    long unsigned int NewFrameId();
+    long unsigned int NewKeyFrameId();
+    long unsigned int NewMapPointId();
+
+    // Restart Frame and KeyFrame numbering (map reset). MapPoint ids keep growing.
+    void ResetIds();
+
+public:
+
+    // Calibration, image bounds and grid cell sizes are computed on the first Frame
+    // (or after a change in the calibration) and copied into every following Frame.
+    bool mbInitialComputations;
+
+    float fx, fy, cx, cy, invfx, invfy;
+
+    float mnMinX, mnMaxX, mnMinY, mnMaxY;
+
+    float mfGridElementWidthInv, mfGridElementHeightInv;
+
+    // Guards MapPoint position updates against the pose optimization of the current frame.
+    std::mutex mGlobalMutex;
+
+protected:
+
+    std::atomic<long unsigned int> mnNextFrameId;
+    std::atomic<long unsigned int> mnNextKeyFrameId;
+    std::atomic<long unsigned int> mnNextMapPointId;
+};
+
+} //namespace ORB_SLAM
+
+#endif // SYSTEMCONTEXT_H
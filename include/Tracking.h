@@ -52,6 +52,9 @@ class Map;
 class LocalMapping;
 class LoopClosing;
 class System;
+class MotionLabeler;
+class Scheduler;
+class SystemContext;
 
 class Tracking
 {
@@ -73,14 +76,48 @@ class Tracking
     };
 
 public:
+    // Neighbor graph over the dynamic points in compressed sparse row form.
+    // Neighbors of point i are vAdj[vOffsets[i]] ... vAdj[vOffsets[i+1]-1], sorted by index.
+    struct NeighborGraph {
+        std::vector<int> vOffsets;
+        std::vector<int> vAdj;
+
+        int size() const { return vOffsets.empty() ? 0 : (int)vOffsets.size()-1; }
+        int Degree(const int i) const { return vOffsets[i+1]-vOffsets[i]; }
+        const int* begin(const int i) const { return vAdj.data()+vOffsets[i]; }
+        const int* end(const int i) const { return vAdj.data()+vOffsets[i+1]; }
+    };
+
     Tracking(System* pSys, ORBVocabulary* pVoc, FrameDrawer* pFrameDrawer, MapDrawer* pMapDrawer, Map* pMap,
-             KeyFrameDatabase* pKFDB, const string &strSettingPath, const int sensor);
+             KeyFrameDatabase* pKFDB, const string &strSettingPath, const int sensor, Scheduler* pScheduler, SystemContext* pContext);
+    ~Tracking();
 
     // Preprocess the input and call Track(). Extract features and performs stereo matching.
     cv::Mat GrabImageStereo(const cv::Mat &imRectLeft,const cv::Mat &imRectRight, const cv::Mat &imMask, const double &timestamp);
     cv::Mat GrabImageRGBD(const cv::Mat &imRGB, cv::Mat &imD, const cv::Mat &imFlow, const cv::Mat &maskSEM,
                           const cv::Mat &mTcw_gt, const vector<vector<float> > &vObjPose_gt, const double &timestamp,
                           std::vector<float> &coer, std::vector<float> &reproer, int &m_num, cv::Mat &imTraj);
+
+    // Two-stage pipelined GrabImageRGBD: the frame passed in is built (depth, ORB, flow sampling)
+    // on the scheduler while the frame of the previous call is tracked. The returned pose and
+    // the outputs belong to that previous frame (empty pose on the first call). The images of a
+    // call must stay untouched by the caller until the next call returns.
+    cv::Mat GrabImageRGBDPipelined(const cv::Mat &imRGB, cv::Mat &imD, const cv::Mat &imFlow, const cv::Mat &maskSEM,
+                                   const cv::Mat &mTcw_gt, const vector<vector<float> > &vObjPose_gt, const double &timestamp,
+                                   std::vector<float> &coer, std::vector<float> &reproer, int &m_num, cv::Mat &imTraj);
+
+    // Track the frame still in the pipeline. Returns an empty pose if there is none.
+    cv::Mat FlushRGBD(std::vector<float> &coer, std::vector<float> &reproer, int &m_num, cv::Mat &imTraj);
+
+    // Back stage time per pipelined frame and time spent waiting for the front stage after it
+    struct PipelineStats
+    {
+        PipelineStats(): nFrames(0), backMs(0), stallMs(0) {}
+        int nFrames;
+        double backMs;
+        double stallMs;
+    };
+    PipelineStats GetPipelineStats() const { return mPipelineStats; }
     cv::Mat GrabImageMonocular(const cv::Mat &im, const double &timestamp);
 
     void SetLocalMapper(LocalMapping* pLocalMapper);
@@ -109,19 +146,25 @@ public:
     // GET object motion
     cv::Mat GetObjMod(const vector<int> &TemperalMatch, const vector<int> &ObjId);
 
-    // Delaunay neighbor
-    cv::Mat Delaunay(const std::vector<int> &id_dynamic);
+    // Delaunay neighbor of the keypoints vKeys[id_dynamic[i]]. If maxDegree>0 every point selects its
+    // maxDegree closest neighbors and only the edges selected by both ends are kept, so the graph stays symmetric.
+    NeighborGraph Delaunay(const std::vector<cv::KeyPoint> &vKeys, const std::vector<int> &id_dynamic,
+                           const int maxDegree=0);
 
-    // Minimal Sample Sets (MSS)
+    // Minimal Sample Sets (MSS). Row r of Sorted_ind holds the points of id_unknown sorted by their
+    // distance to point r (column 0 is r itself), only columns 1..5 are used.
+    // nThreads>1 splits the points into that many tasks on the scheduler.
     std::vector<Eigen::Vector4i> GetMSS(const std::vector<int> &id_dynamic, const std::vector<int> &id_inter,
-                                        const std::vector<int> &id_unknown, const Eigen::MatrixXi &Sorted_ind);
+                                        const std::vector<int> &id_unknown, const Eigen::MatrixXi &Sorted_ind,
+                                        const int nThreads=1);
 
     // Motion model
     cv::Mat GetModel(const Eigen::Vector4i &mss, const vector<int> &TemperalMatch);
 
-    // Energy functions
-    void GCoptimal(const vector<int> &TemperalMatch, const std::vector<int> &id_dynamic,
-                   const std::vector<std::vector<int> > &vNeighs, const cv::Mat &Mods);
+    // Reassign the points of the dynamic objects to the object whose motion explains them best,
+    // by graph-cut over their Delaunay graph. ObjId and SemPos are updated in place, the points
+    // of objects left with too few points are labeled as outliers.
+    void GCoptimal(std::vector<std::vector<int> > &ObjId, std::vector<int> &SemPos);
 
     void DrawLine(cv::KeyPoint &keys, cv::Point2f &flow, cv::Mat &ref_image, const cv::Scalar &color,
                   int thickness=2, int line_type=1, const cv::Point2i &offset=cv::Point2i(0,0));
@@ -222,6 +265,16 @@ public:
 
     void Reset();
 
+    // Time Track() spends waiting for and holding mMutexMapUpdate, accumulated over all frames
+    struct MapLockStats {
+        MapLockStats(): nFrames(0), waitMs(0), holdMs(0), maxHoldMs(0) {}
+        int nFrames;
+        double waitMs;
+        double holdMs;
+        double maxHoldMs;
+    };
+    MapLockStats GetMapLockStats() const { return mMapLockStats; }
+
 protected:
 
     // Main tracking function. It is independent of the input sensor.
@@ -272,6 +325,45 @@ protected:
     // Initalization (only for monocular)
     Initializer* mpInitializer;
 
+    // Workers shared with the other threads of the System
+    Scheduler* mpScheduler;
+
+    // Calibration and id counters of the System, given to every Frame
+    SystemContext* mpContext;
+
+    // Graph-cut labeling of the dynamic points into motions
+    MotionLabeler* mpMotionLabeler;
+    bool mbGraphCutLabeling;
+
+    MapLockStats mMapLockStats;
+
+    // Raw inputs of one RGB-D frame and the Frame built from them
+    struct RGBDInput
+    {
+        cv::Mat imRGB;
+        cv::Mat imGray;
+        cv::Mat imDepth;
+        cv::Mat imFlow;
+        cv::Mat maskSEM;
+        cv::Mat mTcw_gt;
+        vector<vector<float> > vObjPose_gt;
+        double timestamp;
+        Frame frame;
+    };
+
+    void SetRGBDInput(RGBDInput &input, const cv::Mat &imRGB, cv::Mat &imD, const cv::Mat &imFlow, const cv::Mat &maskSEM,
+                      const cv::Mat &mTcw_gt, const vector<vector<float> > &vObjPose_gt, const double &timestamp);
+
+    // Front stage: depth and gray conversion and Frame construction. Depends on the inputs only.
+    void BuildFrameRGBD(RGBDInput &input);
+
+    // Back stage: take over the correspondences of the last frame, then camera and object motion
+    cv::Mat TrackFrameRGBD(RGBDInput &input, std::vector<float> &coer, std::vector<float> &reproer, int &m_num, cv::Mat &imTraj);
+
+    // Frame built by the last pipelined call, waiting for its back stage (NULL if none)
+    RGBDInput* mpPendingRGBD;
+    PipelineStats mPipelineStats;
+
     //Local Map
     KeyFrame* mpReferenceKF;
     std::vector<KeyFrame*> mvpLocalKeyFrames;
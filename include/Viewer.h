@@ -28,6 +28,7 @@
 #include "System.h"
 
 #include <mutex>
+#include <condition_variable>
 
 namespace ORB_SLAM2
 {
@@ -56,6 +57,10 @@ public:
 
     void Release();
 
+    // Block the caller until the viewer has stopped or finished
+    void WaitUntilStopped();
+    void WaitUntilFinished();
+
 private:
 
     bool Stop();
@@ -76,10 +81,12 @@ private:
     bool mbFinishRequested;
     bool mbFinished;
     std::mutex mMutexFinish;
+    std::condition_variable mCondFinish;
 
     bool mbStopped;
     bool mbStopRequested;
     std::mutex mMutexStop;
+    std::condition_variable mCondStop;
 
 };
 
@@ -106,6 +106,7 @@
 #endif
 
 #include <cstddef>
+#include <vector>
 #include "gco/energy.h"
 #include "src/gco/graph.cpp"
 #include "src/gco/maxflow.cpp"
@@ -271,6 +272,43 @@ public:
 	//   2 => expansion-/swap-level output (label(s), current energy)
 	void setVerbosity(int level) { m_verbosity = level; }
 
+	// The binary graph of each expansion/swap move is built in a single Energy
+	// that keeps its memory between moves. By default it is owned by this object;
+	// passing a workspace keeps the memory across optimizers as well (e.g. one
+	// optimizer per frame). The workspace must outlive this object.
+	void setWorkspace(EnergyT* workspace);
+
+	// Same for the per-thread binary graphs of setParallelFor: entries missing for
+	// a thread are allocated into the vector, and the caller deletes them. The
+	// vector must outlive this object.
+	void setThreadWorkspaces(std::vector<EnergyT*>* workspaces);
+
+	// Timing of each alpha-expansion move run since the last call to expansion()
+	struct ExpansionTiming {
+		LabelID    label;
+		SiteID     numVars;       // active sites in the binary problem
+		SiteID     numComponents; // independent binary problems it was split into
+		gcoclock_t setupTicks;    // building the binary graph(s), summed over threads
+		gcoclock_t maxflowTicks;  // solving them, summed over threads
+		gcoclock_t totalTicks;    // elapsed time of the whole move
+		bool       improved;      // labeling was updated
+	};
+
+	// Runs job(index,thread,jobData) once for each index in [0,count), possibly
+	// concurrently. thread identifies the executing thread and must be smaller
+	// than the numThreads passed to setParallelFor.
+	typedef void (*JobFn)(int index, int thread, void* jobData);
+	typedef void (*ParallelForFn)(int count, JobFn job, void* jobData, void* extraData);
+
+	// When the neighborhood system has several connected components, the binary
+	// problem of each expansion move splits into independent ones. With a parallel
+	// loop set, those are built and solved concurrently; the move is accepted or
+	// rejected as a whole, so the labeling is identical to the single-graph solve.
+	// Data and smooth cost functions must then be safe to call from several threads.
+	// Not used with label costs or sparse data costs.
+	void setParallelFor(ParallelForFn fn, void* extraData, int numThreads);
+	const std::vector<ExpansionTiming>& expansionTimings() const { return m_expansionTimings; }
+
 protected:
 	struct LabelCost {
 		~LabelCost() { delete [] labels; }
@@ -314,10 +352,35 @@ protected:
 	SiteID *m_numNeighbors;              // holds num of neighbors for each site
 	SiteID  m_numNeighborsTotal;         // holds total num of neighbor relationships
 
+	EnergyT *m_energy;                   // binary graph reused by every move
+	bool     m_ownsEnergy;
+	SiteID  *m_activeSites;              // sites participating in the current move
+	std::vector<ExpansionTiming> m_expansionTimings;
+
+	// Expansion over the connected components of the neighborhood system
+	ParallelForFn m_parallelFor;
+	void*   m_parallelForData;
+	int     m_numThreads;
+	SiteID  m_numComponents;             // -1 until computed
+	std::vector<SiteID>     m_siteComponent;
+	std::vector<SiteID>     m_componentStart;   // active sites of component c: m_activeSites[start[c]..start[c+1])
+	std::vector<std::vector<SiteID> > m_componentBins; // components solved by each job
+	std::vector<EnergyType> m_componentBefore;
+	std::vector<EnergyType> m_componentAfter;
+	std::vector<char>       m_moveCut;          // 0 => active site switches to alpha
+	std::vector<EnergyT*>*  m_threadEnergies;   // binary graph of each thread, m_ownThreadEnergies unless borrowed
+	std::vector<EnergyT*>   m_ownThreadEnergies;
+	std::vector<gcoclock_t> m_threadSetupTicks;
+	std::vector<gcoclock_t> m_threadMaxflowTicks;
+	LabelID m_moveAlpha;
+
+	// Returns the reused binary graph, emptied
+	EnergyT* resetEnergy(SiteID numVars, SiteID numEdges);
+
 	EnergyType (GCoptimization::*m_giveSmoothEnergyInternal)();
 	SiteID (GCoptimization::*m_queryActiveSitesExpansion)(LabelID, SiteID*);
-	void (GCoptimization::*m_setupDataCostsExpansion)(SiteID,LabelID,EnergyT*,SiteID*);
-	void (GCoptimization::*m_setupSmoothCostsExpansion)(SiteID,LabelID,EnergyT*,SiteID*);
+	void (GCoptimization::*m_setupDataCostsExpansion)(SiteID,LabelID,EnergyT*,SiteID*,EnergyType&);
+	void (GCoptimization::*m_setupSmoothCostsExpansion)(SiteID,LabelID,EnergyT*,SiteID*,EnergyType&);
 	void (GCoptimization::*m_setupDataCostsSwap)(SiteID,LabelID,LabelID,EnergyT*,SiteID*);
 	void (GCoptimization::*m_setupSmoothCostsSwap)(SiteID,LabelID,LabelID,EnergyT*,SiteID*);
 	void (GCoptimization::*m_applyNewLabeling)(EnergyT*,SiteID*,SiteID,LabelID);
@@ -443,9 +506,9 @@ protected:
 	};
 
 	template <typename DataCostT> SiteID queryActiveSitesExpansion(LabelID alpha_label, SiteID* activeSites);
-	template <typename DataCostT>   void setupDataCostsExpansion(SiteID size,LabelID alpha_label,EnergyT *e,SiteID *activeSites);
+	template <typename DataCostT>   void setupDataCostsExpansion(SiteID size,LabelID alpha_label,EnergyT *e,SiteID *activeSites,EnergyType& before);
 	template <typename DataCostT>   void setupDataCostsSwap(SiteID size,LabelID alpha_label,LabelID beta_label,EnergyT *e,SiteID *activeSites);
-	template <typename SmoothCostT> void setupSmoothCostsExpansion(SiteID size,LabelID alpha_label,EnergyT *e,SiteID *activeSites);
+	template <typename SmoothCostT> void setupSmoothCostsExpansion(SiteID size,LabelID alpha_label,EnergyT *e,SiteID *activeSites,EnergyType& before);
 	template <typename SmoothCostT> void setupSmoothCostsSwap(SiteID size,LabelID alpha_label,LabelID beta_label,EnergyT *e,SiteID *activeSites);
 	template <typename DataCostT>   void applyNewLabeling(EnergyT *e,SiteID *activeSites,SiteID size,LabelID alpha_label);
 	template <typename DataCostT>   void updateLabelingDataCosts();
@@ -455,10 +518,11 @@ protected:
 	EnergyType setupLabelCostsExpansion(SiteID size,LabelID alpha_label,EnergyT *e,SiteID *activeSites);
 	void       updateLabelingInfo(bool updateCounts=true,bool updateActive=true,bool updateCosts=true);
 	
-	// Check for overflow and submodularity issues when setting up binary graph cut
-	void addterm1_checked(EnergyT *e,VarID i,EnergyTermType e0,EnergyTermType e1);
-	void addterm1_checked(EnergyT *e,VarID i,EnergyTermType e0,EnergyTermType e1,EnergyTermType w);
-	void addterm2_checked(EnergyT *e,VarID i,VarID j,EnergyTermType e00,EnergyTermType e01,EnergyTermType e10,EnergyTermType e11,EnergyTermType w);
+	// Check for overflow and submodularity issues when setting up binary graph cut.
+	// The energy of the current labeling over the added terms is accumulated in before.
+	void addterm1_checked(EnergyT *e,EnergyType& before,VarID i,EnergyTermType e0,EnergyTermType e1);
+	void addterm1_checked(EnergyT *e,EnergyType& before,VarID i,EnergyTermType e0,EnergyTermType e1,EnergyTermType w);
+	void addterm2_checked(EnergyT *e,EnergyType& before,VarID i,VarID j,EnergyTermType e00,EnergyTermType e01,EnergyTermType e10,EnergyTermType e11,EnergyTermType w);
 
 	// Returns Smooth Energy of current labeling
 	template <typename SmoothCostT> EnergyType giveSmoothEnergyInternal();
@@ -468,6 +532,11 @@ protected:
 	static void checkInterrupt();
 
 private:
+	void computeComponents();
+	bool alphaExpansionComponents(LabelID alpha_label, gcoclock_t ticks0);
+	void expandComponentBin(int bin, int thread);
+	static void expandComponentBinJob(int bin, int thread, void* data);
+
 	// Peforms one iteration (one pass over all pairs of labels) of expansion/swap algorithm
 	EnergyType oneExpansionIteration();
 	EnergyType oneSwapIteration();
@@ -578,6 +647,12 @@ public:
 	// in the same order as neighborIndexes[i] stores the indexes
 	void setAllNeighbors(SiteID *numNeighbors,SiteID **neighborsIndexes,EnergyTermType **neighborsWeights);
 
+	// Sets the whole neighborhood system at once from a compressed sparse row list:
+	// the neighbors of site i are neighbors[offsets[i]] .. neighbors[offsets[i+1]-1]
+	// with weights in the same positions of weights (all 1 if weights is NULL).
+	// The list must be symmetric. The data is copied.
+	void setNeighborsCSR(const SiteID *offsets, const SiteID *neighbors, const EnergyTermType *weights=0);
+
 protected: 
 	virtual void giveNeighborInfo(SiteID site, SiteID *numSites, SiteID **neighbors, EnergyTermType **weights);
 	virtual void finalizeNeighbors();
@@ -594,6 +669,10 @@ private:
 	SiteID **m_neighborsIndexes;
 	EnergyTermType **m_neighborsWeights;
 	bool m_needTodeleteNeighbors;
+
+	// contiguous storage behind m_neighborsIndexes/m_neighborsWeights when set by setNeighborsCSR
+	SiteID *m_csrIndexes;
+	EnergyTermType *m_csrWeights;
 };
 
 
@@ -29,6 +29,7 @@
 #include "Frame.h"
 #include "Converter.h"
 #include "ORBmatcher.h"
+#include "Scheduler.h"
 #include <thread>
 #include<time.h>
 #include<chrono>
@@ -36,30 +37,28 @@
 namespace ORB_SLAM2
 {
 
-long unsigned int Frame::nNextId=0;
-bool Frame::mbInitialComputations=true;
-float Frame::cx, Frame::cy, Frame::fx, Frame::fy, Frame::invfx, Frame::invfy;
-float Frame::mnMinX, Frame::mnMinY, Frame::mnMaxX, Frame::mnMaxY;
-float Frame::mfGridElementWidthInv, Frame::mfGridElementHeightInv;
-
 // cv::RNG rng;
 
-Frame::Frame()
+Frame::Frame():mpContext(static_cast<SystemContext*>(NULL))
 {}
 
 //Copy Constructor
 Frame::Frame(const Frame &frame)
     :mpORBvocabulary(frame.mpORBvocabulary), mpORBextractorLeft(frame.mpORBextractorLeft), mpORBextractorRight(frame.mpORBextractorRight),
-     mTimeStamp(frame.mTimeStamp), mK(frame.mK.clone()), mDistCoef(frame.mDistCoef.clone()),
+     mTimeStamp(frame.mTimeStamp), mK(frame.mK.clone()), fx(frame.fx), fy(frame.fy), cx(frame.cx), cy(frame.cy),
+     invfx(frame.invfx), invfy(frame.invfy), mDistCoef(frame.mDistCoef.clone()),
      mbf(frame.mbf), mb(frame.mb), mThDepth(frame.mThDepth), N(frame.N), mvKeys(frame.mvKeys),
      mvKeysRight(frame.mvKeysRight), mvKeysUn(frame.mvKeysUn),  mvuRight(frame.mvuRight),
      mvDepth(frame.mvDepth), mBowVec(frame.mBowVec), mFeatVec(frame.mFeatVec),
      mDescriptors(frame.mDescriptors.clone()), mDescriptorsRight(frame.mDescriptorsRight.clone()),
-     mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier), mnId(frame.mnId),
+     mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier),
+     mfGridElementWidthInv(frame.mfGridElementWidthInv), mfGridElementHeightInv(frame.mfGridElementHeightInv),
+     mGrid(frame.mGrid), mnId(frame.mnId),
      mpReferenceKF(frame.mpReferenceKF), mnScaleLevels(frame.mnScaleLevels),
      mfScaleFactor(frame.mfScaleFactor), mfLogScaleFactor(frame.mfLogScaleFactor),
      mvScaleFactors(frame.mvScaleFactors), mvInvScaleFactors(frame.mvInvScaleFactors),
      mvLevelSigma2(frame.mvLevelSigma2), mvInvLevelSigma2(frame.mvInvLevelSigma2),
+     mnMinX(frame.mnMinX), mnMaxX(frame.mnMaxX), mnMinY(frame.mnMinY), mnMaxY(frame.mnMaxY), mpContext(frame.mpContext),
      // new added
      mTcw_gt(frame.mTcw_gt), vObjPose_gt(frame.vObjPose_gt), nSemPosi_gt(frame.nSemPosi_gt), vObjBox_gt(frame.vObjBox_gt),
      vObjLabel(frame.vObjLabel),
@@ -67,21 +66,17 @@ Frame::Frame(const Frame &frame)
      mvCorres(frame.mvCorres), mvObjCorres(frame.mvObjCorres),
      mvFlowNext(frame.mvFlowNext), mvObjFlowNext(frame.mvObjFlowNext)
 {
-    for(int i=0;i<FRAME_GRID_COLS;i++)
-        for(int j=0; j<FRAME_GRID_ROWS; j++)
-            mGrid[i][j]=frame.mGrid[i][j];
-
     if(!frame.mTcw.empty())
         SetPose(frame.mTcw);
 }
 
 
-Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const cv::Mat &imMask, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
+Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const cv::Mat &imMask, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, SystemContext* pContext)
     :mpORBvocabulary(voc),mpORBextractorLeft(extractorLeft),mpORBextractorRight(extractorRight), mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth),
-     mpReferenceKF(static_cast<KeyFrame*>(NULL))
+     mpReferenceKF(static_cast<KeyFrame*>(NULL)), mpContext(pContext)
 {
     // Frame ID
-    mnId=nNextId++;
+    mnId=mpContext->NewFrameId();
 
     // Scale Level Info
     mnScaleLevels = mpORBextractorLeft->GetLevels();
@@ -92,14 +87,28 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const cv::Mat &imMas
     mvLevelSigma2 = mpORBextractorLeft->GetScaleSigmaSquares();
     mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
-    // ORB extraction
-    thread threadLeft(&Frame::ExtractORB,this,0,imLeft);
-    thread threadRight(&Frame::ExtractORB,this,1,imRight);
-    threadLeft.join();
-    threadRight.join();
+    // ORB extraction, the right image as a task on the extractors' scheduler
+    Scheduler* pScheduler = mpORBextractorLeft->GetScheduler();
+    if(pScheduler)
+    {
+        TaskGroup extraction(pScheduler);
+        extraction.Run([&]() { ExtractORB(1,imRight); });
+        ExtractORB(0,imLeft);
+        extraction.Wait();
+    }
+    else
+    {
+        thread threadLeft(&Frame::ExtractORB,this,0,imLeft);
+        thread threadRight(&Frame::ExtractORB,this,1,imRight);
+        threadLeft.join();
+        threadRight.join();
+    }
 
     N = mvKeys.size();
 
+    // Calibration is set even on empty frames, they can still be copied into mLastFrame
+    SetCalibration(imLeft,K);
+
     if(mvKeys.empty())
         return;
 
@@ -135,36 +144,18 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const cv::Mat &imMas
     mvbOutlier = vector<bool>(N,false);
 
 
-    // This is done only for the first Frame (or after a change in the calibration)
-    if(mbInitialComputations)
-    {
-        ComputeImageBounds(imLeft);
-
-        mfGridElementWidthInv=static_cast<float>(FRAME_GRID_COLS)/(mnMaxX-mnMinX);
-        mfGridElementHeightInv=static_cast<float>(FRAME_GRID_ROWS)/(mnMaxY-mnMinY);
-
-        fx = K.at<float>(0,0);
-        fy = K.at<float>(1,1);
-        cx = K.at<float>(0,2);
-        cy = K.at<float>(1,2);
-        invfx = 1.0f/fx;
-        invfy = 1.0f/fy;
-
-        mbInitialComputations=false;
-    }
-
     mb = mbf/fx;
 
     AssignFeaturesToGrid();
 }
 
 Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const cv::Mat &imFlow, const cv::Mat &maskSEM,
-    const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
+    const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, SystemContext* pContext)
     :mpORBvocabulary(voc),mpORBextractorLeft(extractor),mpORBextractorRight(static_cast<ORBextractor*>(NULL)),
-     mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth)
+     mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth), mpContext(pContext)
 {
     // Frame ID
-    mnId=nNextId++;
+    mnId=mpContext->NewFrameId();
 
     // Scale Level Info
     mnScaleLevels = mpORBextractorLeft->GetLevels();
@@ -508,6 +499,9 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const cv::Mat &imFlo
 
     N = mvKeys.size();
 
+    // Calibration is set even on empty frames, they can still be copied into mLastFrame
+    SetCalibration(imGray,K);
+
     if(mvKeys.empty())
         return;
 
@@ -518,36 +512,18 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const cv::Mat &imFlo
     mvpMapPoints = vector<MapPoint*>(N,static_cast<MapPoint*>(NULL));
     mvbOutlier = vector<bool>(N,false);
 
-    // This is done only for the first Frame (or after a change in the calibration)
-    if(mbInitialComputations)
-    {
-        ComputeImageBounds(imGray);
-
-        mfGridElementWidthInv=static_cast<float>(FRAME_GRID_COLS)/static_cast<float>(mnMaxX-mnMinX);
-        mfGridElementHeightInv=static_cast<float>(FRAME_GRID_ROWS)/static_cast<float>(mnMaxY-mnMinY);
-
-        fx = K.at<float>(0,0);
-        fy = K.at<float>(1,1);
-        cx = K.at<float>(0,2);
-        cy = K.at<float>(1,2);
-        invfx = 1.0f/fx;
-        invfy = 1.0f/fy;
-
-        mbInitialComputations=false;
-    }
-
     mb = mbf/fx;
 
     AssignFeaturesToGrid();
 }
 
 
-Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
+Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, SystemContext* pContext)
     :mpORBvocabulary(voc),mpORBextractorLeft(extractor),mpORBextractorRight(static_cast<ORBextractor*>(NULL)),
-     mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth)
+     mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth), mpContext(pContext)
 {
     // Frame ID
-    mnId=nNextId++;
+    mnId=mpContext->NewFrameId();
 
     // Scale Level Info
     mnScaleLevels = mpORBextractorLeft->GetLevels();
@@ -563,6 +539,9 @@ Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extra
 
     N = mvKeys.size();
 
+    // Calibration is set even on empty frames, they can still be copied into mLastFrame
+    SetCalibration(imGray,K);
+
     if(mvKeys.empty())
         return;
 
@@ -575,44 +554,54 @@ Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extra
     mvpMapPoints = vector<MapPoint*>(N,static_cast<MapPoint*>(NULL));
     mvbOutlier = vector<bool>(N,false);
 
+    mb = mbf/fx;
+
+    AssignFeaturesToGrid();
+}
+
+void Frame::SetCalibration(const cv::Mat &im, const cv::Mat &K)
+{
     // This is done only for the first Frame (or after a change in the calibration)
-    if(mbInitialComputations)
+    if(mpContext->mbInitialComputations)
     {
-        ComputeImageBounds(imGray);
+        ComputeImageBounds(im);
 
-        mfGridElementWidthInv=static_cast<float>(FRAME_GRID_COLS)/static_cast<float>(mnMaxX-mnMinX);
-        mfGridElementHeightInv=static_cast<float>(FRAME_GRID_ROWS)/static_cast<float>(mnMaxY-mnMinY);
+        mpContext->mnMinX = mnMinX;
+        mpContext->mnMaxX = mnMaxX;
+        mpContext->mnMinY = mnMinY;
+        mpContext->mnMaxY = mnMaxY;
 
-        fx = K.at<float>(0,0);
-        fy = K.at<float>(1,1);
-        cx = K.at<float>(0,2);
-        cy = K.at<float>(1,2);
-        invfx = 1.0f/fx;
-        invfy = 1.0f/fy;
+        mpContext->mfGridElementWidthInv=static_cast<float>(FRAME_GRID_COLS)/static_cast<float>(mnMaxX-mnMinX);
+        mpContext->mfGridElementHeightInv=static_cast<float>(FRAME_GRID_ROWS)/static_cast<float>(mnMaxY-mnMinY);
 
-        mbInitialComputations=false;
-    }
+        mpContext->fx = K.at<float>(0,0);
+        mpContext->fy = K.at<float>(1,1);
+        mpContext->cx = K.at<float>(0,2);
+        mpContext->cy = K.at<float>(1,2);
+        mpContext->invfx = 1.0f/mpContext->fx;
+        mpContext->invfy = 1.0f/mpContext->fy;
 
-    mb = mbf/fx;
+        mpContext->mbInitialComputations=false;
+    }
 
-    AssignFeaturesToGrid();
+    mnMinX = mpContext->mnMinX;
+    mnMaxX = mpContext->mnMaxX;
+    mnMinY = mpContext->mnMinY;
+    mnMaxY = mpContext->mnMaxY;
+    mfGridElementWidthInv = mpContext->mfGridElementWidthInv;
+    mfGridElementHeightInv = mpContext->mfGridElementHeightInv;
+
+    fx = mpContext->fx;
+    fy = mpContext->fy;
+    cx = mpContext->cx;
+    cy = mpContext->cy;
+    invfx = mpContext->invfx;
+    invfy = mpContext->invfy;
 }
 
 void Frame::AssignFeaturesToGrid()
 {
-    int nReserve = 0.5f*N/(FRAME_GRID_COLS*FRAME_GRID_ROWS);
-    for(unsigned int i=0; i<FRAME_GRID_COLS;i++)
-        for (unsigned int j=0; j<FRAME_GRID_ROWS;j++)
-            mGrid[i][j].reserve(nReserve);
-
-    for(int i=0;i<N;i++)
-    {
-        const cv::KeyPoint &kp = mvKeysUn[i];
-
-        int nGridPosX, nGridPosY;
-        if(PosInGrid(kp,nGridPosX,nGridPosY))
-            mGrid[nGridPosX][nGridPosY].push_back(i);
-    }
+    mGrid.Assign(mvKeysUn,mnMinX,mnMinY,mfGridElementWidthInv,mfGridElementHeightInv);
 }
 
 void Frame::ExtractORB(int flag, const cv::Mat &im)
@@ -654,13 +643,15 @@ bool Frame::isInFrustum(MapPoint *pMP, float viewingCosLimit)
     pMP->mbTrackInView = false;
 
     // 3D in absolute coordinates
-    cv::Mat P = pMP->GetWorldPos();
+    const cv::Matx31f P = pMP->GetWorldPos3f();
 
     // 3D in camera coordinates
-    const cv::Mat Pc = mRcw*P+mtcw;
-    const float &PcX = Pc.at<float>(0);
-    const float &PcY= Pc.at<float>(1);
-    const float &PcZ = Pc.at<float>(2);
+    const float* T0 = mTcw.ptr<float>(0);
+    const float* T1 = mTcw.ptr<float>(1);
+    const float* T2 = mTcw.ptr<float>(2);
+    const float PcX = T0[0]*P(0)+T0[1]*P(1)+T0[2]*P(2)+T0[3];
+    const float PcY = T1[0]*P(0)+T1[1]*P(1)+T1[2]*P(2)+T1[3];
+    const float PcZ = T2[0]*P(0)+T2[1]*P(1)+T2[2]*P(2)+T2[3];
 
     // Check positive depth
     if(PcZ<0.0f)
@@ -679,14 +670,14 @@ bool Frame::isInFrustum(MapPoint *pMP, float viewingCosLimit)
     // Check distance is in the scale invariance region of the MapPoint
     const float maxDistance = pMP->GetMaxDistanceInvariance();
     const float minDistance = pMP->GetMinDistanceInvariance();
-    const cv::Mat PO = P-mOw;
+    const cv::Matx31f PO(P(0)-mOw.at<float>(0),P(1)-mOw.at<float>(1),P(2)-mOw.at<float>(2));
     const float dist = cv::norm(PO);
 
     if(dist<minDistance || dist>maxDistance)
         return false;
 
    // Check viewing angle
-    cv::Mat Pn = pMP->GetNormal();
+    const cv::Matx31f Pn = pMP->GetNormal3f();
 
     const float viewCos = PO.dot(Pn)/dist;
 
@@ -710,68 +701,19 @@ bool Frame::isInFrustum(MapPoint *pMP, float viewingCosLimit)
 vector<size_t> Frame::GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel) const
 {
     vector<size_t> vIndices;
-    vIndices.reserve(N);
-
-    const int nMinCellX = max(0,(int)floor((x-mnMinX-r)*mfGridElementWidthInv));
-    if(nMinCellX>=FRAME_GRID_COLS)
-        return vIndices;
-
-    const int nMaxCellX = min((int)FRAME_GRID_COLS-1,(int)ceil((x-mnMinX+r)*mfGridElementWidthInv));
-    if(nMaxCellX<0)
-        return vIndices;
-
-    const int nMinCellY = max(0,(int)floor((y-mnMinY-r)*mfGridElementHeightInv));
-    if(nMinCellY>=FRAME_GRID_ROWS)
-        return vIndices;
-
-    const int nMaxCellY = min((int)FRAME_GRID_ROWS-1,(int)ceil((y-mnMinY+r)*mfGridElementHeightInv));
-    if(nMaxCellY<0)
-        return vIndices;
-
-    const bool bCheckLevels = (minLevel>0) || (maxLevel>=0);
-
-    for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
-    {
-        for(int iy = nMinCellY; iy<=nMaxCellY; iy++)
-        {
-            const vector<size_t> vCell = mGrid[ix][iy];
-            if(vCell.empty())
-                continue;
-
-            for(size_t j=0, jend=vCell.size(); j<jend; j++)
-            {
-                const cv::KeyPoint &kpUn = mvKeysUn[vCell[j]];
-                if(bCheckLevels)
-                {
-                    if(kpUn.octave<minLevel)
-                        continue;
-                    if(maxLevel>=0)
-                        if(kpUn.octave>maxLevel)
-                            continue;
-                }
-
-                const float distx = kpUn.pt.x-x;
-                const float disty = kpUn.pt.y-y;
-
-                if(fabs(distx)<r && fabs(disty)<r)
-                    vIndices.push_back(vCell[j]);
-            }
-        }
-    }
-
+    mGrid.GetFeaturesInArea(mvKeysUn,x,y,r,minLevel,maxLevel,vIndices);
     return vIndices;
 }
 
-bool Frame::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY)
+void Frame::GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel,
+                              vector<size_t> &vIndices) const
 {
-    posX = round((kp.pt.x-mnMinX)*mfGridElementWidthInv);
-    posY = round((kp.pt.y-mnMinY)*mfGridElementHeightInv);
-
-    //Keypoint's coordinates are undistorted, which could cause to go out of the image
-    if(posX<0 || posX>=FRAME_GRID_COLS || posY<0 || posY>=FRAME_GRID_ROWS)
-        return false;
+    mGrid.GetFeaturesInArea(mvKeysUn,x,y,r,minLevel,maxLevel,vIndices);
+}
 
-    return true;
+bool Frame::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY)
+{
+    return mGrid.PosInGrid(kp,posX,posY);
 }
 
 
@@ -780,7 +722,13 @@ void Frame::ComputeBoW()
     if(mBowVec.empty())
     {
         vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
+
+        // The descriptors descend the vocabulary tree in parallel on the extractors' scheduler
+        Scheduler* pScheduler = mpORBextractorLeft ? mpORBextractorLeft->GetScheduler() : static_cast<Scheduler*>(NULL);
+        if(pScheduler)
+            mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4,&Scheduler::RangeParallelFor,pScheduler);
+        else
+            mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
     }
 }
 
@@ -24,18 +24,24 @@
 
 #include "Optimizer.h"
 #include "ORBmatcher.h"
+#include "Scheduler.h"
+#include "Converter.h"
 
-#include<thread>
+#include<Eigen/Dense>
 
 namespace ORB_SLAM2
 {
 
-Initializer::Initializer(const Frame &ReferenceFrame, float sigma, int iterations)
+Initializer::Initializer(const Frame &ReferenceFrame, float sigma, int iterations, Scheduler* pScheduler):
+    mpScheduler(pScheduler)
 {
     mK = ReferenceFrame.mK.clone();
 
     mvKeys1 = ReferenceFrame.mvKeysUn;
 
+    // The reference keypoints are normalized once for all the calls to Initialize
+    Normalize(mvKeys1,mPn1,mT1);
+
     mSigma = sigma;
     mSigma2 = sigma*sigma;
     mMaxIterations = iterations;
@@ -50,6 +56,7 @@ bool Initializer::Initialize(const Frame &CurrentFrame, const vector<int> &vMatc
 
     mvMatches12.clear();
     mvMatches12.reserve(mvKeys2.size());
+    mvU1.clear(); mvV1.clear(); mvU2.clear(); mvV2.clear();
     mvbMatched1.resize(mvKeys1.size());
     for(size_t i=0, iend=vMatches12.size();i<iend; i++)
     {
@@ -57,6 +64,11 @@ bool Initializer::Initialize(const Frame &CurrentFrame, const vector<int> &vMatc
         {
             mvMatches12.push_back(make_pair(i,vMatches12[i]));
             mvbMatched1[i]=true;
+
+            mvU1.push_back(mvKeys1[i].pt.x);
+            mvV1.push_back(mvKeys1[i].pt.y);
+            mvU2.push_back(mvKeys2[vMatches12[i]].pt.x);
+            mvV2.push_back(mvKeys2[vMatches12[i]].pt.y);
         }
         else
             mvbMatched1[i]=false;
@@ -64,6 +76,9 @@ bool Initializer::Initialize(const Frame &CurrentFrame, const vector<int> &vMatc
 
     const int N = mvMatches12.size();
 
+    // Normalize coordinates of the current keypoints
+    Normalize(mvKeys2,mPn2,mT2);
+
     // Indices for minimum set selection
     vector<size_t> vAllIndices;
     vAllIndices.reserve(N);
@@ -96,17 +111,23 @@ bool Initializer::Initialize(const Frame &CurrentFrame, const vector<int> &vMatc
         }
     }
 
-    // Launch threads to compute in parallel a fundamental matrix and a homography
+    // Compute in parallel a fundamental matrix and a homography
     vector<bool> vbMatchesInliersH, vbMatchesInliersF;
     float SH, SF;
     cv::Mat H, F;
 
-    thread threadH(&Initializer::FindHomography,this,ref(vbMatchesInliersH), ref(SH), ref(H));
-    thread threadF(&Initializer::FindFundamental,this,ref(vbMatchesInliersF), ref(SF), ref(F));
-
-    // Wait until both threads have finished
-    threadH.join();
-    threadF.join();
+    if(mpScheduler)
+    {
+        TaskGroup models(mpScheduler);
+        models.Run([&]() { FindFundamental(vbMatchesInliersF,SF,F); });
+        FindHomography(vbMatchesInliersH,SH,H);
+        models.Wait();
+    }
+    else
+    {
+        FindHomography(vbMatchesInliersH,SH,H);
+        FindFundamental(vbMatchesInliersF,SF,F);
+    }
 
     // Compute ratio of scores
     float RH = SH/(SH+SF);
@@ -126,230 +147,249 @@ void Initializer::FindHomography(vector<bool> &vbMatchesInliers, float &score, c
     // Number of putative matches
     const int N = mvMatches12.size();
 
-    // Normalize coordinates
-    vector<cv::Point2f> vPn1, vPn2;
-    cv::Mat T1, T2;
-    Normalize(mvKeys1,vPn1, T1);
-    Normalize(mvKeys2,vPn2, T2);
-    cv::Mat T2inv = T2.inv();
-
-    // Best Results variables
-    score = 0.0;
-    vbMatchesInliers = vector<bool>(N,false);
-
-    // Iteration variables
-    vector<cv::Point2f> vPn1i(8);
-    vector<cv::Point2f> vPn2i(8);
-    cv::Mat H21i, H12i;
-    vector<bool> vbCurrentInliers(N,false);
-    float currentScore;
+    const Eigen::Matrix3f T2inv = mT2.inverse();
 
     // Perform all RANSAC iterations and save the solution with highest score
-    for(int it=0; it<mMaxIterations; it++)
+    Eigen::Matrix3f H21best;
+    const bool bFound = FindBestHypothesis([&](const int it, Eigen::Matrix3f &H21i, ModelScore &currentScore)
     {
         // Select a minimum set
+        MinimalSet Pn1i, Pn2i;
         for(size_t j=0; j<8; j++)
         {
             int idx = mvSets[it][j];
 
-            vPn1i[j] = vPn1[mvMatches12[idx].first];
-            vPn2i[j] = vPn2[mvMatches12[idx].second];
+            Pn1i.col(j) = mPn1.col(mvMatches12[idx].first);
+            Pn2i.col(j) = mPn2.col(mvMatches12[idx].second);
         }
 
-        cv::Mat Hn = ComputeH21(vPn1i,vPn2i);
-        H21i = T2inv*Hn*T1;
-        H12i = H21i.inv();
+        H21i = T2inv*ComputeH21(Pn1i,Pn2i)*mT1;
 
-        currentScore = CheckHomography(H21i, H12i, vbCurrentInliers, mSigma);
+        return CheckHomography(H21i,H21i.inverse(),currentScore,mSigma);
+    },mvHomographyScores,H21best,score);
 
-        if(currentScore>score)
-        {
-            H21 = H21i.clone();
-            vbMatchesInliers = vbCurrentInliers;
-            score = currentScore;
-        }
+    vbMatchesInliers = vector<bool>(N,false);
+    if(!bFound)
+    {
+        H21 = cv::Mat();
+        return;
     }
+
+    ModelScore &bestScore = mvHomographyScores[0];
+    CheckHomography(H21best,H21best.inverse(),bestScore,mSigma);
+    for(int i=0; i<N; i++)
+        vbMatchesInliers[i] = bestScore.vbInliers[i];
+
+    const Eigen::Matrix3d H = H21best.cast<double>();
+    H21 = Converter::toCvMat(H);
 }
 
 
 void Initializer::FindFundamental(vector<bool> &vbMatchesInliers, float &score, cv::Mat &F21)
 {
     // Number of putative matches
-    const int N = vbMatchesInliers.size();
-
-    // Normalize coordinates
-    vector<cv::Point2f> vPn1, vPn2;
-    cv::Mat T1, T2;
-    Normalize(mvKeys1,vPn1, T1);
-    Normalize(mvKeys2,vPn2, T2);
-    cv::Mat T2t = T2.t();
-
-    // Best Results variables
-    score = 0.0;
-    vbMatchesInliers = vector<bool>(N,false);
+    const int N = mvMatches12.size();
 
-    // Iteration variables
-    vector<cv::Point2f> vPn1i(8);
-    vector<cv::Point2f> vPn2i(8);
-    cv::Mat F21i;
-    vector<bool> vbCurrentInliers(N,false);
-    float currentScore;
+    const Eigen::Matrix3f T2t = mT2.transpose();
 
     // Perform all RANSAC iterations and save the solution with highest score
-    for(int it=0; it<mMaxIterations; it++)
+    Eigen::Matrix3f F21best;
+    const bool bFound = FindBestHypothesis([&](const int it, Eigen::Matrix3f &F21i, ModelScore &currentScore)
     {
         // Select a minimum set
+        MinimalSet Pn1i, Pn2i;
         for(int j=0; j<8; j++)
         {
             int idx = mvSets[it][j];
 
-            vPn1i[j] = vPn1[mvMatches12[idx].first];
-            vPn2i[j] = vPn2[mvMatches12[idx].second];
+            Pn1i.col(j) = mPn1.col(mvMatches12[idx].first);
+            Pn2i.col(j) = mPn2.col(mvMatches12[idx].second);
         }
 
-        cv::Mat Fn = ComputeF21(vPn1i,vPn2i);
+        F21i = T2t*ComputeF21(Pn1i,Pn2i)*mT1;
 
-        F21i = T2t*Fn*T1;
+        return CheckFundamental(F21i,currentScore,mSigma);
+    },mvFundamentalScores,F21best,score);
 
-        currentScore = CheckFundamental(F21i, vbCurrentInliers, mSigma);
+    vbMatchesInliers = vector<bool>(N,false);
+    if(!bFound)
+    {
+        F21 = cv::Mat();
+        return;
+    }
+
+    ModelScore &bestScore = mvFundamentalScores[0];
+    CheckFundamental(F21best,bestScore,mSigma);
+    for(int i=0; i<N; i++)
+        vbMatchesInliers[i] = bestScore.vbInliers[i];
+
+    const Eigen::Matrix3d F = F21best.cast<double>();
+    F21 = Converter::toCvMat(F);
+}
+
+
+bool Initializer::FindBestHypothesis(const Hypothesis &hypothesis, vector<ModelScore> &vScoreBuffers,
+                                     Eigen::Matrix3f &bestModel, float &bestScore)
+{
+    const int N = mvMatches12.size();
+    const int nChunks = mpScheduler ? min(mpScheduler->Concurrency(),mMaxIterations) : 1;
+
+    if((int)vScoreBuffers.size()<nChunks)
+        vScoreBuffers.resize(nChunks);
+    for(int c=0; c<nChunks; c++)
+    {
+        vScoreBuffers[c].vScores.resize(N);
+        vScoreBuffers[c].vbInliers.resize(N);
+    }
 
-        if(currentScore>score)
+    // Best hypothesis of each chunk
+    vector<float> vBestScores(nChunks,0.0f);
+    vector<Eigen::Matrix3f> vBestModels(nChunks);
+
+    auto search = [&](int begin, int end, int chunk)
+    {
+        Eigen::Matrix3f model;
+        for(int it=begin; it<end; it++)
+        {
+            const float currentScore = hypothesis(it,model,vScoreBuffers[chunk]);
+
+            if(currentScore>vBestScores[chunk])
+            {
+                vBestScores[chunk] = currentScore;
+                vBestModels[chunk] = model;
+            }
+        }
+    };
+
+    if(mpScheduler)
+        mpScheduler->ParallelFor(mMaxIterations,search,nChunks);
+    else
+        search(0,mMaxIterations,0);
+
+    // Chunks cover consecutive iterations in order, so the first maximum is the earliest iteration
+    bool bFound = false;
+    bestScore = 0.0f;
+    for(int c=0; c<nChunks; c++)
+    {
+        if(vBestScores[c]>bestScore)
         {
-            F21 = F21i.clone();
-            vbMatchesInliers = vbCurrentInliers;
-            score = currentScore;
+            bestScore = vBestScores[c];
+            bestModel = vBestModels[c];
+            bFound = true;
         }
     }
+
+    return bFound;
 }
 
 
-cv::Mat Initializer::ComputeH21(const vector<cv::Point2f> &vP1, const vector<cv::Point2f> &vP2)
+Eigen::Matrix3f Initializer::ComputeH21(const MinimalSet &P1, const MinimalSet &P2)
 {
-    const int N = vP1.size();
+    Eigen::Matrix<float,16,9> A;
 
-    cv::Mat A(2*N,9,CV_32F);
-
-    for(int i=0; i<N; i++)
+    for(int i=0; i<8; i++)
     {
-        const float u1 = vP1[i].x;
-        const float v1 = vP1[i].y;
-        const float u2 = vP2[i].x;
-        const float v2 = vP2[i].y;
-
-        A.at<float>(2*i,0) = 0.0;
-        A.at<float>(2*i,1) = 0.0;
-        A.at<float>(2*i,2) = 0.0;
-        A.at<float>(2*i,3) = -u1;
-        A.at<float>(2*i,4) = -v1;
-        A.at<float>(2*i,5) = -1;
-        A.at<float>(2*i,6) = v2*u1;
-        A.at<float>(2*i,7) = v2*v1;
-        A.at<float>(2*i,8) = v2;
-
-        A.at<float>(2*i+1,0) = u1;
-        A.at<float>(2*i+1,1) = v1;
-        A.at<float>(2*i+1,2) = 1;
-        A.at<float>(2*i+1,3) = 0.0;
-        A.at<float>(2*i+1,4) = 0.0;
-        A.at<float>(2*i+1,5) = 0.0;
-        A.at<float>(2*i+1,6) = -u2*u1;
-        A.at<float>(2*i+1,7) = -u2*v1;
-        A.at<float>(2*i+1,8) = -u2;
+        const float u1 = P1(0,i);
+        const float v1 = P1(1,i);
+        const float u2 = P2(0,i);
+        const float v2 = P2(1,i);
 
+        A.row(2*i) << 0.0, 0.0, 0.0, -u1, -v1, -1, v2*u1, v2*v1, v2;
+        A.row(2*i+1) << u1, v1, 1, 0.0, 0.0, 0.0, -u2*u1, -u2*v1, -u2;
     }
 
-    cv::Mat u,w,vt;
+    // Right singular vector of the smallest singular value, rows of H21 one after the other
+    Eigen::JacobiSVD<Eigen::Matrix<float,16,9> > svd(A,Eigen::ComputeFullV);
+    const Eigen::Matrix<float,9,1> h = svd.matrixV().col(8);
 
-    cv::SVDecomp(A,w,u,vt,cv::SVD::MODIFY_A | cv::SVD::FULL_UV);
+    Eigen::Matrix3f H;
+    H << h(0), h(1), h(2),
+         h(3), h(4), h(5),
+         h(6), h(7), h(8);
 
-    return vt.row(8).reshape(0, 3);
+    return H;
 }
 
-cv::Mat Initializer::ComputeF21(const vector<cv::Point2f> &vP1,const vector<cv::Point2f> &vP2)
+Eigen::Matrix3f Initializer::ComputeF21(const MinimalSet &P1, const MinimalSet &P2)
 {
-    const int N = vP1.size();
+    // The last row stays zero, so that the system is square and has a full V
+    Eigen::Matrix<float,9,9> A = Eigen::Matrix<float,9,9>::Zero();
 
-    cv::Mat A(N,9,CV_32F);
-
-    for(int i=0; i<N; i++)
+    for(int i=0; i<8; i++)
     {
-        const float u1 = vP1[i].x;
-        const float v1 = vP1[i].y;
-        const float u2 = vP2[i].x;
-        const float v2 = vP2[i].y;
-
-        A.at<float>(i,0) = u2*u1;
-        A.at<float>(i,1) = u2*v1;
-        A.at<float>(i,2) = u2;
-        A.at<float>(i,3) = v2*u1;
-        A.at<float>(i,4) = v2*v1;
-        A.at<float>(i,5) = v2;
-        A.at<float>(i,6) = u1;
-        A.at<float>(i,7) = v1;
-        A.at<float>(i,8) = 1;
-    }
+        const float u1 = P1(0,i);
+        const float v1 = P1(1,i);
+        const float u2 = P2(0,i);
+        const float v2 = P2(1,i);
 
-    cv::Mat u,w,vt;
+        A.row(i) << u2*u1, u2*v1, u2, v2*u1, v2*v1, v2, u1, v1, 1;
+    }
 
-    cv::SVDecomp(A,w,u,vt,cv::SVD::MODIFY_A | cv::SVD::FULL_UV);
+    Eigen::JacobiSVD<Eigen::Matrix<float,9,9> > svd(A,Eigen::ComputeFullV);
+    const Eigen::Matrix<float,9,1> f = svd.matrixV().col(8);
 
-    cv::Mat Fpre = vt.row(8).reshape(0, 3);
+    Eigen::Matrix3f Fpre;
+    Fpre << f(0), f(1), f(2),
+            f(3), f(4), f(5),
+            f(6), f(7), f(8);
 
-    cv::SVDecomp(Fpre,w,u,vt,cv::SVD::MODIFY_A | cv::SVD::FULL_UV);
+    // Enforce rank 2
+    Eigen::JacobiSVD<Eigen::Matrix3f> svd2(Fpre,Eigen::ComputeFullU | Eigen::ComputeFullV);
+    Eigen::Vector3f w = svd2.singularValues();
 
-    w.at<float>(2)=0;
+    w(2)=0;
 
-    return  u*cv::Mat::diag(w)*vt;
+    return svd2.matrixU()*w.asDiagonal()*svd2.matrixV().transpose();
 }
 
-float Initializer::CheckHomography(const cv::Mat &H21, const cv::Mat &H12, vector<bool> &vbMatchesInliers, float sigma)
+float Initializer::CheckHomography(const Eigen::Matrix3f &H21, const Eigen::Matrix3f &H12, ModelScore &score, float sigma)
 {   
     const int N = mvMatches12.size();
 
-    const float h11 = H21.at<float>(0,0);
-    const float h12 = H21.at<float>(0,1);
-    const float h13 = H21.at<float>(0,2);
-    const float h21 = H21.at<float>(1,0);
-    const float h22 = H21.at<float>(1,1);
-    const float h23 = H21.at<float>(1,2);
-    const float h31 = H21.at<float>(2,0);
-    const float h32 = H21.at<float>(2,1);
-    const float h33 = H21.at<float>(2,2);
-
-    const float h11inv = H12.at<float>(0,0);
-    const float h12inv = H12.at<float>(0,1);
-    const float h13inv = H12.at<float>(0,2);
-    const float h21inv = H12.at<float>(1,0);
-    const float h22inv = H12.at<float>(1,1);
-    const float h23inv = H12.at<float>(1,2);
-    const float h31inv = H12.at<float>(2,0);
-    const float h32inv = H12.at<float>(2,1);
-    const float h33inv = H12.at<float>(2,2);
-
-    vbMatchesInliers.resize(N);
-
-    float score = 0;
+    const float h11 = H21(0,0);
+    const float h12 = H21(0,1);
+    const float h13 = H21(0,2);
+    const float h21 = H21(1,0);
+    const float h22 = H21(1,1);
+    const float h23 = H21(1,2);
+    const float h31 = H21(2,0);
+    const float h32 = H21(2,1);
+    const float h33 = H21(2,2);
+
+    const float h11inv = H12(0,0);
+    const float h12inv = H12(0,1);
+    const float h13inv = H12(0,2);
+    const float h21inv = H12(1,0);
+    const float h22inv = H12(1,1);
+    const float h23inv = H12(1,2);
+    const float h31inv = H12(2,0);
+    const float h32inv = H12(2,1);
+    const float h33inv = H12(2,2);
 
     const float th = 5.991;
 
     const float invSigmaSquare = 1.0/(sigma*sigma);
 
+    const float* pU1 = mvU1.data();
+    const float* pV1 = mvV1.data();
+    const float* pU2 = mvU2.data();
+    const float* pV2 = mvV2.data();
+    float* pScores = score.vScores.data();
+    unsigned char* pbInliers = score.vbInliers.data();
+
+    // Branch-free over contiguous arrays so that it vectorizes. The score of each match
+    // is stored and summed afterwards, as the compiler does not reorder float sums.
     for(int i=0; i<N; i++)
     {
-        bool bIn = true;
-
-        const cv::KeyPoint &kp1 = mvKeys1[mvMatches12[i].first];
-        const cv::KeyPoint &kp2 = mvKeys2[mvMatches12[i].second];
-
-        const float u1 = kp1.pt.x;
-        const float v1 = kp1.pt.y;
-        const float u2 = kp2.pt.x;
-        const float v2 = kp2.pt.y;
+        const float u1 = pU1[i];
+        const float v1 = pV1[i];
+        const float u2 = pU2[i];
+        const float v2 = pV2[i];
 
         // Reprojection error in first image
         // x2in1 = H12*x2
 
-        const float w2in1inv = 1.0/(h31inv*u2+h32inv*v2+h33inv);
+        const float w2in1inv = 1.0f/(h31inv*u2+h32inv*v2+h33inv);
         const float u2in1 = (h11inv*u2+h12inv*v2+h13inv)*w2in1inv;
         const float v2in1 = (h21inv*u2+h22inv*v2+h23inv)*w2in1inv;
 
@@ -357,15 +397,10 @@ float Initializer::CheckHomography(const cv::Mat &H21, const cv::Mat &H12, vecto
 
         const float chiSquare1 = squareDist1*invSigmaSquare;
 
-        if(chiSquare1>th)
-            bIn = false;
-        else
-            score += th - chiSquare1;
-
         // Reprojection error in second image
         // x1in2 = H21*x1
 
-        const float w1in2inv = 1.0/(h31*u1+h32*v1+h33);
+        const float w1in2inv = 1.0f/(h31*u1+h32*v1+h33);
         const float u1in2 = (h11*u1+h12*v1+h13)*w1in2inv;
         const float v1in2 = (h21*u1+h22*v1+h23)*w1in2inv;
 
@@ -373,54 +408,49 @@ float Initializer::CheckHomography(const cv::Mat &H21, const cv::Mat &H12, vecto
 
         const float chiSquare2 = squareDist2*invSigmaSquare;
 
-        if(chiSquare2>th)
-            bIn = false;
-        else
-            score += th - chiSquare2;
+        const bool bIn1 = chiSquare1<=th;
+        const bool bIn2 = chiSquare2<=th;
 
-        if(bIn)
-            vbMatchesInliers[i]=true;
-        else
-            vbMatchesInliers[i]=false;
+        pScores[i] = (bIn1 ? th-chiSquare1 : 0.0f) + (bIn2 ? th-chiSquare2 : 0.0f);
+        pbInliers[i] = bIn1 && bIn2;
     }
 
-    return score;
+    return Eigen::Map<const Eigen::ArrayXf>(pScores,N).sum();
 }
 
-float Initializer::CheckFundamental(const cv::Mat &F21, vector<bool> &vbMatchesInliers, float sigma)
+float Initializer::CheckFundamental(const Eigen::Matrix3f &F21, ModelScore &score, float sigma)
 {
     const int N = mvMatches12.size();
 
-    const float f11 = F21.at<float>(0,0);
-    const float f12 = F21.at<float>(0,1);
-    const float f13 = F21.at<float>(0,2);
-    const float f21 = F21.at<float>(1,0);
-    const float f22 = F21.at<float>(1,1);
-    const float f23 = F21.at<float>(1,2);
-    const float f31 = F21.at<float>(2,0);
-    const float f32 = F21.at<float>(2,1);
-    const float f33 = F21.at<float>(2,2);
-
-    vbMatchesInliers.resize(N);
-
-    float score = 0;
+    const float f11 = F21(0,0);
+    const float f12 = F21(0,1);
+    const float f13 = F21(0,2);
+    const float f21 = F21(1,0);
+    const float f22 = F21(1,1);
+    const float f23 = F21(1,2);
+    const float f31 = F21(2,0);
+    const float f32 = F21(2,1);
+    const float f33 = F21(2,2);
 
     const float th = 3.841;
     const float thScore = 5.991;
 
     const float invSigmaSquare = 1.0/(sigma*sigma);
 
+    const float* pU1 = mvU1.data();
+    const float* pV1 = mvV1.data();
+    const float* pU2 = mvU2.data();
+    const float* pV2 = mvV2.data();
+    float* pScores = score.vScores.data();
+    unsigned char* pbInliers = score.vbInliers.data();
+
+    // Same layout as CheckHomography
     for(int i=0; i<N; i++)
     {
-        bool bIn = true;
-
-        const cv::KeyPoint &kp1 = mvKeys1[mvMatches12[i].first];
-        const cv::KeyPoint &kp2 = mvKeys2[mvMatches12[i].second];
-
-        const float u1 = kp1.pt.x;
-        const float v1 = kp1.pt.y;
-        const float u2 = kp2.pt.x;
-        const float v2 = kp2.pt.y;
+        const float u1 = pU1[i];
+        const float v1 = pV1[i];
+        const float u2 = pU2[i];
+        const float v2 = pV2[i];
 
         // Reprojection error in second image
         // l2=F21x1=(a2,b2,c2)
@@ -435,11 +465,6 @@ float Initializer::CheckFundamental(const cv::Mat &F21, vector<bool> &vbMatchesI
 
         const float chiSquare1 = squareDist1*invSigmaSquare;
 
-        if(chiSquare1>th)
-            bIn = false;
-        else
-            score += thScore - chiSquare1;
-
         // Reprojection error in second image
         // l1 =x2tF21=(a1,b1,c1)
 
@@ -453,18 +478,14 @@ float Initializer::CheckFundamental(const cv::Mat &F21, vector<bool> &vbMatchesI
 
         const float chiSquare2 = squareDist2*invSigmaSquare;
 
-        if(chiSquare2>th)
-            bIn = false;
-        else
-            score += thScore - chiSquare2;
+        const bool bIn1 = chiSquare1<=th;
+        const bool bIn2 = chiSquare2<=th;
 
-        if(bIn)
-            vbMatchesInliers[i]=true;
-        else
-            vbMatchesInliers[i]=false;
+        pScores[i] = (bIn1 ? thScore-chiSquare1 : 0.0f) + (bIn2 ? thScore-chiSquare2 : 0.0f);
+        pbInliers[i] = bIn1 && bIn2;
     }
 
-    return score;
+    return Eigen::Map<const Eigen::ArrayXf>(pScores,N).sum();
 }
 
 bool Initializer::ReconstructF(vector<bool> &vbMatchesInliers, cv::Mat &F21, cv::Mat &K,
@@ -746,13 +767,13 @@ void Initializer::Triangulate(const cv::KeyPoint &kp1, const cv::KeyPoint &kp2,
     x3D = x3D.rowRange(0,3)/x3D.at<float>(3);
 }
 
-void Initializer::Normalize(const vector<cv::KeyPoint> &vKeys, vector<cv::Point2f> &vNormalizedPoints, cv::Mat &T)
+void Initializer::Normalize(const vector<cv::KeyPoint> &vKeys, Eigen::Matrix<float,2,Eigen::Dynamic> &Pn, Eigen::Matrix3f &T)
 {
     float meanX = 0;
     float meanY = 0;
     const int N = vKeys.size();
 
-    vNormalizedPoints.resize(N);
+    Pn.resize(2,N);
 
     for(int i=0; i<N; i++)
     {
@@ -768,11 +789,11 @@ void Initializer::Normalize(const vector<cv::KeyPoint> &vKeys, vector<cv::Point2
 
     for(int i=0; i<N; i++)
     {
-        vNormalizedPoints[i].x = vKeys[i].pt.x - meanX;
-        vNormalizedPoints[i].y = vKeys[i].pt.y - meanY;
+        Pn(0,i) = vKeys[i].pt.x - meanX;
+        Pn(1,i) = vKeys[i].pt.y - meanY;
 
-        meanDevX += fabs(vNormalizedPoints[i].x);
-        meanDevY += fabs(vNormalizedPoints[i].y);
+        meanDevX += fabs(Pn(0,i));
+        meanDevY += fabs(Pn(1,i));
     }
 
     meanDevX = meanDevX/N;
@@ -781,20 +802,14 @@ void Initializer::Normalize(const vector<cv::KeyPoint> &vKeys, vector<cv::Point2
     float sX = 1.0/meanDevX;
     float sY = 1.0/meanDevY;
 
-    for(int i=0; i<N; i++)
-    {
-        vNormalizedPoints[i].x = vNormalizedPoints[i].x * sX;
-        vNormalizedPoints[i].y = vNormalizedPoints[i].y * sY;
-    }
+    Pn.row(0) *= sX;
+    Pn.row(1) *= sY;
 
-    T = cv::Mat::eye(3,3,CV_32F);
-    T.at<float>(0,0) = sX;
-    T.at<float>(1,1) = sY;
-    T.at<float>(0,2) = -meanX*sX;
-    T.at<float>(1,2) = -meanY*sY;
+    T << sX, 0, -meanX*sX,
+         0, sY, -meanY*sY,
+         0, 0, 1;
 }
 
-
 int Initializer::CheckRT(const cv::Mat &R, const cv::Mat &t, const vector<cv::KeyPoint> &vKeys1, const vector<cv::KeyPoint> &vKeys2,
                        const vector<Match> &vMatches12, vector<bool> &vbMatchesInliers,
                        const cv::Mat &K, vector<cv::Point3f> &vP3D, float th2, vector<bool> &vbGood, float &parallax)
@@ -21,18 +21,17 @@
 #include "KeyFrame.h"
 #include "Converter.h"
 #include "ORBmatcher.h"
+#include "Scheduler.h"
 #include<mutex>
 
 namespace ORB_SLAM2
 {
 
-long unsigned int KeyFrame::nNextId=0;
-
 KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
-    mnFrameId(F.mnId),  mTimeStamp(F.mTimeStamp), mnGridCols(FRAME_GRID_COLS), mnGridRows(FRAME_GRID_ROWS),
+    mpContext(F.mpContext), mnFrameId(F.mnId),  mTimeStamp(F.mTimeStamp), mnGridCols(FRAME_GRID_COLS), mnGridRows(FRAME_GRID_ROWS),
     mfGridElementWidthInv(F.mfGridElementWidthInv), mfGridElementHeightInv(F.mfGridElementHeightInv),
     mnTrackReferenceForFrame(0), mnFuseTargetForKF(0), mnBALocalForKF(0), mnBAFixedForKF(0),
-    mnLoopQuery(0), mnLoopWords(0), mnRelocQuery(0), mnRelocWords(0), mnBAGlobalForKF(0),
+    mnBAGlobalForKF(0),
     fx(F.fx), fy(F.fy), cx(F.cx), cy(F.cy), invfx(F.invfx), invfy(F.invfy),
     mbf(F.mbf), mb(F.mb), mThDepth(F.mThDepth), N(F.N), mvKeys(F.mvKeys), mvKeysUn(F.mvKeysUn), vDescIndex(F.vDescIndex),
     mvuRight(F.mvuRight), mvDepth(F.mvDepth), mDescriptors(F.mDescriptors.clone()), mDescriptorsRight(F.mDescriptorsRight.clone()),
@@ -40,30 +39,25 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     mfLogScaleFactor(F.mfLogScaleFactor), mvScaleFactors(F.mvScaleFactors), mvLevelSigma2(F.mvLevelSigma2),
     mvInvLevelSigma2(F.mvInvLevelSigma2), mnMinX(F.mnMinX), mnMinY(F.mnMinY), mnMaxX(F.mnMaxX),
     mnMaxY(F.mnMaxY), mK(F.mK), mvpMapPoints(F.mvpMapPoints), mpKeyFrameDB(pKFDB),
-    mpORBvocabulary(F.mpORBvocabulary), mbFirstConnection(true), mpParent(NULL), mbNotErase(false),
+    mpORBvocabulary(F.mpORBvocabulary), mGrid(F.mGrid), mbFirstConnection(true), mpParent(NULL), mbNotErase(false),
     mbToBeErased(false), mbBad(false), mHalfBaseline(F.mb/2), mpMap(pMap)
 {
-    mnId=nNextId++;
-
-    mGrid.resize(mnGridCols);
-    for(int i=0; i<mnGridCols;i++)
-    {
-        mGrid[i].resize(mnGridRows);
-        for(int j=0; j<mnGridRows; j++)
-            mGrid[i][j] = F.mGrid[i][j];
-    }
+    mnId=mpContext->NewKeyFrameId();
 
     SetPose(F.mTcw);    
 }
 
-void KeyFrame::ComputeBoW()
+void KeyFrame::ComputeBoW(Scheduler* pScheduler)
 {
     if(mBowVec.empty() || mFeatVec.empty())
     {
         vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
         // Feature vector associate features with nodes in the 4th level (from leaves up)
         // We assume the vocabulary tree has 6 levels, change the 4 otherwise
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
+        if(pScheduler)
+            mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4,&Scheduler::RangeParallelFor,pScheduler);
+        else
+            mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
     }
 }
 
@@ -81,24 +75,40 @@ void KeyFrame::SetPose(const cv::Mat &Tcw_)
     Ow.copyTo(Twc.rowRange(0,3).col(3));
     cv::Mat center = (cv::Mat_<float>(4,1) << mHalfBaseline, 0 , 0, 1);
     Cw = Twc*center;
+
+    mTcwSeq.Store(cv::Matx44f(Tcw));
+    mTwcSeq.Store(cv::Matx44f(Twc));
 }
 
 cv::Mat KeyFrame::GetPose()
 {
-    unique_lock<mutex> lock(mMutexPose);
-    return Tcw.clone();
+    return cv::Mat(mTcwSeq.Load(),true);
 }
 
 cv::Mat KeyFrame::GetPoseInverse()
 {
-    unique_lock<mutex> lock(mMutexPose);
-    return Twc.clone();
+    return cv::Mat(mTwcSeq.Load(),true);
 }
 
 cv::Mat KeyFrame::GetCameraCenter()
 {
-    unique_lock<mutex> lock(mMutexPose);
-    return Ow.clone();
+    return cv::Mat(GetCameraCenter3f(),true);
+}
+
+cv::Matx44f KeyFrame::GetPose4f() const
+{
+    return mTcwSeq.Load();
+}
+
+cv::Matx44f KeyFrame::GetPoseInverse4f() const
+{
+    return mTwcSeq.Load();
+}
+
+cv::Matx31f KeyFrame::GetCameraCenter3f() const
+{
+    const cv::Matx44f Twc_ = mTwcSeq.Load();
+    return cv::Matx31f(Twc_(0,3),Twc_(1,3),Twc_(2,3));
 }
 
 cv::Mat KeyFrame::GetStereoCenter()
@@ -110,14 +120,16 @@ cv::Mat KeyFrame::GetStereoCenter()
 
 cv::Mat KeyFrame::GetRotation()
 {
-    unique_lock<mutex> lock(mMutexPose);
-    return Tcw.rowRange(0,3).colRange(0,3).clone();
+    const cv::Matx44f Tcw_ = mTcwSeq.Load();
+    return (cv::Mat_<float>(3,3) << Tcw_(0,0), Tcw_(0,1), Tcw_(0,2),
+                                    Tcw_(1,0), Tcw_(1,1), Tcw_(1,2),
+                                    Tcw_(2,0), Tcw_(2,1), Tcw_(2,2));
 }
 
 cv::Mat KeyFrame::GetTranslation()
 {
-    unique_lock<mutex> lock(mMutexPose);
-    return Tcw.rowRange(0,3).col(3).clone();
+    const cv::Matx44f Tcw_ = mTcwSeq.Load();
+    return (cv::Mat_<float>(3,1) << Tcw_(0,3), Tcw_(1,3), Tcw_(2,3));
 }
 
 void KeyFrame::AddConnection(KeyFrame *pKF, const int &weight)
@@ -569,44 +581,15 @@ void KeyFrame::EraseConnection(KeyFrame* pKF)
 vector<size_t> KeyFrame::GetFeaturesInArea(const float &x, const float &y, const float &r) const
 {
     vector<size_t> vIndices;
-    vIndices.reserve(N);
-
-    const int nMinCellX = max(0,(int)floor((x-mnMinX-r)*mfGridElementWidthInv));
-    if(nMinCellX>=mnGridCols)
-        return vIndices;
-
-    const int nMaxCellX = min((int)mnGridCols-1,(int)ceil((x-mnMinX+r)*mfGridElementWidthInv));
-    if(nMaxCellX<0)
-        return vIndices;
-
-    const int nMinCellY = max(0,(int)floor((y-mnMinY-r)*mfGridElementHeightInv));
-    if(nMinCellY>=mnGridRows)
-        return vIndices;
-
-    const int nMaxCellY = min((int)mnGridRows-1,(int)ceil((y-mnMinY+r)*mfGridElementHeightInv));
-    if(nMaxCellY<0)
-        return vIndices;
-
-    for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
-    {
-        for(int iy = nMinCellY; iy<=nMaxCellY; iy++)
-        {
-            const vector<size_t> vCell = mGrid[ix][iy];
-            for(size_t j=0, jend=vCell.size(); j<jend; j++)
-            {
-                const cv::KeyPoint &kpUn = mvKeysUn[vCell[j]];
-                const float distx = kpUn.pt.x-x;
-                const float disty = kpUn.pt.y-y;
-
-                if(fabs(distx)<r && fabs(disty)<r)
-                    vIndices.push_back(vCell[j]);
-            }
-        }
-    }
-
+    mGrid.GetFeaturesInArea(mvKeysUn,x,y,r,-1,-1,vIndices);
     return vIndices;
 }
 
+void KeyFrame::GetFeaturesInArea(const float &x, const float &y, const float &r, vector<size_t> &vIndices) const
+{
+    mGrid.GetFeaturesInArea(mvKeysUn,x,y,r,-1,-1,vIndices);
+}
+
 bool KeyFrame::IsInImage(const float &x, const float &y) const
 {
     return (x>=mnMinX && x<mnMaxX && y>=mnMinY && y<mnMaxY);
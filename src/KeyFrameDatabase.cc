@@ -21,8 +21,10 @@
 #include "KeyFrameDatabase.h"
 
 #include "KeyFrame.h"
+#include "Scheduler.h"
 #include "Thirdparty/DBoW2/DBoW2/BowVector.h"
 
+#include<algorithm>
 #include<mutex>
 
 using namespace std;
@@ -30,8 +32,8 @@ using namespace std;
 namespace ORB_SLAM2
 {
 
-KeyFrameDatabase::KeyFrameDatabase (const ORBVocabulary &voc):
-    mpVoc(&voc)
+KeyFrameDatabase::KeyFrameDatabase (const ORBVocabulary &voc, Scheduler* pScheduler):
+    mpVoc(&voc), mpScheduler(pScheduler), mnPostings(0), mnDeadPostings(0)
 {
     mvInvertedFile.resize(voc.size());
 }
@@ -41,111 +43,197 @@ void KeyFrameDatabase::add(KeyFrame *pKF)
 {
     unique_lock<mutex> lock(mMutex);
 
+    if(mmKFSlots.count(pKF))
+        return;
+
+    unsigned int slot;
+    if(!mvFreeSlots.empty())
+    {
+        slot = mvFreeSlots.back();
+        mvFreeSlots.pop_back();
+        mvpSlotKFs[slot] = pKF;
+    }
+    else
+    {
+        slot = mvpSlotKFs.size();
+        mvpSlotKFs.push_back(pKF);
+    }
+    mmKFSlots[pKF] = slot;
+
     for(DBoW2::BowVector::const_iterator vit= pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
-        mvInvertedFile[vit->first].push_back(pKF);
+        mvInvertedFile[vit->first].push_back(slot);
+
+    mnPostings += pKF->mBowVec.size();
 }
 
 void KeyFrameDatabase::erase(KeyFrame* pKF)
 {
     unique_lock<mutex> lock(mMutex);
 
-    // Erase elements in the Inverse File for the entry
+    unordered_map<KeyFrame*,unsigned int>::iterator it = mmKFSlots.find(pKF);
+    if(it==mmKFSlots.end())
+        return;
+
+    // Leave a tombstone, the postings are cleaned in batches
+    const unsigned int slot = it->second;
+    mmKFSlots.erase(it);
+    mvpSlotKFs[slot] = static_cast<KeyFrame*>(NULL);
+    mvErasedSlots.push_back(slot);
+    mnDeadPostings += pKF->mBowVec.size();
     for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
-    {
-        // List of keyframes that share the word
-        list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
+        mvDirtyWords.push_back(vit->first);
 
-        for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
+    if(2*mnDeadPostings > mnPostings)
+        Compact();
+}
+
+void KeyFrameDatabase::Compact()
+{
+    sort(mvDirtyWords.begin(),mvDirtyWords.end());
+    mvDirtyWords.erase(unique(mvDirtyWords.begin(),mvDirtyWords.end()),mvDirtyWords.end());
+
+    for(vector<DBoW2::WordId>::const_iterator wit=mvDirtyWords.begin(), wend=mvDirtyWords.end(); wit!=wend; wit++)
+    {
+        vector<unsigned int> &vSlots = mvInvertedFile[*wit];
+        vSlots.erase(remove_if(vSlots.begin(),vSlots.end(),[this](const unsigned int slot)
         {
-            if(pKF==*lit)
-            {
-                lKFs.erase(lit);
-                break;
-            }
-        }
+            return mvpSlotKFs[slot]==NULL;
+        }), vSlots.end());
     }
+    mvDirtyWords.clear();
+
+    mnPostings -= mnDeadPostings;
+    mnDeadPostings = 0;
+
+    mvFreeSlots.insert(mvFreeSlots.end(),mvErasedSlots.begin(),mvErasedSlots.end());
+    mvErasedSlots.clear();
 }
 
 void KeyFrameDatabase::clear()
 {
+    unique_lock<mutex> lock(mMutex);
+
     mvInvertedFile.clear();
     mvInvertedFile.resize(mpVoc->size());
+    mvpSlotKFs.clear();
+    mmKFSlots.clear();
+    mvErasedSlots.clear();
+    mvFreeSlots.clear();
+    mvDirtyWords.clear();
+    mnPostings = 0;
+    mnDeadPostings = 0;
 }
 
-
-vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float minScore)
+void KeyFrameDatabase::GetCandidates(const DBoW2::BowVector &bowVec, const set<KeyFrame*> &spExcluded,
+                                     vector<Candidate> &vCandidates)
 {
-    set<KeyFrame*> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
-    list<KeyFrame*> lKFsSharingWords;
+    vCandidates.clear();
 
-    // Search all keyframes that share a word with current keyframes
-    // Discard keyframes connected to the query keyframe
+    unique_lock<mutex> lock(mMutex);
+
+    // Index of each slot in vCandidates: -1 not seen yet, -2 tombstone or excluded
+    vector<int> vSlotCandidate(mvpSlotKFs.size(),-1);
+
+    for(DBoW2::BowVector::const_iterator vit=bowVec.begin(), vend=bowVec.end(); vit != vend; vit++)
     {
-        unique_lock<mutex> lock(mMutex);
+        const vector<unsigned int> &vSlots = mvInvertedFile[vit->first];
 
-        for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
+        for(vector<unsigned int>::const_iterator sit=vSlots.begin(), send=vSlots.end(); sit!=send; sit++)
         {
-            list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
-
-            for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
+            int &idx = vSlotCandidate[*sit];
+            if(idx==-1)
             {
-                KeyFrame* pKFi=*lit;
-                if(pKFi->mnLoopQuery!=pKF->mnId)
+                KeyFrame* pKFi = mvpSlotKFs[*sit];
+                if(!pKFi || spExcluded.count(pKFi))
                 {
-                    pKFi->mnLoopWords=0;
-                    if(!spConnectedKeyFrames.count(pKFi))
-                    {
-                        pKFi->mnLoopQuery=pKF->mnId;
-                        lKFsSharingWords.push_back(pKFi);
-                    }
+                    idx = -2;
+                    continue;
                 }
-                pKFi->mnLoopWords++;
+
+                idx = vCandidates.size();
+                Candidate candidate;
+                candidate.pKF = pKFi;
+                candidate.nWords = 0;
+                candidate.score = -1.0f;
+                vCandidates.push_back(candidate);
             }
+
+            if(idx>=0)
+                vCandidates[idx].nWords++;
         }
     }
+}
 
-    if(lKFsSharingWords.empty())
-        return vector<KeyFrame*>();
+void KeyFrameDatabase::ScoreCandidates(const DBoW2::BowVector &bowVec, const int minCommonWords,
+                                       vector<Candidate> &vCandidates)
+{
+    vector<Candidate*> vpToScore;
+    vpToScore.reserve(vCandidates.size());
+    for(size_t i=0; i<vCandidates.size(); i++)
+    {
+        if(vCandidates[i].nWords>minCommonWords)
+            vpToScore.push_back(&vCandidates[i]);
+    }
 
-    list<pair<float,KeyFrame*> > lScoreAndMatch;
+    auto score = [&](int begin, int end, int)
+    {
+        for(int i=begin; i<end; i++)
+            vpToScore[i]->score = mpVoc->score(bowVec,vpToScore[i]->pKF->mBowVec);
+    };
+
+    if(mpScheduler)
+        mpScheduler->ParallelFor(vpToScore.size(),score);
+    else
+        score(0,vpToScore.size(),0);
+}
+
+
+vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float minScore)
+{
+    set<KeyFrame*> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
+
+    // Search all keyframes that share a word with current keyframes
+    // Discard keyframes connected to the query keyframe
+    vector<Candidate> vCandidates;
+    GetCandidates(pKF->mBowVec,spConnectedKeyFrames,vCandidates);
+
+    if(vCandidates.empty())
+        return vector<KeyFrame*>();
 
     // Only compare against those keyframes that share enough words
     int maxCommonWords=0;
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(vector<Candidate>::const_iterator it=vCandidates.begin(), itend=vCandidates.end(); it!=itend; it++)
     {
-        if((*lit)->mnLoopWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnLoopWords;
+        if(it->nWords>maxCommonWords)
+            maxCommonWords=it->nWords;
     }
 
     int minCommonWords = maxCommonWords*0.8f;
 
-    int nscores=0;
-
     // Compute similarity score. Retain the matches whose score is higher than minScore
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
-    {
-        KeyFrame* pKFi = *lit;
+    ScoreCandidates(pKF->mBowVec,minCommonWords,vCandidates);
 
-        if(pKFi->mnLoopWords>minCommonWords)
+    unordered_map<KeyFrame*,float> mScores;
+    vector<pair<float,KeyFrame*> > vScoreAndMatch;
+    for(vector<Candidate>::const_iterator it=vCandidates.begin(), itend=vCandidates.end(); it!=itend; it++)
+    {
+        if(it->nWords>minCommonWords)
         {
-            nscores++;
-
-            float si = mpVoc->score(pKF->mBowVec,pKFi->mBowVec);
-
-            pKFi->mLoopScore = si;
-            if(si>=minScore)
-                lScoreAndMatch.push_back(make_pair(si,pKFi));
+            mScores[it->pKF] = it->score;
+            if(it->score>=minScore)
+                vScoreAndMatch.push_back(make_pair(it->score,it->pKF));
         }
     }
 
-    if(lScoreAndMatch.empty())
+    if(vScoreAndMatch.empty())
         return vector<KeyFrame*>();
 
-    list<pair<float,KeyFrame*> > lAccScoreAndMatch;
+    vector<pair<float,KeyFrame*> > vAccScoreAndMatch;
+    vAccScoreAndMatch.reserve(vScoreAndMatch.size());
     float bestAccScore = minScore;
 
     // Lets now accumulate score by covisibility
-    for(list<pair<float,KeyFrame*> >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
+    for(vector<pair<float,KeyFrame*> >::iterator it=vScoreAndMatch.begin(), itend=vScoreAndMatch.end(); it!=itend; it++)
     {
         KeyFrame* pKFi = it->second;
         vector<KeyFrame*> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
@@ -155,19 +243,19 @@ vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float mi
         KeyFrame* pBestKF = pKFi;
         for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
         {
-            KeyFrame* pKF2 = *vit;
-            if(pKF2->mnLoopQuery==pKF->mnId && pKF2->mnLoopWords>minCommonWords)
+            unordered_map<KeyFrame*,float>::const_iterator sit = mScores.find(*vit);
+            if(sit==mScores.end())
+                continue;
+
+            accScore+=sit->second;
+            if(sit->second>bestScore)
             {
-                accScore+=pKF2->mLoopScore;
-                if(pKF2->mLoopScore>bestScore)
-                {
-                    pBestKF=pKF2;
-                    bestScore = pKF2->mLoopScore;
-                }
+                pBestKF=*vit;
+                bestScore = sit->second;
             }
         }
 
-        lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
+        vAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
         if(accScore>bestAccScore)
             bestAccScore=accScore;
     }
@@ -177,9 +265,9 @@ vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float mi
 
     set<KeyFrame*> spAlreadyAddedKF;
     vector<KeyFrame*> vpLoopCandidates;
-    vpLoopCandidates.reserve(lAccScoreAndMatch.size());
+    vpLoopCandidates.reserve(vAccScoreAndMatch.size());
 
-    for(list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
+    for(vector<pair<float,KeyFrame*> >::iterator it=vAccScoreAndMatch.begin(), itend=vAccScoreAndMatch.end(); it!=itend; it++)
     {
         if(it->first>minScoreToRetain)
         {
@@ -198,68 +286,46 @@ vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float mi
 
 vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F)
 {
-    list<KeyFrame*> lKFsSharingWords;
-
     // Search all keyframes that share a word with current frame
-    {
-        unique_lock<mutex> lock(mMutex);
+    vector<Candidate> vCandidates;
+    GetCandidates(F->mBowVec,set<KeyFrame*>(),vCandidates);
 
-        for(DBoW2::BowVector::const_iterator vit=F->mBowVec.begin(), vend=F->mBowVec.end(); vit != vend; vit++)
-        {
-            list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
-
-            for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-            {
-                KeyFrame* pKFi=*lit;
-                if(pKFi->mnRelocQuery!=F->mnId)
-                {
-                    pKFi->mnRelocWords=0;
-                    pKFi->mnRelocQuery=F->mnId;
-                    lKFsSharingWords.push_back(pKFi);
-                }
-                pKFi->mnRelocWords++;
-            }
-        }
-    }
-    if(lKFsSharingWords.empty())
+    if(vCandidates.empty())
         return vector<KeyFrame*>();
 
     // Only compare against those keyframes that share enough words
     int maxCommonWords=0;
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(vector<Candidate>::const_iterator it=vCandidates.begin(), itend=vCandidates.end(); it!=itend; it++)
     {
-        if((*lit)->mnRelocWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnRelocWords;
+        if(it->nWords>maxCommonWords)
+            maxCommonWords=it->nWords;
     }
 
     int minCommonWords = maxCommonWords*0.8f;
 
-    list<pair<float,KeyFrame*> > lScoreAndMatch;
-
-    int nscores=0;
-
     // Compute similarity score.
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
-    {
-        KeyFrame* pKFi = *lit;
+    ScoreCandidates(F->mBowVec,minCommonWords,vCandidates);
 
-        if(pKFi->mnRelocWords>minCommonWords)
+    unordered_map<KeyFrame*,float> mScores;
+    vector<pair<float,KeyFrame*> > vScoreAndMatch;
+    for(vector<Candidate>::const_iterator it=vCandidates.begin(), itend=vCandidates.end(); it!=itend; it++)
+    {
+        if(it->nWords>minCommonWords)
         {
-            nscores++;
-            float si = mpVoc->score(F->mBowVec,pKFi->mBowVec);
-            pKFi->mRelocScore=si;
-            lScoreAndMatch.push_back(make_pair(si,pKFi));
+            mScores[it->pKF] = it->score;
+            vScoreAndMatch.push_back(make_pair(it->score,it->pKF));
         }
     }
 
-    if(lScoreAndMatch.empty())
+    if(vScoreAndMatch.empty())
         return vector<KeyFrame*>();
 
-    list<pair<float,KeyFrame*> > lAccScoreAndMatch;
+    vector<pair<float,KeyFrame*> > vAccScoreAndMatch;
+    vAccScoreAndMatch.reserve(vScoreAndMatch.size());
     float bestAccScore = 0;
 
-    // Lets now accumulate score by covisibility
-    for(list<pair<float,KeyFrame*> >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
+    // Lets now accumulate score by covisibility (with the neighbours scored by this query)
+    for(vector<pair<float,KeyFrame*> >::iterator it=vScoreAndMatch.begin(), itend=vScoreAndMatch.end(); it!=itend; it++)
     {
         KeyFrame* pKFi = it->second;
         vector<KeyFrame*> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
@@ -269,19 +335,19 @@ vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F)
         KeyFrame* pBestKF = pKFi;
         for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
         {
-            KeyFrame* pKF2 = *vit;
-            if(pKF2->mnRelocQuery!=F->mnId)
+            unordered_map<KeyFrame*,float>::const_iterator sit = mScores.find(*vit);
+            if(sit==mScores.end())
                 continue;
 
-            accScore+=pKF2->mRelocScore;
-            if(pKF2->mRelocScore>bestScore)
+            accScore+=sit->second;
+            if(sit->second>bestScore)
             {
-                pBestKF=pKF2;
-                bestScore = pKF2->mRelocScore;
+                pBestKF=*vit;
+                bestScore = sit->second;
             }
 
         }
-        lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
+        vAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
         if(accScore>bestAccScore)
             bestAccScore=accScore;
     }
@@ -290,8 +356,8 @@ vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F)
     float minScoreToRetain = 0.75f*bestAccScore;
     set<KeyFrame*> spAlreadyAddedKF;
     vector<KeyFrame*> vpRelocCandidates;
-    vpRelocCandidates.reserve(lAccScoreAndMatch.size());
-    for(list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
+    vpRelocCandidates.reserve(vAccScoreAndMatch.size());
+    for(vector<pair<float,KeyFrame*> >::iterator it=vAccScoreAndMatch.begin(), itend=vAccScoreAndMatch.end(); it!=itend; it++)
     {
         const float &si = it->first;
         if(si>minScoreToRetain)
@@ -0,0 +1,107 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "KeyFrameQueue.h"
+
+namespace ORB_SLAM2
+{
+
+KeyFrameQueue::KeyFrameQueue(const size_t capacity):
+    mnHead(0), mnTail(0), mnMaxDepth(0), mnFullEvents(0)
+{
+    size_t n = 1;
+    while(n<capacity)
+        n <<= 1;
+    mvSlots.resize(n);
+    mnMask = n-1;
+}
+
+bool KeyFrameQueue::Push(KeyFrame *pKF)
+{
+    const size_t tail = mnTail.load(std::memory_order_relaxed);
+    const size_t head = mnHead.load(std::memory_order_acquire);
+    if(tail-head>mnMask)
+    {
+        mnFullEvents.fetch_add(1,std::memory_order_relaxed);
+        return false;
+    }
+
+    Slot &slot = mvSlots[tail&mnMask];
+    slot.pKF = pKF;
+    slot.tInserted = std::chrono::steady_clock::now();
+    mnTail.store(tail+1,std::memory_order_release);
+
+    // Only the producer writes the high-water mark
+    const size_t depth = tail+1-head;
+    if(depth>mnMaxDepth.load(std::memory_order_relaxed))
+        mnMaxDepth.store(depth,std::memory_order_relaxed);
+
+    return true;
+}
+
+bool KeyFrameQueue::Pop(KeyFrame* &pKF, TimePoint &tInserted)
+{
+    const size_t head = mnHead.load(std::memory_order_relaxed);
+    const size_t tail = mnTail.load(std::memory_order_acquire);
+    if(head==tail)
+        return false;
+
+    const Slot &slot = mvSlots[head&mnMask];
+    pKF = slot.pKF;
+    tInserted = slot.tInserted;
+    mnHead.store(head+1,std::memory_order_release);
+    return true;
+}
+
+size_t KeyFrameQueue::Size() const
+{
+    // Read head first: the tail can only move forward, so the difference never wraps
+    const size_t head = mnHead.load(std::memory_order_acquire);
+    const size_t tail = mnTail.load(std::memory_order_acquire);
+    return tail-head;
+}
+
+bool KeyFrameQueue::Empty() const
+{
+    return Size()==0;
+}
+
+bool KeyFrameQueue::Full() const
+{
+    return Size()>mnMask;
+}
+
+size_t KeyFrameQueue::Capacity() const
+{
+    return mnMask+1;
+}
+
+size_t KeyFrameQueue::MaxDepth() const
+{
+    return mnMaxDepth.load(std::memory_order_relaxed);
+}
+
+size_t KeyFrameQueue::FullEvents() const
+{
+    return mnFullEvents.load(std::memory_order_relaxed);
+}
+
+} //namespace ORB_SLAM
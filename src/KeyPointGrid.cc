@@ -0,0 +1,132 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "KeyPointGrid.h"
+
+#include <cmath>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+KeyPointGrid::KeyPointGrid():
+    mfMinX(0), mfMinY(0), mfGridElementWidthInv(0), mfGridElementHeightInv(0),
+    mvCellStart(FRAME_GRID_COLS*FRAME_GRID_ROWS+1,0)
+{
+}
+
+void KeyPointGrid::Assign(const vector<cv::KeyPoint> &vKeysUn, const float minX, const float minY,
+                          const float gridElementWidthInv, const float gridElementHeightInv)
+{
+    mfMinX = minX;
+    mfMinY = minY;
+    mfGridElementWidthInv = gridElementWidthInv;
+    mfGridElementHeightInv = gridElementHeightInv;
+
+    const int N = vKeysUn.size();
+    const int nCells = FRAME_GRID_COLS*FRAME_GRID_ROWS;
+
+    // Counting sort by cell, stable so indices stay ascending inside a cell
+    vector<int> vCell(N,-1);
+    mvCellStart.assign(nCells+1,0);
+    for(int i=0; i<N; i++)
+    {
+        int nGridPosX, nGridPosY;
+        if(PosInGrid(vKeysUn[i],nGridPosX,nGridPosY))
+        {
+            vCell[i] = nGridPosX*FRAME_GRID_ROWS+nGridPosY;
+            mvCellStart[vCell[i]+1]++;
+        }
+    }
+
+    for(int c=0; c<nCells; c++)
+        mvCellStart[c+1] += mvCellStart[c];
+
+    mvIndices.resize(mvCellStart[nCells]);
+    vector<int> vNext(mvCellStart.begin(),mvCellStart.end()-1);
+    for(int i=0; i<N; i++)
+    {
+        if(vCell[i]>=0)
+            mvIndices[vNext[vCell[i]]++] = i;
+    }
+}
+
+bool KeyPointGrid::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY) const
+{
+    posX = round((kp.pt.x-mfMinX)*mfGridElementWidthInv);
+    posY = round((kp.pt.y-mfMinY)*mfGridElementHeightInv);
+
+    //Keypoint's coordinates are undistorted, which could cause to go out of the image
+    if(posX<0 || posX>=FRAME_GRID_COLS || posY<0 || posY>=FRAME_GRID_ROWS)
+        return false;
+
+    return true;
+}
+
+void KeyPointGrid::GetFeaturesInArea(const vector<cv::KeyPoint> &vKeysUn, const float x, const float y, const float r,
+                                     const int minLevel, const int maxLevel, vector<size_t> &vIndices) const
+{
+    vIndices.clear();
+
+    const int nMinCellX = max(0,(int)floor((x-mfMinX-r)*mfGridElementWidthInv));
+    if(nMinCellX>=FRAME_GRID_COLS)
+        return;
+
+    const int nMaxCellX = min((int)FRAME_GRID_COLS-1,(int)ceil((x-mfMinX+r)*mfGridElementWidthInv));
+    if(nMaxCellX<0)
+        return;
+
+    const int nMinCellY = max(0,(int)floor((y-mfMinY-r)*mfGridElementHeightInv));
+    if(nMinCellY>=FRAME_GRID_ROWS)
+        return;
+
+    const int nMaxCellY = min((int)FRAME_GRID_ROWS-1,(int)ceil((y-mfMinY+r)*mfGridElementHeightInv));
+    if(nMaxCellY<0 || nMinCellY>nMaxCellY)
+        return;
+
+    const bool bCheckLevels = (minLevel>0) || (maxLevel>=0);
+
+    for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
+    {
+        // The cells of a column are contiguous: one span from the first to the last row
+        const unsigned int* pEnd = CellEnd(ix,nMaxCellY);
+        for(const unsigned int* pIdx = CellBegin(ix,nMinCellY); pIdx!=pEnd; pIdx++)
+        {
+            const cv::KeyPoint &kpUn = vKeysUn[*pIdx];
+            if(bCheckLevels)
+            {
+                if(kpUn.octave<minLevel)
+                    continue;
+                if(maxLevel>=0)
+                    if(kpUn.octave>maxLevel)
+                        continue;
+            }
+
+            const float distx = kpUn.pt.x-x;
+            const float disty = kpUn.pt.y-y;
+
+            if(fabs(distx)<r && fabs(disty)<r)
+                vIndices.push_back(*pIdx);
+        }
+    }
+}
+
+} //namespace ORB_SLAM
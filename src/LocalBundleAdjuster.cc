@@ -0,0 +1,424 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LocalBundleAdjuster.h"
+
+#include "Thirdparty/g2o/g2o/core/optimization_algorithm_levenberg.h"
+#include "Thirdparty/g2o/g2o/core/robust_kernel_impl.h"
+
+#include "Converter.h"
+#include "Scheduler.h"
+
+#include<mutex>
+#include<functional>
+
+namespace ORB_SLAM2
+{
+
+static const float thHuberMono = sqrt(5.991);
+static const float thHuberStereo = sqrt(7.815);
+
+LocalBundleAdjuster::LocalBundleAdjuster(Scheduler* pScheduler): mnWindow(0)
+{
+    mpLinearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+
+    g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(mpLinearSolver);
+
+    g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+    mOptimizer.setAlgorithm(solver);
+    mOptimizer.setThreadPool(pScheduler ? pScheduler->GetThreadPool() : static_cast<g2o::ThreadPool*>(NULL));
+}
+
+void LocalBundleAdjuster::Clear()
+{
+    mOptimizer.clear();
+    mCameras.clear();
+    mPoints.clear();
+    mvEdgesMono.clear();
+    mvEdgesStereo.clear();
+}
+
+void LocalBundleAdjuster::GetSymbolicStats(int &nAnalyzed, int &nReused)
+{
+    nAnalyzed = mpLinearSolver->numSymbolicDecompositions();
+    nReused = mpLinearSolver->numSymbolicReuses();
+}
+
+g2o::VertexSE3Expmap* LocalBundleAdjuster::UpdateCamera(KeyFrame* pKF, const bool bFixed)
+{
+    CameraEntry &entry = mCameras[pKF];
+    if(!entry.pVertex)
+    {
+        entry.pVertex = new g2o::VertexSE3Expmap();
+        entry.pVertex->setId(2*pKF->mnId);
+        mOptimizer.addVertex(entry.pVertex);
+    }
+    entry.pVertex->setEstimate(Converter::toSE3Quat(pKF->GetPose4f()));
+    entry.pVertex->setFixed(bFixed);
+    entry.nWindow = mnWindow;
+    return entry.pVertex;
+}
+
+LocalBundleAdjuster::Observation LocalBundleAdjuster::CreateEdge(g2o::VertexSBAPointXYZ* pVertex, KeyFrame* pKF, const size_t idx)
+{
+    Observation obs;
+    obs.pKF = pKF;
+    obs.idx = idx;
+    obs.bStereo = pKF->mvuRight[idx]>=0;
+
+    const cv::KeyPoint &kpUn = pKF->mvKeysUn[idx];
+    const float &invSigma2 = pKF->mvInvLevelSigma2[kpUn.octave];
+    g2o::VertexSE3Expmap* vSE3 = mCameras[pKF].pVertex;
+
+    // Monocular observation
+    if(!obs.bStereo)
+    {
+        Eigen::Matrix<double,2,1> z;
+        z << kpUn.pt.x, kpUn.pt.y;
+
+        g2o::EdgeSE3ProjectXYZ* e = new g2o::EdgeSE3ProjectXYZ();
+
+        e->setVertex(0, pVertex);
+        e->setVertex(1, vSE3);
+        e->setMeasurement(z);
+        e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+
+        e->fx = pKF->fx;
+        e->fy = pKF->fy;
+        e->cx = pKF->cx;
+        e->cy = pKF->cy;
+
+        obs.pEdge = e;
+    }
+    else // Stereo observation
+    {
+        Eigen::Matrix<double,3,1> z;
+        const float kp_ur = pKF->mvuRight[idx];
+        z << kpUn.pt.x, kpUn.pt.y, kp_ur;
+
+        g2o::EdgeStereoSE3ProjectXYZ* e = new g2o::EdgeStereoSE3ProjectXYZ();
+
+        e->setVertex(0, pVertex);
+        e->setVertex(1, vSE3);
+        e->setMeasurement(z);
+        e->setInformation(Eigen::Matrix3d::Identity()*invSigma2);
+
+        e->fx = pKF->fx;
+        e->fy = pKF->fy;
+        e->cx = pKF->cx;
+        e->cy = pKF->cy;
+        e->bf = pKF->mbf;
+
+        obs.pEdge = e;
+    }
+
+    mOptimizer.addEdge(obs.pEdge);
+    ResetEdge(obs);
+    return obs;
+}
+
+void LocalBundleAdjuster::ResetEdge(const Observation &obs)
+{
+    // The previous window may have left the edge as an outlier (level 1, no kernel)
+    obs.pEdge->setLevel(0);
+    g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+    rk->setDelta(obs.bStereo ? thHuberStereo : thHuberMono);
+    obs.pEdge->setRobustKernel(rk);
+}
+
+void LocalBundleAdjuster::UpdatePoint(MapPoint* pMP, const size_t nObsBegin, const size_t nObsEnd)
+{
+    PointEntry &entry = mPoints[pMP];
+    if(!entry.pVertex)
+    {
+        entry.pVertex = new g2o::VertexSBAPointXYZ();
+        entry.pVertex->setId(2*pMP->mnId+1);
+        entry.pVertex->setMarginalized(true);
+        mOptimizer.addVertex(entry.pVertex);
+    }
+    entry.pVertex->setEstimate(Converter::toVector3d(pMP->GetWorldPos3f()));
+    entry.nWindow = mnWindow;
+
+    // Merge the current observations with the cached edges, both sorted by keyframe. A keyframe
+    // observing the point through another keypoint (after a fusion) gets a new edge.
+    std::less<KeyFrame*> before;
+    const std::vector<Observation> &vCached = entry.vObs;
+    mvMergedObs.clear();
+    size_t j=0;
+    for(size_t i=nObsBegin; i<nObsEnd; i++)
+    {
+        KeyFrame* pKFi = mvObservations[i].first;
+        const size_t idx = mvObservations[i].second;
+
+        if(pKFi->isBad())
+            continue;
+
+        while(j<vCached.size() && before(vCached[j].pKF,pKFi))
+            mOptimizer.removeEdge(vCached[j++].pEdge);
+
+        if(j<vCached.size() && vCached[j].pKF==pKFi && vCached[j].idx==idx)
+        {
+            ResetEdge(vCached[j]);
+            mvMergedObs.push_back(vCached[j++]);
+        }
+        else
+        {
+            if(j<vCached.size() && vCached[j].pKF==pKFi)
+                mOptimizer.removeEdge(vCached[j++].pEdge);
+            mvMergedObs.push_back(CreateEdge(entry.pVertex,pKFi,idx));
+        }
+    }
+    while(j<vCached.size())
+        mOptimizer.removeEdge(vCached[j++].pEdge);
+
+    entry.vObs.swap(mvMergedObs);
+
+    for(size_t i=0; i<entry.vObs.size(); i++)
+    {
+        if(entry.vObs[i].bStereo)
+            mvEdgesStereo.push_back(make_pair(entry.vObs[i],pMP));
+        else
+            mvEdgesMono.push_back(make_pair(entry.vObs[i],pMP));
+    }
+}
+
+void LocalBundleAdjuster::RemoveStale()
+{
+    // Points first, removing a vertex also removes its edges. Cameras that left the window have
+    // no edges left once the points are merged and swept.
+    for(std::unordered_map<MapPoint*,PointEntry>::iterator it=mPoints.begin(); it!=mPoints.end();)
+    {
+        if(it->second.nWindow!=mnWindow)
+        {
+            mOptimizer.removeVertex(it->second.pVertex);
+            it = mPoints.erase(it);
+        }
+        else
+            it++;
+    }
+
+    for(std::unordered_map<KeyFrame*,CameraEntry>::iterator it=mCameras.begin(); it!=mCameras.end();)
+    {
+        if(it->second.nWindow!=mnWindow)
+        {
+            mOptimizer.removeVertex(it->second.pVertex);
+            it = mCameras.erase(it);
+        }
+        else
+            it++;
+    }
+}
+
+void LocalBundleAdjuster::Optimize(KeyFrame *pKF, bool* pbStopFlag, Map* pMap)
+{
+    mnWindow++;
+
+    // Local KeyFrames: First Breath Search from Current Keyframe
+    mvpLocalKeyFrames.clear();
+    mvpLocalKeyFrames.push_back(pKF);
+    pKF->mnBALocalForKF = pKF->mnId;
+
+    const vector<KeyFrame*> vNeighKFs = pKF->GetVectorCovisibleKeyFrames();
+    for(int i=0, iend=vNeighKFs.size(); i<iend; i++)
+    {
+        KeyFrame* pKFi = vNeighKFs[i];
+        pKFi->mnBALocalForKF = pKF->mnId;
+        if(!pKFi->isBad())
+            mvpLocalKeyFrames.push_back(pKFi);
+    }
+
+    // Local MapPoints seen in Local KeyFrames
+    mvpLocalMapPoints.clear();
+    for(size_t i=0; i<mvpLocalKeyFrames.size(); i++)
+    {
+        vector<MapPoint*> vpMPs = mvpLocalKeyFrames[i]->GetMapPointMatches();
+        for(vector<MapPoint*>::iterator vit=vpMPs.begin(), vend=vpMPs.end(); vit!=vend; vit++)
+        {
+            MapPoint* pMP = *vit;
+            if(pMP)
+                if(!pMP->isBad())
+                    if(pMP->mnBALocalForKF!=pKF->mnId)
+                    {
+                        mvpLocalMapPoints.push_back(pMP);
+                        pMP->mnBALocalForKF=pKF->mnId;
+                    }
+        }
+    }
+
+    // Observations of the local MapPoints, fetched once for the fixed cameras and the edges
+    mvObservations.clear();
+    mvObservationsBegin.resize(mvpLocalMapPoints.size()+1);
+    for(size_t i=0; i<mvpLocalMapPoints.size(); i++)
+    {
+        mvObservationsBegin[i] = mvObservations.size();
+        mvpLocalMapPoints[i]->GetObservations(mvObservations);
+    }
+    mvObservationsBegin[mvpLocalMapPoints.size()] = mvObservations.size();
+
+    // Fixed Keyframes. Keyframes that see Local MapPoints but that are not Local Keyframes
+    mvpFixedCameras.clear();
+    for(size_t i=0; i<mvObservations.size(); i++)
+    {
+        KeyFrame* pKFi = mvObservations[i].first;
+
+        if(pKFi->mnBALocalForKF!=pKF->mnId && pKFi->mnBAFixedForKF!=pKF->mnId)
+        {
+            pKFi->mnBAFixedForKF=pKF->mnId;
+            if(!pKFi->isBad())
+                mvpFixedCameras.push_back(pKFi);
+        }
+    }
+
+    mOptimizer.setForceStopFlag(pbStopFlag);
+
+    // Update the cached problem to the new window
+    for(size_t i=0; i<mvpLocalKeyFrames.size(); i++)
+        UpdateCamera(mvpLocalKeyFrames[i],mvpLocalKeyFrames[i]->mnId==0);
+
+    for(size_t i=0; i<mvpFixedCameras.size(); i++)
+        UpdateCamera(mvpFixedCameras[i],true);
+
+    mvEdgesMono.clear();
+    mvEdgesStereo.clear();
+    for(size_t i=0; i<mvpLocalMapPoints.size(); i++)
+        UpdatePoint(mvpLocalMapPoints[i],mvObservationsBegin[i],mvObservationsBegin[i+1]);
+
+    RemoveStale();
+
+    if(pbStopFlag)
+        if(*pbStopFlag)
+            return;
+
+    mOptimizer.initializeOptimization();
+    mOptimizer.optimize(5);
+
+    bool bDoMore= true;
+
+    if(pbStopFlag)
+        if(*pbStopFlag)
+            bDoMore = false;
+
+    if(bDoMore)
+    {
+
+    // Check inlier observations
+    for(size_t i=0, iend=mvEdgesMono.size(); i<iend;i++)
+    {
+        g2o::EdgeSE3ProjectXYZ* e = static_cast<g2o::EdgeSE3ProjectXYZ*>(mvEdgesMono[i].first.pEdge);
+        MapPoint* pMP = mvEdgesMono[i].second;
+
+        if(pMP->isBad())
+            continue;
+
+        if(e->chi2()>5.991 || !e->isDepthPositive())
+        {
+            e->setLevel(1);
+        }
+
+        e->setRobustKernel(0);
+    }
+
+    for(size_t i=0, iend=mvEdgesStereo.size(); i<iend;i++)
+    {
+        g2o::EdgeStereoSE3ProjectXYZ* e = static_cast<g2o::EdgeStereoSE3ProjectXYZ*>(mvEdgesStereo[i].first.pEdge);
+        MapPoint* pMP = mvEdgesStereo[i].second;
+
+        if(pMP->isBad())
+            continue;
+
+        if(e->chi2()>7.815 || !e->isDepthPositive())
+        {
+            e->setLevel(1);
+        }
+
+        e->setRobustKernel(0);
+    }
+
+    // Optimize again without the outliers
+    // The cameras are those of the first pass: the symbolic factorization is reused unless
+    // dropping the outliers disconnected two of them
+
+    mOptimizer.initializeOptimization(0);
+    mOptimizer.optimize(10);
+
+    }
+
+    vector<pair<KeyFrame*,MapPoint*> > vToErase;
+    vToErase.reserve(mvEdgesMono.size()+mvEdgesStereo.size());
+
+    // Check inlier observations
+    for(size_t i=0, iend=mvEdgesMono.size(); i<iend;i++)
+    {
+        g2o::EdgeSE3ProjectXYZ* e = static_cast<g2o::EdgeSE3ProjectXYZ*>(mvEdgesMono[i].first.pEdge);
+        MapPoint* pMP = mvEdgesMono[i].second;
+
+        if(pMP->isBad())
+            continue;
+
+        if(e->chi2()>5.991 || !e->isDepthPositive())
+            vToErase.push_back(make_pair(mvEdgesMono[i].first.pKF,pMP));
+    }
+
+    for(size_t i=0, iend=mvEdgesStereo.size(); i<iend;i++)
+    {
+        g2o::EdgeStereoSE3ProjectXYZ* e = static_cast<g2o::EdgeStereoSE3ProjectXYZ*>(mvEdgesStereo[i].first.pEdge);
+        MapPoint* pMP = mvEdgesStereo[i].second;
+
+        if(pMP->isBad())
+            continue;
+
+        if(e->chi2()>7.815 || !e->isDepthPositive())
+            vToErase.push_back(make_pair(mvEdgesStereo[i].first.pKF,pMP));
+    }
+
+    // Get Map Mutex
+    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+
+    if(!vToErase.empty())
+    {
+        for(size_t i=0;i<vToErase.size();i++)
+        {
+            KeyFrame* pKFi = vToErase[i].first;
+            MapPoint* pMPi = vToErase[i].second;
+            pKFi->EraseMapPointMatch(pMPi);
+            pMPi->EraseObservation(pKFi);
+        }
+    }
+
+    // Recover optimized data
+
+    //Keyframes
+    for(size_t i=0; i<mvpLocalKeyFrames.size(); i++)
+    {
+        KeyFrame* pKFi = mvpLocalKeyFrames[i];
+        g2o::SE3Quat SE3quat = mCameras[pKFi].pVertex->estimate();
+        pKFi->SetPose(Converter::toCvMat(SE3quat));
+    }
+
+    //Points
+    for(size_t i=0; i<mvpLocalMapPoints.size(); i++)
+    {
+        MapPoint* pMP = mvpLocalMapPoints[i];
+        pMP->SetWorldPos(Converter::toCvMat(mPoints[pMP].pVertex->estimate()));
+        pMP->UpdateNormalAndDepth();
+    }
+}
+
+} //namespace ORB_SLAM
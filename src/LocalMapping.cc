@@ -22,15 +22,18 @@
 #include "LoopClosing.h"
 #include "ORBmatcher.h"
 #include "Optimizer.h"
+#include "Scheduler.h"
 
 #include<mutex>
-#include<unistd.h>
+#include<thread>
 
 namespace ORB_SLAM2
 {
 
-LocalMapping::LocalMapping(Map *pMap, const float bMonocular):
-    mbMonocular(bMonocular), mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
+LocalMapping::LocalMapping(Map *pMap, const float bMonocular, Scheduler* pScheduler, const bool bIncrementalBA):
+    mbMonocular(bMonocular), mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mbWakeUp(false), mbSleeping(false), mpMap(pMap), mpScheduler(pScheduler),
+    mbIncrementalBA(bIncrementalBA), mLocalBA(pScheduler), mnLocalBAs(0), mLocalBASum(0), mLocalBAMax(0), mnSymbolic(0), mnSymbolicReused(0),
+    mNewKeyFrames(32), mnLatencyKFs(0), mLatencySum(0), mLatencyMax(0),
     mbAbortBA(false), mbStopped(false), mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true)
 {
 }
@@ -55,8 +58,8 @@ void LocalMapping::Run()
         // Tracking will see that Local Mapping is busy
         SetAcceptKeyFrames(false);
 
-        // Check if there are keyframes in the queue
-        if(CheckNewKeyFrames())
+        // Check if there are keyframes in the queue, and room to hand them on to Loop Closing
+        if(CheckNewKeyFrames() && !mpLoopCloser->KeyFrameQueueFull())
         {
             // BoW conversion and insertion in Map
             ProcessNewKeyFrame();
@@ -80,7 +83,7 @@ void LocalMapping::Run()
                 // Local BA
                 if(mpMap->KeyFramesInMap()>2){
                     // cout << "perform local bundle adjustment..!..!..!..!..!..!..!..!..!" << endl;
-                    Optimizer::LocalBundleAdjustment(mpCurrentKeyFrame,&mbAbortBA, mpMap);
+                    LocalBundleAdjustment();
                 }
 
                 // Check redundant local Keyframes
@@ -94,10 +97,13 @@ void LocalMapping::Run()
             // Safe area to stop
             while(isStopped() && !CheckFinish())
             {
-                usleep(3000);
+                WaitForWork(false);
             }
             if(CheckFinish())
                 break;
+
+            // Release deleted the queued keyframes, which may be observations in the cached problem
+            mLocalBA.Clear();
         }
 
         ResetIfRequested();
@@ -108,36 +114,98 @@ void LocalMapping::Run()
         if(CheckFinish())
             break;
 
-        usleep(3000);
+        WaitForWork(true);
     }
 
     SetFinish();
 }
 
-void LocalMapping::InsertKeyFrame(KeyFrame *pKF)
+void LocalMapping::LocalBundleAdjustment()
 {
-    unique_lock<mutex> lock(mMutexNewKFs);
-    mlNewKeyFrames.push_back(pKF);
+    const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+    if(mbIncrementalBA)
+        mLocalBA.Optimize(mpCurrentKeyFrame,&mbAbortBA,mpMap);
+    else
+        Optimizer::LocalBundleAdjustment(mpCurrentKeyFrame,&mbAbortBA,mpMap,mpScheduler);
+
+    const double t = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-t0).count();
+
+    unique_lock<mutex> lock(mMutexLocalBAStats);
+    mnLocalBAs++;
+    mLocalBASum += t;
+    mLocalBAMax = max(mLocalBAMax,t);
+    if(mbIncrementalBA)
+        mLocalBA.GetSymbolicStats(mnSymbolic,mnSymbolicReused);
+}
+
+bool LocalMapping::InsertKeyFrame(KeyFrame *pKF)
+{
+    if(!mNewKeyFrames.Push(pKF))
+        return false;
     mbAbortBA=true;
+
+    // Pairs with the fence in WaitForWork: either Run sees the new keyframe or we see it asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(mbSleeping.load(std::memory_order_relaxed))
+    {
+        unique_lock<mutex> lock(mMutexNewKFs);
+        mCondNewKFs.notify_one();
+    }
+    return true;
 }
 
+void LocalMapping::LoopQueuePopped()
+{
+    // Pairs with the fence in WaitForWork, as in InsertKeyFrame
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(mbSleeping.load(std::memory_order_relaxed))
+    {
+        unique_lock<mutex> lock(mMutexNewKFs);
+        mCondNewKFs.notify_one();
+    }
+}
 
-bool LocalMapping::CheckNewKeyFrames()
+void LocalMapping::WakeUp()
 {
     unique_lock<mutex> lock(mMutexNewKFs);
-    return(!mlNewKeyFrames.empty());
+    mbWakeUp = true;
+    mCondNewKFs.notify_one();
+}
+
+void LocalMapping::WaitForWork(const bool bKeyFrames)
+{
+    // Requests keep their own flags, mbWakeUp only tells Run to look at them again
+    unique_lock<mutex> lock(mMutexNewKFs);
+    mbSleeping.store(true,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while(!mbWakeUp && !(bKeyFrames && !mNewKeyFrames.Empty() && !mpLoopCloser->KeyFrameQueueFull()))
+        mCondNewKFs.wait(lock);
+    mbSleeping.store(false,std::memory_order_relaxed);
+    mbWakeUp = false;
+}
+
+
+bool LocalMapping::CheckNewKeyFrames()
+{
+    return(!mNewKeyFrames.Empty());
 }
 
 void LocalMapping::ProcessNewKeyFrame()
 {
     {
         unique_lock<mutex> lock(mMutexNewKFs);
-        mpCurrentKeyFrame = mlNewKeyFrames.front();
-        mlNewKeyFrames.pop_front();
+        KeyFrameQueue::TimePoint tInserted;
+        mNewKeyFrames.Pop(mpCurrentKeyFrame,tInserted);
+
+        const double latency = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-tInserted).count();
+        mnLatencyKFs++;
+        mLatencySum += latency;
+        mLatencyMax = max(mLatencyMax,latency);
     }
 
     // Compute Bags of Words structures
-    mpCurrentKeyFrame->ComputeBoW();
+    mpCurrentKeyFrame->ComputeBoW(mpScheduler);
 
     // Associate MapPoints to the new keyframe and update normal and descriptor
     const vector<MapPoint*> vpMapPointMatches = mpCurrentKeyFrame->GetMapPointMatches();
@@ -562,6 +630,8 @@ void LocalMapping::RequestStop()
     mbStopRequested = true;
     unique_lock<mutex> lock2(mMutexNewKFs);
     mbAbortBA = true;
+    mbWakeUp = true;
+    mCondNewKFs.notify_one();
 }
 
 bool LocalMapping::Stop()
@@ -570,6 +640,7 @@ bool LocalMapping::Stop()
     if(mbStopRequested && !mbNotStop)
     {
         mbStopped = true;
+        mCondStop.notify_all();
         cout << "Local Mapping STOP" << endl;
         return true;
     }
@@ -597,22 +668,26 @@ void LocalMapping::Release()
         return;
     mbStopped = false;
     mbStopRequested = false;
-    for(list<KeyFrame*>::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
-        delete *lit;
-    mlNewKeyFrames.clear();
+    {
+        unique_lock<mutex> lock3(mMutexNewKFs);
+        KeyFrame* pKF;
+        KeyFrameQueue::TimePoint tInserted;
+        while(mNewKeyFrames.Pop(pKF,tInserted))
+            delete pKF;
+        mbWakeUp = true;
+        mCondNewKFs.notify_one();
+    }
 
     cout << "Local Mapping RELEASE" << endl;
 }
 
 bool LocalMapping::AcceptKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexAccept);
     return mbAcceptKeyFrames;
 }
 
 void LocalMapping::SetAcceptKeyFrames(bool flag)
 {
-    unique_lock<mutex> lock(mMutexAccept);
     mbAcceptKeyFrames=flag;
 }
 
@@ -712,16 +787,11 @@ void LocalMapping::RequestReset()
         unique_lock<mutex> lock(mMutexReset);
         mbResetRequested = true;
     }
+    WakeUp();
 
-    while(1)
-    {
-        {
-            unique_lock<mutex> lock2(mMutexReset);
-            if(!mbResetRequested)
-                break;
-        }
-        usleep(3000);
-    }
+    unique_lock<mutex> lock2(mMutexReset);
+    while(mbResetRequested)
+        mCondReset.wait(lock2);
 }
 
 void LocalMapping::ResetIfRequested()
@@ -729,16 +799,26 @@ void LocalMapping::ResetIfRequested()
     unique_lock<mutex> lock(mMutexReset);
     if(mbResetRequested)
     {
-        mlNewKeyFrames.clear();
+        {
+            unique_lock<mutex> lock2(mMutexNewKFs);
+            KeyFrame* pKF;
+            KeyFrameQueue::TimePoint tInserted;
+            while(mNewKeyFrames.Pop(pKF,tInserted));
+        }
         mlpRecentAddedMapPoints.clear();
+        mLocalBA.Clear();
         mbResetRequested=false;
+        mCondReset.notify_all();
     }
 }
 
 void LocalMapping::RequestFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinishRequested = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    WakeUp();
 }
 
 bool LocalMapping::CheckFinish()
@@ -751,8 +831,10 @@ void LocalMapping::SetFinish()
 {
     unique_lock<mutex> lock(mMutexFinish);
     mbFinished = true;    
+    mCondFinish.notify_all();
     unique_lock<mutex> lock2(mMutexStop);
     mbStopped = true;
+    mCondStop.notify_all();
 }
 
 bool LocalMapping::isFinished()
@@ -761,4 +843,42 @@ bool LocalMapping::isFinished()
     return mbFinished;
 }
 
+void LocalMapping::WaitUntilStopped()
+{
+    unique_lock<mutex> lock(mMutexStop);
+    while(!mbStopped)
+        mCondStop.wait(lock);
+}
+
+void LocalMapping::WaitUntilFinished()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    while(!mbFinished)
+        mCondFinish.wait(lock);
+}
+
+void LocalMapping::GetKeyFrameLatency(int &nKFs, double &meanMs, double &maxMs)
+{
+    unique_lock<mutex> lock(mMutexNewKFs);
+    nKFs = mnLatencyKFs;
+    meanMs = mnLatencyKFs>0 ? mLatencySum/mnLatencyKFs : 0;
+    maxMs = mLatencyMax;
+}
+
+void LocalMapping::GetKeyFrameQueueStats(int &nMaxDepth, int &nFullEvents)
+{
+    nMaxDepth = mNewKeyFrames.MaxDepth();
+    nFullEvents = mNewKeyFrames.FullEvents();
+}
+
+void LocalMapping::GetLocalBAStats(int &nKFs, double &meanMs, double &maxMs, int &nSymbolic, int &nSymbolicReused)
+{
+    unique_lock<mutex> lock(mMutexLocalBAStats);
+    nKFs = mnLocalBAs;
+    meanMs = mnLocalBAs>0 ? mLocalBASum/mnLocalBAs : 0;
+    maxMs = mLocalBAMax;
+    nSymbolic = mnSymbolic;
+    nSymbolicReused = mnSymbolicReused;
+}
+
 } //namespace ORB_SLAM
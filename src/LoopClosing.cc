@@ -25,21 +25,22 @@
 #include "Converter.h"
 
 #include "Optimizer.h"
+#include "Scheduler.h"
 
 #include "ORBmatcher.h"
 
 #include<mutex>
+#include<atomic>
 #include<thread>
-#include<unistd.h>
 
 
 namespace ORB_SLAM2
 {
 
-LoopClosing::LoopClosing(Map *pMap, KeyFrameDatabase *pDB, ORBVocabulary *pVoc, const bool bFixScale):
-    mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
-    mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
-    mbStopGBA(false), mpThreadGBA(NULL), mbFixScale(bFixScale), mnFullBAIdx(0)
+LoopClosing::LoopClosing(Map *pMap, KeyFrameDatabase *pDB, ORBVocabulary *pVoc, const bool bFixScale, Scheduler* pScheduler):
+    mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mbWakeUp(false), mbSleeping(false), mpMap(pMap), mpScheduler(pScheduler),
+    mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mLoopKeyFrameQueue(256), mnLatencyKFs(0), mLatencySum(0), mLatencyMax(0), mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
+    mbStopGBA(false), mnGBATasks(0), mbFixScale(bFixScale), mnFullBAIdx(0)
 {
     mnCovisibilityConsistencyTh = 3;
 }
@@ -83,34 +84,69 @@ void LoopClosing::Run()
         if(CheckFinish())
             break;
 
-        usleep(5000);
+        WaitForWork();
     }
 
     SetFinish();
 }
 
-void LoopClosing::InsertKeyFrame(KeyFrame *pKF)
+bool LoopClosing::InsertKeyFrame(KeyFrame *pKF)
+{
+    if(pKF->mnId==0)
+        return true;
+
+    if(!mLoopKeyFrameQueue.Push(pKF))
+        return false;
+
+    // Pairs with the fence in WaitForWork
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(mbSleeping.load(std::memory_order_relaxed))
+    {
+        unique_lock<mutex> lock(mMutexLoopQueue);
+        mCondLoopQueue.notify_one();
+    }
+    return true;
+}
+
+void LoopClosing::WakeUp()
 {
     unique_lock<mutex> lock(mMutexLoopQueue);
-    if(pKF->mnId!=0)
-        mlpLoopKeyFrameQueue.push_back(pKF);
+    mbWakeUp = true;
+    mCondLoopQueue.notify_one();
 }
 
-bool LoopClosing::CheckNewKeyFrames()
+void LoopClosing::WaitForWork()
 {
     unique_lock<mutex> lock(mMutexLoopQueue);
-    return(!mlpLoopKeyFrameQueue.empty());
+    mbSleeping.store(true,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while(!mbWakeUp && mLoopKeyFrameQueue.Empty())
+        mCondLoopQueue.wait(lock);
+    mbSleeping.store(false,std::memory_order_relaxed);
+    mbWakeUp = false;
+}
+
+bool LoopClosing::CheckNewKeyFrames()
+{
+    return(!mLoopKeyFrameQueue.Empty());
 }
 
 bool LoopClosing::DetectLoop()
 {
     {
         unique_lock<mutex> lock(mMutexLoopQueue);
-        mpCurrentKF = mlpLoopKeyFrameQueue.front();
-        mlpLoopKeyFrameQueue.pop_front();
+        KeyFrameQueue::TimePoint tInserted;
+        mLoopKeyFrameQueue.Pop(mpCurrentKF,tInserted);
+
+        const double latency = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-tInserted).count();
+        mnLatencyKFs++;
+        mLatencySum += latency;
+        mLatencyMax = max(mLatencyMax,latency);
+
         // Avoid that a keyframe can be erased while it is being process by this thread
         mpCurrentKF->SetNotErase();
     }
+    mpLocalMapper->LoopQueuePopped();
 
     //If the map contains less than 10 KF or less than 10 KF have passed from last loop detection
     if(mpCurrentKF->mnId<mLastLoopKFid+10)
@@ -236,112 +272,92 @@ bool LoopClosing::ComputeSim3()
 
     const int nInitialCandidates = mvpEnoughConsistentCandidates.size();
 
-    // We compute first ORB matches for each candidate
-    // If enough matches are found, we setup a Sim3Solver
-    ORBmatcher matcher(0.75,true);
-
-    vector<Sim3Solver*> vpSim3Solvers;
-    vpSim3Solvers.resize(nInitialCandidates);
-
-    vector<vector<MapPoint*> > vvpMapPointMatches;
-    vvpMapPointMatches.resize(nInitialCandidates);
-
-    vector<bool> vbDiscarded;
-    vbDiscarded.resize(nInitialCandidates);
-
-    int nCandidates=0; //candidates with enough matches
-
+    // avoid that local mapping erase the candidates while they are being processed in this thread
     for(int i=0; i<nInitialCandidates; i++)
-    {
-        KeyFrame* pKF = mvpEnoughConsistentCandidates[i];
+        mvpEnoughConsistentCandidates[i]->SetNotErase();
 
-        // avoid that local mapping erase it while it is being processed in this thread
-        pKF->SetNotErase();
+    // Each candidate is verified by its own task: ORB matching, Sim3 RANSAC, guided matching
+    // and Sim3 optimization. The first candidate that succeeds raises bMatch, which stops the
+    // RANSAC of the other candidates.
+    std::atomic<bool> bMatch(false);
+    KeyFrame* pMatchedKF = NULL;
+    g2o::Sim3 gScmFound;
+    vector<MapPoint*> vpMatchedPointsFound;
 
-        if(pKF->isBad())
+    auto verify = [&](int begin, int end, int)
+    {
+        for(int i=begin; i<end && !bMatch.load(); i++)
         {
-            vbDiscarded[i] = true;
-            continue;
-        }
-
-        int nmatches = matcher.SearchByBoW(mpCurrentKF,pKF,vvpMapPointMatches[i]);
+            KeyFrame* pKF = mvpEnoughConsistentCandidates[i];
 
-        if(nmatches<20)
-        {
-            vbDiscarded[i] = true;
-            continue;
-        }
-        else
-        {
-            Sim3Solver* pSolver = new Sim3Solver(mpCurrentKF,pKF,vvpMapPointMatches[i],mbFixScale);
-            pSolver->SetRansacParameters(0.99,20,300);
-            vpSim3Solvers[i] = pSolver;
-        }
+            if(pKF->isBad())
+                continue;
 
-        nCandidates++;
-    }
+            // We compute first ORB matches for the candidate
+            // If enough matches are found, we setup a Sim3Solver
+            ORBmatcher matcher(0.75,true);
+            vector<MapPoint*> vpCandidateMatches;
 
-    bool bMatch = false;
+            int nmatches = matcher.SearchByBoW(mpCurrentKF,pKF,vpCandidateMatches);
 
-    // Perform alternatively RANSAC iterations for each candidate
-    // until one is succesful or all fail
-    while(nCandidates>0 && !bMatch)
-    {
-        for(int i=0; i<nInitialCandidates; i++)
-        {
-            if(vbDiscarded[i])
+            if(nmatches<20)
                 continue;
 
-            KeyFrame* pKF = mvpEnoughConsistentCandidates[i];
+            Sim3Solver solver(mpCurrentKF,pKF,vpCandidateMatches,mbFixScale);
+            solver.SetRansacParameters(0.99,20,300);
+            solver.SetCancelFlag(&bMatch);
 
-            // Perform 5 Ransac Iterations
-            vector<bool> vbInliers;
-            int nInliers;
-            bool bNoMore;
+            // Perform RANSAC iterations until it is succesful, reachs max. iterations
+            // or another candidate is accepted
+            bool bNoMore = false;
+            while(!bNoMore)
+            {
+                // Perform 5 Ransac Iterations
+                vector<bool> vbInliers;
+                int nInliers;
 
-            Sim3Solver* pSolver = vpSim3Solvers[i];
-            cv::Mat Scm  = pSolver->iterate(5,bNoMore,vbInliers,nInliers);
+                cv::Mat Scm  = solver.iterate(5,bNoMore,vbInliers,nInliers);
 
-            // If Ransac reachs max. iterations discard keyframe
-            if(bNoMore)
-            {
-                vbDiscarded[i]=true;
-                nCandidates--;
-            }
+                // If RANSAC returns a Sim3, perform a guided matching and optimize with all correspondences
+                if(Scm.empty())
+                    continue;
 
-            // If RANSAC returns a Sim3, perform a guided matching and optimize with all correspondences
-            if(!Scm.empty())
-            {
-                vector<MapPoint*> vpMapPointMatches(vvpMapPointMatches[i].size(), static_cast<MapPoint*>(NULL));
+                vector<MapPoint*> vpMapPointMatches(vpCandidateMatches.size(), static_cast<MapPoint*>(NULL));
                 for(size_t j=0, jend=vbInliers.size(); j<jend; j++)
                 {
                     if(vbInliers[j])
-                       vpMapPointMatches[j]=vvpMapPointMatches[i][j];
+                       vpMapPointMatches[j]=vpCandidateMatches[j];
                 }
 
-                cv::Mat R = pSolver->GetEstimatedRotation();
-                cv::Mat t = pSolver->GetEstimatedTranslation();
-                const float s = pSolver->GetEstimatedScale();
+                cv::Mat R = solver.GetEstimatedRotation();
+                cv::Mat t = solver.GetEstimatedTranslation();
+                const float s = solver.GetEstimatedScale();
                 matcher.SearchBySim3(mpCurrentKF,pKF,vpMapPointMatches,s,R,t,7.5);
 
                 g2o::Sim3 gScm(Converter::toMatrix3d(R),Converter::toVector3d(t),s);
-                const int nInliers = Optimizer::OptimizeSim3(mpCurrentKF, pKF, vpMapPointMatches, gScm, 10, mbFixScale);
+                const int nInliersOpt = Optimizer::OptimizeSim3(mpCurrentKF, pKF, vpMapPointMatches, gScm, 10, mbFixScale);
 
-                // If optimization is succesful stop ransacs and continue
-                if(nInliers>=20)
+                // If optimization is succesful stop ransacs and continue.
+                // Only the first candidate to get here publishes its Sim3.
+                if(nInliersOpt>=20)
                 {
-                    bMatch = true;
-                    mpMatchedKF = pKF;
-                    g2o::Sim3 gSmw(Converter::toMatrix3d(pKF->GetRotation()),Converter::toVector3d(pKF->GetTranslation()),1.0);
-                    mg2oScw = gScm*gSmw;
-                    mScw = Converter::toCvMat(mg2oScw);
-
-                    mvpCurrentMatchedPoints = vpMapPointMatches;
+                    bool bExpected = false;
+                    if(bMatch.compare_exchange_strong(bExpected,true))
+                    {
+                        pMatchedKF = pKF;
+                        gScmFound = gScm;
+                        vpMatchedPointsFound = vpMapPointMatches;
+                    }
                     break;
                 }
             }
         }
-    }
+    };
+
+    if(mpScheduler)
+        mpScheduler->ParallelFor(nInitialCandidates,verify,nInitialCandidates);
+    else
+        verify(0,nInitialCandidates,0);
 
     if(!bMatch)
     {
@@ -351,6 +367,13 @@ bool LoopClosing::ComputeSim3()
         return false;
     }
 
+    mpMatchedKF = pMatchedKF;
+    g2o::Sim3 gSmw(Converter::toMatrix3d(mpMatchedKF->GetRotation()),Converter::toVector3d(mpMatchedKF->GetTranslation()),1.0);
+    mg2oScw = gScmFound*gSmw;
+    mScw = Converter::toCvMat(mg2oScw);
+
+    mvpCurrentMatchedPoints = vpMatchedPointsFound;
+
     // Retrieve MapPoints seen in Loop Keyframe and neighbors
     vector<KeyFrame*> vpLoopConnectedKFs = mpMatchedKF->GetVectorCovisibleKeyFrames();
     vpLoopConnectedKFs.push_back(mpMatchedKF);
@@ -374,6 +397,7 @@ bool LoopClosing::ComputeSim3()
     }
 
     // Find more matches projecting with the computed Sim3
+    ORBmatcher matcher(0.75,true);
     matcher.SearchByProjection(mpCurrentKF, mScw, mvpLoopMapPoints, mvpCurrentMatchedPoints,10);
 
     // If enough matches accept Loop
@@ -415,20 +439,12 @@ void LoopClosing::CorrectLoop()
         unique_lock<mutex> lock(mMutexGBA);
         mbStopGBA = true;
 
+        // The aborted GBA task returns as soon as it sees the index changed
         mnFullBAIdx++;
-
-        if(mpThreadGBA)
-        {
-            mpThreadGBA->detach();
-            delete mpThreadGBA;
-        }
     }
 
     // Wait until Local Mapping has effectively stopped
-    while(!mpLocalMapper->isStopped())
-    {
-        usleep(1000);
-    }
+    mpLocalMapper->WaitUntilStopped();
 
     // Ensure current keyframe is updated
     mpCurrentKF->UpdateConnections();
@@ -566,7 +582,7 @@ void LoopClosing::CorrectLoop()
     }
 
     // Optimize graph
-    Optimizer::OptimizeEssentialGraph(mpMap, mpMatchedKF, mpCurrentKF, NonCorrectedSim3, CorrectedSim3, LoopConnections, mbFixScale);
+    Optimizer::OptimizeEssentialGraph(mpMap, mpMatchedKF, mpCurrentKF, NonCorrectedSim3, CorrectedSim3, LoopConnections, mbFixScale, mpScheduler);
 
     mpMap->InformNewBigChange();
 
@@ -574,11 +590,18 @@ void LoopClosing::CorrectLoop()
     mpMatchedKF->AddLoopEdge(mpCurrentKF);
     mpCurrentKF->AddLoopEdge(mpMatchedKF);
 
-    // Launch a new thread to perform Global Bundle Adjustment
-    mbRunningGBA = true;
-    mbFinishedGBA = false;
-    mbStopGBA = false;
-    mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment,this,mpCurrentKF->mnId);
+    // Launch a new task to perform Global Bundle Adjustment
+    {
+        unique_lock<mutex> lock(mMutexGBA);
+        mbRunningGBA = true;
+        mbFinishedGBA = false;
+        mbStopGBA = false;
+        mnGBATasks++;
+    }
+    if(mpScheduler)
+        mpScheduler->Submit(std::bind(&LoopClosing::RunGlobalBundleAdjustment,this,mpCurrentKF->mnId));
+    else
+        thread(&LoopClosing::RunGlobalBundleAdjustment,this,mpCurrentKF->mnId).detach();
 
     // Loop closed. Release Local Mapping.
     mpLocalMapper->Release();    
@@ -621,16 +644,11 @@ void LoopClosing::RequestReset()
         unique_lock<mutex> lock(mMutexReset);
         mbResetRequested = true;
     }
+    WakeUp();
 
-    while(1)
-    {
-        {
-        unique_lock<mutex> lock2(mMutexReset);
-        if(!mbResetRequested)
-            break;
-        }
-        usleep(5000);
-    }
+    unique_lock<mutex> lock2(mMutexReset);
+    while(mbResetRequested)
+        mCondReset.wait(lock2);
 }
 
 void LoopClosing::ResetIfRequested()
@@ -638,9 +656,16 @@ void LoopClosing::ResetIfRequested()
     unique_lock<mutex> lock(mMutexReset);
     if(mbResetRequested)
     {
-        mlpLoopKeyFrameQueue.clear();
+        {
+            unique_lock<mutex> lock2(mMutexLoopQueue);
+            KeyFrame* pKF;
+            KeyFrameQueue::TimePoint tInserted;
+            while(mLoopKeyFrameQueue.Pop(pKF,tInserted));
+        }
+        mpLocalMapper->LoopQueuePopped();
         mLastLoopKFid=0;
         mbResetRequested=false;
+        mCondReset.notify_all();
     }
 }
 
@@ -648,8 +673,12 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
 {
     cout << "Starting Global Bundle Adjustment.................................................." << endl;
 
-    int idx =  mnFullBAIdx;
-    Optimizer::GlobalBundleAdjustemnt(mpMap,10,&mbStopGBA,nLoopKF,false);
+    int idx;
+    {
+        unique_lock<mutex> lock(mMutexGBA);
+        idx = mnFullBAIdx;
+    }
+    Optimizer::GlobalBundleAdjustemnt(mpMap,10,&mbStopGBA,nLoopKF,false,mpScheduler);
 
     // Update all MapPoints and KeyFrames
     // Local Mapping was active during BA, that means that there might be new keyframes
@@ -658,19 +687,20 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
     {
         unique_lock<mutex> lock(mMutexGBA);
         if(idx!=mnFullBAIdx)
+        {
+            // Aborted by a newer loop, which launched its own task
+            mnGBATasks--;
+            mCondGBA.notify_all();
             return;
+        }
 
         if(!mbStopGBA)
         {
             cout << "Global Bundle Adjustment finished" << endl;
             cout << "Updating map ..." << endl;
             mpLocalMapper->RequestStop();
-            // Wait until Local Mapping has effectively stopped
-
-            while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
-            {
-                usleep(1000);
-            }
+            // Wait until Local Mapping has effectively stopped (a finished Local Mapping counts as stopped)
+            mpLocalMapper->WaitUntilStopped();
 
             // Get Map Mutex
             unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
@@ -747,13 +777,18 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
 
         mbFinishedGBA = true;
         mbRunningGBA = false;
+        mnGBATasks--;
+        mCondGBA.notify_all();
     }
 }
 
 void LoopClosing::RequestFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinishRequested = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    WakeUp();
 }
 
 bool LoopClosing::CheckFinish()
@@ -766,6 +801,7 @@ void LoopClosing::SetFinish()
 {
     unique_lock<mutex> lock(mMutexFinish);
     mbFinished = true;
+    mCondFinish.notify_all();
 }
 
 bool LoopClosing::isFinished()
@@ -774,5 +810,34 @@ bool LoopClosing::isFinished()
     return mbFinished;
 }
 
+void LoopClosing::WaitUntilFinished()
+{
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        while(!mbFinished)
+            mCondFinish.wait(lock);
+    }
+
+    // Global BA is only launched from Run, so none can start after this point. Aborted tasks
+    // may still be optimizing the map, wait for them too.
+    unique_lock<mutex> lock(mMutexGBA);
+    while(mnGBATasks>0)
+        mCondGBA.wait(lock);
+}
+
+void LoopClosing::GetKeyFrameLatency(int &nKFs, double &meanMs, double &maxMs)
+{
+    unique_lock<mutex> lock(mMutexLoopQueue);
+    nKFs = mnLatencyKFs;
+    meanMs = mnLatencyKFs>0 ? mLatencySum/mnLatencyKFs : 0;
+    maxMs = mLatencyMax;
+}
+
+void LoopClosing::GetKeyFrameQueueStats(int &nMaxDepth, int &nFullEvents)
+{
+    nMaxDepth = mLoopKeyFrameQueue.MaxDepth();
+    nFullEvents = mLoopKeyFrameQueue.FullEvents();
+}
+
 
 } //namespace ORB_SLAM
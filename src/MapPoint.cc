@@ -26,28 +26,27 @@
 namespace ORB_SLAM2
 {
 
-long unsigned int MapPoint::nNextId=0;
-mutex MapPoint::mGlobalMutex;
-
 MapPoint::MapPoint(const cv::Mat &Pos, KeyFrame *pRefKF, Map* pMap):
-    mnFirstKFid(pRefKF->mnId), mnFirstFrame(pRefKF->mnFrameId), nObs(0), mnTrackReferenceForFrame(0),
+    mpContext(pRefKF->mpContext), mnFirstKFid(pRefKF->mnId), mnFirstFrame(pRefKF->mnFrameId), nObs(0), mnTrackReferenceForFrame(0),
     mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
     mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
-    mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0), mpMap(pMap)
+    mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0), mpMap(pMap), mbHasDescriptor(false)
 {
     Pos.copyTo(mWorldPos);
     mNormalVector = cv::Mat::zeros(3,1,CV_32F);
+    mWorldPosSeq.Store(cv::Matx31f(mWorldPos));
+    PublishViewInfo();
 
     // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
     unique_lock<mutex> lock(mpMap->mMutexPointCreation);
-    mnId=nNextId++;
+    mnId=mpContext->NewMapPointId();
 }
 
 MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF):
-    mnFirstKFid(-1), mnFirstFrame(pFrame->mnId), nObs(0), mnTrackReferenceForFrame(0), mnLastFrameSeen(0),
+    mpContext(pFrame->mpContext), mnFirstKFid(-1), mnFirstFrame(pFrame->mnId), nObs(0), mnTrackReferenceForFrame(0), mnLastFrameSeen(0),
     mnBALocalForKF(0), mnFuseCandidateForKF(0),mnLoopPointForKF(0), mnCorrectedByKF(0),
     mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(static_cast<KeyFrame*>(NULL)), mnVisible(1),
-    mnFound(1), mbBad(false), mpReplaced(NULL), mpMap(pMap)
+    mnFound(1), mbBad(false), mpReplaced(NULL), mpMap(pMap), mbHasDescriptor(false)
 {
     Pos.copyTo(mWorldPos);
     cv::Mat Ow = pFrame->GetCameraCenter();
@@ -65,28 +64,68 @@ MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF
 
     pFrame->mDescriptors.row(idxF).copyTo(mDescriptor);
 
+    mWorldPosSeq.Store(cv::Matx31f(mWorldPos));
+    PublishViewInfo();
+    PublishDescriptor();
+
     // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
     unique_lock<mutex> lock(mpMap->mMutexPointCreation);
-    mnId=nNextId++;
+    mnId=mpContext->NewMapPointId();
 }
 
 void MapPoint::SetWorldPos(const cv::Mat &Pos)
 {
-    unique_lock<mutex> lock2(mGlobalMutex);
+    unique_lock<mutex> lock2(mpContext->mGlobalMutex);
     unique_lock<mutex> lock(mMutexPos);
     Pos.copyTo(mWorldPos);
+    mWorldPosSeq.Store(cv::Matx31f(mWorldPos));
 }
 
 cv::Mat MapPoint::GetWorldPos()
 {
-    unique_lock<mutex> lock(mMutexPos);
-    return mWorldPos.clone();
+    return cv::Mat(mWorldPosSeq.Load(),true);
 }
 
 cv::Mat MapPoint::GetNormal()
 {
-    unique_lock<mutex> lock(mMutexPos);
-    return mNormalVector.clone();
+    return cv::Mat(mViewInfoSeq.Load().normal,true);
+}
+
+cv::Matx31f MapPoint::GetWorldPos3f() const
+{
+    return mWorldPosSeq.Load();
+}
+
+cv::Matx31f MapPoint::GetNormal3f() const
+{
+    return mViewInfoSeq.Load().normal;
+}
+
+bool MapPoint::GetDescriptor(Descriptor &descriptor) const
+{
+    if(!mbHasDescriptor.load(std::memory_order_acquire))
+        return false;
+    descriptor = mDescriptorSeq.Load();
+    return true;
+}
+
+void MapPoint::PublishViewInfo()
+{
+    ViewInfo info;
+    info.normal = cv::Matx31f(mNormalVector);
+    info.fMinDistance = mfMinDistance;
+    info.fMaxDistance = mfMaxDistance;
+    mViewInfoSeq.Store(info);
+}
+
+void MapPoint::PublishDescriptor()
+{
+    if(mDescriptor.total()*mDescriptor.elemSize()!=sizeof(Descriptor))
+        return;
+    Descriptor d;
+    memcpy(d.val,mDescriptor.ptr<uchar>(),sizeof(Descriptor));
+    mDescriptorSeq.Store(d);
+    mbHasDescriptor.store(true,std::memory_order_release);
 }
 
 KeyFrame* MapPoint::GetReferenceKeyFrame()
@@ -142,6 +181,12 @@ map<KeyFrame*, size_t> MapPoint::GetObservations()
     return mObservations;
 }
 
+void MapPoint::GetObservations(vector<pair<KeyFrame*,size_t> > &vObs)
+{
+    unique_lock<mutex> lock(mMutexFeatures);
+    vObs.insert(vObs.end(),mObservations.begin(),mObservations.end());
+}
+
 int MapPoint::Observations()
 {
     unique_lock<mutex> lock(mMutexFeatures);
@@ -303,13 +348,20 @@ void MapPoint::ComputeDistinctiveDescriptors()
     {
         unique_lock<mutex> lock(mMutexFeatures);
         mDescriptor = vDescriptors[BestIdx].clone();
+        PublishDescriptor();
     }
 }
 
 cv::Mat MapPoint::GetDescriptor()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    return mDescriptor.clone();
+    Descriptor d;
+    if(!GetDescriptor(d))
+    {
+        // Not published yet (or not an ORB descriptor)
+        unique_lock<mutex> lock(mMutexFeatures);
+        return mDescriptor.clone();
+    }
+    return cv::Mat(1,sizeof(Descriptor),CV_8U,d.val).clone();
 }
 
 int MapPoint::GetIndexInKeyFrame(KeyFrame *pKF)
@@ -351,7 +403,7 @@ void MapPoint::UpdateNormalAndDepth()
     {
         KeyFrame* pKF = mit->first;
         cv::Mat Owi = pKF->GetCameraCenter();
-        cv::Mat normali = mWorldPos - Owi;
+        cv::Mat normali = Pos - Owi;
         normal = normal + normali/cv::norm(normali);
         n++;
     }
@@ -367,28 +419,23 @@ void MapPoint::UpdateNormalAndDepth()
         mfMaxDistance = dist*levelScaleFactor;
         mfMinDistance = mfMaxDistance/pRefKF->mvScaleFactors[nLevels-1];
         mNormalVector = normal/n;
+        PublishViewInfo();
     }
 }
 
 float MapPoint::GetMinDistanceInvariance()
 {
-    unique_lock<mutex> lock(mMutexPos);
-    return 0.8f*mfMinDistance;
+    return 0.8f*mViewInfoSeq.Load().fMinDistance;
 }
 
 float MapPoint::GetMaxDistanceInvariance()
 {
-    unique_lock<mutex> lock(mMutexPos);
-    return 1.2f*mfMaxDistance;
+    return 1.2f*mViewInfoSeq.Load().fMaxDistance;
 }
 
 int MapPoint::PredictScale(const float &currentDist, KeyFrame* pKF)
 {
-    float ratio;
-    {
-        unique_lock<mutex> lock(mMutexPos);
-        ratio = mfMaxDistance/currentDist;
-    }
+    const float ratio = mViewInfoSeq.Load().fMaxDistance/currentDist;
 
     int nScale = ceil(log(ratio)/pKF->mfLogScaleFactor);
     if(nScale<0)
@@ -401,11 +448,7 @@ int MapPoint::PredictScale(const float &currentDist, KeyFrame* pKF)
 
 int MapPoint::PredictScale(const float &currentDist, Frame* pF)
 {
-    float ratio;
-    {
-        unique_lock<mutex> lock(mMutexPos);
-        ratio = mfMaxDistance/currentDist;
-    }
+    const float ratio = mViewInfoSeq.Load().fMaxDistance/currentDist;
 
     int nScale = ceil(log(ratio)/pF->mfLogScaleFactor);
     if(nScale<0)
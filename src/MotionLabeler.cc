@@ -0,0 +1,198 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "MotionLabeler.h"
+
+#include "Scheduler.h"
+
+#include<opencv2/calib3d/calib3d.hpp>
+
+#include<Eigen/Core>
+
+#include<iostream>
+#include<chrono>
+#include<cmath>
+
+namespace ORB_SLAM2
+{
+
+// Runs the expansion jobs of GCoptimization on the scheduler
+static void SchedulerParallelFor(int count, GCoptimization::JobFn job, void* jobData, void* extraData)
+{
+    Scheduler* pScheduler = static_cast<Scheduler*>(extraData);
+    pScheduler->ParallelFor(count,[&](int begin, int end, int thread)
+    {
+        for(int i=begin; i<end; i++)
+            job(i,thread,jobData);
+    });
+}
+
+MotionLabeler::MotionLabeler(const double lambda, const double beta, const double thRepro, Scheduler* pScheduler):
+    mLambda(lambda), mBeta(beta), mThRepro(thRepro), mbVerbose(false), mEnergy(1024, 8192),
+    mpScheduler(pScheduler)
+{
+}
+
+MotionLabeler::~MotionLabeler()
+{
+    for(size_t t=0; t<mvThreadEnergies.size(); t++)
+        delete mvThreadEnergies[t];
+}
+
+long long MotionLabeler::Label(const std::vector<cv::Point3d> &vPre3d, const std::vector<cv::Point2d> &vCur2d,
+                               const cv::Mat &Mods, const cv::Mat &K, const std::vector<int> &vOffsets,
+                               const std::vector<int> &vAdj, std::vector<int> &vLabels, const int maxIterations)
+{
+    const int N = vPre3d.size();
+    const int L = Mods.cols;
+
+    // Nothing to choose
+    if(N<2 || L<2)
+        return 0;
+
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    ComputeDataCosts(vPre3d,vCur2d,Mods,K);
+    ComputeNeighborWeights(vCur2d,vOffsets,vAdj);
+    std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+    const double tDataCost = std::chrono::duration_cast<std::chrono::duration<double> >(t2 - t1).count();
+
+    // Potts model
+    mvSmoothCost.assign(L*L,(EnergyTermType)std::floor(mBeta+0.5));
+    for(int l=0; l<L; l++)
+        mvSmoothCost[l*L+l] = 0;
+
+    GCoptimizationGeneralGraph gc(N,L);
+    gc.setWorkspace(&mEnergy);
+    gc.setThreadWorkspaces(&mvThreadEnergies);
+    gc.setDataCost(mvDataCost.data());
+    gc.setSmoothCost(mvSmoothCost.data());
+    gc.setNeighborsCSR(vOffsets.data(),vAdj.data(),mvWeights.data());
+    if(mpScheduler)
+        gc.setParallelFor(&SchedulerParallelFor,mpScheduler,mpScheduler->Concurrency());
+
+    for(int i=0; i<N; i++)
+        gc.setLabel(i,vLabels[i]);
+
+    const long long E = gc.expansion(maxIterations);
+
+    for(int i=0; i<N; i++)
+        vLabels[i] = gc.whatLabel(i);
+
+    PrintTimings(gc,tDataCost);
+
+    return E;
+}
+
+void MotionLabeler::ComputeDataCosts(const std::vector<cv::Point3d> &vPre3d, const std::vector<cv::Point2d> &vCur2d,
+                                     const cv::Mat &Mods, const cv::Mat &K)
+{
+    const int N = vPre3d.size();
+    const int L = Mods.cols;
+
+    const double fx = K.at<double>(0,0);
+    const double fy = K.at<double>(1,1);
+    const double cx = K.at<double>(0,2);
+    const double cy = K.at<double>(1,2);
+
+    Eigen::Matrix3Xd X(3,N);
+    Eigen::ArrayXd u(N), v(N);
+    for(int i=0; i<N; i++)
+    {
+        X(0,i) = vPre3d[i].x; X(1,i) = vPre3d[i].y; X(2,i) = vPre3d[i].z;
+        u(i) = vCur2d[i].x; v(i) = vCur2d[i].y;
+    }
+
+    // Inside the threshold the cost grows with the squared reprojection error, outside it is constant
+    const EnergyTermType outlierCost = 2*(EnergyTermType)std::floor(mLambda+0.5);
+    const double scale = mLambda/mThRepro;
+
+    mvDataCost.resize(N*L);
+    Eigen::Map<Eigen::Matrix<EnergyTermType,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> > D(mvDataCost.data(),N,L);
+
+    cv::Mat R;
+    for(int l=0; l<L; l++)
+    {
+        cv::Rodrigues(Mods.col(l).rowRange(0,3),R);
+        Eigen::Matrix3d Rl;
+        Eigen::Vector3d tl;
+        for(int r=0; r<3; r++)
+        {
+            for(int c=0; c<3; c++)
+                Rl(r,c) = R.at<double>(r,c);
+            tl(r) = Mods.at<double>(3+r,l);
+        }
+
+        const Eigen::Matrix3Xd Xc = (Rl*X).colwise() + tl;
+        const Eigen::ArrayXd invz = Xc.row(2).array().inverse().transpose();
+        const Eigen::ArrayXd du = fx*Xc.row(0).array().transpose()*invz + cx - u;
+        const Eigen::ArrayXd dv = fy*Xc.row(1).array().transpose()*invz + cy - v;
+        const Eigen::ArrayXd d2 = du.square() + dv.square();
+
+        D.col(l) = (d2<mThRepro).select((scale*d2+0.5).cast<EnergyTermType>(),outlierCost).matrix();
+    }
+}
+
+void MotionLabeler::ComputeNeighborWeights(const std::vector<cv::Point2d> &vCur2d, const std::vector<int> &vOffsets,
+                                           const std::vector<int> &vAdj)
+{
+    const int N = vCur2d.size();
+
+    mvWeights.resize(vAdj.size());
+    for(int i=0; i<N; i++)
+    {
+        for(int k=vOffsets[i]; k<vOffsets[i+1]; k++)
+        {
+            const cv::Point2d d = vCur2d[i]-vCur2d[vAdj[k]];
+            mvWeights[k] = (EnergyTermType)std::floor(100.0*std::exp(-std::sqrt(d.x*d.x+d.y*d.y)/49.0)+0.5);
+        }
+    }
+}
+
+void MotionLabeler::PrintTimings(const GCoptimization &gc, const double tDataCost) const
+{
+    const std::vector<GCoptimization::ExpansionTiming> &vTimings = gc.expansionTimings();
+
+    double tSetup = 0, tMaxflow = 0, tTotal = 0;
+    int nImproved = 0;
+    for(size_t i=0; i<vTimings.size(); i++)
+    {
+        const GCoptimization::ExpansionTiming &t = vTimings[i];
+        const double setup = 1000.0*t.setupTicks/GCO_CLOCKS_PER_SEC;
+        const double maxflow = 1000.0*t.maxflowTicks/GCO_CLOCKS_PER_SEC;
+        tSetup += setup;
+        tMaxflow += maxflow;
+        tTotal += 1000.0*t.totalTicks/GCO_CLOCKS_PER_SEC;
+        if(t.improved)
+            nImproved++;
+
+        if(mbVerbose)
+            std::cout << "(Labeling) expansion " << t.label << ": " << t.numVars << " vars in " << t.numComponents
+                      << " components, setup " << setup
+                      << " ms, maxflow " << maxflow << " ms" << (t.improved ? " (improved)" : "") << std::endl;
+    }
+
+    if(mbVerbose)
+        std::cout << "(Labeling) costs " << 1000.0*tDataCost << " ms, " << vTimings.size() << " expansions ("
+                  << nImproved << " improved) in " << tTotal << " ms, setup " << tSetup << " ms, maxflow " << tMaxflow
+                  << " ms" << std::endl;
+}
+
+} //namespace ORB_SLAM
@@ -26,6 +26,8 @@
 #include<opencv2/features2d/features2d.hpp>
 
 #include "Thirdparty/DBoW2/DBoW2/FeatureVector.h"
+#include "Thirdparty/DBoW2/DBoW2/FORB.h"
+#include "Scheduler.h"
 
 #ifdef __APPLE__
 #include<stdint.h>
@@ -415,20 +417,28 @@ int ORBmatcher::ProjMatching(Frame &CurrentFrame, Frame &LastFrame, vector<int>
     return nmatches;
 }
 
-int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoints, const float th)
+int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoints, const float th, Scheduler* pScheduler)
 {
-    int nmatches=0;
-
     const bool bFactor = th!=1.0;
 
-    for(size_t iMP=0; iMP<vpMapPoints.size(); iMP++)
+    // Keypoints already associated to a MapPoint with observations cannot be taken
+    vector<char> vbTaken(F.N,false);
+    for(int i=0; i<F.N; i++)
+    {
+        if(F.mvpMapPoints[i])
+            if(F.mvpMapPoints[i]->Observations()>0)
+                vbTaken[i]=true;
+    }
+
+    auto propose = [&](const int iMP, const vector<char> &vbBlocked, int &bestDist,
+                       vector<size_t> &vIndices, vector<size_t> &vCandidates) -> int
     {
         MapPoint* pMP = vpMapPoints[iMP];
         if(!pMP->mbTrackInView)
-            continue;
+            return -1;
 
         if(pMP->isBad())
-            continue;
+            return -1;
 
         const int &nPredictedLevel = pMP->mnTrackScaleLevel;
 
@@ -438,28 +448,22 @@ int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoint
         if(bFactor)
             r*=th;
 
-        const vector<size_t> vIndices =
-                F.GetFeaturesInArea(pMP->mTrackProjX,pMP->mTrackProjY,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel);
+        F.GetFeaturesInArea(pMP->mTrackProjX,pMP->mTrackProjY,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel,vIndices);
 
         if(vIndices.empty())
-            continue;
+            return -1;
 
-        const cv::Mat MPdescriptor = pMP->GetDescriptor();
+        MapPoint::Descriptor MPdescriptor;
+        if(!pMP->GetDescriptor(MPdescriptor))
+            return -1;
 
-        int bestDist=256;
-        int bestLevel= -1;
-        int bestDist2=256;
-        int bestLevel2 = -1;
-        int bestIdx =-1 ;
-
-        // Get best and second matches with near keypoints
+        vCandidates.clear();
         for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
         {
             const size_t idx = *vit;
 
-            if(F.mvpMapPoints[idx])
-                if(F.mvpMapPoints[idx]->Observations()>0)
-                    continue;
+            if(vbBlocked[idx])
+                continue;
 
             if(F.mvuRight[idx]>0)
             {
@@ -468,37 +472,108 @@ int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoint
                     continue;
             }
 
-            const cv::Mat &d = F.mDescriptors.row(idx);
+            vCandidates.push_back(idx);
+        }
 
-            const int dist = DescriptorDistance(MPdescriptor,d);
+        // Get best and second matches with near keypoints
+        int bestPos, bestDist2, bestPos2;
+        SearchBestTwo(MPdescriptor.val,F.mDescriptors,vCandidates,bestDist,bestPos,bestDist2,bestPos2);
 
-            if(dist<bestDist)
-            {
-                bestDist2=bestDist;
-                bestDist=dist;
-                bestLevel2 = bestLevel;
-                bestLevel = F.mvKeysUn[idx].octave;
-                bestIdx=idx;
-            }
-            else if(dist<bestDist2)
+        if(bestDist>TH_HIGH)
+            return -1;
+
+        // Apply ratio to second match (only if best and second are in the same scale level)
+        const int bestIdx = vCandidates[bestPos];
+        const int bestLevel = F.mvKeysUn[bestIdx].octave;
+        const int bestLevel2 = bestPos2>=0 ? F.mvKeysUn[vCandidates[bestPos2]].octave : -1;
+        if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
+            return -1;
+
+        return bestIdx;
+    };
+
+    vector<int> vMatches;
+    ResolveProjections(vpMapPoints.size(),vbTaken,propose,pScheduler,vMatches);
+
+    int nmatches=0;
+    for(size_t iMP=0; iMP<vpMapPoints.size(); iMP++)
+    {
+        if(vMatches[iMP]<0)
+            continue;
+
+        F.mvpMapPoints[vMatches[iMP]]=vpMapPoints[iMP];
+        nmatches++;
+    }
+
+    return nmatches;
+}
+
+void ORBmatcher::ResolveProjections(const int nItems, vector<char> &vbTaken, const ProposalFunction &propose,
+                                    Scheduler* pScheduler, vector<int> &vItemMatches)
+{
+    vItemMatches.assign(nItems,-1);
+
+    vector<int> vProposal(nItems,-1);
+    vector<int> vDist(nItems,256);
+    vector<int> vOwner(vbTaken.size(),-1);
+
+    vector<int> vPending(nItems);
+    for(int i=0; i<nItems; i++)
+        vPending[i]=i;
+
+    while(!vPending.empty())
+    {
+        auto search = [&](int begin, int end, int)
+        {
+            vector<size_t> vIndices;
+            vector<size_t> vCandidates;
+            for(int i=begin; i<end; i++)
             {
-                bestLevel2 = F.mvKeysUn[idx].octave;
-                bestDist2=dist;
+                const int item = vPending[i];
+                vProposal[item] = propose(item,vbTaken,vDist[item],vIndices,vCandidates);
             }
+        };
+
+        if(pScheduler)
+            pScheduler->ParallelFor(vPending.size(),search);
+        else
+            search(0,vPending.size(),0);
+
+        // Each keypoint goes to its closest proposal, the lowest item on ties (pending items are sorted)
+        for(vector<int>::const_iterator it=vPending.begin(), itend=vPending.end(); it!=itend; it++)
+        {
+            const int k = vProposal[*it];
+            if(k<0)
+                continue;
+            if(vOwner[k]<0 || vDist[*it]<vDist[vOwner[k]])
+                vOwner[k]=*it;
         }
 
-        // Apply ratio to second match (only if best and second are in the same scale level)
-        if(bestDist<=TH_HIGH)
+        // The losers search again without the keypoints taken in this round
+        vector<int> vNextPending;
+        for(vector<int>::const_iterator it=vPending.begin(), itend=vPending.end(); it!=itend; it++)
         {
-            if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
+            const int k = vProposal[*it];
+            if(k<0)
                 continue;
 
-            F.mvpMapPoints[bestIdx]=pMP;
-            nmatches++;
+            if(vOwner[k]==*it)
+            {
+                vItemMatches[*it]=k;
+                vbTaken[k]=true;
+            }
+            else
+                vNextPending.push_back(*it);
         }
-    }
 
-    return nmatches;
+        for(vector<int>::const_iterator it=vPending.begin(), itend=vPending.end(); it!=itend; it++)
+        {
+            if(vProposal[*it]>=0)
+                vOwner[vProposal[*it]]=-1;
+        }
+
+        vPending.swap(vNextPending);
+    }
 }
 
 float ORBmatcher::RadiusByViewingCos(const float &viewCos)
@@ -550,12 +625,14 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
     DBoW2::FeatureVector::const_iterator KFend = vFeatVecKF.end();
     DBoW2::FeatureVector::const_iterator Fend = F.mFeatVec.end();
 
+    vector<size_t> vCandidates;
+
     while(KFit != KFend && Fit != Fend)
     {
         if(KFit->first == Fit->first)
         {
-            const vector<unsigned int> vIndicesKF = KFit->second;
-            const vector<unsigned int> vIndicesF = Fit->second;
+            const vector<unsigned int> &vIndicesKF = KFit->second;
+            const vector<unsigned int> &vIndicesF = Fit->second;
 
             for(size_t iKF=0; iKF<vIndicesKF.size(); iKF++)
             {
@@ -569,12 +646,7 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
                 if(pMP->isBad())
                     continue;
 
-                const cv::Mat &dKF= pKF->mDescriptors.row(realIdxKF);
-
-                int bestDist1=256;
-                int bestIdxF =-1 ;
-                int bestDist2=256;
-
+                vCandidates.clear();
                 for(size_t iF=0; iF<vIndicesF.size(); iF++)
                 {
                     const unsigned int realIdxF = vIndicesF[iF];
@@ -582,26 +654,17 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
                     if(vpMapPointMatches[realIdxF])
                         continue;
 
-                    const cv::Mat &dF = F.mDescriptors.row(realIdxF);
-
-                    const int dist =  DescriptorDistance(dKF,dF);
-
-                    if(dist<bestDist1)
-                    {
-                        bestDist2=bestDist1;
-                        bestDist1=dist;
-                        bestIdxF=realIdxF;
-                    }
-                    else if(dist<bestDist2)
-                    {
-                        bestDist2=dist;
-                    }
+                    vCandidates.push_back(realIdxF);
                 }
 
+                int bestDist1, bestPosF, bestDist2, bestPos2;
+                SearchBestTwo(pKF->mDescriptors.ptr<uchar>(realIdxKF),F.mDescriptors,vCandidates,bestDist1,bestPosF,bestDist2,bestPos2);
+
                 if(bestDist1<=TH_LOW)
                 {
                     if(static_cast<float>(bestDist1)<mfNNratio*static_cast<float>(bestDist2))
                     {
+                        const int bestIdxF = vCandidates[bestPosF];
                         vpMapPointMatches[bestIdxF]=pMP;
                         // TemperalMatch[bestIdxF] = realIdxKF;
 
@@ -683,6 +746,9 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
 
     int nmatches=0;
 
+    vector<size_t> vIndices;
+    vector<size_t> vCandidates;
+
     // For each Candidate MapPoint Project and Match
     for(int iMP=0, iendMP=vpPoints.size(); iMP<iendMP; iMP++)
     {
@@ -734,7 +800,7 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
         // Search in a radius
         const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
 
-        const vector<size_t> vIndices = pKF->GetFeaturesInArea(u,v,radius);
+        pKF->GetFeaturesInArea(u,v,radius,vIndices);
 
         if(vIndices.empty())
             continue;
@@ -742,8 +808,7 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
         // Match to the most similar keypoint in the radius
         const cv::Mat dMP = pMP->GetDescriptor();
 
-        int bestDist = 256;
-        int bestIdx = -1;
+        vCandidates.clear();
         for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
         {
             const size_t idx = *vit;
@@ -755,20 +820,15 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
             if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP,dKF);
-
-            if(dist<bestDist)
-            {
-                bestDist = dist;
-                bestIdx = idx;
-            }
+            vCandidates.push_back(idx);
         }
 
+        int bestDist, bestPos, bestDist2, bestPos2;
+        SearchBestTwo(dMP.ptr<uchar>(),pKF->mDescriptors,vCandidates,bestDist,bestPos,bestDist2,bestPos2);
+
         if(bestDist<=TH_LOW)
         {
-            vpMatched[bestIdx]=pMP;
+            vpMatched[vCandidates[bestPos]]=pMP;
             nmatches++;
         }
 
@@ -790,6 +850,9 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
     vector<int> vMatchedDistance(F2.mvKeysUn.size(),INT_MAX);
     vector<int> vnMatches21(F2.mvKeysUn.size(),-1);
 
+    vector<size_t> vIndices2;
+    vector<int> vDist2;
+
     for(size_t i1=0, iend1=F1.mvKeysUn.size(); i1<iend1; i1++)
     {
         cv::KeyPoint kp1 = F1.mvKeysUn[i1];
@@ -797,24 +860,21 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
         if(level1>0)
             continue;
 
-        vector<size_t> vIndices2 = F2.GetFeaturesInArea(vbPrevMatched[i1].x,vbPrevMatched[i1].y, windowSize,level1,level1);
+        F2.GetFeaturesInArea(vbPrevMatched[i1].x,vbPrevMatched[i1].y, windowSize,level1,level1,vIndices2);
 
         if(vIndices2.empty())
             continue;
 
-        cv::Mat d1 = F1.mDescriptors.row(i1);
+        DescriptorDistances(F1.mDescriptors.ptr<uchar>(i1),F2.mDescriptors,vIndices2,vDist2);
 
         int bestDist = INT_MAX;
         int bestDist2 = INT_MAX;
         int bestIdx2 = -1;
 
-        for(vector<size_t>::iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
+        for(size_t j=0, jend=vIndices2.size(); j<jend; j++)
         {
-            size_t i2 = *vit;
-
-            cv::Mat d2 = F2.mDescriptors.row(i2);
-
-            int dist = DescriptorDistance(d1,d2);
+            const size_t i2 = vIndices2[j];
+            const int dist = vDist2[j];
 
             if(vMatchedDistance[i2]<=dist)
                 continue;
@@ -922,6 +982,8 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
     DBoW2::FeatureVector::const_iterator f1end = vFeatVec1.end();
     DBoW2::FeatureVector::const_iterator f2end = vFeatVec2.end();
 
+    vector<size_t> vCandidates;
+
     while(f1it != f1end && f2it != f2end)
     {
         if(f1it->first == f2it->first)
@@ -936,12 +998,7 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
                 if(pMP1->isBad())
                     continue;
 
-                const cv::Mat &d1 = Descriptors1.row(idx1);
-
-                int bestDist1=256;
-                int bestIdx2 =-1 ;
-                int bestDist2=256;
-
+                vCandidates.clear();
                 for(size_t i2=0, iend2=f2it->second.size(); i2<iend2; i2++)
                 {
                     const size_t idx2 = f2it->second[i2];
@@ -954,26 +1011,17 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
                     if(pMP2->isBad())
                         continue;
 
-                    const cv::Mat &d2 = Descriptors2.row(idx2);
-
-                    int dist = DescriptorDistance(d1,d2);
-
-                    if(dist<bestDist1)
-                    {
-                        bestDist2=bestDist1;
-                        bestDist1=dist;
-                        bestIdx2=idx2;
-                    }
-                    else if(dist<bestDist2)
-                    {
-                        bestDist2=dist;
-                    }
+                    vCandidates.push_back(idx2);
                 }
 
+                int bestDist1, bestPos, bestDist2, bestPos2;
+                SearchBestTwo(Descriptors1.ptr<uchar>(idx1),Descriptors2,vCandidates,bestDist1,bestPos,bestDist2,bestPos2);
+
                 if(bestDist1<TH_LOW)
                 {
                     if(static_cast<float>(bestDist1)<mfNNratio*static_cast<float>(bestDist2))
                     {
+                        const size_t bestIdx2 = vCandidates[bestPos];
                         vpMatches12[idx1]=vpMapPoints2[bestIdx2];
                         vbMatched2[bestIdx2]=true;
 
@@ -1063,6 +1111,9 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
     DBoW2::FeatureVector::const_iterator f1end = vFeatVec1.end();
     DBoW2::FeatureVector::const_iterator f2end = vFeatVec2.end();
 
+    vector<size_t> vCandidates;
+    vector<int> vDist;
+
     while(f1it!=f1end && f2it!=f2end)
     {
         if(f1it->first == f2it->first)
@@ -1085,11 +1136,7 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
                 
                 const cv::KeyPoint &kp1 = pKF1->mvKeysUn[idx1];
                 
-                const cv::Mat &d1 = pKF1->mDescriptors.row(idx1);
-                
-                int bestDist = TH_LOW;
-                int bestIdx2 = -1;
-                
+                vCandidates.clear();
                 for(size_t i2=0, iend2=f2it->second.size(); i2<iend2; i2++)
                 {
                     size_t idx2 = f2it->second[i2];
@@ -1100,19 +1147,28 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
                     if(vbMatched2[idx2] || pMP2)
                         continue;
 
-                    const bool bStereo2 = pKF2->mvuRight[idx2]>=0;
-
                     if(bOnlyStereo)
-                        if(!bStereo2)
+                        if(pKF2->mvuRight[idx2]<0)
                             continue;
-                    
-                    const cv::Mat &d2 = pKF2->mDescriptors.row(idx2);
-                    
-                    const int dist = DescriptorDistance(d1,d2);
+
+                    vCandidates.push_back(idx2);
+                }
+
+                DescriptorDistances(pKF1->mDescriptors.ptr<uchar>(idx1),pKF2->mDescriptors,vCandidates,vDist);
+
+                int bestDist = TH_LOW;
+                int bestIdx2 = -1;
+                
+                for(size_t j=0, jend=vCandidates.size(); j<jend; j++)
+                {
+                    const size_t idx2 = vCandidates[j];
+                    const int dist = vDist[j];
                     
                     if(dist>TH_LOW || dist>bestDist)
                         continue;
 
+                    const bool bStereo2 = pKF2->mvuRight[idx2]>=0;
+
                     const cv::KeyPoint &kp2 = pKF2->mvKeysUn[idx2];
 
                     if(!bStereo1 && !bStereo2)
@@ -1214,6 +1270,9 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
 
     const int nMPs = vpMapPoints.size();
 
+    vector<size_t> vIndices;
+    vector<size_t> vCandidates;
+
     for(int i=0; i<nMPs; i++)
     {
         MapPoint* pMP = vpMapPoints[i];
@@ -1264,7 +1323,7 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
         // Search in a radius
         const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
 
-        const vector<size_t> vIndices = pKF->GetFeaturesInArea(u,v,radius);
+        pKF->GetFeaturesInArea(u,v,radius,vIndices);
 
         if(vIndices.empty())
             continue;
@@ -1273,8 +1332,7 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
 
         const cv::Mat dMP = pMP->GetDescriptor();
 
-        int bestDist = 256;
-        int bestIdx = -1;
+        vCandidates.clear();
         for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
         {
             const size_t idx = *vit;
@@ -1312,20 +1370,16 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
                     continue;
             }
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP,dKF);
-
-            if(dist<bestDist)
-            {
-                bestDist = dist;
-                bestIdx = idx;
-            }
+            vCandidates.push_back(idx);
         }
 
+        int bestDist, bestPos, bestDist2, bestPos2;
+        SearchBestTwo(dMP.ptr<uchar>(),pKF->mDescriptors,vCandidates,bestDist,bestPos,bestDist2,bestPos2);
+
         // If there is already a MapPoint replace otherwise add new measurement
         if(bestDist<=TH_LOW)
         {
+            const int bestIdx = vCandidates[bestPos];
             MapPoint* pMPinKF = pKF->GetMapPoint(bestIdx);
             if(pMPinKF)
             {
@@ -1371,6 +1425,9 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
 
     const int nPoints = vpPoints.size();
 
+    vector<size_t> vIndices;
+    vector<size_t> vCandidates;
+
     // For each candidate MapPoint project and match
     for(int iMP=0; iMP<nPoints; iMP++)
     {
@@ -1423,7 +1480,7 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
         // Search in a radius
         const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
 
-        const vector<size_t> vIndices = pKF->GetFeaturesInArea(u,v,radius);
+        pKF->GetFeaturesInArea(u,v,radius,vIndices);
 
         if(vIndices.empty())
             continue;
@@ -1432,8 +1489,7 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
 
         const cv::Mat dMP = pMP->GetDescriptor();
 
-        int bestDist = INT_MAX;
-        int bestIdx = -1;
+        vCandidates.clear();
         for(vector<size_t>::const_iterator vit=vIndices.begin(); vit!=vIndices.end(); vit++)
         {
             const size_t idx = *vit;
@@ -1442,20 +1498,16 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
             if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-            int dist = DescriptorDistance(dMP,dKF);
-
-            if(dist<bestDist)
-            {
-                bestDist = dist;
-                bestIdx = idx;
-            }
+            vCandidates.push_back(idx);
         }
 
+        int bestDist, bestPos, bestDist2, bestPos2;
+        SearchBestTwo(dMP.ptr<uchar>(),pKF->mDescriptors,vCandidates,bestDist,bestPos,bestDist2,bestPos2);
+
         // If there is already a MapPoint replace otherwise add new measurement
         if(bestDist<=TH_LOW)
         {
+            const int bestIdx = vCandidates[bestPos];
             MapPoint* pMPinKF = pKF->GetMapPoint(bestIdx);
             if(pMPinKF)
             {
@@ -1519,6 +1571,9 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
     vector<int> vnMatch1(N1,-1);
     vector<int> vnMatch2(N2,-1);
 
+    vector<size_t> vIndices;
+    vector<size_t> vCandidates;
+
     // Transform from KF1 to KF2 and search
     for(int i1=0; i1<N1; i1++)
     {
@@ -1563,7 +1618,7 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
         // Search in a radius
         const float radius = th*pKF2->mvScaleFactors[nPredictedLevel];
 
-        const vector<size_t> vIndices = pKF2->GetFeaturesInArea(u,v,radius);
+        pKF2->GetFeaturesInArea(u,v,radius,vIndices);
 
         if(vIndices.empty())
             continue;
@@ -1571,8 +1626,7 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
         // Match to the most similar keypoint in the radius
         const cv::Mat dMP = pMP->GetDescriptor();
 
-        int bestDist = INT_MAX;
-        int bestIdx = -1;
+        vCandidates.clear();
         for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
         {
             const size_t idx = *vit;
@@ -1582,20 +1636,15 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
             if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF2->mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP,dKF);
-
-            if(dist<bestDist)
-            {
-                bestDist = dist;
-                bestIdx = idx;
-            }
+            vCandidates.push_back(idx);
         }
 
+        int bestDist, bestPos, bestDist2, bestPos2;
+        SearchBestTwo(dMP.ptr<uchar>(),pKF2->mDescriptors,vCandidates,bestDist,bestPos,bestDist2,bestPos2);
+
         if(bestDist<=TH_HIGH)
         {
-            vnMatch1[i1]=bestIdx;
+            vnMatch1[i1]=vCandidates[bestPos];
         }
     }
 
@@ -1643,7 +1692,7 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
         // Search in a radius of 2.5*sigma(ScaleLevel)
         const float radius = th*pKF1->mvScaleFactors[nPredictedLevel];
 
-        const vector<size_t> vIndices = pKF1->GetFeaturesInArea(u,v,radius);
+        pKF1->GetFeaturesInArea(u,v,radius,vIndices);
 
         if(vIndices.empty())
             continue;
@@ -1651,8 +1700,7 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
         // Match to the most similar keypoint in the radius
         const cv::Mat dMP = pMP->GetDescriptor();
 
-        int bestDist = INT_MAX;
-        int bestIdx = -1;
+        vCandidates.clear();
         for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
         {
             const size_t idx = *vit;
@@ -1662,20 +1710,15 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
             if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF1->mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP,dKF);
-
-            if(dist<bestDist)
-            {
-                bestDist = dist;
-                bestIdx = idx;
-            }
+            vCandidates.push_back(idx);
         }
 
+        int bestDist, bestPos, bestDist2, bestPos2;
+        SearchBestTwo(dMP.ptr<uchar>(),pKF1->mDescriptors,vCandidates,bestDist,bestPos,bestDist2,bestPos2);
+
         if(bestDist<=TH_HIGH)
         {
-            vnMatch2[i2]=bestIdx;
+            vnMatch2[i2]=vCandidates[bestPos];
         }
     }
 
@@ -1955,7 +1998,8 @@ int ORBmatcher::SearchByQuadKeyFrame(KeyFrame* pKF,Frame &F, vector<MapPoint*> v
 }
 
 
-int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono, vector<int> &TemperalMatch)
+int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono, vector<int> &TemperalMatch,
+                                   Scheduler* pScheduler)
 {
     int nmatches = 0;
 
@@ -1978,100 +2022,113 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
     const bool bForward = tlc.at<float>(2)>CurrentFrame.mb && !bMono;
     const bool bBackward = -tlc.at<float>(2)>CurrentFrame.mb && !bMono;
 
-    for(int i=0; i<LastFrame.N; i++)
+    const cv::Matx33f Rcw3(Rcw);
+    const cv::Matx31f tcw3(tcw);
+
+    // Keypoints already associated to a MapPoint with observations cannot be taken
+    vector<char> vbTaken(CurrentFrame.N,false);
+    for(int i2=0; i2<CurrentFrame.N; i2++)
+    {
+        if(CurrentFrame.mvpMapPoints[i2])
+            if(CurrentFrame.mvpMapPoints[i2]->Observations()>0)
+                vbTaken[i2]=true;
+    }
+
+    auto propose = [&](const int i, const vector<char> &vbBlocked, int &bestDist,
+                       vector<size_t> &vIndices2, vector<size_t> &vCandidates) -> int
     {
         MapPoint* pMP = LastFrame.mvpMapPoints[i];
 
-        if(pMP)
-        {
-            if(!LastFrame.mvbOutlier[i])
-            {
-                // Project
-                cv::Mat x3Dw = pMP->GetWorldPos();
-                cv::Mat x3Dc = Rcw*x3Dw+tcw;
+        if(!pMP || LastFrame.mvbOutlier[i])
+            return -1;
 
-                const float xc = x3Dc.at<float>(0);
-                const float yc = x3Dc.at<float>(1);
-                const float invzc = 1.0/x3Dc.at<float>(2);
+        // Project
+        const cv::Matx31f x3Dc = Rcw3*pMP->GetWorldPos3f()+tcw3;
 
-                if(invzc<0)
-                    continue;
+        const float xc = x3Dc(0);
+        const float yc = x3Dc(1);
+        const float invzc = 1.0/x3Dc(2);
 
-                float u = CurrentFrame.fx*xc*invzc+CurrentFrame.cx;
-                float v = CurrentFrame.fy*yc*invzc+CurrentFrame.cy;
+        if(invzc<0)
+            return -1;
 
-                if(u<CurrentFrame.mnMinX || u>CurrentFrame.mnMaxX)
-                    continue;
-                if(v<CurrentFrame.mnMinY || v>CurrentFrame.mnMaxY)
-                    continue;
+        float u = CurrentFrame.fx*xc*invzc+CurrentFrame.cx;
+        float v = CurrentFrame.fy*yc*invzc+CurrentFrame.cy;
 
-                int nLastOctave = LastFrame.mvKeys[i].octave;
+        if(u<CurrentFrame.mnMinX || u>CurrentFrame.mnMaxX)
+            return -1;
+        if(v<CurrentFrame.mnMinY || v>CurrentFrame.mnMaxY)
+            return -1;
 
-                // Search in a window. Size depends on scale
-                float radius = th*CurrentFrame.mvScaleFactors[nLastOctave];
+        int nLastOctave = LastFrame.mvKeys[i].octave;
 
-                vector<size_t> vIndices2;
+        // Search in a window. Size depends on scale
+        float radius = th*CurrentFrame.mvScaleFactors[nLastOctave];
 
-                if(bForward)
-                    vIndices2 = CurrentFrame.GetFeaturesInArea(u,v, radius, nLastOctave);
-                else if(bBackward)
-                    vIndices2 = CurrentFrame.GetFeaturesInArea(u,v, radius, 0, nLastOctave);
-                else
-                    vIndices2 = CurrentFrame.GetFeaturesInArea(u,v, radius, nLastOctave-1, nLastOctave+1);
+        if(bForward)
+            CurrentFrame.GetFeaturesInArea(u,v, radius, nLastOctave, -1, vIndices2);
+        else if(bBackward)
+            CurrentFrame.GetFeaturesInArea(u,v, radius, 0, nLastOctave, vIndices2);
+        else
+            CurrentFrame.GetFeaturesInArea(u,v, radius, nLastOctave-1, nLastOctave+1, vIndices2);
 
-                if(vIndices2.empty())
-                    continue;
+        if(vIndices2.empty())
+            return -1;
 
-                const cv::Mat dMP = pMP->GetDescriptor();
+        MapPoint::Descriptor dMP;
+        if(!pMP->GetDescriptor(dMP))
+            return -1;
 
-                int bestDist = 256;
-                int bestIdx2 = -1;
+        vCandidates.clear();
+        for(vector<size_t>::const_iterator vit=vIndices2.begin(), vend=vIndices2.end(); vit!=vend; vit++)
+        {
+            const size_t i2 = *vit;
+            if(vbBlocked[i2])
+                continue;
 
-                for(vector<size_t>::const_iterator vit=vIndices2.begin(), vend=vIndices2.end(); vit!=vend; vit++)
-                {
-                    const size_t i2 = *vit;
-                    if(CurrentFrame.mvpMapPoints[i2])
-                        if(CurrentFrame.mvpMapPoints[i2]->Observations()>0)
-                            continue;
+            if(CurrentFrame.mvuRight[i2]>0)
+            {
+                const float ur = u - CurrentFrame.mbf*invzc;
+                const float er = fabs(ur - CurrentFrame.mvuRight[i2]);
+                if(er>radius)
+                    continue;
+            }
 
-                    if(CurrentFrame.mvuRight[i2]>0)
-                    {
-                        const float ur = u - CurrentFrame.mbf*invzc;
-                        const float er = fabs(ur - CurrentFrame.mvuRight[i2]);
-                        if(er>radius)
-                            continue;
-                    }
+            vCandidates.push_back(i2);
+        }
 
-                    const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
+        int bestPos, bestDist2, bestPos2;
+        SearchBestTwo(dMP.val,CurrentFrame.mDescriptors,vCandidates,bestDist,bestPos,bestDist2,bestPos2);
 
-                    const int dist = DescriptorDistance(dMP,d);
+        if(bestDist>TH_HIGH)
+            return -1;
 
-                    if(dist<bestDist)
-                    {
-                        bestDist=dist;
-                        bestIdx2=i2;
-                    }
-                }
+        return vCandidates[bestPos];
+    };
 
-                if(bestDist<=TH_HIGH)
-                {
-                    CurrentFrame.mvpMapPoints[bestIdx2]=pMP;
-                    // TemperalMatch[bestIdx2] = i;
-                    nmatches++;
+    vector<int> vMatches;
+    ResolveProjections(LastFrame.N,vbTaken,propose,pScheduler,vMatches);
 
-                    if(mbCheckOrientation)
-                    {
-                        float rot = LastFrame.mvKeysUn[i].angle-CurrentFrame.mvKeysUn[bestIdx2].angle;
-                        if(rot<0.0)
-                            rot+=360.0f;
-                        int bin = round(rot*factor);
-                        if(bin==HISTO_LENGTH)
-                            bin=0;
-                        assert(bin>=0 && bin<HISTO_LENGTH);
-                        rotHist[bin].push_back(bestIdx2);
-                    }
-                }
-            }
+    for(int i=0; i<LastFrame.N; i++)
+    {
+        const int bestIdx2 = vMatches[i];
+        if(bestIdx2<0)
+            continue;
+
+        CurrentFrame.mvpMapPoints[bestIdx2]=LastFrame.mvpMapPoints[i];
+        // TemperalMatch[bestIdx2] = i;
+        nmatches++;
+
+        if(mbCheckOrientation)
+        {
+            float rot = LastFrame.mvKeysUn[i].angle-CurrentFrame.mvKeysUn[bestIdx2].angle;
+            if(rot<0.0)
+                rot+=360.0f;
+            int bin = round(rot*factor);
+            if(bin==HISTO_LENGTH)
+                bin=0;
+            assert(bin>=0 && bin<HISTO_LENGTH);
+            rotHist[bin].push_back(bestIdx2);
         }
     }
 
@@ -2101,13 +2158,14 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
     return nmatches;
 }
 
-int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set<MapPoint*> &sAlreadyFound, const float th , const int ORBdist)
+int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set<MapPoint*> &sAlreadyFound, const float th , const int ORBdist,
+                                   Scheduler* pScheduler)
 {
     int nmatches = 0;
 
-    const cv::Mat Rcw = CurrentFrame.mTcw.rowRange(0,3).colRange(0,3);
-    const cv::Mat tcw = CurrentFrame.mTcw.rowRange(0,3).col(3);
-    const cv::Mat Ow = -Rcw.t()*tcw;
+    const cv::Matx33f Rcw(CurrentFrame.mTcw.rowRange(0,3).colRange(0,3));
+    const cv::Matx31f tcw(CurrentFrame.mTcw.rowRange(0,3).col(3));
+    const cv::Matx31f Ow = -Rcw.t()*tcw;
 
     // Rotation Histogram (to check rotation consistency)
     vector<int> rotHist[HISTO_LENGTH];
@@ -2117,92 +2175,107 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
 
     const vector<MapPoint*> vpMPs = pKF->GetMapPointMatches();
 
-    for(size_t i=0, iend=vpMPs.size(); i<iend; i++)
+    // Keypoints already associated to a MapPoint cannot be taken
+    vector<char> vbTaken(CurrentFrame.N,false);
+    for(int i2=0; i2<CurrentFrame.N; i2++)
+    {
+        if(CurrentFrame.mvpMapPoints[i2])
+            vbTaken[i2]=true;
+    }
+
+    auto propose = [&](const int i, const vector<char> &vbBlocked, int &bestDist,
+                       vector<size_t> &vIndices2, vector<size_t> &vCandidates) -> int
     {
         MapPoint* pMP = vpMPs[i];
 
-        if(pMP)
-        {
-            if(!pMP->isBad() && !sAlreadyFound.count(pMP))
-            {
-                //Project
-                cv::Mat x3Dw = pMP->GetWorldPos();
-                cv::Mat x3Dc = Rcw*x3Dw+tcw;
+        if(!pMP)
+            return -1;
 
-                const float xc = x3Dc.at<float>(0);
-                const float yc = x3Dc.at<float>(1);
-                const float invzc = 1.0/x3Dc.at<float>(2);
+        if(pMP->isBad() || sAlreadyFound.count(pMP))
+            return -1;
 
-                const float u = CurrentFrame.fx*xc*invzc+CurrentFrame.cx;
-                const float v = CurrentFrame.fy*yc*invzc+CurrentFrame.cy;
+        //Project
+        const cv::Matx31f x3Dw = pMP->GetWorldPos3f();
+        const cv::Matx31f x3Dc = Rcw*x3Dw+tcw;
 
-                if(u<CurrentFrame.mnMinX || u>CurrentFrame.mnMaxX)
-                    continue;
-                if(v<CurrentFrame.mnMinY || v>CurrentFrame.mnMaxY)
-                    continue;
+        const float xc = x3Dc(0);
+        const float yc = x3Dc(1);
+        const float invzc = 1.0/x3Dc(2);
 
-                // Compute predicted scale level
-                cv::Mat PO = x3Dw-Ow;
-                float dist3D = cv::norm(PO);
+        const float u = CurrentFrame.fx*xc*invzc+CurrentFrame.cx;
+        const float v = CurrentFrame.fy*yc*invzc+CurrentFrame.cy;
 
-                const float maxDistance = pMP->GetMaxDistanceInvariance();
-                const float minDistance = pMP->GetMinDistanceInvariance();
+        if(u<CurrentFrame.mnMinX || u>CurrentFrame.mnMaxX)
+            return -1;
+        if(v<CurrentFrame.mnMinY || v>CurrentFrame.mnMaxY)
+            return -1;
 
-                // Depth must be inside the scale pyramid of the image
-                if(dist3D<minDistance || dist3D>maxDistance)
-                    continue;
+        // Compute predicted scale level
+        const cv::Matx31f PO = x3Dw-Ow;
+        float dist3D = cv::norm(PO);
 
-                int nPredictedLevel = pMP->PredictScale(dist3D,&CurrentFrame);
+        const float maxDistance = pMP->GetMaxDistanceInvariance();
+        const float minDistance = pMP->GetMinDistanceInvariance();
 
-                // Search in a window
-                const float radius = th*CurrentFrame.mvScaleFactors[nPredictedLevel];
+        // Depth must be inside the scale pyramid of the image
+        if(dist3D<minDistance || dist3D>maxDistance)
+            return -1;
 
-                const vector<size_t> vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, nPredictedLevel-1, nPredictedLevel+1);
+        int nPredictedLevel = pMP->PredictScale(dist3D,&CurrentFrame);
 
-                if(vIndices2.empty())
-                    continue;
+        // Search in a window
+        const float radius = th*CurrentFrame.mvScaleFactors[nPredictedLevel];
 
-                const cv::Mat dMP = pMP->GetDescriptor();
+        CurrentFrame.GetFeaturesInArea(u, v, radius, nPredictedLevel-1, nPredictedLevel+1, vIndices2);
 
-                int bestDist = 256;
-                int bestIdx2 = -1;
+        if(vIndices2.empty())
+            return -1;
 
-                for(vector<size_t>::const_iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
-                {
-                    const size_t i2 = *vit;
-                    if(CurrentFrame.mvpMapPoints[i2])
-                        continue;
+        MapPoint::Descriptor dMP;
+        if(!pMP->GetDescriptor(dMP))
+            return -1;
 
-                    const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
+        vCandidates.clear();
+        for(vector<size_t>::const_iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
+        {
+            const size_t i2 = *vit;
+            if(vbBlocked[i2])
+                continue;
 
-                    const int dist = DescriptorDistance(dMP,d);
+            vCandidates.push_back(i2);
+        }
 
-                    if(dist<bestDist)
-                    {
-                        bestDist=dist;
-                        bestIdx2=i2;
-                    }
-                }
+        int bestPos, bestDist2, bestPos2;
+        SearchBestTwo(dMP.val,CurrentFrame.mDescriptors,vCandidates,bestDist,bestPos,bestDist2,bestPos2);
 
-                if(bestDist<=ORBdist)
-                {
-                    CurrentFrame.mvpMapPoints[bestIdx2]=pMP;
-                    nmatches++;
+        if(bestDist>ORBdist)
+            return -1;
 
-                    if(mbCheckOrientation)
-                    {
-                        float rot = pKF->mvKeysUn[i].angle-CurrentFrame.mvKeysUn[bestIdx2].angle;
-                        if(rot<0.0)
-                            rot+=360.0f;
-                        int bin = round(rot*factor);
-                        if(bin==HISTO_LENGTH)
-                            bin=0;
-                        assert(bin>=0 && bin<HISTO_LENGTH);
-                        rotHist[bin].push_back(bestIdx2);
-                    }
-                }
+        return vCandidates[bestPos];
+    };
 
-            }
+    vector<int> vMatches;
+    ResolveProjections(vpMPs.size(),vbTaken,propose,pScheduler,vMatches);
+
+    for(size_t i=0, iend=vpMPs.size(); i<iend; i++)
+    {
+        const int bestIdx2 = vMatches[i];
+        if(bestIdx2<0)
+            continue;
+
+        CurrentFrame.mvpMapPoints[bestIdx2]=vpMPs[i];
+        nmatches++;
+
+        if(mbCheckOrientation)
+        {
+            float rot = pKF->mvKeysUn[i].angle-CurrentFrame.mvKeysUn[bestIdx2].angle;
+            if(rot<0.0)
+                rot+=360.0f;
+            int bin = round(rot*factor);
+            if(bin==HISTO_LENGTH)
+                bin=0;
+            assert(bin>=0 && bin<HISTO_LENGTH);
+            rotHist[bin].push_back(bestIdx2);
         }
     }
 
@@ -2274,24 +2347,86 @@ void ORBmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
 }
 
 
-// Bit set count operation from
-// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+// One popcount per 64-bit word. It becomes the popcnt instruction only when the target has it
+// (-march=native in CMakeLists.txt on a host with POPCNT, or -mpopcnt); otherwise the compiler
+// falls back to its generic bit-twiddling popcount
+int ORBmatcher::DescriptorDistance(const uchar* a, const uchar* b)
+{
+    uint64_t pa[4], pb[4];
+    memcpy(pa,a,sizeof(pa));
+    memcpy(pb,b,sizeof(pb));
+
+    return __builtin_popcountll(pa[0]^pb[0]) + __builtin_popcountll(pa[1]^pb[1]) +
+           __builtin_popcountll(pa[2]^pb[2]) + __builtin_popcountll(pa[3]^pb[3]);
+}
+
 int ORBmatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
 {
-    const int *pa = a.ptr<int32_t>();
-    const int *pb = b.ptr<int32_t>();
+    return DescriptorDistance(a.ptr<uchar>(),b.ptr<uchar>());
+}
 
-    int dist=0;
+int ORBmatcher::DescriptorDistance(const MapPoint::Descriptor &a, const cv::Mat &b)
+{
+    return DescriptorDistance(a.val,b.ptr<uchar>());
+}
+
+// The rows of a batch are gathered on the stack and handed to the DBoW2 kernel, which picks
+// AVX-512 VPOPCNTQ, AVX2 or POPCNT at run time
+static const int DISTANCE_BATCH = 64;
+
+void ORBmatcher::DescriptorDistances(const uchar* a, const cv::Mat &B, const vector<size_t> &vIndices, vector<int> &vDist)
+{
+    const int N = vIndices.size();
+    vDist.resize(N);
 
-    for(int i=0; i<8; i++, pa++, pb++)
+    const uchar* vpRows[DISTANCE_BATCH];
+    for(int i0=0; i0<N; i0+=DISTANCE_BATCH)
     {
-        unsigned  int v = *pa ^ *pb;
-        v = v - ((v >> 1) & 0x55555555);
-        v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-        dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
+        const int n = min(DISTANCE_BATCH,N-i0);
+        for(int k=0; k<n; k++)
+            vpRows[k] = B.ptr<uchar>(vIndices[i0+k]);
+
+        DBoW2::FORB::distances(a,vpRows,n,&vDist[i0]);
     }
+}
+
+void ORBmatcher::SearchBestTwo(const uchar* a, const cv::Mat &B, const vector<size_t> &vIndices,
+                               int &bestDist, int &bestPos, int &bestDist2, int &bestPos2)
+{
+    bestDist = 256;
+    bestDist2 = 256;
+    bestPos = -1;
+    bestPos2 = -1;
+
+    const int N = vIndices.size();
+    const uchar* vpRows[DISTANCE_BATCH];
+    int vDist[DISTANCE_BATCH];
+
+    for(int i0=0; i0<N; i0+=DISTANCE_BATCH)
+    {
+        const int n = min(DISTANCE_BATCH,N-i0);
+        for(int k=0; k<n; k++)
+            vpRows[k] = B.ptr<uchar>(vIndices[i0+k]);
+
+        DBoW2::FORB::distances(a,vpRows,n,vDist);
 
-    return dist;
+        for(int k=0; k<n; k++)
+        {
+            const int dist = vDist[k];
+            if(dist<bestDist)
+            {
+                bestDist2=bestDist;
+                bestPos2=bestPos;
+                bestDist=dist;
+                bestPos=i0+k;
+            }
+            else if(dist<bestDist2)
+            {
+                bestDist2=dist;
+                bestPos2=i0+k;
+            }
+        }
+    }
 }
 
 } //namespace ORB_SLAM
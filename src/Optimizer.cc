@@ -28,26 +28,37 @@
 #include "Thirdparty/g2o/g2o/core/robust_kernel_impl.h"
 #include "Thirdparty/g2o/g2o/solvers/linear_solver_dense.h"
 #include "Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
+#include "Thirdparty/g2o/g2o/stuff/thread_pool.h"
 
 #include<Eigen/StdVector>
 
 #include "Converter.h"
+#include "Scheduler.h"
 
 #include<mutex>
 
 namespace ORB_SLAM2
 {
 
-void Optimizer::GlobalBundleAdjustemnt(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust)
+// Workers building the linear system of the map-wide optimizations (local BA, GBA and
+// essential graph). Several optimizations may share the scheduler at the same time.
+static g2o::ThreadPool* BAThreadPool(Scheduler* pScheduler)
+{
+    return pScheduler ? pScheduler->GetThreadPool() : static_cast<g2o::ThreadPool*>(NULL);
+}
+
+void Optimizer::GlobalBundleAdjustemnt(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust,
+                                       Scheduler* pScheduler)
 {
     vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
     vector<MapPoint*> vpMP = pMap->GetAllMapPoints();
-    BundleAdjustment(vpKFs,vpMP,nIterations,pbStopFlag, nLoopKF, bRobust);
+    BundleAdjustment(vpKFs,vpMP,nIterations,pbStopFlag, nLoopKF, bRobust, pScheduler);
 }
 
 
 void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<MapPoint *> &vpMP,
-                                 int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust)
+                                 int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust,
+                                 Scheduler* pScheduler)
 {
     vector<bool> vbNotIncludedMP;
     vbNotIncludedMP.resize(vpMP.size());
@@ -61,6 +72,7 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
 
     g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
     optimizer.setAlgorithm(solver);
+    optimizer.setThreadPool(BAThreadPool(pScheduler));
 
     if(pbStopFlag)
         optimizer.setForceStopFlag(pbStopFlag);
@@ -628,65 +640,36 @@ cv::Mat Optimizer::PoseOptimizationObj(Frame *pCurFrame, Frame *pLastFrame, cons
     // Set MapPoint vertices
     const int N = ObjId.size();
 
-    vector<g2o::EdgeSE3ProjectXYZOnlyPose*> vpEdgesMono;
-    vector<size_t> vnIndexEdgeMono;
-    vpEdgesMono.reserve(N);
-    vnIndexEdgeMono.reserve(N);
-
-    vector<g2o::EdgeStereoSE3ProjectXYZOnlyPose*> vpEdgesStereo;
-    vector<size_t> vnIndexEdgeStereo;
-    vpEdgesStereo.reserve(N);
-    vnIndexEdgeStereo.reserve(N);
+    // all observations of the object share one pose, so they go into a single batched edge
+    g2o::EdgeSE3ProjectXYZOnlyPoseBatch* e = new g2o::EdgeSE3ProjectXYZOnlyPoseBatch();
+    e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
+    e->fx = pCurFrame->fx;
+    e->fy = pCurFrame->fy;
+    e->cx = pCurFrame->cx;
+    e->cy = pCurFrame->cy;
+    e->reserve(N);
 
     const float deltaMono = sqrt(5.991);
-
-    bool mono = 1; // monocular
-    std::vector<bool> vIsOutlier(N);
+    e->setRobustDelta(deltaMono);
 
     for(int i=0; i<N; i++)
     {
         if(TemperalMatch[ObjId[i]]==-1)
             continue;
 
-        if(mono)
-        {
-            nInitialCorrespondences++;
-            vIsOutlier[i] = false;
-
-            Eigen::Matrix<double,2,1> obs;
-            const cv::KeyPoint &kpUn = pCurFrame->mvSiftKeys[ObjId[i]];
-            obs << kpUn.pt.x, kpUn.pt.y;
-
-            g2o::EdgeSE3ProjectXYZOnlyPose* e = new g2o::EdgeSE3ProjectXYZOnlyPose();
-
-            e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
-            e->setMeasurement(obs);
-            // const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-            e->setInformation(Eigen::Matrix2d::Identity());
-
-            g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-            e->setRobustKernel(rk);
-            rk->setDelta(deltaMono);
-
-            e->fx = pCurFrame->fx;
-            e->fy = pCurFrame->fy;
-            e->cx = pCurFrame->cx;
-            e->cy = pCurFrame->cy;
-
-            cv::Mat Xw = pLastFrame->UnprojectStereoSift(TemperalMatch[ObjId[i]],1);
-            e->Xw[0] = Xw.at<float>(0);
-            e->Xw[1] = Xw.at<float>(1);
-            e->Xw[2] = Xw.at<float>(2);
-
-            optimizer.addEdge(e);
-
-            vpEdgesMono.push_back(e);
-            vnIndexEdgeMono.push_back(i);
+        nInitialCorrespondences++;
 
-        }
+        Eigen::Matrix<double,2,1> obs;
+        const cv::KeyPoint &kpUn = pCurFrame->mvSiftKeys[ObjId[i]];
+        obs << kpUn.pt.x, kpUn.pt.y;
 
+        cv::Mat Xw = pLastFrame->UnprojectStereoSift(TemperalMatch[ObjId[i]],1);
+        // const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
+        e->addObservation(obs, Eigen::Vector3d(Xw.at<float>(0), Xw.at<float>(1), Xw.at<float>(2)));
     }
 
+    optimizer.addEdge(e);
+
 
     // if(nInitialCorrespondences<3)
     //     return cv::Mat::eye(4,4,CV_32F);
@@ -704,25 +687,18 @@ cv::Mat Optimizer::PoseOptimizationObj(Frame *pCurFrame, Frame *pLastFrame, cons
         optimizer.initializeOptimization(0);
         optimizer.optimize(its[it]);
 
+        // refresh the residuals of all observations, including the masked ones
+        e->computeError();
+
         nBad=0;
         // monocular
-        for(size_t i=0, iend=vpEdgesMono.size(); i<iend; i++)
+        for(int i=0, iend=e->size(); i<iend; i++)
         {
-            g2o::EdgeSE3ProjectXYZOnlyPose* e = vpEdgesMono[i];
-
-            const size_t idx = vnIndexEdgeMono[i];
-
-            if(vIsOutlier[idx])
-            {
-                e->computeError();
-            }
-
-            const float chi2 = e->chi2();
+            const float chi2 = e->chi2(i);
 
             if(chi2>chi2Mono[it])
             {
-                vIsOutlier[idx]=true;
-                e->setLevel(1);
+                e->setInlier(i,false);
                 nBad++;
             }
             else
@@ -732,15 +708,14 @@ cv::Mat Optimizer::PoseOptimizationObj(Frame *pCurFrame, Frame *pLastFrame, cons
                 {
                     repro_e = repro_e + std::sqrt(chi2);
                 }
-                vIsOutlier[idx]=false;
-                e->setLevel(0);
+                e->setInlier(i,true);
             }
-
-            if(it==2)
-                e->setRobustKernel(0);
         }
 
-        if(optimizer.edges().size()<10)
+        if(it==2)
+            e->setRobustDelta(0);
+
+        if(e->size()<10)
             break;
     }
 
@@ -3157,7 +3132,7 @@ int Optimizer::PoseOptimization(Frame *pFrame)
 
 
     {
-    unique_lock<mutex> lock(MapPoint::mGlobalMutex);
+    unique_lock<mutex> lock(pFrame->mpContext->mGlobalMutex);
 
     for(int i=0; i<N; i++)
     {
@@ -3338,7 +3313,7 @@ int Optimizer::PoseOptimization(Frame *pFrame)
     return nInitialCorrespondences-nBad;
 }
 
-void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap)
+void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap, Scheduler* pScheduler)
 {
     // Local KeyFrames: First Breath Search from Current Keyframe
     list<KeyFrame*> lLocalKeyFrames;
@@ -3401,6 +3376,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
 
     g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
     optimizer.setAlgorithm(solver);
+    optimizer.setThreadPool(BAThreadPool(pScheduler));
 
     if(pbStopFlag)
         optimizer.setForceStopFlag(pbStopFlag);
@@ -3412,7 +3388,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
     {
         KeyFrame* pKFi = *lit;
         g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
-        vSE3->setEstimate(Converter::toSE3Quat(pKFi->GetPose()));
+        vSE3->setEstimate(Converter::toSE3Quat(pKFi->GetPose4f()));
         vSE3->setId(pKFi->mnId);
         vSE3->setFixed(pKFi->mnId==0);
         optimizer.addVertex(vSE3);
@@ -3425,7 +3401,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
     {
         KeyFrame* pKFi = *lit;
         g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
-        vSE3->setEstimate(Converter::toSE3Quat(pKFi->GetPose()));
+        vSE3->setEstimate(Converter::toSE3Quat(pKFi->GetPose4f()));
         vSE3->setId(pKFi->mnId);
         vSE3->setFixed(true);
         optimizer.addVertex(vSE3);
@@ -3461,7 +3437,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
     {
         MapPoint* pMP = *lit;
         g2o::VertexSBAPointXYZ* vPoint = new g2o::VertexSBAPointXYZ();
-        vPoint->setEstimate(Converter::toVector3d(pMP->GetWorldPos()));
+        vPoint->setEstimate(Converter::toVector3d(pMP->GetWorldPos3f()));
         int id = pMP->mnId+maxKFid+1;
         vPoint->setId(id);
         vPoint->setMarginalized(true);
@@ -3669,7 +3645,8 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
 void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
-                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections, const bool &bFixScale)
+                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections, const bool &bFixScale,
+                                       Scheduler* pScheduler)
 {
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
@@ -3681,6 +3658,7 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
 
     solver->setUserLambdaInit(1e-16);
     optimizer.setAlgorithm(solver);
+    optimizer.setThreadPool(BAThreadPool(pScheduler));
 
     const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
     const vector<MapPoint*> vpMPs = pMap->GetAllMapPoints();
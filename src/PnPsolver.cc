@@ -66,12 +66,15 @@ namespace ORB_SLAM2
 
 PnPsolver::PnPsolver(const Frame &F, const vector<MapPoint*> &vpMapPointMatches):
     pws(0), us(0), alphas(0), pcs(0), maximum_number_of_correspondences(0), number_of_correspondences(0), mnInliersi(0),
-    mnIterations(0), mnBestInliers(0), N(0)
+    mnIterations(0), mnBestInliers(0), N(0), mRng(DUtils::Random::RandomInt(1,1<<30)), mpbCancel(NULL)
 {
     mvpMapPointMatches = vpMapPointMatches;
-    mvP2D.reserve(F.mvpMapPoints.size());
+    mvU.reserve(F.mvpMapPoints.size());
+    mvV.reserve(F.mvpMapPoints.size());
     mvSigma2.reserve(F.mvpMapPoints.size());
-    mvP3Dw.reserve(F.mvpMapPoints.size());
+    mvPwX.reserve(F.mvpMapPoints.size());
+    mvPwY.reserve(F.mvpMapPoints.size());
+    mvPwZ.reserve(F.mvpMapPoints.size());
     mvKeyPointIndices.reserve(F.mvpMapPoints.size());
     mvAllIndices.reserve(F.mvpMapPoints.size());
 
@@ -86,11 +89,14 @@ PnPsolver::PnPsolver(const Frame &F, const vector<MapPoint*> &vpMapPointMatches)
             {
                 const cv::KeyPoint &kp = F.mvKeysUn[i];
 
-                mvP2D.push_back(kp.pt);
+                mvU.push_back(kp.pt.x);
+                mvV.push_back(kp.pt.y);
                 mvSigma2.push_back(F.mvLevelSigma2[kp.octave]);
 
                 cv::Mat Pos = pMP->GetWorldPos();
-                mvP3Dw.push_back(cv::Point3f(Pos.at<float>(0),Pos.at<float>(1), Pos.at<float>(2)));
+                mvPwX.push_back(Pos.at<float>(0));
+                mvPwY.push_back(Pos.at<float>(1));
+                mvPwZ.push_back(Pos.at<float>(2));
 
                 mvKeyPointIndices.push_back(i);
                 mvAllIndices.push_back(idx);               
@@ -126,7 +132,7 @@ void PnPsolver::SetRansacParameters(double probability, int minInliers, int maxI
     mRansacEpsilon = epsilon;
     mRansacMinSet = minSet;
 
-    N = mvP2D.size(); // number of correspondences
+    N = mvU.size(); // number of correspondences
 
     mvbInliersi.resize(N);
 
@@ -156,6 +162,11 @@ void PnPsolver::SetRansacParameters(double probability, int minInliers, int maxI
         mvMaxError[i] = mvSigma2[i]*th2;
 }
 
+void PnPsolver::SetCancelFlag(const std::atomic<bool>* pbCancel)
+{
+    mpbCancel = pbCancel;
+}
+
 cv::Mat PnPsolver::find(vector<bool> &vbInliers, int &nInliers)
 {
     bool bFlag;
@@ -181,6 +192,12 @@ cv::Mat PnPsolver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInlie
     int nCurrentIterations = 0;
     while(mnIterations<mRansacMaxIts || nCurrentIterations<nIterations)
     {
+        if(mpbCancel && mpbCancel->load(std::memory_order_relaxed))
+        {
+            bNoMore = true;
+            return cv::Mat();
+        }
+
         nCurrentIterations++;
         mnIterations++;
         reset_correspondences();
@@ -190,11 +207,11 @@ cv::Mat PnPsolver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInlie
         // Get min set of points
         for(short i = 0; i < mRansacMinSet; ++i)
         {
-            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size()-1);
+            int randi = std::uniform_int_distribution<int>(0, vAvailableIndices.size()-1)(mRng);
 
             int idx = vAvailableIndices[randi];
 
-            add_correspondence(mvP3Dw[idx].x,mvP3Dw[idx].y,mvP3Dw[idx].z,mvP2D[idx].x,mvP2D[idx].y);
+            add_correspondence(mvPwX[idx],mvPwY[idx],mvPwZ[idx],mvU[idx],mvV[idx]);
 
             vAvailableIndices[randi] = vAvailableIndices.back();
             vAvailableIndices.pop_back();
@@ -277,7 +294,7 @@ bool PnPsolver::Refine()
     for(size_t i=0; i<vIndices.size(); i++)
     {
         int idx = vIndices[i];
-        add_correspondence(mvP3Dw[idx].x,mvP3Dw[idx].y,mvP3Dw[idx].z,mvP2D[idx].x,mvP2D[idx].y);
+        add_correspondence(mvPwX[idx],mvPwY[idx],mvPwZ[idx],mvU[idx],mvV[idx]);
     }
 
     // Compute camera pose
@@ -307,35 +324,38 @@ bool PnPsolver::Refine()
 
 void PnPsolver::CheckInliers()
 {
-    mnInliersi=0;
-
+    // Single precision pose and branch-free body over contiguous arrays, so that the
+    // compiler evaluates several correspondences per instruction
+    const float r00 = mRi[0][0], r01 = mRi[0][1], r02 = mRi[0][2];
+    const float r10 = mRi[1][0], r11 = mRi[1][1], r12 = mRi[1][2];
+    const float r20 = mRi[2][0], r21 = mRi[2][1], r22 = mRi[2][2];
+    const float tx = mti[0], ty = mti[1], tz = mti[2];
+    const float fx = fu, fy = fv, cx = uc, cy = vc;
+
+    const float* pX = mvPwX.data();
+    const float* pY = mvPwY.data();
+    const float* pZ = mvPwZ.data();
+    const float* pU = mvU.data();
+    const float* pV = mvV.data();
+    const float* pMaxError = mvMaxError.data();
+    unsigned char* pbInlier = mvbInliersi.data();
+
+    int nInliers=0;
     for(int i=0; i<N; i++)
     {
-        cv::Point3f P3Dw = mvP3Dw[i];
-        cv::Point2f P2D = mvP2D[i];
-
-        float Xc = mRi[0][0]*P3Dw.x+mRi[0][1]*P3Dw.y+mRi[0][2]*P3Dw.z+mti[0];
-        float Yc = mRi[1][0]*P3Dw.x+mRi[1][1]*P3Dw.y+mRi[1][2]*P3Dw.z+mti[1];
-        float invZc = 1/(mRi[2][0]*P3Dw.x+mRi[2][1]*P3Dw.y+mRi[2][2]*P3Dw.z+mti[2]);
+        const float Xc = r00*pX[i]+r01*pY[i]+r02*pZ[i]+tx;
+        const float Yc = r10*pX[i]+r11*pY[i]+r12*pZ[i]+ty;
+        const float invZc = 1.0f/(r20*pX[i]+r21*pY[i]+r22*pZ[i]+tz);
 
-        double ue = uc + fu * Xc * invZc;
-        double ve = vc + fv * Yc * invZc;
+        const float distX = pU[i]-(cx+fx*Xc*invZc);
+        const float distY = pV[i]-(cy+fy*Yc*invZc);
 
-        float distX = P2D.x-ue;
-        float distY = P2D.y-ve;
-
-        float error2 = distX*distX+distY*distY;
-
-        if(error2<mvMaxError[i])
-        {
-            mvbInliersi[i]=true;
-            mnInliersi++;
-        }
-        else
-        {
-            mvbInliersi[i]=false;
-        }
+        const unsigned char bInlier = (distX*distX+distY*distY)<pMaxError[i];
+        pbInlier[i] = bInlier;
+        nInliers += bInlier;
     }
+
+    mnInliersi = nInliers;
 }
 
 
@@ -859,8 +879,8 @@ void PnPsolver::gauss_newton(const CvMat * L_6x10, const CvMat * Rho,
 
 void PnPsolver::qr_solve(CvMat * A, CvMat * b, CvMat * X)
 {
-  static int max_nr = 0;
-  static double * A1, * A2;
+  static thread_local int max_nr = 0;
+  static thread_local double * A1, * A2;
 
   const int nr = A->rows;
   const int nc = A->cols;
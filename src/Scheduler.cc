@@ -0,0 +1,415 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "Scheduler.h"
+#include "Thirdparty/g2o/g2o/stuff/thread_pool.h"
+
+#include<algorithm>
+
+namespace ORB_SLAM2
+{
+
+// Worker identity of the calling thread
+static thread_local const Scheduler* tlsScheduler = NULL;
+static thread_local int tlsWorker = -1;
+
+// g2o optimizers expect a ThreadPool, this one hands their loops to the scheduler.
+// The chunk index doubles as g2o's thread index for the per-thread accumulators.
+class SchedulerThreadPool : public g2o::ThreadPool
+{
+public:
+    explicit SchedulerThreadPool(Scheduler* pScheduler):
+        g2o::ThreadPool(pScheduler->Concurrency(),false), mpScheduler(pScheduler) {}
+
+    int parallelFor(int n, const RangeFunction &func)
+    {
+        return mpScheduler->ParallelFor(n,func,numThreads());
+    }
+
+protected:
+    Scheduler* mpScheduler;
+};
+
+Scheduler::Scheduler(int nWorkers):
+    mnWorkers(nWorkers), mnNextWorker(0), mnQueued(0), mbStop(false), mnHelped(0), mnNextPinned(0),
+    mtStart(std::chrono::steady_clock::now())
+{
+    if(mnWorkers<=0)
+        mnWorkers = std::max(1,(int)std::thread::hardware_concurrency()-1);
+
+    for(int w=0; w<mnWorkers; w++)
+        mvpWorkers.push_back(new Worker());
+    for(int w=0; w<mnWorkers; w++)
+        mvpWorkers[w]->mThread = std::thread(&Scheduler::WorkerLoop,this,w);
+
+    mpThreadPool = new SchedulerThreadPool(this);
+}
+
+Scheduler::~Scheduler()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexSleep);
+        mbStop = true;
+    }
+    mCondWork.notify_all();
+
+    for(int w=0; w<mnWorkers; w++)
+    {
+        mvpWorkers[w]->mThread.join();
+        delete mvpWorkers[w];
+    }
+
+    for(size_t i=0; i<mvpPinned.size(); i++)
+    {
+        mvpPinned[i]->thread.join();
+        delete mvpPinned[i];
+    }
+
+    delete mpThreadPool;
+}
+
+int Scheduler::CurrentWorker() const
+{
+    return tlsScheduler==this ? tlsWorker : -1;
+}
+
+void Scheduler::Submit(const Task &task)
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexDetached);
+        mDetached.push_back(task);
+    }
+    NotifyQueued();
+}
+
+void Scheduler::Push(const Task &task, TaskGroup* pGroup)
+{
+    // Tasks spawned by a worker stay on its deque (they are likely to share its cache),
+    // tasks from other threads are dealt round robin
+    int w = CurrentWorker();
+    if(w<0)
+        w = mnNextWorker.fetch_add(1)%mnWorkers;
+
+    GroupTask groupTask;
+    groupTask.task = task;
+    groupTask.pGroup = pGroup;
+    pGroup->mnQueued.fetch_add(1);
+    {
+        std::unique_lock<std::mutex> lock(mvpWorkers[w]->mMutex);
+        mvpWorkers[w]->mTasks.push_back(groupTask);
+    }
+    NotifyQueued();
+}
+
+void Scheduler::NotifyQueued()
+{
+    mnQueued.fetch_add(1);
+
+    // A worker checks mnQueued under this mutex before sleeping, so it cannot miss the task
+    {
+        std::unique_lock<std::mutex> lock(mMutexSleep);
+    }
+    mCondWork.notify_one();
+}
+
+bool Scheduler::TakeTask(const int self, Task &task, bool &bStolen)
+{
+    {
+        Worker* pW = mvpWorkers[self];
+        std::unique_lock<std::mutex> lock(pW->mMutex);
+        if(!pW->mTasks.empty())
+        {
+            task.swap(pW->mTasks.back().task);
+            pW->mTasks.back().pGroup->mnQueued.fetch_sub(1);
+            pW->mTasks.pop_back();
+            mnQueued.fetch_sub(1);
+            bStolen = false;
+            return true;
+        }
+    }
+
+    if(mnQueued.load()<=0)
+        return false;
+
+    for(int k=1; k<mnWorkers; k++)
+    {
+        Worker* pV = mvpWorkers[(self+k)%mnWorkers];
+        std::unique_lock<std::mutex> lock(pV->mMutex);
+        if(!pV->mTasks.empty())
+        {
+            task.swap(pV->mTasks.front().task);
+            pV->mTasks.front().pGroup->mnQueued.fetch_sub(1);
+            pV->mTasks.pop_front();
+            mnQueued.fetch_sub(1);
+            bStolen = true;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Scheduler::TakeGroupTask(TaskGroup* pGroup, Task &task)
+{
+    // Start with the own deque if the caller is a worker, where the group pushed its tasks
+    const int self = CurrentWorker();
+    const int start = self>=0 ? self : (int)(mnNextWorker.load()%mnWorkers);
+    for(int k=0; k<mnWorkers && pGroup->mnQueued.load()>0; k++)
+    {
+        Worker* pV = mvpWorkers[(start+k)%mnWorkers];
+        std::unique_lock<std::mutex> lock(pV->mMutex);
+        for(std::deque<GroupTask>::iterator it=pV->mTasks.begin(); it!=pV->mTasks.end(); it++)
+        {
+            if(it->pGroup!=pGroup)
+                continue;
+
+            task.swap(it->task);
+            pV->mTasks.erase(it);
+            pGroup->mnQueued.fetch_sub(1);
+            mnQueued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Scheduler::TakeDetached(Task &task)
+{
+    std::unique_lock<std::mutex> lock(mMutexDetached);
+    if(mDetached.empty())
+        return false;
+
+    task.swap(mDetached.front());
+    mDetached.pop_front();
+    mnQueued.fetch_sub(1);
+    return true;
+}
+
+void Scheduler::WorkerLoop(const int w)
+{
+    tlsScheduler = this;
+    tlsWorker = w;
+
+    Worker* pW = mvpWorkers[w];
+    Task task;
+    bool bStolen;
+
+    while(true)
+    {
+        bStolen = false;
+        if(TakeTask(w,task,bStolen) || TakeDetached(task))
+        {
+            std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+            task();
+            task = Task();
+            std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+            pW->busyNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(t2-t1).count());
+            pW->nTasks.fetch_add(1);
+            if(bStolen)
+                pW->nStolen.fetch_add(1);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mMutexSleep);
+        while(!mbStop && mnQueued.load()<=0)
+            mCondWork.wait(lock);
+        if(mbStop && mnQueued.load()<=0)
+            return;
+    }
+}
+
+bool Scheduler::Help(TaskGroup* pGroup)
+{
+    Task task;
+    if(!TakeGroupTask(pGroup,task))
+        return false;
+
+    task();
+    mnHelped.fetch_add(1);
+    return true;
+}
+
+int Scheduler::ParallelFor(const int n, const RangeFunction &func, int nChunks)
+{
+    if(n<=0)
+        return 0;
+
+    if(nChunks<=0)
+        nChunks = Concurrency();
+    nChunks = std::min(nChunks,n);
+
+    if(nChunks<=1)
+    {
+        func(0,n,0);
+        return 1;
+    }
+
+    TaskGroup group(this);
+    for(int c=1; c<nChunks; c++)
+    {
+        const int begin = (int)(((long long)n*c)/nChunks);
+        const int end = (int)(((long long)n*(c+1))/nChunks);
+        group.Run([&func,begin,end,c]()
+        {
+            func(begin,end,c);
+        });
+    }
+
+    func(0,(int)((long long)n/nChunks),0);
+
+    group.Wait();
+
+    return nChunks;
+}
+
+void Scheduler::RangeParallelFor(int count, void (*job)(int, int, void*), void* jobData, void* extraData)
+{
+    Scheduler* pScheduler = static_cast<Scheduler*>(extraData);
+    pScheduler->ParallelFor(count,[job,jobData](int begin, int end, int)
+    {
+        job(begin,end,jobData);
+    });
+}
+
+int Scheduler::StartPinned(const std::string &name, const Task &loop)
+{
+    PinnedLoop* pLoop = new PinnedLoop();
+    pLoop->name = name;
+    pLoop->thread = std::thread(loop);
+
+    std::unique_lock<std::mutex> lock(mMutexPinned);
+    pLoop->id = mnNextPinned++;
+    mvpPinned.push_back(pLoop);
+    return pLoop->id;
+}
+
+void Scheduler::JoinPinned(const int id)
+{
+    PinnedLoop* pLoop = static_cast<PinnedLoop*>(NULL);
+    {
+        std::unique_lock<std::mutex> lock(mMutexPinned);
+        for(size_t i=0; i<mvpPinned.size(); i++)
+        {
+            if(mvpPinned[i]->id==id)
+            {
+                pLoop = mvpPinned[i];
+                mvpPinned.erase(mvpPinned.begin()+i);
+                break;
+            }
+        }
+    }
+
+    if(!pLoop)
+        return;
+
+    pLoop->thread.join();
+    delete pLoop;
+}
+
+std::vector<Scheduler::WorkerStats> Scheduler::GetWorkerStats()
+{
+    const double lifetimeMs = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(
+                std::chrono::steady_clock::now()-mtStart).count();
+
+    std::vector<WorkerStats> vStats;
+    for(int w=0; w<mnWorkers; w++)
+    {
+        WorkerStats stats;
+        stats.name = "worker " + std::to_string(w);
+        stats.bPinned = false;
+        stats.nTasks = mvpWorkers[w]->nTasks.load();
+        stats.nStolen = mvpWorkers[w]->nStolen.load();
+        stats.busyMs = mvpWorkers[w]->busyNs.load()/1e6;
+        stats.utilization = lifetimeMs>0 ? stats.busyMs/lifetimeMs : 0;
+        vStats.push_back(stats);
+    }
+
+    // The pinned loops wait on their own events, the scheduler does not see their busy time
+    std::unique_lock<std::mutex> lock(mMutexPinned);
+    for(size_t i=0; i<mvpPinned.size(); i++)
+    {
+        WorkerStats stats;
+        stats.name = mvpPinned[i]->name;
+        stats.bPinned = true;
+        stats.nTasks = 1;
+        stats.nStolen = 0;
+        stats.busyMs = -1;
+        stats.utilization = -1;
+        vStats.push_back(stats);
+    }
+
+    return vStats;
+}
+
+TaskGroup::TaskGroup(Scheduler* pScheduler): mpScheduler(pScheduler), mnPending(0), mnQueued(0)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+    Wait();
+}
+
+void TaskGroup::Run(const Scheduler::Task &task)
+{
+    mnPending.fetch_add(1);
+    mpScheduler->Push([this,task]()
+    {
+        task();
+        TaskDone();
+    }, this);
+
+    // Wait() checks mnQueued under this mutex before sleeping, so it cannot miss the task
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+    }
+    mCond.notify_all();
+}
+
+void TaskGroup::TaskDone()
+{
+    // Decrement under the mutex: Wait() takes it before returning, so the group
+    // is not destroyed while the last task is still notifying
+    std::unique_lock<std::mutex> lock(mMutex);
+    if(mnPending.fetch_sub(1)==1)
+        mCond.notify_all();
+}
+
+void TaskGroup::Wait()
+{
+    while(mnPending.load()>0)
+    {
+        if(mpScheduler->Help(this))
+            continue;
+
+        // The remaining tasks are running on other threads: sleep until one is done or a new
+        // one of this group is queued
+        std::unique_lock<std::mutex> lock(mMutex);
+        while(mnPending.load()>0 && mnQueued.load()<=0)
+            mCond.wait(lock);
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+}
+
+} //namespace ORB_SLAM
@@ -24,9 +24,11 @@
 #include <vector>
 #include <cmath>
 #include <opencv2/core/core.hpp>
+#include <Eigen/Dense>
 
 #include "KeyFrame.h"
 #include "ORBmatcher.h"
+#include "Converter.h"
 
 #include "Thirdparty/DBoW2/DUtils/Random.h"
 
@@ -35,7 +37,7 @@ namespace ORB_SLAM2
 
 
 Sim3Solver::Sim3Solver(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *> &vpMatched12, const bool bFixScale):
-    mnIterations(0), mnBestInliers(0), mbFixScale(bFixScale)
+    mnIterations(0), mnBestInliers(0), mbFixScale(bFixScale), mRng(DUtils::Random::RandomInt(1,1<<30)), mpbCancel(NULL)
 {
     mpKF1 = pKF1;
     mpKF2 = pKF2;
@@ -48,13 +50,17 @@ Sim3Solver::Sim3Solver(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *>
     mvpMapPoints2.reserve(mN1);
     mvpMatches12 = vpMatched12;
     mvnIndices1.reserve(mN1);
-    mvX3Dc1.reserve(mN1);
-    mvX3Dc2.reserve(mN1);
+    mX3Dc1.resize(mN1,3);
+    mX3Dc2.resize(mN1,3);
 
-    cv::Mat Rcw1 = pKF1->GetRotation();
-    cv::Mat tcw1 = pKF1->GetTranslation();
-    cv::Mat Rcw2 = pKF2->GetRotation();
-    cv::Mat tcw2 = pKF2->GetTranslation();
+    vector<float> vMaxError1, vMaxError2;
+    vMaxError1.reserve(mN1);
+    vMaxError2.reserve(mN1);
+
+    const Eigen::Matrix3f Rcw1 = Converter::toMatrix3d(pKF1->GetRotation()).cast<float>();
+    const Eigen::Vector3f tcw1 = Converter::toVector3d(pKF1->GetTranslation()).cast<float>();
+    const Eigen::Matrix3f Rcw2 = Converter::toMatrix3d(pKF2->GetRotation()).cast<float>();
+    const Eigen::Vector3f tcw2 = Converter::toVector3d(pKF2->GetTranslation()).cast<float>();
 
     mvAllIndices.reserve(mN1);
 
@@ -84,29 +90,34 @@ Sim3Solver::Sim3Solver(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *>
             const float sigmaSquare1 = pKF1->mvLevelSigma2[kp1.octave];
             const float sigmaSquare2 = pKF2->mvLevelSigma2[kp2.octave];
 
-            mvnMaxError1.push_back(9.210*sigmaSquare1);
-            mvnMaxError2.push_back(9.210*sigmaSquare2);
+            vMaxError1.push_back(9.210*sigmaSquare1);
+            vMaxError2.push_back(9.210*sigmaSquare2);
 
             mvpMapPoints1.push_back(pMP1);
             mvpMapPoints2.push_back(pMP2);
             mvnIndices1.push_back(i1);
 
-            cv::Mat X3D1w = pMP1->GetWorldPos();
-            mvX3Dc1.push_back(Rcw1*X3D1w+tcw1);
+            const Eigen::Vector3f X3D1w = Converter::toVector3d(pMP1->GetWorldPos()).cast<float>();
+            mX3Dc1.row(idx) = (Rcw1*X3D1w+tcw1).transpose();
 
-            cv::Mat X3D2w = pMP2->GetWorldPos();
-            mvX3Dc2.push_back(Rcw2*X3D2w+tcw2);
+            const Eigen::Vector3f X3D2w = Converter::toVector3d(pMP2->GetWorldPos()).cast<float>();
+            mX3Dc2.row(idx) = (Rcw2*X3D2w+tcw2).transpose();
 
             mvAllIndices.push_back(idx);
             idx++;
         }
     }
 
-    mK1 = pKF1->mK;
-    mK2 = pKF2->mK;
+    mX3Dc1.conservativeResize(idx,3);
+    mX3Dc2.conservativeResize(idx,3);
+    mMaxError1 = Eigen::Map<Eigen::ArrayXf>(vMaxError1.data(),vMaxError1.size());
+    mMaxError2 = Eigen::Map<Eigen::ArrayXf>(vMaxError2.data(),vMaxError2.size());
+
+    mK1 = Converter::toMatrix3d(pKF1->mK).cast<float>();
+    mK2 = Converter::toMatrix3d(pKF2->mK).cast<float>();
 
-    FromCameraToImage(mvX3Dc1,mvP1im1,mK1);
-    FromCameraToImage(mvX3Dc2,mvP2im2,mK2);
+    FromCameraToImage(mX3Dc1,mK1,mP1im1);
+    FromCameraToImage(mX3Dc2,mK2,mP2im2);
 
     SetRansacParameters();
 }
@@ -137,6 +148,11 @@ void Sim3Solver::SetRansacParameters(double probability, int minInliers, int max
     mnIterations = 0;
 }
 
+void Sim3Solver::SetCancelFlag(const std::atomic<bool>* pbCancel)
+{
+    mpbCancel = pbCancel;
+}
+
 cv::Mat Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInliers, int &nInliers)
 {
     bNoMore = false;
@@ -151,12 +167,18 @@ cv::Mat Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInli
 
     vector<size_t> vAvailableIndices;
 
-    cv::Mat P3Dc1i(3,3,CV_32F);
-    cv::Mat P3Dc2i(3,3,CV_32F);
+    Eigen::Matrix3f P3Dc1i;
+    Eigen::Matrix3f P3Dc2i;
 
     int nCurrentIterations = 0;
     while(mnIterations<mRansacMaxIts && nCurrentIterations<nIterations)
     {
+        if(mpbCancel && mpbCancel->load(std::memory_order_relaxed))
+        {
+            bNoMore = true;
+            return cv::Mat();
+        }
+
         nCurrentIterations++;
         mnIterations++;
 
@@ -165,12 +187,12 @@ cv::Mat Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInli
         // Get min set of points
         for(short i = 0; i < 3; ++i)
         {
-            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size()-1);
+            int randi = std::uniform_int_distribution<int>(0, vAvailableIndices.size()-1)(mRng);
 
             int idx = vAvailableIndices[randi];
 
-            mvX3Dc1[idx].copyTo(P3Dc1i.col(i));
-            mvX3Dc2[idx].copyTo(P3Dc2i.col(i));
+            P3Dc1i.col(i) = mX3Dc1.row(idx).transpose();
+            P3Dc2i.col(i) = mX3Dc2.row(idx).transpose();
 
             vAvailableIndices[randi] = vAvailableIndices.back();
             vAvailableIndices.pop_back();
@@ -184,9 +206,8 @@ cv::Mat Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInli
         {
             mvbBestInliers = mvbInliersi;
             mnBestInliers = mnInliersi;
-            mBestT12 = mT12i.clone();
-            mBestRotation = mR12i.clone();
-            mBestTranslation = mt12i.clone();
+            mBestRotation = mR12i;
+            mBestTranslation = mt12i;
             mBestScale = ms12i;
 
             if(mnInliersi>mRansacMinInliers)
@@ -195,7 +216,15 @@ cv::Mat Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInli
                 for(int i=0; i<N; i++)
                     if(mvbInliersi[i])
                         vbInliers[mvnIndices1[i]] = true;
-                return mBestT12;
+
+                cv::Mat BestT12 = cv::Mat::eye(4,4,CV_32F);
+                for(int r=0; r<3; r++)
+                {
+                    for(int c=0; c<3; c++)
+                        BestT12.at<float>(r,c) = mBestScale*mBestRotation(r,c);
+                    BestT12.at<float>(r,3) = mBestTranslation(r);
+                }
+                return BestT12;
             }
         }
     }
@@ -212,99 +241,61 @@ cv::Mat Sim3Solver::find(vector<bool> &vbInliers12, int &nInliers)
     return iterate(mRansacMaxIts,bFlag,vbInliers12,nInliers);
 }
 
-void Sim3Solver::ComputeCentroid(cv::Mat &P, cv::Mat &Pr, cv::Mat &C)
-{
-    cv::reduce(P,C,1,CV_REDUCE_SUM);
-    C = C/P.cols;
-
-    for(int i=0; i<P.cols; i++)
-    {
-        Pr.col(i)=P.col(i)-C;
-    }
-}
-
-void Sim3Solver::ComputeSim3(cv::Mat &P1, cv::Mat &P2)
+void Sim3Solver::ComputeSim3(const Eigen::Matrix3f &P1, const Eigen::Matrix3f &P2)
 {
     // Custom implementation of:
     // Horn 1987, Closed-form solution of absolute orientataion using unit quaternions
 
     // Step 1: Centroid and relative coordinates
 
-    cv::Mat Pr1(P1.size(),P1.type()); // Relative coordinates to centroid (set 1)
-    cv::Mat Pr2(P2.size(),P2.type()); // Relative coordinates to centroid (set 2)
-    cv::Mat O1(3,1,Pr1.type()); // Centroid of P1
-    cv::Mat O2(3,1,Pr2.type()); // Centroid of P2
+    const Eigen::Vector3f O1 = P1.rowwise().mean(); // Centroid of P1
+    const Eigen::Vector3f O2 = P2.rowwise().mean(); // Centroid of P2
 
-    ComputeCentroid(P1,Pr1,O1);
-    ComputeCentroid(P2,Pr2,O2);
+    const Eigen::Matrix3f Pr1 = P1.colwise()-O1; // Relative coordinates to centroid (set 1)
+    const Eigen::Matrix3f Pr2 = P2.colwise()-O2; // Relative coordinates to centroid (set 2)
 
     // Step 2: Compute M matrix
 
-    cv::Mat M = Pr2*Pr1.t();
+    const Eigen::Matrix3d M = (Pr2*Pr1.transpose()).cast<double>();
 
     // Step 3: Compute N matrix
 
-    double N11, N12, N13, N14, N22, N23, N24, N33, N34, N44;
-
-    cv::Mat N(4,4,P1.type());
-
-    N11 = M.at<float>(0,0)+M.at<float>(1,1)+M.at<float>(2,2);
-    N12 = M.at<float>(1,2)-M.at<float>(2,1);
-    N13 = M.at<float>(2,0)-M.at<float>(0,2);
-    N14 = M.at<float>(0,1)-M.at<float>(1,0);
-    N22 = M.at<float>(0,0)-M.at<float>(1,1)-M.at<float>(2,2);
-    N23 = M.at<float>(0,1)+M.at<float>(1,0);
-    N24 = M.at<float>(2,0)+M.at<float>(0,2);
-    N33 = -M.at<float>(0,0)+M.at<float>(1,1)-M.at<float>(2,2);
-    N34 = M.at<float>(1,2)+M.at<float>(2,1);
-    N44 = -M.at<float>(0,0)-M.at<float>(1,1)+M.at<float>(2,2);
-
-    N = (cv::Mat_<float>(4,4) << N11, N12, N13, N14,
-                                 N12, N22, N23, N24,
-                                 N13, N23, N33, N34,
-                                 N14, N24, N34, N44);
-
+    Eigen::Matrix4d N;
 
-    // Step 4: Eigenvector of the highest eigenvalue
+    const double N11 = M(0,0)+M(1,1)+M(2,2);
+    const double N12 = M(1,2)-M(2,1);
+    const double N13 = M(2,0)-M(0,2);
+    const double N14 = M(0,1)-M(1,0);
+    const double N22 = M(0,0)-M(1,1)-M(2,2);
+    const double N23 = M(0,1)+M(1,0);
+    const double N24 = M(2,0)+M(0,2);
+    const double N33 = -M(0,0)+M(1,1)-M(2,2);
+    const double N34 = M(1,2)+M(2,1);
+    const double N44 = -M(0,0)-M(1,1)+M(2,2);
 
-    cv::Mat eval, evec;
+    N << N11, N12, N13, N14,
+         N12, N22, N23, N24,
+         N13, N23, N33, N34,
+         N14, N24, N34, N44;
 
-    cv::eigen(N,eval,evec); //evec[0] is the quaternion of the desired rotation
+    // Step 4: Eigenvector of the highest eigenvalue (the last one, they are sorted increasingly)
+    // is the quaternion (w,x,y,z) of the desired rotation
 
-    cv::Mat vec(1,3,evec.type());
-    (evec.row(0).colRange(1,4)).copyTo(vec); //extract imaginary part of the quaternion (sin*axis)
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix4d> eig(N);
+    const Eigen::Vector4d q = eig.eigenvectors().col(3);
 
-    // Rotation angle. sin is the norm of the imaginary part, cos is the real part
-    double ang=atan2(norm(vec),evec.at<float>(0,0));
-
-    vec = 2*ang*vec/norm(vec); //Angle-axis representation. quaternion angle is the half
-
-    mR12i.create(3,3,P1.type());
-
-    cv::Rodrigues(vec,mR12i); // computes the rotation matrix from angle-axis
+    mR12i = Eigen::Quaterniond(q(0),q(1),q(2),q(3)).normalized().toRotationMatrix().cast<float>();
 
     // Step 5: Rotate set 2
 
-    cv::Mat P3 = mR12i*Pr2;
+    const Eigen::Matrix3f P3 = mR12i*Pr2;
 
     // Step 6: Scale
 
     if(!mbFixScale)
     {
-        double nom = Pr1.dot(P3);
-        cv::Mat aux_P3(P3.size(),P3.type());
-        aux_P3=P3;
-        cv::pow(P3,2,aux_P3);
-        double den = 0;
-
-        for(int i=0; i<aux_P3.rows; i++)
-        {
-            for(int j=0; j<aux_P3.cols; j++)
-            {
-                den+=aux_P3.at<float>(i,j);
-            }
-        }
-
+        const double nom = Pr1.cwiseProduct(P3).sum();
+        const double den = P3.squaredNorm();
         ms12i = nom/den;
     }
     else
@@ -312,66 +303,38 @@ void Sim3Solver::ComputeSim3(cv::Mat &P1, cv::Mat &P2)
 
     // Step 7: Translation
 
-    mt12i.create(1,3,P1.type());
     mt12i = O1 - ms12i*mR12i*O2;
 
-    // Step 8: Transformation
-
-    // Step 8.1 T12
-    mT12i = cv::Mat::eye(4,4,P1.type());
-
-    cv::Mat sR = ms12i*mR12i;
-
-    sR.copyTo(mT12i.rowRange(0,3).colRange(0,3));
-    mt12i.copyTo(mT12i.rowRange(0,3).col(3));
+    // Step 8: Inverse transformation T21
 
-    // Step 8.2 T21
-
-    mT21i = cv::Mat::eye(4,4,P1.type());
-
-    cv::Mat sRinv = (1.0/ms12i)*mR12i.t();
-
-    sRinv.copyTo(mT21i.rowRange(0,3).colRange(0,3));
-    cv::Mat tinv = -sRinv*mt12i;
-    tinv.copyTo(mT21i.rowRange(0,3).col(3));
+    msR21i = (1.0f/ms12i)*mR12i.transpose();
+    mt21i = -msR21i*mt12i;
 }
 
 
 void Sim3Solver::CheckInliers()
 {
-    vector<cv::Mat> vP1im2, vP2im1;
-    Project(mvX3Dc2,vP2im1,mT12i,mK1);
-    Project(mvX3Dc1,vP1im2,mT21i,mK2);
-
-    mnInliersi=0;
-
-    for(size_t i=0; i<mvP1im1.size(); i++)
-    {
-        cv::Mat dist1 = mvP1im1[i]-vP2im1[i];
-        cv::Mat dist2 = vP1im2[i]-mvP2im2[i];
+    Project(mX3Dc2,ms12i*mR12i,mt12i,mK1,mP2im1);
+    Project(mX3Dc1,msR21i,mt21i,mK2,mP1im2);
 
-        const float err1 = dist1.dot(dist1);
-        const float err2 = dist2.dot(dist2);
+    // Squared reprojection errors of all the correspondences at once, in both images
+    mvbInliersi = ((mP1im1-mP2im1).rowwise().squaredNorm().array()<mMaxError1) &&
+                  ((mP1im2-mP2im2).rowwise().squaredNorm().array()<mMaxError2);
 
-        if(err1<mvnMaxError1[i] && err2<mvnMaxError2[i])
-        {
-            mvbInliersi[i]=true;
-            mnInliersi++;
-        }
-        else
-            mvbInliersi[i]=false;
-    }
+    mnInliersi = mvbInliersi.count();
 }
 
 
 cv::Mat Sim3Solver::GetEstimatedRotation()
 {
-    return mBestRotation.clone();
+    const Eigen::Matrix3d R = mBestRotation.cast<double>();
+    return Converter::toCvMat(R);
 }
 
 cv::Mat Sim3Solver::GetEstimatedTranslation()
 {
-    return mBestTranslation.clone();
+    const Eigen::Vector3d t = mBestTranslation.cast<double>();
+    return Converter::toCvMat(t);
 }
 
 float Sim3Solver::GetEstimatedScale()
@@ -379,47 +342,24 @@ float Sim3Solver::GetEstimatedScale()
     return mBestScale;
 }
 
-void Sim3Solver::Project(const vector<cv::Mat> &vP3Dw, vector<cv::Mat> &vP2D, cv::Mat Tcw, cv::Mat K)
+void Sim3Solver::Project(const Points3 &P3D, const Eigen::Matrix3f &sR, const Eigen::Vector3f &t, const Eigen::Matrix3f &K, Points2 &P2D)
 {
-    cv::Mat Rcw = Tcw.rowRange(0,3).colRange(0,3);
-    cv::Mat tcw = Tcw.rowRange(0,3).col(3);
-    const float &fx = K.at<float>(0,0);
-    const float &fy = K.at<float>(1,1);
-    const float &cx = K.at<float>(0,2);
-    const float &cy = K.at<float>(1,2);
-
-    vP2D.clear();
-    vP2D.reserve(vP3Dw.size());
-
-    for(size_t i=0, iend=vP3Dw.size(); i<iend; i++)
-    {
-        cv::Mat P3Dc = Rcw*vP3Dw[i]+tcw;
-        const float invz = 1/(P3Dc.at<float>(2));
-        const float x = P3Dc.at<float>(0)*invz;
-        const float y = P3Dc.at<float>(1)*invz;
+    mP3Dbuffer.noalias() = P3D*sR.transpose();
+    mP3Dbuffer.rowwise() += t.transpose();
 
-        vP2D.push_back((cv::Mat_<float>(2,1) << fx*x+cx, fy*y+cy));
-    }
+    FromCameraToImage(mP3Dbuffer,K,P2D);
 }
 
-void Sim3Solver::FromCameraToImage(const vector<cv::Mat> &vP3Dc, vector<cv::Mat> &vP2D, cv::Mat K)
+void Sim3Solver::FromCameraToImage(const Points3 &P3Dc, const Eigen::Matrix3f &K, Points2 &P2D)
 {
-    const float &fx = K.at<float>(0,0);
-    const float &fy = K.at<float>(1,1);
-    const float &cx = K.at<float>(0,2);
-    const float &cy = K.at<float>(1,2);
-
-    vP2D.clear();
-    vP2D.reserve(vP3Dc.size());
-
-    for(size_t i=0, iend=vP3Dc.size(); i<iend; i++)
-    {
-        const float invz = 1/(vP3Dc[i].at<float>(2));
-        const float x = vP3Dc[i].at<float>(0)*invz;
-        const float y = vP3Dc[i].at<float>(1)*invz;
-
-        vP2D.push_back((cv::Mat_<float>(2,1) << fx*x+cx, fy*y+cy));
-    }
+    const float fx = K(0,0);
+    const float fy = K(1,1);
+    const float cx = K(0,2);
+    const float cy = K(1,2);
+
+    P2D.resize(P3Dc.rows(),2);
+    P2D.col(0) = (fx*P3Dc.col(0).array()/P3Dc.col(2).array()+cx).matrix();
+    P2D.col(1) = (fy*P3Dc.col(1).array()/P3Dc.col(2).array()+cy).matrix();
 }
 
 } //namespace ORB_SLAM
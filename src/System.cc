@@ -26,14 +26,54 @@
 #include <pangolin/pangolin.h>
 #include <iomanip>
 
-#include <unistd.h>
 
 namespace ORB_SLAM2
 {
 
 System::System(const string &strVocFile, const string &strSettingsFile, const eSensor sensor,
-               const bool bUseViewer):mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)), mbReset(false),mbActivateLocalizationMode(false),
-               mbDeactivateLocalizationMode(false)
+               const bool bUseViewer):mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)), mnLastBigChangeIdx(0), mbReset(false),mbActivateLocalizationMode(false),
+               mbDeactivateLocalizationMode(false), mbShutdown(false)
+{
+    Initialize(static_cast<ORBVocabulary*>(NULL), strVocFile, strSettingsFile, bUseViewer, static_cast<Scheduler*>(NULL));
+}
+
+System::System(ORBVocabulary* pVoc, const string &strSettingsFile, const eSensor sensor,
+               const bool bUseViewer, Scheduler* pScheduler):mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)), mnLastBigChangeIdx(0), mbReset(false),mbActivateLocalizationMode(false),
+               mbDeactivateLocalizationMode(false), mbShutdown(false)
+{
+    Initialize(pVoc, string(), strSettingsFile, bUseViewer, pScheduler);
+}
+
+System::~System()
+{
+    if(!mbShutdown)
+        Shutdown();
+
+    // Local Mapping and Loop Closing have returned from Run, join them before they are freed
+    mpScheduler->JoinPinned(mnLocalMappingLoop);
+    mpScheduler->JoinPinned(mnLoopClosingLoop);
+
+    delete mpViewer;
+    delete mpTracker;
+    delete mpLocalMapper;
+    delete mpLoopCloser;
+    delete mpFrameDrawer;
+    delete mpMapDrawer;
+
+    // Deletes the KeyFrames and MapPoints still in the map
+    mpMap->clear();
+    delete mpMap;
+    delete mpKeyFrameDatabase;
+    delete mpContext;
+
+    if(mbOwnVocabulary)
+        delete mpVocabulary;
+    if(mbOwnScheduler)
+        delete mpScheduler;
+}
+
+void System::Initialize(ORBVocabulary* pVoc, const string &strVocFile, const string &strSettingsFile, const bool bUseViewer,
+                        Scheduler* pScheduler)
 {
     // Output welcome message
     // cout << endl <<
@@ -60,21 +100,60 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     }
 
 
-    //Load ORB Vocabulary
-    cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
+    //Create the workers shared by all threads (System.nWorkers: 0 or absent, one per hardware thread but the tracking one)
+    if(pScheduler)
+    {
+        mpScheduler = pScheduler;
+        mbOwnScheduler = false;
+        cout << "Scheduler workers (shared): " << mpScheduler->NumWorkers() << endl;
+    }
+    else
+    {
+        int nWorkers = 0;
+        if(!fsSettings["System.nWorkers"].empty())
+            nWorkers = (int)fsSettings["System.nWorkers"];
+        mpScheduler = new Scheduler(nWorkers);
+        mbOwnScheduler = true;
+        cout << "Scheduler workers: " << mpScheduler->NumWorkers() << endl;
+    }
 
-    mpVocabulary = new ORBVocabulary();
-    bool bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
-    if(!bVocLoad)
+    mbPipelined = !fsSettings["System.Pipelined"].empty() && (int)fsSettings["System.Pipelined"]!=0;
+    if(mbPipelined)
+        cout << "Pipelined RGB-D tracking" << endl;
+
+    //Load ORB Vocabulary, unless one is shared with other Systems
+    if(pVoc)
     {
-        cerr << "Wrong path to vocabulary. " << endl;
-        cerr << "Falied to open at: " << strVocFile << endl;
-        exit(-1);
+        mpVocabulary = pVoc;
+        mbOwnVocabulary = false;
+        cout << endl << "Using shared ORB Vocabulary" << endl << endl;
+    }
+    else
+    {
+        cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
+
+        // A binary vocabulary (see tools/bin_vocabulary) is mapped instead of parsed
+        mpVocabulary = new ORBVocabulary();
+        mbOwnVocabulary = true;
+        bool bVocLoad;
+        if(strVocFile.size()>4 && strVocFile.compare(strVocFile.size()-4,4,".bin")==0)
+            bVocLoad = mpVocabulary->loadFromBinaryFile(strVocFile);
+        else
+            bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
+        if(!bVocLoad)
+        {
+            cerr << "Wrong path to vocabulary. " << endl;
+            cerr << "Falied to open at: " << strVocFile << endl;
+            exit(-1);
+        }
+        cout << "Vocabulary loaded!" << endl << endl;
     }
-    cout << "Vocabulary loaded!" << endl << endl;
+
+    //Calibration and id counters of this System
+    mpContext = new SystemContext();
 
     //Create KeyFrame Database
-    mpKeyFrameDatabase = new KeyFrameDatabase(*mpVocabulary);
+    mpKeyFrameDatabase = new KeyFrameDatabase(*mpVocabulary, mpScheduler);
 
     //Create the Map
     mpMap = new Map();
@@ -86,21 +165,22 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     //Initialize the Tracking thread
     //(it will live in the main thread of execution, the one that called this constructor)
     mpTracker = new Tracking(this, mpVocabulary, mpFrameDrawer, mpMapDrawer,
-                             mpMap, mpKeyFrameDatabase, strSettingsFile, mSensor);
+                             mpMap, mpKeyFrameDatabase, strSettingsFile, mSensor, mpScheduler, mpContext);
 
     //Initialize the Local Mapping thread and launch
-    mpLocalMapper = new LocalMapping(mpMap, mSensor==MONOCULAR);
-    mptLocalMapping = new thread(&ORB_SLAM2::LocalMapping::Run,mpLocalMapper);
+    //(LocalMapping.IncrementalBA: 1 keeps the local BA graph between keyframes, experimental, off by default)
+    const bool bIncrementalBA = !fsSettings["LocalMapping.IncrementalBA"].empty() && (int)fsSettings["LocalMapping.IncrementalBA"]!=0;
+    mpLocalMapper = new LocalMapping(mpMap, mSensor==MONOCULAR, mpScheduler, bIncrementalBA);
+    mnLocalMappingLoop = mpScheduler->StartPinned("LocalMapping",std::bind(&ORB_SLAM2::LocalMapping::Run,mpLocalMapper));
 
     //Initialize the Loop Closing thread and launch
-    mpLoopCloser = new LoopClosing(mpMap, mpKeyFrameDatabase, mpVocabulary, mSensor!=MONOCULAR);
-    mptLoopClosing = new thread(&ORB_SLAM2::LoopClosing::Run, mpLoopCloser);
+    mpLoopCloser = new LoopClosing(mpMap, mpKeyFrameDatabase, mpVocabulary, mSensor!=MONOCULAR, mpScheduler);
+    mnLoopClosingLoop = mpScheduler->StartPinned("LoopClosing",std::bind(&ORB_SLAM2::LoopClosing::Run,mpLoopCloser));
 
-    //Initialize the Viewer thread and launch
+    //Initialize the Viewer (it runs in the main thread, see StartViewer)
     if(bUseViewer)
     {
         mpViewer = new Viewer(this, mpFrameDrawer,mpMapDrawer,mpTracker,strSettingsFile);
-        // mptViewer = new thread(&Viewer::Run, mpViewer);
         mpTracker->SetViewer(mpViewer);
     }
 
@@ -131,10 +211,7 @@ cv::Mat System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const
             mpLocalMapper->RequestStop();
 
             // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
+            mpLocalMapper->WaitUntilStopped();
 
             mpTracker->InformOnlyTracking(true);
             mbActivateLocalizationMode = false;
@@ -184,10 +261,7 @@ cv::Mat System::TrackRGBD(const cv::Mat &im, cv::Mat &depthmap, const cv::Mat &f
             mpLocalMapper->RequestStop();
 
             // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
+            mpLocalMapper->WaitUntilStopped();
 
             mpTracker->InformOnlyTracking(true);
             mbActivateLocalizationMode = false;
@@ -219,6 +293,67 @@ cv::Mat System::TrackRGBD(const cv::Mat &im, cv::Mat &depthmap, const cv::Mat &f
     return Tcw;
 }
 
+cv::Mat System::TrackRGBDPipelined(const cv::Mat &im, cv::Mat &depthmap, const cv::Mat &flowmap, const cv::Mat &masksem,
+                                   const cv::Mat &mTcw_gt, const vector<vector<float> > &vObjPose_gt,
+                                   const double &timestamp, std::vector<float> &coer, std::vector<float> &reproer, int &m_num, cv::Mat &imTraj)
+{
+    if(mSensor!=RGBD)
+    {
+        cerr << "ERROR: you called TrackRGBDPipelined but input sensor was not set to RGBD." << endl;
+        exit(-1);
+    }
+
+    // Check mode change
+    {
+        unique_lock<mutex> lock(mMutexMode);
+        if(mbActivateLocalizationMode)
+        {
+            mpLocalMapper->RequestStop();
+
+            // Wait until Local Mapping has effectively stopped
+            mpLocalMapper->WaitUntilStopped();
+
+            mpTracker->InformOnlyTracking(true);
+            mbActivateLocalizationMode = false;
+        }
+        if(mbDeactivateLocalizationMode)
+        {
+            mpTracker->InformOnlyTracking(false);
+            mpLocalMapper->Release();
+            mbDeactivateLocalizationMode = false;
+        }
+    }
+
+    // Check reset (the frame in the pipeline is dropped)
+    {
+    unique_lock<mutex> lock(mMutexReset);
+    if(mbReset)
+    {
+        mpTracker->Reset();
+        mbReset = false;
+    }
+    }
+
+    cv::Mat Tcw = mpTracker->GrabImageRGBDPipelined(im,depthmap,flowmap,masksem,mTcw_gt,vObjPose_gt,timestamp,coer,reproer,m_num,imTraj);
+
+    unique_lock<mutex> lock2(mMutexState);
+    mTrackingState = mpTracker->mState;
+    mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
+    mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+    return Tcw;
+}
+
+cv::Mat System::FlushRGBD(std::vector<float> &coer, std::vector<float> &reproer, int &m_num, cv::Mat &imTraj)
+{
+    cv::Mat Tcw = mpTracker->FlushRGBD(coer,reproer,m_num,imTraj);
+
+    unique_lock<mutex> lock(mMutexState);
+    mTrackingState = mpTracker->mState;
+    mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
+    mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+    return Tcw;
+}
+
 cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp)
 {
     if(mSensor!=MONOCULAR)
@@ -235,10 +370,7 @@ cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp)
             mpLocalMapper->RequestStop();
 
             // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
+            mpLocalMapper->WaitUntilStopped();
 
             mpTracker->InformOnlyTracking(true);
             mbActivateLocalizationMode = false;
@@ -285,11 +417,10 @@ void System::DeactivateLocalizationMode()
 
 bool System::MapChanged()
 {
-    static int n=0;
     int curn = mpMap->GetLastBigChangeIdx();
-    if(n<curn)
+    if(mnLastBigChangeIdx<curn)
     {
-        n=curn;
+        mnLastBigChangeIdx=curn;
         return true;
     }
     else
@@ -309,18 +440,59 @@ void System::Shutdown()
     if(mpViewer)
     {
         mpViewer->RequestFinish();
-        while(!mpViewer->isFinished())
-            usleep(5000);
+        mpViewer->WaitUntilFinished();
     }
 
     // Wait until all thread have effectively stopped
-    while(!mpLocalMapper->isFinished() || !mpLoopCloser->isFinished() || mpLoopCloser->isRunningGBA())
+    mpLocalMapper->WaitUntilFinished();
+    mpLoopCloser->WaitUntilFinished();
+
+    int nKFs;
+    double meanMs, maxMs;
+    mpLocalMapper->GetKeyFrameLatency(nKFs,meanMs,maxMs);
+    cout << "Local Mapping keyframe hand-off latency: mean " << meanMs << " ms, max " << maxMs << " ms (" << nKFs << " keyframes)" << endl;
+    mpLoopCloser->GetKeyFrameLatency(nKFs,meanMs,maxMs);
+    cout << "Loop Closing keyframe hand-off latency: mean " << meanMs << " ms, max " << maxMs << " ms (" << nKFs << " keyframes)" << endl;
+
+    int nMaxDepth, nFullEvents;
+    mpLocalMapper->GetKeyFrameQueueStats(nMaxDepth,nFullEvents);
+    cout << "Local Mapping keyframe queue: max depth " << nMaxDepth << ", full " << nFullEvents << " times" << endl;
+    mpLoopCloser->GetKeyFrameQueueStats(nMaxDepth,nFullEvents);
+    cout << "Loop Closing keyframe queue: max depth " << nMaxDepth << ", full " << nFullEvents << " times" << endl;
+
+    int nSymbolic, nSymbolicReused;
+    mpLocalMapper->GetLocalBAStats(nKFs,meanMs,maxMs,nSymbolic,nSymbolicReused);
+    cout << "Local BA: mean " << meanMs << " ms, max " << maxMs << " ms (" << nKFs << " keyframes)";
+    if(nSymbolic+nSymbolicReused>0)
+        cout << ", symbolic factorization reused in " << nSymbolicReused << " of " << nSymbolic+nSymbolicReused << " optimizer runs (second passes)";
+    cout << endl;
+
+    const Tracking::MapLockStats lockStats = mpTracker->GetMapLockStats();
+    if(lockStats.nFrames>0)
+        cout << "Tracking map lock: mean wait " << lockStats.waitMs/lockStats.nFrames << " ms, mean hold " << lockStats.holdMs/lockStats.nFrames
+             << " ms, max hold " << lockStats.maxHoldMs << " ms (" << lockStats.nFrames << " frames)" << endl;
+
+    const Tracking::PipelineStats pipelineStats = mpTracker->GetPipelineStats();
+    if(pipelineStats.nFrames>0)
+        cout << "Tracking pipeline: mean back stage " << pipelineStats.backMs/pipelineStats.nFrames << " ms, mean wait for front stage "
+             << pipelineStats.stallMs/pipelineStats.nFrames << " ms (" << pipelineStats.nFrames << " frames)" << endl;
+
+    const vector<Scheduler::WorkerStats> vWorkerStats = mpScheduler->GetWorkerStats();
+    for(size_t i=0; i<vWorkerStats.size(); i++)
     {
-        usleep(5000);
+        const Scheduler::WorkerStats &stats = vWorkerStats[i];
+        if(stats.bPinned)
+            cout << "Scheduler " << stats.name << ": pinned" << endl;
+        else
+            cout << "Scheduler " << stats.name << ": " << stats.nTasks << " tasks (" << stats.nStolen << " stolen), busy "
+                 << stats.busyMs << " ms, utilization " << 100*stats.utilization << " %" << endl;
     }
+    cout << "Scheduler tasks run by waiting threads: " << mpScheduler->GetHelpedTasks() << endl;
 
     if(mpViewer)
         pangolin::BindToContext("ORB-SLAM2: Map Viewer");
+
+    mbShutdown = true;
 }
 
 void System::SaveResults(const string &filename)
@@ -491,6 +663,41 @@ void System::SaveResults(const string &filename)
 
 }
 
+void System::SaveObjectMotions(const string &filename)
+{
+    cout << endl << "Saving object motion errors to " << filename << " ..." << endl;
+
+    std::vector<std::vector<int> >         ObjMotID    = mpMap->vvObjMotID;
+    std::vector<std::vector<cv::Point2f> > ObjMotErr_1 = mpMap->vvObjMotErr_1;
+    std::vector<std::vector<cv::Point2f> > ObjMotErr_2 = mpMap->vvObjMotErr_2;
+    std::vector<std::vector<cv::Point2f> > ObjMotErr_3 = mpMap->vvObjMotErr_3;
+
+    ofstream save_obj_1;
+    string strObj1 = filename + "obj_mot_err.txt";
+    save_obj_1.open(strObj1.c_str(),ios::trunc);
+    ofstream save_obj_2;
+    string strObj2 = filename + "obj_mot_err_convert.txt";
+    save_obj_2.open(strObj2.c_str(),ios::trunc);
+    ofstream save_obj_3;
+    string strObj3 = filename + "obj_speed_err.txt";
+    save_obj_3.open(strObj3.c_str(),ios::trunc);
+
+    // one line per object and frame: object id, then the two error terms
+    for (int i = 0; i < ObjMotErr_3.size(); ++i)
+    {
+        for (int j = 0; j < ObjMotErr_3[i].size(); ++j)
+        {
+            save_obj_1 << fixed << ObjMotID[i][j] << " " << setprecision(6) << ObjMotErr_1[i][j].x << " " << ObjMotErr_1[i][j].y << endl;
+            save_obj_2 << fixed << ObjMotID[i][j] << " " << setprecision(6) << ObjMotErr_2[i][j].x << " " << ObjMotErr_2[i][j].y << endl;
+            save_obj_3 << fixed << ObjMotID[i][j] << " " << setprecision(6) << ObjMotErr_3[i][j].x << " " << ObjMotErr_3[i][j].y << endl;
+        }
+    }
+
+    save_obj_1.close();
+    save_obj_2.close();
+    save_obj_3.close();
+}
+
 void System::SaveTrajectoryTUM(const string &filename)
 {
     cout << endl << "Saving camera trajectory to " << filename << " ..." << endl;
@@ -0,0 +1,56 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "SystemContext.h"
+
+namespace ORB_SLAM2
+{
+
+SystemContext::SystemContext():
+    mbInitialComputations(true), fx(0), fy(0), cx(0), cy(0), invfx(0), invfy(0),
+    mnMinX(0), mnMaxX(0), mnMinY(0), mnMaxY(0), mfGridElementWidthInv(0), mfGridElementHeightInv(0),
+    mnNextFrameId(0), mnNextKeyFrameId(0), mnNextMapPointId(0)
+{
+}
+
+long unsigned int SystemContext::NewFrameId()
+{
+    return mnNextFrameId++;
+}
+
+long unsigned int SystemContext::NewKeyFrameId()
+{
+    return mnNextKeyFrameId++;
+}
+
+long unsigned int SystemContext::NewMapPointId()
+{
+    return mnNextMapPointId++;
+}
+
+void SystemContext::ResetIds()
+{
+    mnNextFrameId = 0;
+    mnNextKeyFrameId = 0;
+}
+
+} //namespace ORB_SLAM
@@ -41,6 +41,8 @@
 
 #include"Optimizer.h"
 #include"PnPsolver.h"
+#include"MotionLabeler.h"
+#include"Scheduler.h"
 
 #include<iostream>
 #include<stdio.h>
@@ -48,54 +50,97 @@
 #include<time.h>
 
 #include<mutex>
+#include<atomic>
 #include<unistd.h>
 
 #include <numeric>
 #include <algorithm>
 #include <map>
+#include <unordered_map>
 #include <random>
-
-//#include "gco/GCoptimization.h"
+#include <cstring>
+#include <cstdint>
+#include <chrono>
 
 using namespace std;
 
 // cv::RNG rng;
 
-struct LessPoint2f {
-    bool operator()(const cv::Point2f& lhs, const cv::Point2f& rhs) const
+struct HashPoint2f {
+    std::size_t operator()(const cv::Point2f& pt) const
     {
-        return (lhs.x == rhs.x) ? (lhs.y < rhs.y) : (lhs.x < rhs.x);
+        uint32_t x, y;
+        std::memcpy(&x, &pt.x, sizeof(x));
+        std::memcpy(&y, &pt.y, sizeof(y));
+        return std::hash<uint64_t>()((uint64_t(x) << 32) | y);
     }
 };
 
-struct EnergyDataStruct
+// Open addressing set of 64 bit keys (no erase). Used by GetMSS to record which
+// (point, neighbor) pairs are already covered by a minimal sample set.
+class CoverSet
 {
-    const std::vector<cv::Point2d> * const Cur_2d;
-    const std::vector<cv::Point3d> * const Pre_3d;
-    const cv::Mat Mods;
-    const cv::Mat Camera;
-    const double lambda;
-    const double beta;
-    const double repro_error_thres;
-
-    EnergyDataStruct(const std::vector<cv::Point2d> * const _p1,
-        const std::vector<cv::Point3d> * const _p2,
-        const cv::Mat _mods,
-        const cv::Mat _camera,
-        const double _lambda,
-        const double _beta
-        ) :
-        Cur_2d(_p1),
-        Pre_3d(_p2),
-        Mods(_mods),
-        Camera(_camera),
-        lambda(_lambda),
-        beta(_beta),
-        repro_error_thres(16)
+public:
+    CoverSet(size_t capacity=64) : mnSize(0)
+    {
+        size_t n = 16;
+        while(n < 2*capacity)
+            n <<= 1;
+        mvKeys.assign(n, EMPTY);
+    }
+
+    bool count(const uint32_t a, const uint32_t b) const
+    {
+        const uint64_t key = (uint64_t(a) << 32) | b;
+        for(size_t h = Slot(key); ; h = (h+1) & (mvKeys.size()-1))
+        {
+            if(mvKeys[h]==key)
+                return true;
+            if(mvKeys[h]==EMPTY)
+                return false;
+        }
+    }
+
+    void insert(const uint32_t a, const uint32_t b)
+    {
+        if(2*(mnSize+1) > mvKeys.size())
+            Grow();
+        const uint64_t key = (uint64_t(a) << 32) | b;
+        size_t h = Slot(key);
+        while(mvKeys[h]!=EMPTY && mvKeys[h]!=key)
+            h = (h+1) & (mvKeys.size()-1);
+        if(mvKeys[h]==EMPTY)
+        {
+            mvKeys[h] = key;
+            mnSize++;
+        }
+    }
+
+private:
+    static const uint64_t EMPTY = ~uint64_t(0);
+
+    size_t Slot(const uint64_t key) const
     {
+        return (key*0x9E3779B97F4A7C15ull >> 32) & (mvKeys.size()-1);
     }
+
+    void Grow()
+    {
+        std::vector<uint64_t> vOld;
+        vOld.swap(mvKeys);
+        mvKeys.assign(2*vOld.size(), EMPTY);
+        mnSize = 0;
+        for(size_t i=0; i<vOld.size(); i++)
+            if(vOld[i]!=EMPTY)
+                insert(uint32_t(vOld[i] >> 32), uint32_t(vOld[i]));
+    }
+
+    std::vector<uint64_t> mvKeys;
+    size_t mnSize;
 };
 
+const uint64_t CoverSet::EMPTY;
+
 std::vector<std::size_t> findDuplicateIndices(std::vector<int> const & v)
 {
     std::vector<std::size_t> indices;
@@ -132,9 +177,59 @@ bool sort_pair_int(const pair<int,int> &a,
 namespace ORB_SLAM2
 {
 
-Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer, MapDrawer *pMapDrawer, Map *pMap, KeyFrameDatabase* pKFDB, const string &strSettingPath, const int sensor):
-    mState(NO_IMAGES_YET), mSensor(sensor), mbOnlyTracking(false), mbVO(false), mpORBVocabulary(pVoc),
-    mpKeyFrameDB(pKFDB), mpInitializer(static_cast<Initializer*>(NULL)), mpSystem(pSys), mpViewer(NULL),
+// Holds the map update mutex for one call of Track() and accounts how long tracking waited
+// for it and held it. The lock can be dropped and retaken around the map-independent stages.
+class MapLockTimer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    MapLockTimer(std::mutex &mutex, Tracking::MapLockStats &stats):
+        mLock(mutex,std::defer_lock), mStats(stats), mWaitMs(0), mHoldMs(0)
+    {
+        Lock();
+    }
+
+    ~MapLockTimer()
+    {
+        if(mLock.owns_lock())
+            Unlock();
+
+        mStats.nFrames++;
+        mStats.waitMs += mWaitMs;
+        mStats.holdMs += mHoldMs;
+        mStats.maxHoldMs = std::max(mStats.maxHoldMs,mHoldMs);
+    }
+
+    void Lock()
+    {
+        const Clock::time_point t0 = Clock::now();
+        mLock.lock();
+        mtLocked = Clock::now();
+        mWaitMs += std::chrono::duration<double,std::milli>(mtLocked-t0).count();
+    }
+
+    void Unlock()
+    {
+        mHoldMs += std::chrono::duration<double,std::milli>(Clock::now()-mtLocked).count();
+        mLock.unlock();
+    }
+
+    bool IsLocked() const { return mLock.owns_lock(); }
+
+private:
+    std::unique_lock<std::mutex> mLock;
+    Tracking::MapLockStats &mStats;
+    Clock::time_point mtLocked;
+    double mWaitMs;
+    double mHoldMs;
+};
+
+Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer, MapDrawer *pMapDrawer, Map *pMap, KeyFrameDatabase* pKFDB, const string &strSettingPath, const int sensor, Scheduler* pScheduler, SystemContext* pContext):
+    mState(NO_IMAGES_YET), mSensor(sensor), mbOnlyTracking(false), mbVO(false),
+    mpORBextractorRight(static_cast<ORBextractor*>(NULL)), mpIniORBextractor(static_cast<ORBextractor*>(NULL)), mpORBVocabulary(pVoc),
+    mpKeyFrameDB(pKFDB), mpInitializer(static_cast<Initializer*>(NULL)), mpScheduler(pScheduler), mpContext(pContext), mpMotionLabeler(new MotionLabeler(80,1,16,pScheduler)),
+    mpPendingRGBD(static_cast<RGBDInput*>(NULL)), mpSystem(pSys), mpViewer(NULL),
     mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer), mpMap(pMap), mnLastRelocFrameId(0)
 {
     // Load camera parameters from settings file
@@ -213,6 +308,13 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     if(sensor==System::MONOCULAR)
         mpIniORBextractor = new ORBextractor(2*nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
 
+    // The pyramid levels are detected and described in parallel
+    mpORBextractorLeft->SetScheduler(mpScheduler);
+    if(sensor==System::STEREO)
+        mpORBextractorRight->SetScheduler(mpScheduler);
+    if(sensor==System::MONOCULAR)
+        mpIniORBextractor->SetScheduler(mpScheduler);
+
     cout << endl  << "ORB Extractor Parameters: " << endl;
     cout << "- Number of Features: " << nFeatures << endl;
     cout << "- Scale Levels: " << nLevels << endl;
@@ -235,6 +337,25 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
             mDepthMapFactor = 1.0f/mDepthMapFactor;
     }
 
+    // Graph-cut relabeling of the object points between the object motions
+    mbGraphCutLabeling = !fSettings["Tracking.GraphCutLabeling"].empty() && (int)fSettings["Tracking.GraphCutLabeling"]!=0;
+    if(mbGraphCutLabeling)
+        cout << endl << "Graph-cut motion labeling of the object points" << endl;
+
+}
+
+Tracking::~Tracking()
+{
+    delete mpORBextractorLeft;
+    delete mpORBextractorRight;
+    delete mpIniORBextractor;
+    delete mpInitializer;
+    delete mpMotionLabeler;
+    delete mpPendingRGBD;
+
+    // Temporal MapPoints of the last frame are not in the map
+    for(list<MapPoint*>::iterator lit = mlpTemporalPoints.begin(), lend =  mlpTemporalPoints.end(); lit!=lend; lit++)
+        delete *lit;
 }
 
 void Tracking::SetLocalMapper(LocalMapping *pLocalMapper)
@@ -286,7 +407,7 @@ cv::Mat Tracking::GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat &imRe
     }
 
 
-    mCurrentFrame = Frame(mImGray,imGrayRight,imMask,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
+    mCurrentFrame = Frame(mImGray,imGrayRight,imMask,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpContext);
 
     // Save temperal matches for visualization
     TemperalMatch = vector<int>(mCurrentFrame.N,-1);
@@ -439,11 +560,76 @@ cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB, cv::Mat &imD, const cv::Ma
                                 const cv::Mat &maskSEM, const cv::Mat &mTcw_gt, const vector<vector<float> > &vObjPose_gt,
                                 const double &timestamp, std::vector<float> &coer, std::vector<float> &reproer, int &m_num, cv::Mat &imTraj)
 {
-    cv::RNG rng((unsigned)time(NULL));
+    RGBDInput input;
+    SetRGBDInput(input,imRGB,imD,imFlow,maskSEM,mTcw_gt,vObjPose_gt,timestamp);
+    BuildFrameRGBD(input);
+    return TrackFrameRGBD(input,coer,reproer,m_num,imTraj);
+}
 
-    mImGray = imRGB;
+cv::Mat Tracking::GrabImageRGBDPipelined(const cv::Mat &imRGB, cv::Mat &imD, const cv::Mat &imFlow,
+                                         const cv::Mat &maskSEM, const cv::Mat &mTcw_gt, const vector<vector<float> > &vObjPose_gt,
+                                         const double &timestamp, std::vector<float> &coer, std::vector<float> &reproer, int &m_num, cv::Mat &imTraj)
+{
+    RGBDInput* pNext = new RGBDInput();
+    SetRGBDInput(*pNext,imRGB,imD,imFlow,maskSEM,mTcw_gt,vObjPose_gt,timestamp);
+
+    cv::Mat Tcw;
+    if(mpPendingRGBD)
+    {
+        // The front stage only reads its own inputs and the extractor, while the back stage
+        // takes the correspondences of mLastFrame. Build the next frame as a task meanwhile.
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        TaskGroup front(mpScheduler);
+        front.Run([&]() { BuildFrameRGBD(*pNext); });
+        Tcw = TrackFrameRGBD(*mpPendingRGBD,coer,reproer,m_num,imTraj);
+        std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+        front.Wait();
+        std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
+
+        mPipelineStats.nFrames++;
+        mPipelineStats.backMs += std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t2-t1).count();
+        mPipelineStats.stallMs += std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t3-t2).count();
+
+        delete mpPendingRGBD;
+    }
+    else
+        BuildFrameRGBD(*pNext);
+
+    mpPendingRGBD = pNext;
+
+    return Tcw;
+}
+
+cv::Mat Tracking::FlushRGBD(std::vector<float> &coer, std::vector<float> &reproer, int &m_num, cv::Mat &imTraj)
+{
+    if(!mpPendingRGBD)
+        return cv::Mat();
+
+    cv::Mat Tcw = TrackFrameRGBD(*mpPendingRGBD,coer,reproer,m_num,imTraj);
+    delete mpPendingRGBD;
+    mpPendingRGBD = static_cast<RGBDInput*>(NULL);
+    return Tcw;
+}
+
+void Tracking::SetRGBDInput(RGBDInput &input, const cv::Mat &imRGB, cv::Mat &imD, const cv::Mat &imFlow,
+                            const cv::Mat &maskSEM, const cv::Mat &mTcw_gt, const vector<vector<float> > &vObjPose_gt,
+                            const double &timestamp)
+{
+    input.imRGB = imRGB;
+    input.imDepth = imD;
+    input.imFlow = imFlow;
+    input.maskSEM = maskSEM;
+    input.mTcw_gt = mTcw_gt;
+    input.vObjPose_gt = vObjPose_gt;
+    input.timestamp = timestamp;
+}
+
+void Tracking::BuildFrameRGBD(RGBDInput &input)
+{
+    cv::Mat imGray = input.imRGB;
 
     // preprocess depth  !!! important for kitti dataset
+    cv::Mat &imD = input.imDepth;
     for (int i = 0; i < imD.rows; i++)
     {
         for (int j = 0; j < imD.cols; j++)
@@ -454,21 +640,20 @@ cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB, cv::Mat &imD, const cv::Ma
         }
         // cout << endl;
     }
-    cv::Mat imDepth = imD;
 
-    if(mImGray.channels()==3)
+    if(imGray.channels()==3)
     {
         if(mbRGB)
-            cvtColor(mImGray,mImGray,CV_RGB2GRAY);
+            cvtColor(imGray,imGray,CV_RGB2GRAY);
         else
-            cvtColor(mImGray,mImGray,CV_BGR2GRAY);
+            cvtColor(imGray,imGray,CV_BGR2GRAY);
     }
-    else if(mImGray.channels()==4)
+    else if(imGray.channels()==4)
     {
         if(mbRGB)
-            cvtColor(mImGray,mImGray,CV_RGBA2GRAY);
+            cvtColor(imGray,imGray,CV_RGBA2GRAY);
         else
-            cvtColor(mImGray,mImGray,CV_BGRA2GRAY);
+            cvtColor(imGray,imGray,CV_BGRA2GRAY);
     }
 
     // if((fabs(mDepthMapFactor-1.0f)>1e-5) || imDepth.type()!=CV_32F){
@@ -478,7 +663,21 @@ cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB, cv::Mat &imD, const cv::Ma
 
 
 
-    mCurrentFrame = Frame(mImGray,imDepth,imFlow,maskSEM,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
+    input.imGray = imGray;
+    input.frame = Frame(imGray,input.imDepth,input.imFlow,input.maskSEM,input.timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpContext);
+}
+
+cv::Mat Tracking::TrackFrameRGBD(RGBDInput &input, std::vector<float> &coer, std::vector<float> &reproer, int &m_num, cv::Mat &imTraj)
+{
+    mImGray = input.imGray;
+    const cv::Mat &imRGB = input.imRGB;
+    const cv::Mat &imDepth = input.imDepth;
+    const cv::Mat &maskSEM = input.maskSEM;
+    const cv::Mat &mTcw_gt = input.mTcw_gt;
+    const vector<vector<float> > &vObjPose_gt = input.vObjPose_gt;
+    const double &timestamp = input.timestamp;
+
+    mCurrentFrame = input.frame;
 
     // ---------------------------------------------------------------------------------------
     // +++++++++++++++++++++++++ For sampled features ++++++++++++++++++++++++++++++++++++++++
@@ -680,6 +879,14 @@ cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB, cv::Mat &imD, const cv::Ma
     //     cv::waitKey(0);
     // }
 
+    // Without a viewer (e.g. batch runs) nothing is drawn, shown or written
+    if(!mpViewer)
+    {
+        mImGrayLast = mImGray;
+        TemperalMatch.clear();
+        return mCurrentFrame.mTcw.clone();
+    }
+
     // // // ************** display label on the image ***************  // //
     if(timestamp!=0 && (bFrame2Frame == true || bSecondFrame == true))
     {
@@ -939,9 +1146,9 @@ cv::Mat Tracking::GrabImageMonocular(const cv::Mat &im, const double &timestamp)
     }
 
     if(mState==NOT_INITIALIZED || mState==NO_IMAGES_YET)
-        mCurrentFrame = Frame(mImGray,timestamp,mpIniORBextractor,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
+        mCurrentFrame = Frame(mImGray,timestamp,mpIniORBextractor,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpContext);
     else
-        mCurrentFrame = Frame(mImGray,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
+        mCurrentFrame = Frame(mImGray,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpContext);
 
     Track();
 
@@ -960,7 +1167,8 @@ void Tracking::Track()
     mLastProcessedState=mState;
 
     // Get Map Mutex -> Map cannot be changed
-    unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+    // It is only held while tracking reads or writes the map. The object stages work on frame-local data.
+    MapLockTimer lock(mpMap->mMutexMapUpdate,mMapLockStats);
 
     if(mState==NOT_INITIALIZED)
     {
@@ -1175,6 +1383,10 @@ void Tracking::Track()
         if(!mCurrentFrame.mpReferenceKF)
             mCurrentFrame.mpReferenceKF = mpReferenceKF;
 
+        // Everything up to the trajectory bookkeeping below only touches the frames and the
+        // result containers owned by this thread, let Local Mapping and Loop Closing run meanwhile.
+        lock.Unlock();
+
 
         // ---------------------------------------------------------------------------------------
         // ++++++++++++++++++++ Compute Sparse Scene Flow ++++++++++++++++++++++++++++++++++++++++
@@ -1537,6 +1749,10 @@ void Tracking::Track()
 
         mpMap->vTotObjNum.push_back(ObjId.size());
 
+        // refine the point sets of the dynamic objects with their motions
+        if (mbGraphCutLabeling && ObjIdNew.size()>1)
+            GCoptimal(ObjIdNew,SemPosNew);
+
         // *************************************************************
 
         // // *** To show the points on object ***
@@ -2478,6 +2694,10 @@ void Tracking::Track()
     }
 
 
+    // The reference keyframe pose may be under correction by Loop Closing
+    if(!lock.IsLocked())
+        lock.Lock();
+
     // Store frame pose information to retrieve the complete camera trajectory afterwards.
     if(!mCurrentFrame.mTcw.empty())
     {
@@ -2502,7 +2722,8 @@ void Tracking::Track()
 void Tracking::StereoInitialization()
 {
     cout << "Initialization ........" << endl;
-    if(mCurrentFrame.N>500)
+    // Never block on Local Mapping, wait for a free slot in its queue before creating the keyframe
+    if(mCurrentFrame.N>500 && mpLocalMapper->KeyFrameQueueFreeSlots()>0)
     {
         // Set Frame pose to the origin
         if(false)
@@ -2597,7 +2818,7 @@ void Tracking::MonocularInitialization()
             if(mpInitializer)
                 delete mpInitializer;
 
-            mpInitializer =  new Initializer(mCurrentFrame,1.0,200);
+            mpInitializer =  new Initializer(mCurrentFrame,1.0,200,mpScheduler);
 
             fill(mvIniMatches.begin(),mvIniMatches.end(),-1);
 
@@ -2663,13 +2884,17 @@ void Tracking::MonocularInitialization()
 
 void Tracking::CreateInitialMapMonocular()
 {
+    // Both keyframes go to Local Mapping, try again on the next frame if its queue has no room
+    if(mpLocalMapper->KeyFrameQueueFreeSlots()<2)
+        return;
+
     // Create KeyFrames
     KeyFrame* pKFini = new KeyFrame(mInitialFrame,mpMap,mpKeyFrameDB);
     KeyFrame* pKFcur = new KeyFrame(mCurrentFrame,mpMap,mpKeyFrameDB);
 
 
-    pKFini->ComputeBoW();
-    pKFcur->ComputeBoW();
+    pKFini->ComputeBoW(mpScheduler);
+    pKFcur->ComputeBoW(mpScheduler);
 
     // Insert KFs in the map
     mpMap->AddKeyFrame(pKFini);
@@ -2710,7 +2935,7 @@ void Tracking::CreateInitialMapMonocular()
     // Bundle Adjustment
     cout << "New Map created with " << mpMap->MapPointsInMap() << " points" << endl;
 
-    Optimizer::GlobalBundleAdjustemnt(mpMap,20);
+    Optimizer::GlobalBundleAdjustemnt(mpMap,20,NULL,0,true,mpScheduler);
 
     // Set median depth to 1
     float medianDepth = pKFini->ComputeSceneMedianDepth(2);
@@ -2983,13 +3208,13 @@ bool Tracking::TrackWithMotionModel()
         th=15;
     else
         th=7; // 7 15
-    int nmatches = matcher.SearchByProjection(mCurrentFrame,mLastFrame,th,mSensor==System::MONOCULAR,TemperalMatch);
+    int nmatches = matcher.SearchByProjection(mCurrentFrame,mLastFrame,th,mSensor==System::MONOCULAR,TemperalMatch,mpScheduler);
 
     // If few matches, uses a wider window search
     if(nmatches<20)
     {
         fill(mCurrentFrame.mvpMapPoints.begin(),mCurrentFrame.mvpMapPoints.end(),static_cast<MapPoint*>(NULL));
-        nmatches = matcher.SearchByProjection(mCurrentFrame,mLastFrame,2*th,mSensor==System::MONOCULAR,TemperalMatch);
+        nmatches = matcher.SearchByProjection(mCurrentFrame,mLastFrame,2*th,mSensor==System::MONOCULAR,TemperalMatch,mpScheduler);
     }
 
     // Search matches by quad matching, i.e., matches must fit to
@@ -3249,6 +3474,10 @@ bool Tracking::NeedNewKeyFrame()
     if(mpLocalMapper->isStopped() || mpLocalMapper->stopRequested())
         return false;
 
+    // Backpressure: Local Mapping has a full queue, inserting now would stall tracking
+    if(mpLocalMapper->KeyFrameQueueFull())
+        return false;
+
     const int nKFs = mpMap->KeyFramesInMap();
 
     // Do not insert keyframes if not enough frames have passed from last relocalisation
@@ -3332,6 +3561,10 @@ bool Tracking::NeedNewKeyFrame()
 
 void Tracking::CreateNewKeyFrame()
 {
+    // NeedNewKeyFrame already refuses this case. Checked again so no keyframe is created that cannot be queued
+    if(mpLocalMapper->KeyFrameQueueFull())
+        return;
+
     if(!mpLocalMapper->SetNotStop(true))
         return;
 
@@ -3461,7 +3694,7 @@ void Tracking::SearchLocalPoints()
         // If the camera has been relocalised recently, perform a coarser search
         if(mCurrentFrame.mnId<mnLastRelocFrameId+2)
             th=5;
-        matcher.SearchByProjection(mCurrentFrame,mvpLocalMapPoints,th);
+        matcher.SearchByProjection(mCurrentFrame,mvpLocalMapPoints,th,mpScheduler);
     }
 }
 
@@ -3626,75 +3859,53 @@ bool Tracking::Relocalization()
 
     const int nKFs = vpCandidateKFs.size();
 
-    // We perform first an ORB matching with each candidate
-    // If enough matches are found we setup a PnP solver
-    ORBmatcher matcher(0.75,true);
-
-    vector<PnPsolver*> vpPnPsolvers;
-    vpPnPsolvers.resize(nKFs);
-
-    vector<vector<MapPoint*> > vvpMapPointMatches;
-    vvpMapPointMatches.resize(nKFs);
-
-    vector<bool> vbDiscarded;
-    vbDiscarded.resize(nKFs);
+    // Each candidate is verified by its own task, on a private copy of the current frame.
+    // The first pose supported by enough inliers raises bFound, which stops the RANSAC of
+    // the other candidates, so the latency is that of the fastest successful candidate.
+    std::atomic<bool> bFound(false);
+    cv::Mat TcwFound;
+    vector<MapPoint*> vpMapPointsFound;
+    vector<bool> vbOutlierFound;
 
-    int nCandidates=0;
-
-    for(int i=0; i<nKFs; i++)
+    mpScheduler->ParallelFor(nKFs,[&](int begin, int end, int)
     {
-        KeyFrame* pKF = vpCandidateKFs[i];
-        if(pKF->isBad())
-            vbDiscarded[i] = true;
-        else
+        for(int i=begin; i<end && !bFound.load(); i++)
         {
-            int nmatches = matcher.SearchByBoW(pKF,mCurrentFrame,vvpMapPointMatches[i],TemperalMatch);
-            if(nmatches<15)
-            {
-                vbDiscarded[i] = true;
+            KeyFrame* pKF = vpCandidateKFs[i];
+            if(pKF->isBad())
                 continue;
-            }
-            else
-            {
-                PnPsolver* pSolver = new PnPsolver(mCurrentFrame,vvpMapPointMatches[i]);
-                pSolver->SetRansacParameters(0.99,10,300,4,0.5,5.991);
-                vpPnPsolvers[i] = pSolver;
-                nCandidates++;
-            }
-        }
-    }
-
-    // Alternatively perform some iterations of P4P RANSAC
-    // Until we found a camera pose supported by enough inliers
-    bool bMatch = false;
-    ORBmatcher matcher2(0.9,true);
 
-    while(nCandidates>0 && !bMatch)
-    {
-        for(int i=0; i<nKFs; i++)
-        {
-            if(vbDiscarded[i])
+            // We perform first an ORB matching with the candidate
+            // If enough matches are found we setup a PnP solver
+            ORBmatcher matcher(0.75,true);
+            vector<MapPoint*> vpMapPointMatches;
+            int nmatches = matcher.SearchByBoW(pKF,mCurrentFrame,vpMapPointMatches,TemperalMatch);
+            if(nmatches<15)
                 continue;
 
-            // Perform 5 Ransac Iterations
-            vector<bool> vbInliers;
-            int nInliers;
-            bool bNoMore;
+            PnPsolver solver(mCurrentFrame,vpMapPointMatches);
+            solver.SetRansacParameters(0.99,10,300,4,0.5,5.991);
+            solver.SetCancelFlag(&bFound);
 
-            PnPsolver* pSolver = vpPnPsolvers[i];
-            cv::Mat Tcw = pSolver->iterate(5,bNoMore,vbInliers,nInliers);
+            Frame F(mCurrentFrame);
+            ORBmatcher matcher2(0.9,true);
 
-            // If Ransac reachs max. iterations discard keyframe
-            if(bNoMore)
+            // Perform P4P RANSAC until we found a camera pose supported by enough inliers,
+            // RANSAC reachs max. iterations or another candidate succeeds
+            bool bNoMore = false;
+            while(!bNoMore)
             {
-                vbDiscarded[i]=true;
-                nCandidates--;
-            }
+                // Perform 5 Ransac Iterations
+                vector<bool> vbInliers;
+                int nInliers;
 
-            // If a Camera Pose is computed, optimize
-            if(!Tcw.empty())
-            {
-                Tcw.copyTo(mCurrentFrame.mTcw);
+                cv::Mat Tcw = solver.iterate(5,bNoMore,vbInliers,nInliers);
+
+                // If a Camera Pose is computed, optimize
+                if(Tcw.empty())
+                    continue;
+
+                Tcw.copyTo(F.mTcw);
 
                 set<MapPoint*> sFound;
 
@@ -3704,71 +3915,80 @@ bool Tracking::Relocalization()
                 {
                     if(vbInliers[j])
                     {
-                        mCurrentFrame.mvpMapPoints[j]=vvpMapPointMatches[i][j];
-                        sFound.insert(vvpMapPointMatches[i][j]);
+                        F.mvpMapPoints[j]=vpMapPointMatches[j];
+                        sFound.insert(vpMapPointMatches[j]);
                     }
                     else
-                        mCurrentFrame.mvpMapPoints[j]=NULL;
+                        F.mvpMapPoints[j]=NULL;
                 }
 
-                int nGood = Optimizer::PoseOptimization(&mCurrentFrame);
+                int nGood = Optimizer::PoseOptimization(&F);
 
                 if(nGood<10)
                     continue;
 
-                for(int io =0; io<mCurrentFrame.N; io++)
-                    if(mCurrentFrame.mvbOutlier[io])
-                        mCurrentFrame.mvpMapPoints[io]=static_cast<MapPoint*>(NULL);
+                for(int io =0; io<F.N; io++)
+                    if(F.mvbOutlier[io])
+                        F.mvpMapPoints[io]=static_cast<MapPoint*>(NULL);
 
                 // If few inliers, search by projection in a coarse window and optimize again
                 if(nGood<50)
                 {
-                    int nadditional =matcher2.SearchByProjection(mCurrentFrame,vpCandidateKFs[i],sFound,10,100);
+                    int nadditional =matcher2.SearchByProjection(F,pKF,sFound,10,100,mpScheduler);
 
                     if(nadditional+nGood>=50)
                     {
-                        nGood = Optimizer::PoseOptimization(&mCurrentFrame);
+                        nGood = Optimizer::PoseOptimization(&F);
 
                         // If many inliers but still not enough, search by projection again in a narrower window
                         // the camera has been already optimized with many points
                         if(nGood>30 && nGood<50)
                         {
                             sFound.clear();
-                            for(int ip =0; ip<mCurrentFrame.N; ip++)
-                                if(mCurrentFrame.mvpMapPoints[ip])
-                                    sFound.insert(mCurrentFrame.mvpMapPoints[ip]);
-                            nadditional =matcher2.SearchByProjection(mCurrentFrame,vpCandidateKFs[i],sFound,3,64);
+                            for(int ip =0; ip<F.N; ip++)
+                                if(F.mvpMapPoints[ip])
+                                    sFound.insert(F.mvpMapPoints[ip]);
+                            nadditional =matcher2.SearchByProjection(F,pKF,sFound,3,64,mpScheduler);
 
                             // Final optimization
                             if(nGood+nadditional>=50)
                             {
-                                nGood = Optimizer::PoseOptimization(&mCurrentFrame);
+                                nGood = Optimizer::PoseOptimization(&F);
 
-                                for(int io =0; io<mCurrentFrame.N; io++)
-                                    if(mCurrentFrame.mvbOutlier[io])
-                                        mCurrentFrame.mvpMapPoints[io]=NULL;
+                                for(int io =0; io<F.N; io++)
+                                    if(F.mvbOutlier[io])
+                                        F.mvpMapPoints[io]=NULL;
                             }
                         }
                     }
                 }
 
-
-                // If the pose is supported by enough inliers stop ransacs and continue
+                // If the pose is supported by enough inliers stop ransacs and continue.
+                // Only the first candidate to get here publishes its pose.
                 if(nGood>=50)
                 {
-                    bMatch = true;
+                    bool bExpected = false;
+                    if(bFound.compare_exchange_strong(bExpected,true))
+                    {
+                        TcwFound = F.mTcw;
+                        vpMapPointsFound = F.mvpMapPoints;
+                        vbOutlierFound = F.mvbOutlier;
+                    }
                     break;
                 }
             }
         }
-    }
+    },nKFs);
 
-    if(!bMatch)
+    if(!bFound)
     {
         return false;
     }
     else
     {
+        mCurrentFrame.SetPose(TcwFound);
+        mCurrentFrame.mvpMapPoints = vpMapPointsFound;
+        mCurrentFrame.mvbOutlier = vbOutlierFound;
         mnLastRelocFrameId = mCurrentFrame.mnId;
         return true;
     }
@@ -3782,8 +4002,7 @@ void Tracking::Reset()
     if(mpViewer)
     {
         mpViewer->RequestStop();
-        while(!mpViewer->isStopped())
-            usleep(3000);
+        mpViewer->WaitUntilStopped();
     }
 
     // Reset Local Mapping
@@ -3804,8 +4023,7 @@ void Tracking::Reset()
     // Clear Map (this erase MapPoints and KeyFrames)
     mpMap->clear();
 
-    KeyFrame::nNextId = 0;
-    Frame::nNextId = 0;
+    mpContext->ResetIds();
     mState = NO_IMAGES_YET;
 
     if(mpInitializer)
@@ -3814,6 +4032,13 @@ void Tracking::Reset()
         mpInitializer = static_cast<Initializer*>(NULL);
     }
 
+    // A frame built in the pipeline before the reset carries an old id
+    if(mpPendingRGBD)
+    {
+        delete mpPendingRGBD;
+        mpPendingRGBD = static_cast<RGBDInput*>(NULL);
+    }
+
     mlRelativeFramePoses.clear();
     mlpReferences.clear();
     mlFrameTimes.clear();
@@ -3853,7 +4078,7 @@ void Tracking::ChangeCalibration(const string &strSettingPath)
 
     mbf = fSettings["Camera.bf"];
 
-    Frame::mbInitialComputations = true;
+    mpContext->mbInitialComputations = true;
 }
 
 void Tracking::InformOnlyTracking(const bool &flag)
@@ -4442,21 +4667,23 @@ cv::Mat Tracking::GetInitModelObj(const std::vector<int> &ObjId, std::vector<int
     return output;
 }
 
-cv::Mat Tracking::Delaunay(const std::vector<int> &id_dynamic)
+Tracking::NeighborGraph Tracking::Delaunay(const std::vector<cv::KeyPoint> &vKeys, const std::vector<int> &id_dynamic, const int maxDegree)
 {
-    /// Return the Delaunay triangulation, under the form of an adjacency matrix
-    /// points is a Nx2 mat containing the coordinates (x, y) of the points
+    /// Return the Delaunay triangulation, under the form of a CSR neighbor graph
+    /// indexed by the position of the points in id_dynamic
     const int r_min = 0, c_min = 0, r_max = mCurrentFrame.mnMaxY, c_max = mCurrentFrame.mnMaxX;
-    std::map<cv::Point2f, int, LessPoint2f> mappts;
-    cv::Mat1b adj(id_dynamic.size(), id_dynamic.size(), uchar(0));
+    const int N = id_dynamic.size();
+    std::unordered_map<cv::Point2f, int, HashPoint2f> mappts;
+    mappts.reserve(N);
+    std::vector<cv::Point2f> vPts(N);
 
     /// Create subdiv and insert the points to it
     // cv::Subdiv2D subdiv(cv::Rect(r_min, c_min, r_max+std::fabs(r_min), c_max+std::fabs(c_min)));
     cv::Subdiv2D subdiv(cv::Rect(r_min, c_min, c_max, r_max));
-    for (int p = 0; p < id_dynamic.size(); p++)
+    for (int p = 0; p < N; p++)
     {
-        float xp = mCurrentFrame.mvSiftKeys[id_dynamic[p]].pt.x;
-        float yp = mCurrentFrame.mvSiftKeys[id_dynamic[p]].pt.y;
+        float xp = vKeys[id_dynamic[p]].pt.x;
+        float yp = vKeys[id_dynamic[p]].pt.y;
 
         if(xp<0)
             xp=0;
@@ -4464,58 +4691,124 @@ cv::Mat Tracking::Delaunay(const std::vector<int> &id_dynamic)
             yp=0;
 
         cv::Point2f fp(xp, yp);
-
-        // cout << "the subdiv dimensions: " << xp << " " << yp << endl;
+        vPts[p] = fp;
 
         // Don't add duplicates
-        if (mappts.count(fp) == 0)
-        {
-            // Save point and index
-            mappts[fp] = p;
+        if (mappts.emplace(fp, p).second)
             subdiv.insert(fp);
-        }
     }
 
-    /// Get the number of edges
+    /// Get the edges
     std::vector<cv::Vec4f> edgeList;
     subdiv.getEdgeList(edgeList);
-    int nE = edgeList.size();
 
-    /// Check adjacency
-    for (int i = 0; i < nE; i++)
+    /// Collect the valid edges and count the degree of each point
+    std::vector<std::pair<int,int> > vEdges;
+    vEdges.reserve(edgeList.size());
+    NeighborGraph graph;
+    graph.vOffsets.assign(N+1, 0);
+    for (size_t i = 0; i < edgeList.size(); i++)
     {
-        cv::Vec4f e = edgeList[i];
-        cv::Point2f pt0(e[0], e[1]);
-        cv::Point2f pt1(e[2], e[3]);
+        const cv::Vec4f &e = edgeList[i];
+        auto it0 = mappts.find(cv::Point2f(e[0], e[1]));
+        auto it1 = mappts.find(cv::Point2f(e[2], e[3]));
 
-        if (mappts.count(pt0) == 0 || mappts.count(pt1) == 0) {
+        if (it0 == mappts.end() || it1 == mappts.end()) {
             continue;  // Not a valid point
         }
 
-        int idx0 = mappts[pt0];
-        int idx1 = mappts[pt1];
+        const int idx0 = it0->second;
+        const int idx1 = it1->second;
+        vEdges.push_back(std::make_pair(idx0, idx1));
+        graph.vOffsets[idx0+1]++;
+        graph.vOffsets[idx1+1]++;
+    }
 
-        // Symmetric matrix
-        adj(idx0, idx1) = 1;
-        adj(idx1, idx0) = 1;
+    /// Fill the symmetric neighbor lists
+    for (int p = 0; p < N; p++)
+        graph.vOffsets[p+1] += graph.vOffsets[p];
 
+    graph.vAdj.resize(graph.vOffsets[N]);
+    std::vector<int> vFill(graph.vOffsets.begin(), graph.vOffsets.end()-1);
+    for (size_t i = 0; i < vEdges.size(); i++)
+    {
+        graph.vAdj[vFill[vEdges[i].first]++] = vEdges[i].second;
+        graph.vAdj[vFill[vEdges[i].second]++] = vEdges[i].first;
     }
 
-    return adj;
+    for (int p = 0; p < N; p++)
+        std::sort(graph.vAdj.begin()+graph.vOffsets[p], graph.vAdj.begin()+graph.vOffsets[p+1]);
+
+    if (maxDegree<=0)
+        return graph;
+
+    /// Bound the degree. Every point selects its maxDegree closest neighbors and an edge
+    /// is kept only if both of its ends select it, so the graph stays symmetric.
+    std::vector<char> vSelected(graph.vAdj.size(), 1);
+    std::vector<std::pair<float,int> > vDistNeigh;
+    for (int p = 0; p < N; p++)
+    {
+        if (graph.Degree(p)<=maxDegree)
+            continue;
+
+        vDistNeigh.clear();
+        for (int s = graph.vOffsets[p]; s < graph.vOffsets[p+1]; s++)
+        {
+            const cv::Point2f d = vPts[graph.vAdj[s]]-vPts[p];
+            vDistNeigh.push_back(std::make_pair(d.x*d.x+d.y*d.y, s));
+        }
+        std::partial_sort(vDistNeigh.begin(), vDistNeigh.begin()+maxDegree, vDistNeigh.end());
+
+        for (size_t k = maxDegree; k < vDistNeigh.size(); k++)
+            vSelected[vDistNeigh[k].second] = 0;
+    }
+
+    NeighborGraph bounded;
+    bounded.vOffsets.assign(N+1, 0);
+    bounded.vAdj.reserve(std::min<size_t>(graph.vAdj.size(), size_t(N)*maxDegree));
+    for (int p = 0; p < N; p++)
+    {
+        for (int s = graph.vOffsets[p]; s < graph.vOffsets[p+1]; s++)
+        {
+            if (!vSelected[s])
+                continue;
+
+            // Rows are sorted, find the slot of p in the row of its neighbor
+            const int q = graph.vAdj[s];
+            const int r = std::lower_bound(graph.begin(q), graph.end(q), p)-graph.vAdj.data();
+            if (vSelected[r])
+                bounded.vAdj.push_back(q);
+        }
+        bounded.vOffsets[p+1] = bounded.vAdj.size();
+    }
+
+    return bounded;
 }
 
-std::vector<Eigen::Vector4i> Tracking::GetMSS(const std::vector<int> &id_dynamic, const std::vector<int> &id_inter, const std::vector<int> &id_unknown, const Eigen::MatrixXi &Sorted_ind)
+std::vector<Eigen::Vector4i> Tracking::GetMSS(const std::vector<int> &id_dynamic, const std::vector<int> &id_inter, const std::vector<int> &id_unknown, const Eigen::MatrixXi &Sorted_ind, const int nThreads)
 {
 
-    int n_kp = id_dynamic.size(), m = 6;  // consider the first 6 neighbors
-    std::vector<Eigen::Vector4i> nMSS;
-    std::vector<std::vector<int> > Ind_cover(id_unknown.size());
+    const int n_kp = id_dynamic.size(), m = 6;  // consider the first 6 neighbors
+    const int max_mss = (m-1)*(m-2)*(m-3)/6;   // triples among neighbors 1..m-1
+    const int cover_size = 24*n_kp;             // 12 pairs per sample, about 2 samples per point
 
-    // Main Loop
-    for (int i = 0; i < n_kp; ++i)
+    // Each point writes its samples to its own slots, compacted in point order at the end
+    std::vector<Eigen::Vector4i> vMSSBuffer(n_kp*max_mss);
+    std::vector<int> vnMSS(n_kp,0);
+
+    // Generate the samples of point i. Coverage is stored as (unknown index, keypoint id) pairs.
+    auto GetPointMSS = [&](const int i, CoverSet &cover)
     {
-        int cc = 0;
-        Eigen::Vector4i mss_tmp;
+        const int u = id_inter[i];
+        int nid[m], kid[m];
+        bool dyn[m];
+        for (int k = 1; k < m; ++k)
+        {
+            nid[k] = Sorted_ind(u,k);
+            kid[k] = id_unknown[nid[k]];
+            dyn[k] = mCurrentFrame.vObjLabel[kid[k]]==1;
+        }
+
         for (int k1 = 1; k1 < m-2; ++k1)
         {
             for (int k2 = k1+1; k2 < m-1; ++k2)
@@ -4523,68 +4816,69 @@ std::vector<Eigen::Vector4i> Tracking::GetMSS(const std::vector<int> &id_dynamic
                 for (int k3 = k2+1; k3 < m; ++k3)
                 {
                     // check if it is dynamic point
-                    if (mCurrentFrame.vObjLabel[id_unknown[Sorted_ind(id_inter[i],k1)]]!=1 || mCurrentFrame.vObjLabel[id_unknown[Sorted_ind(id_inter[i],k2)]]!=1 || mCurrentFrame.vObjLabel[id_unknown[Sorted_ind(id_inter[i],k3)]]!=1){
-                        cc++;
+                    if (!dyn[k1] || !dyn[k2] || !dyn[k3])
                         continue;
-                    }
 
                     // check if it has been used
-                    if (Ind_cover[id_inter[i]].size()>0){
-                        bool used_1 = false, used_2 = false, used_3 = false;
-                        for (int j = 0; j < Ind_cover[id_inter[i]].size(); ++j)
-                        {
-                            if (id_unknown[Sorted_ind(id_inter[i],k1)] == Ind_cover[id_inter[i]][j]){
-                                used_1 = true;
-                                break;
-                            }
-                        }
-                        for (int j = 0; j < Ind_cover[id_inter[i]].size(); ++j)
-                        {
-                            if (id_unknown[Sorted_ind(id_inter[i],k2)]  == Ind_cover[id_inter[i]][j]){
-                                used_2 = true;
-                                break;
-                            }
-                        }
-                        for (int j = 0; j < Ind_cover[id_inter[i]].size(); ++j)
-                        {
-                            if (id_unknown[Sorted_ind(id_inter[i],k3)]  == Ind_cover[id_inter[i]][j]){
-                                used_3 = true;
-                                break;
-                            }
-                        }
-                        if (used_1 == true && used_2 == true && used_3 == true){
-                            cc++;
-                            continue;
-                        }
-                    }
+                    if (cover.count(u,kid[k1]) && cover.count(u,kid[k2]) && cover.count(u,kid[k3]))
+                        continue;
 
                     // add new MSS
-                    mss_tmp[0]=id_dynamic[i];
-                    mss_tmp[1]=id_unknown[Sorted_ind(id_inter[i],k1)];
-                    mss_tmp[2]=id_unknown[Sorted_ind(id_inter[i],k2)];
-                    mss_tmp[3]=id_unknown[Sorted_ind(id_inter[i],k3)];
-                    nMSS.push_back(mss_tmp);
-
-                    // std::cout << "minimal sample set: " << mss_tmp[0] << " " << mss_tmp[1] << " " << mss_tmp[2] << " " << mss_tmp[3] << std::endl;
+                    vMSSBuffer[i*max_mss+vnMSS[i]++] = Eigen::Vector4i(id_dynamic[i],kid[k1],kid[k2],kid[k3]);
 
                     // update the index cover array
-                    Ind_cover[id_inter[i]].push_back(id_unknown[Sorted_ind(id_inter[i],k1)]);
-                    Ind_cover[id_inter[i]].push_back(id_unknown[Sorted_ind(id_inter[i],k2)]);
-                    Ind_cover[id_inter[i]].push_back(id_unknown[Sorted_ind(id_inter[i],k3)]);
-                    Ind_cover[Sorted_ind(id_inter[i],k1)].push_back(id_dynamic[i]);
-                    Ind_cover[Sorted_ind(id_inter[i],k1)].push_back(id_unknown[Sorted_ind(id_inter[i],k2)]);
-                    Ind_cover[Sorted_ind(id_inter[i],k1)].push_back(id_unknown[Sorted_ind(id_inter[i],k3)]);
-                    Ind_cover[Sorted_ind(id_inter[i],k2)].push_back(id_dynamic[i]);
-                    Ind_cover[Sorted_ind(id_inter[i],k2)].push_back(id_unknown[Sorted_ind(id_inter[i],k1)]);
-                    Ind_cover[Sorted_ind(id_inter[i],k2)].push_back(id_unknown[Sorted_ind(id_inter[i],k3)]);
-                    Ind_cover[Sorted_ind(id_inter[i],k3)].push_back(id_dynamic[i]);
-                    Ind_cover[Sorted_ind(id_inter[i],k3)].push_back(id_unknown[Sorted_ind(id_inter[i],k1)]);
-                    Ind_cover[Sorted_ind(id_inter[i],k3)].push_back(id_unknown[Sorted_ind(id_inter[i],k2)]);
+                    cover.insert(u,kid[k1]); cover.insert(u,kid[k2]); cover.insert(u,kid[k3]);
+                    cover.insert(nid[k1],id_dynamic[i]); cover.insert(nid[k1],kid[k2]); cover.insert(nid[k1],kid[k3]);
+                    cover.insert(nid[k2],id_dynamic[i]); cover.insert(nid[k2],kid[k1]); cover.insert(nid[k2],kid[k3]);
+                    cover.insert(nid[k3],id_dynamic[i]); cover.insert(nid[k3],kid[k1]); cover.insert(nid[k3],kid[k2]);
                 }
             }
         }
+    };
+
+    if (nThreads<=1)
+    {
+        CoverSet cover(cover_size);
+        for (int i = 0; i < n_kp; ++i)
+            GetPointMSS(i,cover);
+    }
+    else
+    {
+        // Points whose neighborhoods overlap read each other's coverage, so they must be
+        // processed in order by the same worker. Group them by connected neighborhoods.
+        std::vector<int> vParent(id_unknown.size());
+        std::iota(vParent.begin(),vParent.end(),0);
+        auto Find = [&](int x) -> int
+        {
+            while (vParent[x]!=x)
+                x = vParent[x] = vParent[vParent[x]];
+            return x;
+        };
+        for (int i = 0; i < n_kp; ++i)
+            for (int k = 1; k < m; ++k)
+                vParent[Find(Sorted_ind(id_inter[i],k))] = Find(id_inter[i]);
+
+        std::vector<int> vPartition(n_kp);
+        for (int i = 0; i < n_kp; ++i)
+            vPartition[i] = Find(id_inter[i]) % nThreads;
+
+        mpScheduler->ParallelFor(nThreads,[&](int begin, int end, int)
+        {
+            for (int t = begin; t < end; ++t)
+            {
+                CoverSet cover(cover_size/nThreads);
+                for (int i = 0; i < n_kp; ++i)
+                    if (vPartition[i]==t)
+                        GetPointMSS(i,cover);
+            }
+        },nThreads);
     }
 
+    std::vector<Eigen::Vector4i> nMSS;
+    nMSS.reserve(std::accumulate(vnMSS.begin(),vnMSS.end(),0));
+    for (int i = 0; i < n_kp; ++i)
+        nMSS.insert(nMSS.end(),vMSSBuffer.begin()+i*max_mss,vMSSBuffer.begin()+i*max_mss+vnMSS[i]);
+
     return nMSS;
 }
 
@@ -4632,208 +4926,116 @@ cv::Mat Tracking::GetModel(const Eigen::Vector4i &mss, const vector<int> &Temper
 }
 
 
-// int DataEnergy(int p, int l, void *data)
-// {
-//     EnergyDataStruct *myData = (EnergyDataStruct *)data;
-//     const double lambda = myData->lambda;
-//     const cv::Mat mods = myData->Mods;
-
-//     // if (l == mods.cols){
-//     //     return round(lambda);  // 100*50
-//     // }
-
-//     const std::vector<cv::Point3d> * const pre_3d = myData->Pre_3d;
-//     const std::vector<cv::Point2d> * const cur_2d = myData->Cur_2d;
-
-//     cv::Mat Rvec(cv::Size(1, 3),CV_64FC1);
-//     cv::Mat Tvec(cv::Size(1, 3),CV_64FC1);
-//     Rvec.at<double>(0,0) = mods.at<double>(0,l);Rvec.at<double>(1,0) = mods.at<double>(1,l);Rvec.at<double>(2,0) = mods.at<double>(2,l);
-//     Tvec.at<double>(0,0) = mods.at<double>(3,l);Tvec.at<double>(1,0) = mods.at<double>(4,l);Tvec.at<double>(2,0) = mods.at<double>(5,l);
-
-//     std::vector<cv::Point3d> source(1);
-//     source[0] = pre_3d->at(p);
-//     std::vector<cv::Point2d> projected(1);
-//     const cv::Mat camera_mat = myData->Camera;
-//     cv::projectPoints(source, Rvec, Tvec, camera_mat, cv::Mat::zeros(1, 4, CV_64FC1), projected);
-//     const cv::Point2d src_2d = cur_2d->at(p);
-//     const cv::Point2d dst_2d = projected[0];
-
-//     const double dx = src_2d.x - dst_2d.x;
-//     const double dy = src_2d.y - dst_2d.y;
-//     const double distance = dx*dx + dy*dy;
-
-//     const double repro_error_thres = myData->repro_error_thres;
-//     // cout << "re-projection error: " << distance << endl;
-//     if(distance < repro_error_thres){
-//         return round(lambda * (distance / repro_error_thres));  // 100*(1.0-d/50)
-//     }
-//     return 2 * round(lambda);                                   // 2*100*50
-// }
-
-// int SmoothnessEnergy(int p1, int p2, int l1, int l2, void *data)
-// {
-//     EnergyDataStruct *myData = (EnergyDataStruct *)data;
-//     const double beta = myData->beta;
-//     return l1 != l2 ? round(beta):0;      // 50*NumOfEdge
-// }
-
-// void Tracking::GCoptimal(const vector<int> &TemperalMatch, const std::vector<int> &id_dynamic,
-//                          const std::vector<std::vector<int> > &vNeighs, const cv::Mat &Mods)
-// {
-
-//     const int N_kp = id_dynamic.size();
-
-//     // parameters for the energy function
-//     double lambda = 80, beta =1; // (50 2 10) (200 1 100) (70 1 10/5) (75/80/90 1)
-//     // int label_cost = 10;
-
-//     // consider only the dynamic measurements
-//     std::vector<cv::Point2d> cur_2d_dym(N_kp);
-//     std::vector<cv::Point3d> pre_3d_dym(N_kp);
-//     for (int i = 0; i < N_kp; ++i)
-//     {
-//         cur_2d_dym[i].x = mCurrentFrame.mvSiftKeys[id_dynamic[i]].pt.x;
-//         cur_2d_dym[i].y = mCurrentFrame.mvSiftKeys[id_dynamic[i]].pt.y;
-//         cv::Mat x3D_p = mLastFrame.UnprojectStereoSift(TemperalMatch[id_dynamic[i]],0);
-//         pre_3d_dym[i].x = x3D_p.at<float>(0);
-//         pre_3d_dym[i].y = x3D_p.at<float>(1);
-//         pre_3d_dym[i].z = x3D_p.at<float>(2);
-//     }
-
-//     // compute distance matrix
-//     Eigen::MatrixXd Dist_mat = Eigen::MatrixXd::Zero(N_kp,N_kp);
-//     // std::cout << "distance: " << endl;
-//     for (int i = 0; i < N_kp; ++i)
-//     {
-//         for (int j = i+1; j < N_kp; ++j)
-//         {
-//             Dist_mat(i,j) = sqrt( (cur_2d_dym[i].x-cur_2d_dym[j].x)*(cur_2d_dym[i].x-cur_2d_dym[j].x)
-//                     + (cur_2d_dym[i].y-cur_2d_dym[j].y)*(cur_2d_dym[i].y-cur_2d_dym[j].y) );
-//             Dist_mat(i,j) = 100*std::exp(-Dist_mat(i,j)/49);
-//             // std::cout << Dist_mat(i,j) << " ";
-//         }
-//         // cout << endl;
-//     }
-
-//     // update
-//     int N_ps = Mods.cols;
-//     // std::cout << "N_ps: " << N_ps << " " << Mods.rows << std::endl;
-
-//     // Set up energy terms
-//     GCoptimizationGeneralGraph *gc_optimizator = new GCoptimizationGeneralGraph(N_kp, N_ps);
-
-//     // camera matrix & distortion coefficients
-//     cv::Mat cam_intrinsic(3, 3, CV_64FC1);
-//     cv::Mat distCoeffs = cv::Mat::zeros(1, 4, CV_64FC1);
-//     cam_intrinsic.at<double>(0, 0) = mK.at<float>(0,0);
-//     cam_intrinsic.at<double>(1, 1) = mK.at<float>(1,1);
-//     cam_intrinsic.at<double>(0, 2) = mK.at<float>(0,2);
-//     cam_intrinsic.at<double>(1, 2) = mK.at<float>(1,2);
-//     cam_intrinsic.at<double>(2, 2) = 1.0;
-
-//     EnergyDataStruct toFn(&cur_2d_dym, &pre_3d_dym, Mods, cam_intrinsic, lambda, beta);
-//     gc_optimizator->setDataCost(&DataEnergy, &toFn);
-//     gc_optimizator->setSmoothCost(&SmoothnessEnergy, &toFn);
-//     // gc_optimizator->setLabelCost(label_cost);  //100*NumOfLabel*NumOfPoint
-
-//     // set previous labeling
-//     if (true)
-//     {
-//         int count = 1;
-//         for (int i = 0; i < N_kp; ++i){
-//             if(count < N_ps)
-//                 gc_optimizator->setLabel(i,count);
-//             else
-//                 gc_optimizator->setLabel(i,2);
-//             count++;
-//             // cout << gc_optimizator->whatLabel(i) << endl;
-//         }
-//     }
-
-//     // Set neighbourhood
-//     for (int i = 0; i < N_kp; ++i)
-//         for (int j = i+1; j < N_kp; ++j)
-//             gc_optimizator->setNeighbors(i, j, round(Dist_mat(i,j)));
-
-//     // run alpha-expansion algorithm
-//     int iteration_number = 100;
-//     std::cout << "the data Energy: " << gc_optimizator->giveDataEnergy() << std::endl;
-//     std::cout << "the smoothness Energy: " << gc_optimizator->giveSmoothEnergy() << std::endl;
-//     std::cout << "the label Energy: " << gc_optimizator->giveLabelEnergy() << std::endl;
-//     int E_cur = gc_optimizator->expansion(iteration_number);
-//     std::cout << "the total Energy: " << E_cur << std::endl;
-//     std::cout << "the data Energy: " << gc_optimizator->giveDataEnergy() << std::endl;
-//     std::cout << "the smoothness Energy: " << gc_optimizator->giveSmoothEnergy() << std::endl;
-//     std::cout << "the label Energy: " << gc_optimizator->giveLabelEnergy() << std::endl;
-
-//     // collect classification result
-//     std::vector<std::vector<int> > collect(N_ps);
-//     std::cout << "labels: " << endl;
-//     for (int i = 0; i < N_kp; ++i)
-//     {
-//         int l = gc_optimizator->whatLabel(i);
-//         std::cout << l << " ";
-//         collect[l].push_back(i);
-//     }
-//     cout << endl;
-
-//     // reorganize the label and save model
-//     int l_tmp = 1;
-//     cv::Mat Rvec(3, 1,CV_64FC1);
-//     cv::Mat mObjMod(4, 4, CV_32FC1);
-//     cv::Mat Rot(3, 3, CV_64FC1);
-//     cv::Point2f ObjCentre(0.f,0.f);
-//     for (int i = 0; i < collect.size(); ++i)
-//     {
-//         if (collect[i].size()!=0)
-//         {
-//             // save the object model
-//             Rvec.at<double>(0,0) = Mods.at<double>(0,i);Rvec.at<double>(0,1) = Mods.at<double>(1,i);Rvec.at<double>(0,2) = Mods.at<double>(2,i);
-//             cv::Rodrigues(Rvec, Rot);
-//             mObjMod.at<float>(0,0) = Rot.at<double>(0,0);mObjMod.at<float>(0,1) = Rot.at<double>(0,1);mObjMod.at<float>(0,2) = Rot.at<double>(0,2);mObjMod.at<float>(0,3) = Mods.at<double>(3,i);
-//             mObjMod.at<float>(1,0) = Rot.at<double>(1,0);mObjMod.at<float>(1,1) = Rot.at<double>(1,1);mObjMod.at<float>(1,2) = Rot.at<double>(1,2);mObjMod.at<float>(1,3) = Mods.at<double>(4,i);
-//             mObjMod.at<float>(2,0) = Rot.at<double>(2,0);mObjMod.at<float>(2,1) = Rot.at<double>(2,1);mObjMod.at<float>(2,2) = Rot.at<double>(2,2);mObjMod.at<float>(2,3) = Mods.at<double>(5,i);
-//             mObjMod.at<float>(3,0) = 0;                  mObjMod.at<float>(3,1) = 0;                  mObjMod.at<float>(0,0) = 0;                  mObjMod.at<float>(3,3) = 1;
-//             mObjMod = mCurrentFrame.mTcw*mObjMod;
-//             mCurrentFrame.vObjMod.push_back(mObjMod);
-//             cout << "object model: " << endl;
-//             cout << mObjMod << endl;
-
-//             // save the object label
-//             for (int j = 0; j < collect[i].size(); ++j){
-//                 mCurrentFrame.vObjLabel[id_dynamic[collect[i][j]]]=l_tmp;
-//                 ObjCentre.x = ObjCentre.x + mCurrentFrame.mvSiftKeys[id_dynamic[collect[i][j]]].pt.x;
-//                 ObjCentre.y = ObjCentre.y + mCurrentFrame.mvSiftKeys[id_dynamic[collect[i][j]]].pt.y;
-//             }
-
-//             // save object center
-//             ObjCentre.x = ObjCentre.x/collect[i].size();
-//             ObjCentre.y = ObjCentre.y/collect[i].size();
-//             // mCurrentFrame.vObjCentre.push_back(ObjCentre);
-//             mCurrentFrame.nModLabel.push_back(l_tmp);
-//             cout << "object center: " << ObjCentre.x << " " << ObjCentre.y << endl;
-
-//             // update
-//             l_tmp++;
-//         }
-//         // outlier label
-//         // if (i==collect.size()-1){
-//         //     for (int j = 0; j < collect[i].size(); ++j)
-//         //         mCurrentFrame.vObjLabel[id_dynamic[collect[i][j]]]=-1;
-//         // }
-//         // else{
-//         //     if (collect[i].size()!=0)
-//         //     {
-//         //         for (int j = 0; j < collect[i].size(); ++j)
-//         //             mCurrentFrame.vObjLabel[id_dynamic[collect[i][j]]]=l_tmp;
-//         //         l_tmp++;
-//         //     }
-//         // }
-
-//     }
-
-//     delete gc_optimizator;
-// }
+void Tracking::GCoptimal(std::vector<std::vector<int> > &ObjId, std::vector<int> &SemPos)
+{
+    const int N_ob = ObjId.size();
+
+    // camera matrix & distortion coefficients
+    cv::Mat cam_intrinsic = cv::Mat::zeros(3, 3, CV_64FC1);
+    cv::Mat distCoeffs = cv::Mat::zeros(1, 4, CV_64FC1);
+    cam_intrinsic.at<double>(0, 0) = mK.at<float>(0,0);
+    cam_intrinsic.at<double>(1, 1) = mK.at<float>(1,1);
+    cam_intrinsic.at<double>(0, 2) = mK.at<float>(0,2);
+    cam_intrinsic.at<double>(1, 2) = mK.at<float>(1,2);
+    cam_intrinsic.at<double>(2, 2) = 1.0;
+
+    // one motion model per object, from its own points (PnP RanSac as in GetInitModelObj).
+    // An object whose PnP fails has no model: it is left out of the labeling and kept as it is.
+    std::vector<int> vModel(N_ob,-1);
+    std::vector<cv::Mat> vRvec, vTvec;
+    std::vector<int> id_dynamic, vLabels;
+    std::vector<cv::Point2d> cur_2d_dym;
+    std::vector<cv::Point3d> pre_3d_dym;
+    for (int i = 0; i < N_ob; ++i)
+    {
+        const int n = ObjId[i].size();
+        std::vector<cv::Point2f> cur_2d(n);
+        std::vector<cv::Point3f> pre_3d(n);
+        for (int j = 0; j < n; ++j)
+        {
+            cur_2d[j] = mCurrentFrame.mvObjKeys[ObjId[i][j]].pt;
+            cv::Mat x3D_p = mLastFrame.UnprojectStereoObject(ObjId[i][j],0);
+            pre_3d[j] = cv::Point3f(x3D_p.at<float>(0), x3D_p.at<float>(1), x3D_p.at<float>(2));
+        }
+
+        cv::Mat Rvec(3, 1, CV_64FC1);
+        cv::Mat Tvec(3, 1, CV_64FC1);
+        cv::Mat inliers;
+        int iter_num = 500;
+        double reprojectionError = 0.3, confidence = 0.98;
+        const bool bOk = cv::solvePnPRansac(pre_3d, cur_2d, cam_intrinsic, distCoeffs, Rvec, Tvec, false,
+                   iter_num, reprojectionError, confidence, inliers, cv::SOLVEPNP_AP3P);
+        if (!bOk || inliers.empty())
+            continue;
+
+        vModel[i] = vRvec.size();
+        vRvec.push_back(Rvec);
+        vTvec.push_back(Tvec);
+
+        // consider only the points of the modeled objects, labeled with their model
+        for (int j = 0; j < n; ++j)
+        {
+            id_dynamic.push_back(ObjId[i][j]);
+            vLabels.push_back(vModel[i]);
+            cur_2d_dym.push_back(cv::Point2d(cur_2d[j].x, cur_2d[j].y));
+            pre_3d_dym.push_back(cv::Point3d(pre_3d[j].x, pre_3d[j].y, pre_3d[j].z));
+        }
+    }
+
+    // nothing to choose between
+    const int N_mod = vRvec.size();
+    if (N_mod<2)
+        return;
+
+    cv::Mat Mods(6, N_mod, CV_64FC1);
+    for (int m = 0; m < N_mod; ++m)
+    {
+        vRvec[m].copyTo(Mods.col(m).rowRange(0,3));
+        vTvec[m].copyTo(Mods.col(m).rowRange(3,6));
+    }
+
+    // run alpha-expansion algorithm over the Delaunay graph of the points
+    const int N_kp = id_dynamic.size();
+    const NeighborGraph Neighs = Delaunay(mCurrentFrame.mvObjKeys,id_dynamic);
+    int iteration_number = 100;
+    const long long E_cur = mpMotionLabeler->Label(pre_3d_dym,cur_2d_dym,Mods,cam_intrinsic,Neighs.vOffsets,Neighs.vAdj,vLabels,iteration_number);
+    std::cout << "the total Energy: " << E_cur << std::endl;
+
+    // collect classification result
+    std::vector<std::vector<int> > collect(N_mod);
+    for (int i = 0; i < N_kp; ++i)
+        collect[vLabels[i]].push_back(id_dynamic[i]);
+
+    // keep the objects that still have enough points
+    std::vector<std::vector<int> > ObjIdNew;
+    std::vector<int> SemPosNew;
+    for (int i = 0; i < N_ob; ++i)
+    {
+        if (vModel[i]<0)
+        {
+            cout << "object " << SemPos[i] << " has no motion model, not relabeled" << endl;
+            ObjIdNew.push_back(ObjId[i]);
+            SemPosNew.push_back(SemPos[i]);
+            continue;
+        }
+
+        const std::vector<int> &vPoints = collect[vModel[i]];
+        cout << "object " << SemPos[i] << " points before/after graph-cut: " << ObjId[i].size() << "/" << vPoints.size() << endl;
+        if (vPoints.size()>100)
+        {
+            ObjIdNew.push_back(vPoints);
+            SemPosNew.push_back(SemPos[i]);
+        }
+        else
+        {
+            for (int k = 0; k < vPoints.size(); ++k)
+                mCurrentFrame.vObjLabel[vPoints[k]] = -1;
+        }
+    }
+
+    ObjId.swap(ObjIdNew);
+    SemPos.swap(SemPosNew);
+}
 
 void Tracking::DrawLine(cv::KeyPoint &keys, cv::Point2f &flow, cv::Mat &ref_image, const cv::Scalar &color, int thickness, int line_type, const cv::Point2i &offset)
 {
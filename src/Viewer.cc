@@ -22,7 +22,6 @@
 #include <pangolin/pangolin.h>
 
 #include <mutex>
-#include <unistd.h>
 
 namespace ORB_SLAM2
 {
@@ -164,10 +163,10 @@ void Viewer::Run()
 
         if(Stop())
         {
-            while(isStopped())
-            {
-                usleep(3000);
-            }
+            // Sleep until released (or asked to finish)
+            unique_lock<mutex> lock(mMutexStop);
+            while(mbStopped && !CheckFinish())
+                mCondStop.wait(lock);
         }
 
         if(CheckFinish())
@@ -179,8 +178,12 @@ void Viewer::Run()
 
 void Viewer::RequestFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinishRequested = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    unique_lock<mutex> lock(mMutexStop);
+    mCondStop.notify_all();
 }
 
 bool Viewer::CheckFinish()
@@ -193,6 +196,7 @@ void Viewer::SetFinish()
 {
     unique_lock<mutex> lock(mMutexFinish);
     mbFinished = true;
+    mCondFinish.notify_all();
 }
 
 bool Viewer::isFinished()
@@ -225,6 +229,7 @@ bool Viewer::Stop()
     {
         mbStopped = true;
         mbStopRequested = false;
+        mCondStop.notify_all();
         return true;
     }
 
@@ -236,6 +241,21 @@ void Viewer::Release()
 {
     unique_lock<mutex> lock(mMutexStop);
     mbStopped = false;
+    mCondStop.notify_all();
+}
+
+void Viewer::WaitUntilStopped()
+{
+    unique_lock<mutex> lock(mMutexStop);
+    while(!mbStopped)
+        mCondStop.wait(lock);
+}
+
+void Viewer::WaitUntilFinished()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    while(!mbFinished)
+        mCondFinish.wait(lock);
 }
 
 }
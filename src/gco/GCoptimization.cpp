@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <vector>
 #include <algorithm>
+#include <functional>
 
 // will leave this one just for the laughs :)
 //#define olga_assert(expr) assert(!(expr))
@@ -30,10 +31,18 @@ extern "C" inline gcoclock_t gcoclock() // TODO: not thread safe; separate begin
 }
 
 #else
+#include <time.h>
 extern "C" {
-gcoclock_t GCO_CLOCKS_PER_SEC = CLOCKS_PER_SEC;
+gcoclock_t GCO_CLOCKS_PER_SEC = 1000000;
+}
+// Wall-clock microseconds; clock() measures the CPU time of the whole process,
+// which is meaningless for moves solved on several threads.
+extern "C" gcoclock_t gcoclock()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (gcoclock_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
 }
-extern "C" gcoclock_t gcoclock() { return clock(); }
 #endif
 
 #ifdef MATLAB_MEX_FILE
@@ -119,9 +128,19 @@ GCoptimization::GCoptimization(SiteID nSites, LabelID nLabels)
 , m_activeLabelCounts(new SiteID[m_num_labels])
 , m_stepsThisCycle(0)
 , m_stepsThisCycleTotal(0)
+, m_energy(0)
+, m_ownsEnergy(false)
+, m_activeSites(0)
+, m_parallelFor(0)
+, m_parallelForData(0)
+, m_numThreads(1)
+, m_numComponents(-1)
+, m_threadEnergies(&m_ownThreadEnergies)
+, m_moveAlpha(0)
 {
 	if ( nLabels <= 1 ) handleError("Number of labels must be >= 2");
 	if ( nSites <= 0 )  handleError("Number of sites must be >= 1");
+	m_activeSites = new SiteID[nSites];
 	
 	if ( !m_lookupSiteVar || !m_labelTable || !m_labeling ){
 		if (m_lookupSiteVar) delete [] m_lookupSiteVar;
@@ -148,6 +167,10 @@ GCoptimization::~GCoptimization()
 	delete [] m_labelingDataCosts;
 	delete [] m_labelCounts;
 	delete [] m_activeLabelCounts;
+	delete [] m_activeSites;
+	if (m_ownsEnergy) delete m_energy;
+	for ( size_t t = 0; t < m_ownThreadEnergies.size(); ++t )
+		delete m_ownThreadEnergies[t];
 
 	if (m_datacostFnDelete) m_datacostFnDelete(m_datacostFn);
 	if (m_smoothcostFnDelete) m_smoothcostFnDelete(m_smoothcostFn);
@@ -176,7 +199,7 @@ GCoptimization::SiteID GCoptimization::queryActiveSitesExpansion<GCoptimization:
 //-------------------------------------------------------------------
 
 template <>
-void GCoptimization::setupDataCostsExpansion<GCoptimization::DataCostFnSparse>(SiteID size,LabelID alpha_label,EnergyT *e,SiteID *activeSites)
+void GCoptimization::setupDataCostsExpansion<GCoptimization::DataCostFnSparse>(SiteID size,LabelID alpha_label,EnergyT *e,SiteID *activeSites,EnergyType& before)
 {
 	DataCostFnSparse* dc = (DataCostFnSparse*)m_datacostFn;
 	DataCostFnSparse::iterator dciter = dc->begin(alpha_label);
@@ -185,7 +208,7 @@ void GCoptimization::setupDataCostsExpansion<GCoptimization::DataCostFnSparse>(S
 		SiteID site = activeSites[i];
 		while ( dciter.site() != site )
 			++dciter;
-		addterm1_checked(e,i,dciter.cost(),m_labelingDataCosts[site]);
+		addterm1_checked(e,before,i,dciter.cost(),m_labelingDataCosts[site]);
 	}
 }
 
@@ -276,25 +299,25 @@ GCoptimization::EnergyType GCoptimization::giveSmoothEnergyInternal()
 
 //-------------------------------------------------------------------
 
-OLGA_INLINE void GCoptimization::addterm1_checked(EnergyT* e, VarID i, EnergyTermType e0, EnergyTermType e1)
+OLGA_INLINE void GCoptimization::addterm1_checked(EnergyT* e, EnergyType& before, VarID i, EnergyTermType e0, EnergyTermType e1)
 {
 	if ( e0 > GCO_MAX_ENERGYTERM || e1 > GCO_MAX_ENERGYTERM )
 		handleError("Data cost term was larger than GCO_MAX_ENERGYTERM; danger of integer overflow.");
-	m_beforeExpansionEnergy += e1;
+	before += e1;
 	e->add_term1(i,e0,e1);
 }
 
-OLGA_INLINE void GCoptimization::addterm1_checked(EnergyT* e, VarID i, EnergyTermType e0, EnergyTermType e1, EnergyTermType w)
+OLGA_INLINE void GCoptimization::addterm1_checked(EnergyT* e, EnergyType& before, VarID i, EnergyTermType e0, EnergyTermType e1, EnergyTermType w)
 {
 	if ( e0 > GCO_MAX_ENERGYTERM || e1 > GCO_MAX_ENERGYTERM )
 		handleError("Smooth cost term was larger than GCO_MAX_ENERGYTERM; danger of integer overflow.");
 	if ( w > GCO_MAX_ENERGYTERM )
 		handleError("Smoothness weight was larger than GCO_MAX_ENERGYTERM; danger of integer overflow.");
-	m_beforeExpansionEnergy += e1*w;
+	before += e1*w;
 	e->add_term1(i,e0*w,e1*w);
 }
 
-OLGA_INLINE void GCoptimization::addterm2_checked(EnergyT* e, VarID i, VarID j, EnergyTermType e00, EnergyTermType e01, EnergyTermType e10, EnergyTermType e11, EnergyTermType w)
+OLGA_INLINE void GCoptimization::addterm2_checked(EnergyT* e, EnergyType& before, VarID i, VarID j, EnergyTermType e00, EnergyTermType e01, EnergyTermType e10, EnergyTermType e11, EnergyTermType w)
 {
 	if ( e00 > GCO_MAX_ENERGYTERM || e11 > GCO_MAX_ENERGYTERM || e01 > GCO_MAX_ENERGYTERM || e10 > GCO_MAX_ENERGYTERM )
 		handleError("Smooth cost term was larger than GCO_MAX_ENERGYTERM; danger of integer overflow.");
@@ -304,7 +327,7 @@ OLGA_INLINE void GCoptimization::addterm2_checked(EnergyT* e, VarID i, VarID j,
 	// but is optimized out. We check it in release builds as well.
 	if ( e00+e11 > e01+e10 )
 		handleError("Non-submodular expansion term detected; smooth costs must be a metric for expansion");
-	m_beforeExpansionEnergy += e11*w;
+	before += e11*w;
 	e->add_term2(i,j,e00*w,e01*w,e10*w,e11*w);
 }
 
@@ -323,17 +346,17 @@ GCoptimization::SiteID GCoptimization::queryActiveSitesExpansion(LabelID alpha_l
 //-------------------------------------------------------------------
 
 template <typename DataCostT>
-void GCoptimization::setupDataCostsExpansion(SiteID size,LabelID alpha_label,EnergyT *e,SiteID *activeSites)
+void GCoptimization::setupDataCostsExpansion(SiteID size,LabelID alpha_label,EnergyT *e,SiteID *activeSites,EnergyType& before)
 {
 	DataCostT* dc = (DataCostT*)m_datacostFn;
 	for ( SiteID i = 0; i < size; ++i )
-		addterm1_checked(e,i,dc->compute(activeSites[i],alpha_label),m_labelingDataCosts[activeSites[i]]);
+		addterm1_checked(e,before,i,dc->compute(activeSites[i],alpha_label),m_labelingDataCosts[activeSites[i]]);
 }
 
 //-------------------------------------------------------------------
 
 template <typename SmoothCostT>
-void GCoptimization::setupSmoothCostsExpansion(SiteID size,LabelID alpha_label,EnergyT *e,SiteID *activeSites)
+void GCoptimization::setupSmoothCostsExpansion(SiteID size,LabelID alpha_label,EnergyT *e,SiteID *activeSites,EnergyType& before)
 {
 	SiteID i,nSite,site,n,nNum,*nPointer;
 	EnergyTermType *weights;
@@ -347,11 +370,11 @@ void GCoptimization::setupSmoothCostsExpansion(SiteID size,LabelID alpha_label,E
 		{
 			nSite = nPointer[n];
 			if ( m_lookupSiteVar[nSite] == -1 ) 
-				addterm1_checked(e,i,sc->compute(site,nSite,alpha_label,m_labeling[nSite]),
+				addterm1_checked(e,before,i,sc->compute(site,nSite,alpha_label,m_labeling[nSite]),
 				                     sc->compute(site,nSite,m_labeling[site],m_labeling[nSite]),weights[n]);
 			else if ( nSite < site ) 
 			{
-				addterm2_checked(e,i,m_lookupSiteVar[nSite],
+				addterm2_checked(e,before,i,m_lookupSiteVar[nSite],
 				                 sc->compute(site,nSite,alpha_label,alpha_label),
 				                 sc->compute(site,nSite,alpha_label,m_labeling[nSite]),
 				                 sc->compute(site,nSite,m_labeling[site],alpha_label),
@@ -384,6 +407,7 @@ void GCoptimization::setupSmoothCostsSwap(SiteID size, LabelID alpha_label,Label
 	SiteID i,nSite,site,n,nNum,*nPointer;
 	EnergyTermType *weights;
 	SmoothCostT* sc = (SmoothCostT*)m_smoothcostFn;
+	EnergyType before = 0; // not used by swap moves
 
 	for ( i = size - 1; i >= 0; i-- )
 	{
@@ -393,11 +417,11 @@ void GCoptimization::setupSmoothCostsSwap(SiteID size, LabelID alpha_label,Label
 		{
 			nSite = nPointer[n];
 			if ( m_lookupSiteVar[nSite] == -1 )
-				addterm1_checked(e,i,sc->compute(site,nSite,alpha_label,m_labeling[nSite]),
+				addterm1_checked(e,before,i,sc->compute(site,nSite,alpha_label,m_labeling[nSite]),
 				                     sc->compute(site,nSite,beta_label, m_labeling[nSite]),weights[n]);
 			else if ( nSite < site )
 			{
-				addterm2_checked(e,i,m_lookupSiteVar[nSite],
+				addterm2_checked(e,before,i,m_lookupSiteVar[nSite],
 				                 sc->compute(site,nSite,alpha_label,alpha_label),
 				                 sc->compute(site,nSite,alpha_label,beta_label),
 				                 sc->compute(site,nSite,beta_label,alpha_label),
@@ -964,6 +988,7 @@ void GCoptimization::permuteLabelTable()
 GCoptimization::EnergyType GCoptimization::expansion(int max_num_iterations)
 {
 	EnergyType new_energy, old_energy;
+	m_expansionTimings.clear();
 	if ( (this->*m_solveSpecialCases)(new_energy) )
 		return new_energy;
  	permuteLabelTable();
@@ -1044,6 +1069,42 @@ GCoptimization::EnergyType GCoptimization::expansion(int max_num_iterations)
 
 //-------------------------------------------------------------------
 
+void GCoptimization::setWorkspace(EnergyT* workspace)
+{
+	if ( m_ownsEnergy )
+		delete m_energy;
+	m_energy = workspace;
+	m_ownsEnergy = false;
+}
+
+//-------------------------------------------------------------------
+
+void GCoptimization::setThreadWorkspaces(std::vector<EnergyT*>* workspaces)
+{
+	for ( size_t t = 0; t < m_ownThreadEnergies.size(); ++t )
+		delete m_ownThreadEnergies[t];
+	m_ownThreadEnergies.clear();
+	m_threadEnergies = workspaces;
+	if ( m_threadEnergies->size() < (size_t)m_numThreads )
+		m_threadEnergies->resize(m_numThreads,0);
+}
+
+//-------------------------------------------------------------------
+
+GCoptimization::EnergyT* GCoptimization::resetEnergy(SiteID numVars, SiteID numEdges)
+{
+	if ( !m_energy )
+	{
+		m_energy = new EnergyT(numVars,numEdges,handleError);
+		m_ownsEnergy = true;
+	}
+	else
+		m_energy->reset();
+	return m_energy;
+}
+
+//-------------------------------------------------------------------
+
 void GCoptimization::setLabelOrder(bool isRandom)
 {
 	m_random_label_order = isRandom;
@@ -1205,10 +1266,20 @@ bool GCoptimization::alpha_expansion(LabelID alpha_label)
 		m_labelingInfoDirty = true; // if not inside expansion(), assume data cost function could have changed since last expansion
 	updateLabelingInfo();
 
+	// Independent binary problems per connected component
+	if ( m_parallelFor && m_numThreads > 1 && !m_labelcostsAll &&
+	     m_queryActiveSitesExpansion != (SiteID (GCoptimization::*)(LabelID,SiteID*))&GCoptimization::queryActiveSitesExpansion<DataCostFnSparse> )
+	{
+		computeComponents();
+		if ( m_numComponents > 1 )
+			return alphaExpansionComponents(alpha_label,ticks0);
+	}
+
 	// Determine list of active sites for this expansion move
 	SiteID size = 0;
-	SiteID *activeSites = new SiteID[m_num_sites];
+	SiteID *activeSites = m_activeSites;
 	EnergyType afterExpansionEnergy = 0;
+	ExpansionTiming timing = { alpha_label, 0, 1, 0, 0, 0, false };
 	try 
 	{
 		// Get list of active sites based on alpha and current labeling
@@ -1216,7 +1287,8 @@ bool GCoptimization::alpha_expansion(LabelID alpha_label)
 			size = (this->*m_queryActiveSitesExpansion)(alpha_label,activeSites);
 		if ( size == 0 )  // Nothing to do
 		{
-			delete [] activeSites;
+			timing.setupTicks = timing.totalTicks = gcoclock() - ticks0;
+			m_expansionTimings.push_back(timing);
 			printStatus2(alpha_label,-1,size,ticks0);
 			return false;
 		}
@@ -1228,18 +1300,25 @@ bool GCoptimization::alpha_expansion(LabelID alpha_label)
 
 		// Create binary variables for each remaining site, add the data costs,
 		// and compute the smooth costs between variables.
-		EnergyT e(size+m_labelcostCount, // poor guess at number of pairwise terms needed :(
-				 m_numNeighborsTotal+(m_labelcostCount?size+m_labelcostCount : 0),
-				 handleError);
+		EnergyT& e = *resetEnergy(size+m_labelcostCount, // poor guess at number of pairwise terms needed :(
+				 m_numNeighborsTotal+(m_labelcostCount?size+m_labelcostCount : 0));
 		e.add_variable(size);
 		m_beforeExpansionEnergy = 0;
-		if ( m_setupDataCostsExpansion   ) (this->*m_setupDataCostsExpansion  )(size,alpha_label,&e,activeSites);
-		if ( m_setupSmoothCostsExpansion ) (this->*m_setupSmoothCostsExpansion)(size,alpha_label,&e,activeSites);
+		if ( m_setupDataCostsExpansion   ) (this->*m_setupDataCostsExpansion  )(size,alpha_label,&e,activeSites,m_beforeExpansionEnergy);
+		if ( m_setupSmoothCostsExpansion ) (this->*m_setupSmoothCostsExpansion)(size,alpha_label,&e,activeSites,m_beforeExpansionEnergy);
 		EnergyType alphaCorrection = setupLabelCostsExpansion(size,alpha_label,&e,activeSites);
 		checkInterrupt();
+		gcoclock_t ticks1 = gcoclock();
 		afterExpansionEnergy = e.minimize() + alphaCorrection;
 		checkInterrupt();
 
+		timing.numVars      = size;
+		timing.setupTicks   = ticks1 - ticks0;
+		timing.maxflowTicks = gcoclock() - ticks1;
+		timing.totalTicks   = timing.setupTicks + timing.maxflowTicks;
+		timing.improved     = afterExpansionEnergy < m_beforeExpansionEnergy;
+		m_expansionTimings.push_back(timing);
+
 		if ( afterExpansionEnergy < m_beforeExpansionEnergy )
 			(this->*m_applyNewLabeling)(&e,activeSites,size,alpha_label);
 
@@ -1250,15 +1329,220 @@ bool GCoptimization::alpha_expansion(LabelID alpha_label)
 	} 
 	catch (...)
 	{
-		delete [] activeSites;
+		for ( SiteID i = 0; i < size; i++ )
+			m_lookupSiteVar[activeSites[i]] = -1;
 		throw;
 	}
-	delete [] activeSites;
 	return afterExpansionEnergy < m_beforeExpansionEnergy;
 }
 
 //-------------------------------------------------------------------
 
+void GCoptimization::setParallelFor(ParallelForFn fn, void* extraData, int numThreads)
+{
+	m_parallelFor     = fn;
+	m_parallelForData = extraData;
+	m_numThreads      = numThreads > 1 ? numThreads : 1;
+
+	// Borrowed graphs are only added to, the caller owns them
+	if ( m_threadEnergies == &m_ownThreadEnergies )
+	{
+		for ( size_t t = m_numThreads; t < m_ownThreadEnergies.size(); ++t )
+			delete m_ownThreadEnergies[t];
+		m_ownThreadEnergies.resize(m_numThreads,0);
+	}
+	else if ( m_threadEnergies->size() < (size_t)m_numThreads )
+		m_threadEnergies->resize(m_numThreads,0);
+	m_threadSetupTicks.assign(m_numThreads,0);
+	m_threadMaxflowTicks.assign(m_numThreads,0);
+}
+
+//-------------------------------------------------------------------
+// Labels every site with the connected component of the neighborhood system it belongs to
+//
+void GCoptimization::computeComponents()
+{
+	if ( m_numComponents >= 0 )
+		return;
+
+	m_siteComponent.assign(m_num_sites,-1);
+	std::vector<SiteID> stack;
+	m_numComponents = 0;
+	for ( SiteID seed = 0; seed < m_num_sites; ++seed )
+	{
+		if ( m_siteComponent[seed] >= 0 )
+			continue;
+		m_siteComponent[seed] = m_numComponents;
+		stack.push_back(seed);
+		while ( !stack.empty() )
+		{
+			SiteID site = stack.back(), numN, *nPointer;
+			EnergyTermType *weights;
+			stack.pop_back();
+			giveNeighborInfo(site,&numN,&nPointer,&weights);
+			for ( SiteID n = 0; n < numN; ++n )
+				if ( m_siteComponent[nPointer[n]] < 0 )
+				{
+					m_siteComponent[nPointer[n]] = m_numComponents;
+					stack.push_back(nPointer[n]);
+				}
+		}
+		m_numComponents++;
+	}
+}
+
+//-------------------------------------------------------------------
+// Same move as alpha_expansion, with one binary problem per connected component.
+// The sum of the component energies is the energy of the single binary problem,
+// and every component's cut is the one the single problem would return, so the
+// move is accepted or rejected for all components together.
+//
+bool GCoptimization::alphaExpansionComponents(LabelID alpha_label, gcoclock_t ticks0)
+{
+	ExpansionTiming timing = { alpha_label, 0, 0, 0, 0, 0, false };
+
+	// Active sites grouped by component, in increasing order within each
+	m_componentStart.assign(m_numComponents+1,0);
+	SiteID size = 0;
+	for ( SiteID i = 0; i < m_num_sites; i++ )
+		if ( m_labeling[i] != alpha_label )
+		{
+			m_componentStart[m_siteComponent[i]+1]++;
+			size++;
+		}
+	if ( size == 0 )
+	{
+		timing.totalTicks = gcoclock() - ticks0;
+		m_expansionTimings.push_back(timing);
+		printStatus2(alpha_label,-1,size,ticks0);
+		return false;
+	}
+	for ( SiteID c = 0; c < m_numComponents; c++ )
+		m_componentStart[c+1] += m_componentStart[c];
+	std::vector<SiteID> fill(m_componentStart.begin(),m_componentStart.end()-1);
+	for ( SiteID i = 0; i < m_num_sites; i++ )
+		if ( m_labeling[i] != alpha_label )
+			m_activeSites[fill[m_siteComponent[i]]++] = i;
+
+	// Spread the components over one job per thread (some may stay empty),
+	// largest first to the least loaded job
+	std::vector<std::pair<SiteID,SiteID> > order;
+	for ( SiteID c = 0; c < m_numComponents; c++ )
+		if ( m_componentStart[c+1] > m_componentStart[c] )
+			order.push_back(std::make_pair(m_componentStart[c+1]-m_componentStart[c],c));
+	std::sort(order.begin(),order.end(),std::greater<std::pair<SiteID,SiteID> >());
+	const int numBins = m_numThreads;
+	m_componentBins.resize(numBins);
+	std::vector<SiteID> load(numBins,0);
+	for ( int b = 0; b < numBins; b++ )
+		m_componentBins[b].clear();
+	for ( size_t k = 0; k < order.size(); k++ )
+	{
+		const int b = (int)(std::min_element(load.begin(),load.end()) - load.begin());
+		m_componentBins[b].push_back(order[k].second);
+		load[b] += order[k].first;
+	}
+
+	m_componentBefore.assign(m_numComponents,0);
+	m_componentAfter.assign(m_numComponents,0);
+	m_moveCut.resize(size);
+	m_threadSetupTicks.assign(m_numThreads,0);
+	m_threadMaxflowTicks.assign(m_numThreads,0);
+	m_moveAlpha = alpha_label;
+
+	m_parallelFor(numBins,&GCoptimization::expandComponentBinJob,this,m_parallelForData);
+
+	EnergyType before = 0, after = 0;
+	for ( SiteID c = 0; c < m_numComponents; c++ )
+	{
+		before += m_componentBefore[c];
+		after  += m_componentAfter[c];
+	}
+	m_beforeExpansionEnergy = before;
+
+	const bool improved = after < before;
+	if ( improved )
+	{
+		for ( SiteID i = 0; i < size; i++ )
+		{
+			if ( m_moveCut[i] == 0 )
+			{
+				SiteID site = m_activeSites[i];
+				m_labelCounts[m_labeling[site]]--;
+				m_labelCounts[alpha_label]++;
+				m_labeling[site] = alpha_label;
+			}
+		}
+		m_labelingInfoDirty = true;
+		updateLabelingInfo(false,true,true);
+	}
+
+	timing.numVars       = size;
+	timing.numComponents = (SiteID)order.size();
+	for ( int t = 0; t < m_numThreads; t++ )
+	{
+		timing.setupTicks   += m_threadSetupTicks[t];
+		timing.maxflowTicks += m_threadMaxflowTicks[t];
+	}
+	timing.totalTicks = gcoclock() - ticks0;
+	timing.improved   = improved;
+	m_expansionTimings.push_back(timing);
+
+	printStatus2(alpha_label,-1,size,ticks0);
+	return improved;
+}
+
+//-------------------------------------------------------------------
+
+void GCoptimization::expandComponentBinJob(int bin, int thread, void* data)
+{
+	((GCoptimization*)data)->expandComponentBin(bin,thread);
+}
+
+//-------------------------------------------------------------------
+// Builds and solves the binary problems of the components in one bin.
+// Components share no sites, so the lookup table can be written concurrently.
+//
+void GCoptimization::expandComponentBin(int bin, int thread)
+{
+	EnergyT*& e = (*m_threadEnergies)[thread];
+	if ( !e )
+		e = new EnergyT(m_num_sites,m_numNeighborsTotal,handleError);
+
+	const std::vector<SiteID>& components = m_componentBins[bin];
+	for ( size_t k = 0; k < components.size(); k++ )
+	{
+		const SiteID c = components[k];
+		const SiteID start = m_componentStart[c];
+		const SiteID size  = m_componentStart[c+1] - start;
+		SiteID* activeSites = m_activeSites + start;
+
+		gcoclock_t ticks0 = gcoclock();
+		for ( SiteID i = 0; i < size; i++ )
+			m_lookupSiteVar[activeSites[i]] = i;
+
+		e->reset();
+		e->add_variable(size);
+		EnergyType before = 0;
+		if ( m_setupDataCostsExpansion   ) (this->*m_setupDataCostsExpansion  )(size,m_moveAlpha,e,activeSites,before);
+		if ( m_setupSmoothCostsExpansion ) (this->*m_setupSmoothCostsExpansion)(size,m_moveAlpha,e,activeSites,before);
+		gcoclock_t ticks1 = gcoclock();
+
+		m_componentBefore[c] = before;
+		m_componentAfter[c]  = e->minimize();
+		for ( SiteID i = 0; i < size; i++ )
+		{
+			m_moveCut[start+i] = (char)e->get_var(i);
+			m_lookupSiteVar[activeSites[i]] = -1;
+		}
+
+		m_threadSetupTicks[thread]   += ticks1 - ticks0;
+		m_threadMaxflowTicks[thread] += gcoclock() - ticks1;
+	}
+}
+
+//-------------------------------------------------------------------
+
 GCoptimization::EnergyType GCoptimization::oneExpansionIteration()
 {
 	permuteLabelTable();
@@ -1343,7 +1627,7 @@ void GCoptimization::alpha_beta_swap(LabelID alpha_label, LabelID beta_label)
 
 	// Determine the list of active sites for this swap move
 	SiteID size = 0;
-	SiteID *activeSites = new SiteID[m_num_sites];
+	SiteID *activeSites = m_activeSites;
 	try
 	{
 		for ( SiteID i = 0; i < m_num_sites; i++ )
@@ -1357,14 +1641,13 @@ void GCoptimization::alpha_beta_swap(LabelID alpha_label, LabelID beta_label)
 		}
 		if ( size == 0 )
 		{
-			delete [] activeSites;
 			printStatus2(alpha_label,beta_label,size,ticks0);
 			return;
 		}
 
 		// Create binary variables for each remaining site, add the data costs,
 		// and compute the smooth costs between variables.
-		EnergyT e(size,m_numNeighborsTotal,handleError);
+		EnergyT& e = *resetEnergy(size,m_numNeighborsTotal);
 		e.add_variable(size);
 		if ( m_setupDataCostsSwap   ) (this->*m_setupDataCostsSwap  )(size,alpha_label,beta_label,&e,activeSites);
 		if ( m_setupSmoothCostsSwap ) (this->*m_setupSmoothCostsSwap)(size,alpha_label,beta_label,&e,activeSites);
@@ -1382,10 +1665,10 @@ void GCoptimization::alpha_beta_swap(LabelID alpha_label, LabelID beta_label)
 	} 
 	catch (...)
 	{
-		delete [] activeSites;
+		for ( SiteID i = 0; i < size; i++ )
+			m_lookupSiteVar[activeSites[i]] = -1;
 		throw;
 	}
-	delete [] activeSites;
 
 	printStatus2(alpha_label,beta_label,size,ticks0);
 }
@@ -1530,6 +1813,9 @@ GCoptimizationGeneralGraph::GCoptimizationGeneralGraph(SiteID num_sites,LabelID
 
 	m_needTodeleteNeighbors        = true;
 	m_needToFinishSettingNeighbors = true;
+
+	m_csrIndexes = 0;
+	m_csrWeights = 0;
 }
 
 //------------------------------------------------------------------
@@ -1555,6 +1841,15 @@ GCoptimizationGeneralGraph::~GCoptimizationGeneralGraph()
 		delete [] m_neighborsIndexes;
 		delete [] m_neighborsWeights;
 	}
+
+	if ( m_csrIndexes )
+	{
+		delete [] m_csrIndexes;
+		delete [] m_csrWeights;
+		delete [] m_numNeighbors;
+		delete [] m_neighborsIndexes;
+		delete [] m_neighborsWeights;
+	}
 }
 
 //------------------------------------------------------------------
@@ -1681,6 +1976,37 @@ void GCoptimizationGeneralGraph::setAllNeighbors(SiteID *numNeighbors,SiteID **n
 
 
 
+//------------------------------------------------------------------
+
+void GCoptimizationGeneralGraph::setNeighborsCSR(const SiteID *offsets, const SiteID *neighbors,
+												 const EnergyTermType *weights)
+{
+	if ( m_neighbors || !m_needToFinishSettingNeighbors )
+		handleError("Already set up neighborhood system.");
+	m_needTodeleteNeighbors = false;
+	m_needToFinishSettingNeighbors = false;
+
+	const SiteID total = offsets[m_num_sites] - offsets[0];
+	m_numNeighbors     = new SiteID[m_num_sites];
+	m_neighborsIndexes = new SiteID*[m_num_sites];
+	m_neighborsWeights = new EnergyTermType*[m_num_sites];
+	m_csrIndexes       = new SiteID[total+1];
+	m_csrWeights       = new EnergyTermType[total+1];
+
+	for ( SiteID i = 0; i < total; i++ )
+	{
+		m_csrIndexes[i] = neighbors[offsets[0]+i];
+		m_csrWeights[i] = weights ? weights[offsets[0]+i] : 1;
+	}
+	for ( SiteID site = 0; site < m_num_sites; site++ )
+	{
+		m_numNeighbors[site]     = offsets[site+1] - offsets[site];
+		m_neighborsIndexes[site] = m_csrIndexes + (offsets[site] - offsets[0]);
+		m_neighborsWeights[site] = m_csrWeights + (offsets[site] - offsets[0]);
+	}
+	m_numNeighborsTotal = total;
+}
+
 //------------------------------------------------------------------
 // boring status messages
 
@@ -0,0 +1,70 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <iostream>
+#include <chrono>
+
+#include "ORBVocabulary.h"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    if(argc != 3)
+    {
+        cerr << endl << "Usage: ./bin_vocabulary path_to_vocabulary.txt path_to_vocabulary.bin" << endl;
+        return 1;
+    }
+
+    ORB_SLAM2::ORBVocabulary voc;
+
+    cout << "Loading text vocabulary " << argv[1] << " ..." << endl;
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    if(!voc.loadFromTextFile(argv[1]))
+    {
+        cerr << "Failed to open at: " << argv[1] << endl;
+        return 1;
+    }
+    chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+    cout << voc << endl;
+    cout << "Text load: " << chrono::duration_cast<chrono::duration<double> >(t1 - t0).count() << " s" << endl;
+
+    if(!voc.saveToBinaryFile(argv[2]))
+    {
+        cerr << "Failed to write: " << argv[2] << endl;
+        return 1;
+    }
+
+    // Check the file maps back to the same vocabulary
+    ORB_SLAM2::ORBVocabulary bin;
+    chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+    if(!bin.loadFromBinaryFile(argv[2]) || bin.size() != voc.size())
+    {
+        cerr << "Binary vocabulary " << argv[2] << " could not be read back" << endl;
+        return 1;
+    }
+    chrono::steady_clock::time_point t3 = chrono::steady_clock::now();
+    cout << "Binary load: " << chrono::duration_cast<chrono::duration<double> >(t3 - t2).count() << " s" << endl;
+    cout << "Saved " << argv[2] << endl;
+
+    return 0;
+}